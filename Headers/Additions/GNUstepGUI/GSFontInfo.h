@@ -43,6 +43,9 @@
   NSArray *allFontNames;
   NSMutableDictionary *allFontFamilies;
   NSArray *allFontDescriptors;
+  NSMutableDictionary *fontDescriptorsByName;
+  NSMutableDictionary *fontDescriptorsByFamily;
+  NSMutableDictionary *fontDescriptorsByTraits;
 }
 
 + (void) setDefaultClass: (Class)defaultClass;
@@ -55,6 +58,18 @@
 - (NSArray *) availableFontNamesMatchingFontDescriptor: (NSFontDescriptor *)descriptor;
 - (NSArray *) matchingFontDescriptorsFor: (NSDictionary *)attributes;
 
+/* Backends returning YES from -canCacheFontEnumeration have the result
+of -enumerateFontsAndFamilies kept in a per-user cache file, which is
+used instead of enumerating the fonts again as long as none of the
+directories returned by -fontDirectories has been modified. Only the
+dates of these directories are checked, so backends should list every
+directory fonts are installed in. The default is NO, as the cache only
+holds allFontNames and allFontFamilies, and -fontDirectories returns
+the Library/Fonts directories of all domains. */
+- (BOOL) canCacheFontEnumeration;
+- (NSArray *) fontDirectories;
+- (NSString *) fontCachePath;
+
 /* Note that these are only called once. NSFont will remember the returned
 values. Backends may override these. */
 - (NSString *) defaultSystemFontName;
@@ -154,4 +169,15 @@ values. Backends may override these. */
 
 @end
 
+/* Return the same as -glyphForCharacter:, -advancementForGlyph: and
+   -boundingRectForGlyph:, but only call these once for each character
+   or glyph, so that text layout does not have to go to the backend for
+   every glyph. Each call takes a lock to find the tables of the font. */
+APPKIT_EXPORT NSGlyph GSFontInfoGlyphForCharacter(GSFontInfo *fontInfo,
+  unichar theChar);
+APPKIT_EXPORT NSSize GSFontInfoAdvancementForGlyph(GSFontInfo *fontInfo,
+  NSGlyph aGlyph);
+APPKIT_EXPORT NSRect GSFontInfoBoundingRectForGlyph(GSFontInfo *fontInfo,
+  NSGlyph aGlyph);
+
 #endif /* __GSFontInfo_h_INCLUDE_ */
@@ -112,6 +112,24 @@ atArrangedObjectIndexes: (NSIndexSet*)idx;
 
 @end
 
+#if OS_API_VERSION(GS_API_NONE, GS_API_NONE)
+@interface NSArrayController (GNUstep)
+/** Returns YES if the arranged objects are filtered and sorted on
+ * background threads.
+ */
+- (BOOL) arrangesAsynchronously;
+/** When flag is YES, -rearrangeObjects returns at once and the filtering
+ * and sorting of the content is split across worker threads. The new
+ * arranged objects are published on the main thread when done, and a
+ * later -rearrangeObjects cancels any arrangement still in progress.
+ * The content objects, filter predicate and sort descriptors must be
+ * safe to evaluate from several threads at once.<br />
+ * This has no effect when -arrangeObjects: is overridden.
+ */
+- (void) setArrangesAsynchronously: (BOOL)flag;
+@end
+#endif
+
 #endif // OS_API_VERSION
 
 #endif // _GNUstep_H_NSArrayController
@@ -38,6 +38,7 @@
 @class NSData;
 @class NSDictionary;
 @class NSMutableData;
+@class NSFileHandle;
 @class NSMutableDictionary;
 @class NSColor;
 
@@ -120,8 +121,37 @@ APPKIT_EXPORT NSString *NSImageGamma; // NSNumber 0.0 to 1.0; only for reading &
 APPKIT_EXPORT NSString *NSImageProgressive; // NSNumber boolean; only for reading & writing JPEG files
 APPKIT_EXPORT NSString *NSImageEXIFData; // No GNUstep support yet; for reading & writing JPEG
 
+#if OS_API_VERSION(GS_API_NONE, GS_API_NONE)
+/* The filters a PNG encoder may choose from for each row. With more
+   than one the encoder picks the one that compresses the row best. */
+enum
+{
+  GSPNGFilterNone = 1,
+  GSPNGFilterSub = 2,
+  GSPNGFilterUp = 4,
+  GSPNGFilterAverage = 8,
+  GSPNGFilterPaeth = 16,
+  GSPNGFilterAll = 31
+};
+
+APPKIT_EXPORT NSString *GSImageCompressionLevel; // NSNumber integer 0 to 9; only for writing PNG files
+APPKIT_EXPORT NSString *GSImagePNGFilters; // NSNumber, GSPNGFilter mask; only for writing PNG files
+APPKIT_EXPORT NSString *GSImageOptimizedHuffmanCoding; // NSNumber boolean; only for writing JPEG files
+APPKIT_EXPORT NSString *GSImageChromaSubsampling; // NSNumber 444, 422 or 420; only for writing JPEG files
+#endif
+
 #endif
 
+/* The filters -bitmapImageRepByResamplingToPixelsWide:pixelsHigh:filter:
+   may weight the source pixels with. */
+typedef enum _GSImageResamplingFilter
+{
+  GSImageResamplingBox,
+  GSImageResamplingBilinear,
+  GSImageResamplingLanczos3,
+  GSImageResamplingMitchell
+} GSImageResamplingFilter;
+
 @interface NSBitmapImageRep : NSImageRep
 {
   // Attributes
@@ -250,6 +280,113 @@ APPKIT_EXPORT NSString *NSImageEXIFData; // No GNUstep support yet; for reading
 
 @interface NSBitmapImageRep (GNUstepExtension)
 + (NSArray*) imageRepsWithFile: (NSString *)filename;
+
+/** Loads the first image in imageData scaled down to fit into maxSize
+ *  pixels, keeping its aspect ratio. JPEG and PNG images are scaled
+ *  while they are decoded, so that the memory and time needed depend
+ *  on the size of the result rather than on that of the image. The
+ *  size of the result is its size in pixels.
+ */
+- (id) initWithData: (NSData *)imageData fittingPixelSize: (NSSize)maxSize;
+
+/** Registers decoder, a class implementing its own +imageRepsWithData:
+ *  and -initWithData:, as the reader of images whose data holds
+ *  signature at offset, which must lie within the first 16 bytes.
+ *  Image data is matched against the signatures of all readers at once,
+ *  so formats can be added without slowing down the others.
+ */
++ (void) registerImageDecoder: (Class)decoder
+                 forSignature: (NSData *)signature
+                     atOffset: (NSUInteger)offset
+                         name: (NSString *)name;
+
+/** Returns the number of images decoded, the number of those that
+ *  failed and the seconds spent decoding them (keys Decodes, Failures
+ *  and Time) by image format name.
+ */
++ (NSDictionary *) imageDecoderStatistics;
+
+/** Copies the pixels of the rectangle of width by height pixels at
+ *  (x,y), where (0,0) is the top-left pixel, into buffer as 8 bit RGBA
+ *  samples with unpremultiplied alpha, rowBytes apart. Gray and CMYK
+ *  pixels are converted to RGB and pixels of images without alpha are
+ *  opaque. This is much faster than calling -colorAtX:y: for each pixel;
+ *  pass a height of 1 to read a row span.
+ */
+- (void) getRGBA8: (unsigned char *)buffer
+      bytesPerRow: (NSInteger)rowBytes
+              atX: (NSInteger)x
+                y: (NSInteger)y
+            width: (NSInteger)width
+           height: (NSInteger)height;
+
+/** Stores 8 bit RGBA samples with unpremultiplied alpha, rowBytes apart
+ *  in buffer, as the pixels of the rectangle of width by height pixels
+ *  at (x,y), converting them to the colour space and format of the
+ *  receiver.
+ */
+- (void) setRGBA8: (const unsigned char *)buffer
+      bytesPerRow: (NSInteger)rowBytes
+              atX: (NSInteger)x
+                y: (NSInteger)y
+            width: (NSInteger)width
+           height: (NSInteger)height;
+
+/** Like -getRGBA8:bytesPerRow:atX:y:width:height:, with float samples
+ *  between 0.0 and 1.0.
+ */
+- (void) getRGBAFloat: (float *)buffer
+          bytesPerRow: (NSInteger)rowBytes
+                  atX: (NSInteger)x
+                    y: (NSInteger)y
+                width: (NSInteger)width
+               height: (NSInteger)height;
+
+/** Like -setRGBA8:bytesPerRow:atX:y:width:height:, with float samples
+ *  between 0.0 and 1.0.
+ */
+- (void) setRGBAFloat: (const float *)buffer
+          bytesPerRow: (NSInteger)rowBytes
+                  atX: (NSInteger)x
+                    y: (NSInteger)y
+                width: (NSInteger)width
+               height: (NSInteger)height;
+
+/** Writes the receiver in the format storageType to fileHandle. PNG and
+ *  JPEG data is written as it is encoded rather than built up in memory
+ *  first. Returns NO if the image could not be encoded or written.
+ */
+- (BOOL) writeRepresentationUsingType: (NSBitmapImageFileType)storageType
+                           properties: (NSDictionary *)properties
+                         toFileHandle: (NSFileHandle *)fileHandle;
+
+/** Encodes the bitmaps in imageReps in the format storageType, several
+ *  at a time on worker threads, and returns the data of each in the same
+ *  order. The entries of bitmaps that could not be encoded are NSNull.
+ */
++ (NSArray *) representationsOfImageReps: (NSArray *)imageReps
+                               usingType: (NSBitmapImageFileType)storageType
+                              properties: (NSDictionary *)properties;
+
+/** Like +representationsOfImageReps:usingType:properties:, but writes
+ *  each bitmap to the file handle at the same index of fileHandles as
+ *  it is encoded. Returns NO if any of them could not be written.
+ */
++ (BOOL) writeRepresentationsOfImageReps: (NSArray *)imageReps
+                               usingType: (NSBitmapImageFileType)storageType
+                              properties: (NSDictionary *)properties
+                           toFileHandles: (NSArray *)fileHandles;
+
+/** Returns a new bitmap of width by height pixels holding the receiver
+ *  resampled with filter. The filter is applied to rows and columns in
+ *  turn, on several threads for large images, and with premultiplied
+ *  alpha so that transparent pixels do not bleed into the result. The
+ *  result has 8 bit samples in the colour space of the receiver and
+ *  the same size in points.
+ */
+- (NSBitmapImageRep *) bitmapImageRepByResamplingToPixelsWide: (NSInteger)width
+                                                   pixelsHigh: (NSInteger)height
+                                                       filter: (GSImageResamplingFilter)filter;
 @end
 
 #endif // _GNUstep_H_NSBitmapImageRep
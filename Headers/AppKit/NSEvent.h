@@ -329,6 +329,10 @@ enum
                             withPeriod: (NSTimeInterval)periodSeconds;
 + (void) stopPeriodicEvents;
 
+#if OS_API_VERSION(MAC_OS_X_VERSION_10_5, GS_API_LATEST)
++ (BOOL) isMouseCoalescingEnabled;
++ (void) setMouseCoalescingEnabled: (BOOL)flag;
+#endif
 
 #if OS_API_VERSION(GS_API_MACOSX, GS_API_LATEST)
 - (NSInteger) buttonNumber;
@@ -90,6 +90,7 @@ typedef enum {
     unsigned	cacheSeparately: 1;
     unsigned	unboundedCacheDepth: 1;
     unsigned	syncLoad: 1;
+    unsigned	resamplesWhenReduced: 1;
   } _flags;
   NSMutableArray	*_reps;
   NSColor		*_color;
@@ -442,6 +443,63 @@ typedef enum {
 @end
 
 #if OS_API_VERSION(GS_API_NONE, GS_API_NONE)
+@interface NSImage (GSAsynchronousLoading)
+/** Starts decoding the image in fileName on a background thread, so
+ *  that a view can show a placeholder instead of blocking the main
+ *  thread. When decoding has finished, aSelector is sent to target on
+ *  the main thread with the new image, or with nil if the file could
+ *  not be read.<br />
+ *  The target is not retained; cancel the load with +cancelImageLoad:
+ *  before the target is deallocated. Returns a token for that method.
+ */
++ (id) loadImageWithContentsOfFile: (NSString*)fileName
+                            target: (id)target
+                          selector: (SEL)aSelector;
+
+/** Cancels a load started with
+ *  +loadImageWithContentsOfFile:target:selector:. Once this has been
+ *  called on the main thread the target will not receive the image.
+ */
++ (void) cancelImageLoad: (id)loadToken;
+@end
+
+@interface NSImage (GSResampling)
+/** Sets whether bitmaps drawn at half their size or less are replaced
+ *  by a copy resampled on the CPU. That looks much better than what the
+ *  backend makes of such a reduction, but the copy is made when the
+ *  image is drawn, the first time it is drawn at each size. The last
+ *  few copies are kept until the representations change or -recache is
+ *  called. The default is NO.
+ */
+- (void) setResamplesWhenReduced: (BOOL)flag;
+- (BOOL) resamplesWhenReduced;
+@end
+
+@interface NSImage (GSNamedImageCache)
+/** Sets the number of bytes the representations of named images may
+ *  use. When they use more, images loaded by +imageNamed: are released,
+ *  least recently used first. +imageNamed: returns such an image again
+ *  while it is retained elsewhere, and loads it again from its file once
+ *  it has been deallocated. If that is not enough, the cached
+ *  representations of named images that have not been drawn lately are
+ *  discarded.<br />
+ *  A limit of 0 turns this off. The default is 64MB, or the value of
+ *  the GSNamedImageCacheLimit user default.
+ */
++ (void) setNamedImageCacheLimit: (NSUInteger)bytes;
++ (NSUInteger) namedImageCacheLimit;
+
+/** Returns the number of bytes used by the representations of all
+ *  named images.
+ */
++ (NSUInteger) namedImageCacheSize;
+
+/** Returns the number of bytes used by the pixels of the decoded and
+ *  cached representations of the receiver.
+ */
+- (NSUInteger) byteSize;
+@end
+
 /*
  * A formal protocol that duplicates the informal protocol for delegates.
  */
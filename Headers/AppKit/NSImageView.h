@@ -73,6 +73,14 @@
 @interface NSImageView (GNUstep)
 - (BOOL)initiatesDrag;
 - (void)setInitiatesDrag: (BOOL)flag;
+
+/** Shows placeholder while the image in path is decoded in the
+ *  background, then shows the decoded image. Setting another image
+ *  before that cancels the load. The placeholder stays if the file
+ *  cannot be read.
+ */
+- (void) setImageWithContentsOfFile: (NSString *)path
+                        placeholder: (NSImage *)placeholder;
 @end
 #endif
 #endif /* _GNUstep_H_NSImageView */
@@ -246,6 +246,10 @@ conformsToType: (NSString *)secondTypeName;
 - (NSDictionary*) infoForExtension: (NSString*)ext;
 - (NSBundle*) bundleForApp:(NSString*)appName;
 - (NSImage*) appIconForApp:(NSString*)appName;
+- (NSImage*) iconForFile: (NSString*)fullPath
+		  target: (id)target
+		selector: (SEL)aSelector
+	       loadToken: (id*)loadToken;
 - (NSString*) locateApplicationBinary: (NSString*)appName;
 - (void) setBestApp: (NSString*)appName
 	     inRole: (NSString*)role
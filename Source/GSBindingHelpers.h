@@ -52,6 +52,18 @@
 + (void) unbind: (NSString *)binding  forObject: (id)anObject;
 + (void) unbindAllForObject: (id)anObject;
 
+/* When coalescing, changes of observed values on the main thread are
+ * applied once per binding at the end of the run loop iteration.
+ * Defaults to the GSCoalesceBindingUpdates user default.
+ */
++ (void) setCoalescesUpdates: (BOOL)flag;
++ (BOOL) coalescesUpdates;
+/* Number of coalesced updates applied, and of changes merged into an
+ * update that was already pending.
+ */
++ (NSUInteger) appliedUpdateCount;
++ (NSUInteger) coalescedUpdateCount;
+
 - (id) initWithBinding: (NSString *)binding 
               withName: (NSString *)name
               toObject: (id)dest
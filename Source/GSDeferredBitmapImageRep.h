@@ -0,0 +1,64 @@
+/*
+   GSDeferredBitmapImageRep.h
+
+   Bitmap image rep that decodes its pixels on first use.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNUstep GUI Library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; see the file COPYING.LIB.
+   If not, see <http://www.gnu.org/licenses/> or write to the
+   Free Software Foundation, 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef _GNUstep_H_GSDeferredBitmapImageRep
+#define _GNUstep_H_GSDeferredBitmapImageRep
+
+#import "AppKit/NSBitmapImageRep.h"
+
+/* One image of a file holding several (a multi-directory TIFF or an
+   icon family). Only the description of the image is read when the rep
+   is created; the pixels are decoded from the file data the first time
+   they are asked for or the rep is drawn, so the reps NSImage does not
+   pick never cost a decode or hold a pixel buffer.
+
+   The decoder is an NSBitmapImageRep initialiser taking the file data
+   and the frame number, e.g. -_initBitmapFromTIFF:frame:. */
+@interface GSDeferredBitmapImageRep : NSBitmapImageRep
+{
+  NSData *_source;
+  NSInteger _frame;
+  SEL _decoder;
+}
+
+- (id) initWithData: (NSData *)data
+              frame: (NSInteger)frame
+            decoder: (SEL)decoder
+         pixelsWide: (NSInteger)width
+         pixelsHigh: (NSInteger)height
+      bitsPerSample: (NSInteger)bps
+    samplesPerPixel: (NSInteger)spp
+           hasAlpha: (BOOL)alpha
+           isPlanar: (BOOL)isPlanar
+     colorSpaceName: (NSString *)colorSpaceName
+       bitmapFormat: (NSBitmapFormat)bitmapFormat;
+
+/* Returns YES once the pixels have been decoded. */
+- (BOOL) isDecoded;
+
+@end
+
+#endif /* _GNUstep_H_GSDeferredBitmapImageRep */
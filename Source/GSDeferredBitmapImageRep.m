@@ -0,0 +1,249 @@
+/*
+   GSDeferredBitmapImageRep.m
+
+   Bitmap image rep that decodes its pixels on first use.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNUstep GUI Library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; see the file COPYING.LIB.
+   If not, see <http://www.gnu.org/licenses/> or write to the
+   Free Software Foundation, 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "config.h"
+#import <Foundation/NSData.h>
+#import <Foundation/NSDebug.h>
+#import <Foundation/NSString.h>
+#import "GSDeferredBitmapImageRep.h"
+
+@interface NSBitmapImageRep (GSPrivate)
+- (void) _premultiply;
+- (void) _unpremultiply;
+- (NSBitmapImageRep *) _convertToFormatBitsPerSample: (NSInteger)bps
+                                     samplesPerPixel: (NSInteger)spp
+                                            hasAlpha: (BOOL)alpha
+                                            isPlanar: (BOOL)isPlanar
+                                      colorSpaceName: (NSString*)colorSpaceName
+                                        bitmapFormat: (NSBitmapFormat)bitmapFormat
+                                         bytesPerRow: (NSInteger)rowBytes
+                                        bitsPerPixel: (NSInteger)pixelBits;
+- (void) _adoptBitmapOf: (NSBitmapImageRep *)rep;
+- (void) _getRGBA: (void *)buffer
+          isFloat: (BOOL)isFloat
+      bytesPerRow: (NSInteger)rowBytes
+              atX: (NSInteger)x
+                y: (NSInteger)y
+            width: (NSInteger)width
+           height: (NSInteger)height;
+- (void) _setRGBA: (const void *)buffer
+          isFloat: (BOOL)isFloat
+      bytesPerRow: (NSInteger)rowBytes
+              atX: (NSInteger)x
+                y: (NSInteger)y
+            width: (NSInteger)width
+           height: (NSInteger)height;
+@end
+
+typedef id (*GSFrameDecoder)(id, SEL, NSData *, NSInteger);
+
+@implementation GSDeferredBitmapImageRep
+
+- (id) initWithData: (NSData *)data
+              frame: (NSInteger)frame
+            decoder: (SEL)decoder
+         pixelsWide: (NSInteger)width
+         pixelsHigh: (NSInteger)height
+      bitsPerSample: (NSInteger)bps
+    samplesPerPixel: (NSInteger)spp
+           hasAlpha: (BOOL)alpha
+           isPlanar: (BOOL)isPlanar
+     colorSpaceName: (NSString *)colorSpaceName
+       bitmapFormat: (NSBitmapFormat)bitmapFormat
+{
+  unsigned char *planes[5] = { NULL, NULL, NULL, NULL, NULL };
+
+  /* Claim no alpha until the planes are set up, as the superclass would
+     otherwise scan the (missing) pixels to find out whether the image is
+     opaque. */
+  self = [super initWithBitmapDataPlanes: planes
+                              pixelsWide: width
+                              pixelsHigh: height
+                           bitsPerSample: bps
+                         samplesPerPixel: spp
+                                hasAlpha: NO
+                                isPlanar: isPlanar
+                          colorSpaceName: colorSpaceName
+                            bitmapFormat: bitmapFormat
+                             bytesPerRow: 0
+                            bitsPerPixel: 0];
+  if (self != nil)
+    {
+      [self setAlpha: alpha];
+      [self setOpaque: !alpha];
+      ASSIGN(_source, data);
+      _frame = frame;
+      _decoder = decoder;
+    }
+  return self;
+}
+
+- (void) dealloc
+{
+  RELEASE(_source);
+  [super dealloc];
+}
+
+- (BOOL) isDecoded
+{
+  return (_source == nil);
+}
+
+- (void) _decode
+{
+  NSBitmapImageRep *rep;
+  GSFrameDecoder imp;
+  NSData *source;
+
+  if (_source == nil)
+    {
+      return;
+    }
+
+  /* Clear the source first, so that nothing below comes back here. */
+  source = _source;
+  _source = nil;
+
+  NSDebugLLog(@"NSImage", @"Decoding frame %d of %@", (int)_frame, self);
+  rep = [NSBitmapImageRep alloc];
+  imp = (GSFrameDecoder)[rep methodForSelector: _decoder];
+  rep = imp(rep, _decoder, source, _frame);
+  RELEASE(source);
+
+  if (rep == nil
+      || [rep pixelsWide] != _pixelsWide || [rep pixelsHigh] != _pixelsHigh)
+    {
+      NSLog(@"NSBitmapImageRep: unable to decode frame %d", (int)_frame);
+      rep = [[NSBitmapImageRep alloc]
+        initWithBitmapDataPlanes: NULL
+                      pixelsWide: _pixelsWide
+                      pixelsHigh: _pixelsHigh
+                   bitsPerSample: _bitsPerSample
+                 samplesPerPixel: _numColors
+                        hasAlpha: _hasAlpha
+                        isPlanar: _isPlanar
+                  colorSpaceName: _colorSpace
+                    bitmapFormat: _format
+                     bytesPerRow: 0
+                    bitsPerPixel: 0];
+    }
+  [self _adoptBitmapOf: rep];
+  RELEASE(rep);
+}
+
+- (void) getBitmapDataPlanes: (unsigned char **)data
+{
+  [self _decode];
+  [super getBitmapDataPlanes: data];
+}
+
+- (void) getPixel: (NSUInteger[])pixelData atX: (NSInteger)x y: (NSInteger)y
+{
+  [self _decode];
+  [super getPixel: pixelData atX: x y: y];
+}
+
+- (void) setPixel: (NSUInteger[])pixelData atX: (NSInteger)x y: (NSInteger)y
+{
+  [self _decode];
+  [super setPixel: pixelData atX: x y: y];
+}
+
+- (void) _premultiply
+{
+  [self _decode];
+  [super _premultiply];
+}
+
+- (void) _unpremultiply
+{
+  [self _decode];
+  [super _unpremultiply];
+}
+
+- (void) _getRGBA: (void *)buffer
+          isFloat: (BOOL)isFloat
+      bytesPerRow: (NSInteger)rowBytes
+              atX: (NSInteger)x
+                y: (NSInteger)y
+            width: (NSInteger)width
+           height: (NSInteger)height
+{
+  [self _decode];
+  [super _getRGBA: buffer
+          isFloat: isFloat
+      bytesPerRow: rowBytes
+              atX: x
+                y: y
+            width: width
+           height: height];
+}
+
+- (void) _setRGBA: (const void *)buffer
+          isFloat: (BOOL)isFloat
+      bytesPerRow: (NSInteger)rowBytes
+              atX: (NSInteger)x
+                y: (NSInteger)y
+            width: (NSInteger)width
+           height: (NSInteger)height
+{
+  [self _decode];
+  [super _setRGBA: buffer
+          isFloat: isFloat
+      bytesPerRow: rowBytes
+              atX: x
+                y: y
+            width: width
+           height: height];
+}
+
+- (NSBitmapImageRep *) _convertToFormatBitsPerSample: (NSInteger)bps
+                                     samplesPerPixel: (NSInteger)spp
+                                            hasAlpha: (BOOL)alpha
+                                            isPlanar: (BOOL)isPlanar
+                                      colorSpaceName: (NSString*)colorSpaceName
+                                        bitmapFormat: (NSBitmapFormat)bitmapFormat
+                                         bytesPerRow: (NSInteger)rowBytes
+                                        bitsPerPixel: (NSInteger)pixelBits
+{
+  [self _decode];
+  return [super _convertToFormatBitsPerSample: bps
+                              samplesPerPixel: spp
+                                     hasAlpha: alpha
+                                     isPlanar: isPlanar
+                               colorSpaceName: colorSpaceName
+                                 bitmapFormat: bitmapFormat
+                                  bytesPerRow: rowBytes
+                                 bitsPerPixel: pixelBits];
+}
+
+- (id) copyWithZone: (NSZone *)zone
+{
+  [self _decode];
+  return [super copyWithZone: zone];
+}
+
+@end
@@ -65,6 +65,210 @@ static NSRecursiveLock  *serverLock = nil;
 
 static NSString *NSCurrentServerThreadKey;
 
+/* The event queue is a ring buffer of retained events. It counts the
+   queued events of each type, so that looking for an event of a type
+   which is not queued does not scan the queue. Backends add the events
+   they read from the display to the event_queue array, which is moved
+   into the ring buffer, coalescing mouse motion, whenever the queue is
+   used. */
+typedef struct {
+  NSEvent	**events;
+  NSUInteger	capacity;	/* Always a power of two */
+  NSUInteger	head;		/* Index of the first event */
+  NSUInteger	count;
+  NSUInteger	typeMask;	/* Mask of the types of the queued events */
+  unsigned	typeCounts[32];
+} GSEventQueue;
+
+/* Maps servers to their event queue */
+static NSMapTable *eventQueues = NULL;
+static NSLock *eventQueueLock = nil;
+
+#define	EVENT_QUEUE	event_queue_for(self, event_queue)
+#define	EVENT_AT(q, i)	((q)->events[((q)->head + (i)) & ((q)->capacity - 1)])
+
+static GSEventQueue *
+event_queue_create(NSUInteger capacity)
+{
+  GSEventQueue *q;
+
+  q = NSZoneCalloc(NSDefaultMallocZone(), 1, sizeof(GSEventQueue));
+  q->capacity = capacity;
+  q->events = NSZoneMalloc(NSDefaultMallocZone(), capacity * sizeof(NSEvent*));
+  return q;
+}
+
+static void
+event_queue_free(GSEventQueue *q)
+{
+  NSUInteger i;
+
+  for (i = 0; i < q->count; i++)
+    {
+      RELEASE(EVENT_AT(q, i));
+    }
+  NSZoneFree(NSDefaultMallocZone(), q->events);
+  NSZoneFree(NSDefaultMallocZone(), q);
+}
+
+static inline void
+event_queue_count(GSEventQueue *q, NSEvent *event)
+{
+  NSEventType type = [event type] & 31;
+
+  q->typeCounts[type]++;
+  q->typeMask |= NSEventMaskFromType(type);
+}
+
+static inline void
+event_queue_uncount(GSEventQueue *q, NSEvent *event)
+{
+  NSEventType type = [event type] & 31;
+
+  if (--q->typeCounts[type] == 0)
+    {
+      q->typeMask &= ~NSEventMaskFromType(type);
+    }
+}
+
+static void
+event_queue_insert(GSEventQueue *q, NSEvent *event, BOOL atStart)
+{
+  if (q->count == q->capacity)
+    {
+      NSEvent **events;
+      NSUInteger i;
+
+      events = NSZoneMalloc(NSDefaultMallocZone(),
+        2 * q->capacity * sizeof(NSEvent*));
+      for (i = 0; i < q->count; i++)
+	{
+	  events[i] = EVENT_AT(q, i);
+	}
+      NSZoneFree(NSDefaultMallocZone(), q->events);
+      q->events = events;
+      q->capacity *= 2;
+      q->head = 0;
+    }
+
+  if (atStart)
+    {
+      q->head = (q->head - 1) & (q->capacity - 1);
+    }
+  q->count++;
+  EVENT_AT(q, atStart ? 0 : q->count - 1) = RETAIN(event);
+  event_queue_count(q, event);
+}
+
+/* Removes the event at index, moving the shorter side of the queue
+   to close the gap. */
+static void
+event_queue_remove(GSEventQueue *q, NSUInteger index)
+{
+  NSEvent *event = EVENT_AT(q, index);
+  NSUInteger i;
+
+  if (index < q->count / 2)
+    {
+      for (i = index; i > 0; i--)
+	{
+	  EVENT_AT(q, i) = EVENT_AT(q, i - 1);
+	}
+      q->head = (q->head + 1) & (q->capacity - 1);
+    }
+  else
+    {
+      for (i = index + 1; i < q->count; i++)
+	{
+	  EVENT_AT(q, i - 1) = EVENT_AT(q, i);
+	}
+    }
+  q->count--;
+  event_queue_uncount(q, event);
+  RELEASE(event);
+}
+
+/* Merges a mouse moved or dragged event into the last queued event when
+   that is of the same type and for the same window. The merged event
+   has the position of the new event and the sum of the deltas of both.
+   Events of a subclass or with another subtype are never merged, as
+   the merged event would lose what sets them apart. */
+static BOOL
+event_queue_coalesce(GSEventQueue *q, NSEvent *event)
+{
+  NSEventType type = [event type];
+  NSEvent *last;
+  NSEvent *merged;
+
+  if (q->count == 0
+    || (NSEventMaskFromType(type) & (NSMouseMovedMask | NSLeftMouseDraggedMask
+      | NSRightMouseDraggedMask | NSOtherMouseDraggedMask)) == 0)
+    {
+      return NO;
+    }
+  last = EVENT_AT(q, q->count - 1);
+  if ([last type] != type
+    || [event class] != [NSEvent class]
+    || [last class] != [NSEvent class]
+    || [event subtype] != NSMouseEventSubtype
+    || [last subtype] != NSMouseEventSubtype
+    || [last windowNumber] != [event windowNumber]
+    || [last context] != [event context]
+    || [last modifierFlags] != [event modifierFlags]
+    || [last buttonNumber] != [event buttonNumber])
+    {
+      return NO;
+    }
+
+  merged = [NSEvent mouseEventWithType: type
+			      location: [event locationInWindow]
+			 modifierFlags: [event modifierFlags]
+			     timestamp: [event timestamp]
+			  windowNumber: [event windowNumber]
+			       context: [event context]
+			   eventNumber: [event eventNumber]
+			    clickCount: [event clickCount]
+			      pressure: [event pressure]
+			  buttonNumber: [event buttonNumber]
+				deltaX: [last deltaX] + [event deltaX]
+				deltaY: [last deltaY] + [event deltaY]
+				deltaZ: [last deltaZ] + [event deltaZ]];
+  ASSIGN(EVENT_AT(q, q->count - 1), merged);
+  return YES;
+}
+
+/* Returns the event queue of server, after appending the events the
+   backend added to pending. */
+static GSEventQueue *
+event_queue_for(GSDisplayServer *server, NSMutableArray *pending)
+{
+  GSEventQueue *q;
+  NSUInteger count;
+
+  [eventQueueLock lock];
+  q = NSMapGet(eventQueues, server);
+  [eventQueueLock unlock];
+
+  count = [pending count];
+  if (count > 0)
+    {
+      BOOL coalesce = [NSEvent isMouseCoalescingEnabled];
+      NSUInteger i;
+
+      for (i = 0; i < count; i++)
+	{
+	  NSEvent *event = [pending objectAtIndex: i];
+
+	  if (coalesce == NO || event_queue_coalesce(q, event) == NO)
+	    {
+	      event_queue_insert(q, event, NO);
+	    }
+	}
+      [pending removeAllObjects];
+    }
+  return q;
+}
+
 /** Returns the GSDisplayServer that created the interal
     representation for window. If the internal representation has not
     yet been created (for instance, if the window is deferred), it
@@ -135,6 +339,9 @@ GSCurrentServer(void)
           NSCurrentServerThreadKey  = @"NSCurrentServerThreadKey";
           windowmaps = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
                                         NSNonOwnedPointerMapValueCallBacks, 20);
+          eventQueues = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                                         NSNonOwnedPointerMapValueCallBacks, 4);
+          eventQueueLock = [NSLock new];
         }
       [gnustep_global_lock unlock];
     }
@@ -220,6 +427,9 @@ GSCurrentServer(void)
   server_info = [attributes mutableCopy];
   event_queue = [[NSMutableArray allocWithZone: [self zone]]
 			initWithCapacity: 32];
+  [eventQueueLock lock];
+  NSMapInsert(eventQueues, self, event_queue_create(32));
+  [eventQueueLock unlock];
   drag_types = NSCreateMapTable(NSIntMapKeyCallBacks,
                 NSObjectMapValueCallBacks, 0);
 
@@ -250,6 +460,7 @@ GSCurrentServer(void)
   NSMapEnumerator	enumerator;
   void			*key;
   void			*val;
+  GSEventQueue		*q;
 
   if (windowmaps != NULL)
     {
@@ -271,6 +482,14 @@ GSCurrentServer(void)
 
   DESTROY(server_info);
   DESTROY(event_queue);
+  [eventQueueLock lock];
+  q = NSMapGet(eventQueues, self);
+  NSMapRemove(eventQueues, self);
+  [eventQueueLock unlock];
+  if (q != NULL)
+    {
+      event_queue_free(q);
+    }
   NSFreeMapTable(drag_types);
   [super dealloc];
 }
@@ -975,7 +1194,8 @@ GSCurrentServer(void)
 
   do
     {
-      NSUInteger count = [event_queue count];
+      GSEventQueue *q = EVENT_QUEUE;
+      NSUInteger count = q->count;
       NSEvent *event;
       NSUInteger i = 0;
 
@@ -989,26 +1209,30 @@ GSCurrentServer(void)
 	   * Special case - if the mask matches any event, we just get the
 	   * first event on the queue.
 	   */
-	  event = [event_queue objectAtIndex: 0];
+	  event = EVENT_AT(q, 0);
 	}
       else
 	{
 	  event = nil;
 	  /*
-	   * Scan the queue from the last position we have seen, up to the end.
+	   * Scan the queue from the last position we have seen, up to the end,
+	   * unless no event of a matching type is queued at all.
 	   */
 	  if (count > pos)
 	    {
 	      NSUInteger end = count - pos;
-	      NSRange	r = NSMakeRange(pos, end);
-	      NSEvent	*events[end];
 
-	      [event_queue getObjects: events range: r];
-	      for (i = 0; i < end; i++)
+	      if ((mask & q->typeMask) == 0)
 		{
-		  if (mask & NSEventMaskFromType([events[i] type]))
+		  i = end;
+		}
+	      for (; i < end; i++)
+		{
+		  NSEvent *e = EVENT_AT(q, pos + i);
+
+		  if (mask & NSEventMaskFromType([e type]))
 		    {
-		      event = events[i];
+		      event = e;
 		      break;
 		    }
 		}
@@ -1029,7 +1253,7 @@ GSCurrentServer(void)
 	  RETAIN(event);
 	  if (flag)
 	    {
-	      [event_queue removeObjectAtIndex: pos];
+	      event_queue_remove(q, pos);
 	    }
 	  return AUTORELEASE(event);
 	}
@@ -1055,62 +1279,67 @@ GSCurrentServer(void)
 - (void) discardEventsMatchingMask: (unsigned)mask
 		       beforeEvent: (NSEvent*)limit
 {
-  NSUInteger index = [event_queue count];
+  GSEventQueue *q = EVENT_QUEUE;
+  NSTimeInterval when;
+  NSUInteger i;
+  NSUInteger kept = 0;
+
+  if (q->count == 0
+    || (mask != NSAnyEventMask && (mask & q->typeMask) == 0))
+    {
+      return;
+    }
 
   /*
-   *	If there is a range to use - remove all the matching events in it
-   *    which were created before the specified event.
+   *	Remove all the matching events which were created before the
+   *	specified event, keeping the others in order.
    */
-  if (index > 0)
+  when = [limit timestamp];
+  for (i = 0; i < q->count; i++)
     {
-      NSTimeInterval when = [limit timestamp];
-      NSEvent *events[index];
-
-      [event_queue getObjects: events];
+      NSEvent *event = EVENT_AT(q, i);
 
-      while (index-- > 0)
+      if ([event timestamp] < when
+	&& ((mask == NSAnyEventMask)
+	  || (mask & NSEventMaskFromType([event type]))))
 	{
-	  NSEvent *event = events[index];
-
-	  if ([event timestamp] < when)
-	    {	
-	      if ((mask == NSAnyEventMask)
-		|| (mask & NSEventMaskFromType([event type])))
-		{
-		  [event_queue removeObjectAtIndex: index];
-		}
-	    }
+	  event_queue_uncount(q, event);
+	  RELEASE(event);
+	}
+      else
+	{
+	  EVENT_AT(q, kept++) = event;
 	}
     }
+  q->count = kept;
 }
 
 /** Posts an event to the event queue.  The value of flag determines
  * whether the event is inserted at the start of the queue or appended
- * at the end.
+ * at the end.<br />
+ * Posted events are queued as they are. Backends add the events they
+ * read from the display to the event_queue array instead, and unless
+ * mouse coalescing is disabled (see [NSEvent+setMouseCoalescingEnabled:]),
+ * a mouse moved or dragged event they add right after one of the same
+ * type for the same window replaces it, keeping the sum of their deltas.
  */
 - (void) postEvent: (NSEvent*)anEvent atStart: (BOOL)flag
 {
-  if (flag)
-    [event_queue insertObject: anEvent atIndex: 0];
-  else
-    [event_queue addObject: anEvent];
+  event_queue_insert(EVENT_QUEUE, anEvent, flag);
 }
 
 - (void) _printEventQueue
 {
-  NSUInteger index = [event_queue count];
+  GSEventQueue *q = EVENT_QUEUE;
 
-  if (index > 0)
+  if (q->count > 0)
     {
-      NSEvent *events[index];
       NSUInteger i;
 
       NSLog(@"Dumping events from queue");
-      [event_queue getObjects: events];
-
-      for (i = 0; i < index; i++)
+      for (i = 0; i < q->count; i++)
 	{
-	  NSEvent *event = events[i];
+	  NSEvent *event = EVENT_AT(q, i);
 
           NSLog(@"index %lu %@", (unsigned long) i, event);
         }
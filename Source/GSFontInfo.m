@@ -28,13 +28,22 @@
 */
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #import <Foundation/NSAffineTransform.h>
 #import <Foundation/NSArray.h>
 #import <Foundation/NSCharacterSet.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDate.h>
 #import <Foundation/NSDictionary.h>
 #import <Foundation/NSEnumerator.h>
 #import <Foundation/NSException.h>
+#import <Foundation/NSFileManager.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSMapTable.h>
+#import <Foundation/NSPathUtilities.h>
+#import <Foundation/NSSerialization.h>
 #import <Foundation/NSSet.h>
 #import <Foundation/NSString.h>
 #import <Foundation/NSValue.h>
@@ -42,12 +51,37 @@
 #import "AppKit/NSFontDescriptor.h"
 
 #import "GNUstepGUI/GSFontInfo.h"
+#import "GSGlyphTables.h"
 
 static Class fontEnumeratorClass = Nil;
 static Class fontInfoClass = Nil;
 
 static GSFontEnumerator *sharedEnumerator = nil;
 
+/* Bump this whenever the layout of the font cache file changes. */
+#define GS_FONT_CACHE_VERSION 1
+
+@interface GSFontEnumerator (Private)
+- (NSDictionary *) _fontDirectoryDates;
+- (BOOL) _loadFontCache;
+- (void) _saveFontCache;
+- (NSArray *) _candidateFontDescriptorsFor: (NSDictionary *)attributes;
+@end
+
+static void
+index_descriptor(NSMutableDictionary *index, id key, NSFontDescriptor *fd)
+{
+  NSMutableArray *list = [index objectForKey: key];
+
+  if (list == nil)
+    {
+      list = [[NSMutableArray alloc] initWithCapacity: 4];
+      [index setObject: list forKey: key];
+      RELEASE(list);
+    }
+  [list addObject: fd];
+}
+
 @implementation GSFontEnumerator
 
 + (void) setDefaultClass: (Class)defaultClass
@@ -58,7 +92,11 @@ static GSFontEnumerator *sharedEnumerator = nil;
 - (id) init
 {
   [super init];
-  [self enumerateFontsAndFamilies];
+  if ([self _loadFontCache] == NO)
+    {
+      [self enumerateFontsAndFamilies];
+      [self _saveFontCache];
+    }
 
   return self;
 }
@@ -67,6 +105,10 @@ static GSFontEnumerator *sharedEnumerator = nil;
 {
   RELEASE(allFontNames);
   RELEASE(allFontFamilies);
+  RELEASE(allFontDescriptors);
+  RELEASE(fontDescriptorsByName);
+  RELEASE(fontDescriptorsByFamily);
+  RELEASE(fontDescriptorsByTraits);
   [super dealloc];
 }
 
@@ -112,6 +154,9 @@ static GSFontEnumerator *sharedEnumerator = nil;
       NSString *family;
       
       fontDescriptors = [[NSMutableArray alloc] init];
+      fontDescriptorsByName = [[NSMutableDictionary alloc] init];
+      fontDescriptorsByFamily = [[NSMutableDictionary alloc] init];
+      fontDescriptorsByTraits = [[NSMutableDictionary alloc] init];
       keyEnumerator = [allFontFamilies keyEnumerator];
       while ((family = [keyEnumerator nextObject]) != nil)
         {
@@ -143,6 +188,12 @@ static GSFontEnumerator *sharedEnumerator = nil;
               fd = [[NSFontDescriptor alloc] initWithFontAttributes: attributes];
               
               [fontDescriptors addObject: fd];
+              index_descriptor(fontDescriptorsByName,
+                               [fontDef objectAtIndex: 0], fd);
+              index_descriptor(fontDescriptorsByFamily, family, fd);
+              index_descriptor(fontDescriptorsByTraits,
+                               [NSNumber numberWithUnsignedInt:
+                                           [traits unsignedIntValue]], fd);
               RELEASE(fd);
             }
         }
@@ -191,8 +242,9 @@ static GSFontEnumerator *sharedEnumerator = nil;
   NSArray *keys = [attributes allKeys];
 
   found = [NSMutableArray arrayWithCapacity: 3];
-  // Get an enumerator for all available font descriptors
-  fdEnumerator = [[self availableFontDescriptors] objectEnumerator];
+  // Only check the descriptors which may match the indexed attributes
+  fdEnumerator = [[self _candidateFontDescriptorsFor: attributes]
+                   objectEnumerator];
   while ((fd = [fdEnumerator nextObject]) != nil)
     {
         NSEnumerator *keyEnumerator;
@@ -272,6 +324,231 @@ static GSFontEnumerator *sharedEnumerator = nil;
   return @"Courier";
 }
 
+- (BOOL) canCacheFontEnumeration
+{
+  return NO;
+}
+
+- (NSArray *) fontDirectories
+{
+  NSMutableArray *dirs = [NSMutableArray array];
+  NSEnumerator *enumerator;
+  NSString *path;
+
+  enumerator = [NSSearchPathForDirectoriesInDomains(NSLibraryDirectory,
+    NSAllDomainsMask, YES) objectEnumerator];
+  while ((path = [enumerator nextObject]) != nil)
+    {
+      [dirs addObject: [path stringByAppendingPathComponent: @"Fonts"]];
+    }
+
+  return dirs;
+}
+
+- (NSString *) fontCachePath
+{
+  NSArray *paths;
+
+  paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory,
+    NSUserDomainMask, YES);
+  if ([paths count] == 0)
+    {
+      return nil;
+    }
+  return [[[paths objectAtIndex: 0] stringByAppendingPathComponent: @"Fonts"]
+           stringByAppendingPathComponent: NSStringFromClass([self class])];
+}
+
+@end
+
+@implementation GSFontEnumerator (Private)
+
+/* Returns the modification dates of the font directories. Adding or
+   removing a font changes the date of the directory holding it, so
+   backends installing fonts in subdirectories must list those too. */
+- (NSDictionary *) _fontDirectoryDates
+{
+  NSFileManager *mgr = [NSFileManager defaultManager];
+  NSMutableDictionary *dates = [NSMutableDictionary dictionary];
+  NSEnumerator *enumerator;
+  NSString *root;
+
+  enumerator = [[self fontDirectories] objectEnumerator];
+  while ((root = [enumerator nextObject]) != nil)
+    {
+      NSDictionary *attributes;
+
+      attributes = [mgr fileAttributesAtPath: root traverseLink: YES];
+      if ([[attributes fileType] isEqualToString: NSFileTypeDirectory])
+        {
+          [dates setObject: [NSNumber numberWithDouble:
+            [[attributes fileModificationDate]
+              timeIntervalSinceReferenceDate]]
+                    forKey: root];
+        }
+    }
+
+  return dates;
+}
+
+- (BOOL) _loadFontCache
+{
+  NSString *path;
+  NSData *data;
+  NSDictionary *cache;
+  NSArray *names;
+  NSDictionary *families;
+
+  if ([self canCacheFontEnumeration] == NO
+    || (path = [self fontCachePath]) == nil
+    || (data = [NSData dataWithContentsOfFile: path]) == nil)
+    {
+      return NO;
+    }
+
+  NS_DURING
+    {
+      cache = [NSDeserializer deserializePropertyListFromData: data
+                                            mutableContainers: NO];
+    }
+  NS_HANDLER
+    {
+      cache = nil;
+    }
+  NS_ENDHANDLER
+
+  if (![cache isKindOfClass: [NSDictionary class]]
+    || [[cache objectForKey: @"Version"] intValue] != GS_FONT_CACHE_VERSION
+    || ![[cache objectForKey: @"Directories"]
+          isEqual: [self _fontDirectoryDates]])
+    {
+      return NO;
+    }
+
+  names = [cache objectForKey: @"Names"];
+  families = [cache objectForKey: @"Families"];
+  if (![names isKindOfClass: [NSArray class]]
+    || ![families isKindOfClass: [NSDictionary class]])
+    {
+      return NO;
+    }
+
+  ASSIGN(allFontNames, names);
+  RELEASE(allFontFamilies);
+  allFontFamilies = [families mutableCopy];
+  return YES;
+}
+
+- (void) _saveFontCache
+{
+  NSFileManager *mgr = [NSFileManager defaultManager];
+  NSString *path;
+  NSString *dir;
+  NSDictionary *cache;
+  NSData *data;
+
+  if (allFontNames == nil || allFontFamilies == nil
+    || [self canCacheFontEnumeration] == NO
+    || (path = [self fontCachePath]) == nil)
+    {
+      return;
+    }
+
+  dir = [path stringByDeletingLastPathComponent];
+  if ([mgr fileExistsAtPath: dir] == NO
+    && [mgr createDirectoryAtPath: dir
+      withIntermediateDirectories: YES
+                       attributes: nil
+                            error: NULL] == NO)
+    {
+      return;
+    }
+
+  cache = [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSNumber numberWithInt: GS_FONT_CACHE_VERSION], @"Version",
+    [self _fontDirectoryDates], @"Directories",
+    allFontNames, @"Names",
+    allFontFamilies, @"Families",
+    nil];
+  NS_DURING
+    {
+      data = [NSSerializer serializePropertyList: cache];
+    }
+  NS_HANDLER
+    {
+      // The backend stored something which is not a property list.
+      data = nil;
+    }
+  NS_ENDHANDLER
+
+  if (data != nil)
+    {
+      [data writeToFile: path atomically: YES];
+    }
+}
+
+/* Returns the shortest list of font descriptors which have the name,
+   family and symbolic traits asked for in attributes.
+   -matchingFontDescriptorsFor: still checks every attribute of them. */
+- (NSArray *) _candidateFontDescriptorsFor: (NSDictionary *)attributes
+{
+  NSArray *best = [self availableFontDescriptors];
+  NSArray *list;
+  id value;
+
+  if (fontDescriptorsByName == nil)
+    {
+      // A subclass built the descriptors without indexing them.
+      return best;
+    }
+
+  value = [attributes objectForKey: NSFontNameAttribute];
+  if (value != nil)
+    {
+      list = [fontDescriptorsByName objectForKey: value];
+      if (list == nil)
+        {
+          return [NSArray array];
+        }
+      if ([list count] < [best count])
+        {
+          best = list;
+        }
+    }
+
+  value = [attributes objectForKey: NSFontFamilyAttribute];
+  if (value != nil)
+    {
+      list = [fontDescriptorsByFamily objectForKey: value];
+      if (list == nil)
+        {
+          return [NSArray array];
+        }
+      if ([list count] < [best count])
+        {
+          best = list;
+        }
+    }
+
+  value = [[attributes objectForKey: NSFontTraitsAttribute]
+            objectForKey: NSFontSymbolicTrait];
+  if (value != nil)
+    {
+      list = [fontDescriptorsByTraits objectForKey:
+        [NSNumber numberWithUnsignedInt: [value unsignedIntValue]]];
+      if (list == nil)
+        {
+          return [NSArray array];
+        }
+      if ([list count] < [best count])
+        {
+          best = list;
+        }
+    }
+
+  return best;
+}
+
 @end
 
 @interface GSFontInfo (Backend)
@@ -380,8 +657,79 @@ static GSFontEnumerator *sharedEnumerator = nil;
   return self;
 }
 
+/* The glyph tables of each font are kept in glyphTables rather than in
+   ivars, so that the layout of the class stays the same. The lock
+   guards the map and the filling of the tables. */
+static NSLock *glyphTablesLock = nil;
+static NSMapTable *glyphTables = NULL;
+
+/* Frees a page table of GSFontInfo. */
+static void
+free_pages(void **pages)
+{
+  unsigned i;
+
+  for (i = 0; i < 256; i++)
+    {
+      free(pages[i]);
+    }
+}
+
+/* Returns the page of pages holding entry index, allocating the page
+   with the unfilled value of size bytes at unknown. Must be called with
+   glyphTablesLock held. */
+static void *
+page_for_index(void **pages, unsigned index, size_t size,
+  const void *unknown)
+{
+  unsigned char *page;
+  unsigned i;
+
+  page = pages[index >> 8];
+  if (page == NULL)
+    {
+      page = malloc(256 * size);
+      if (page == NULL)
+        {
+          return NULL;
+        }
+      for (i = 0; i < 256; i++)
+        {
+          memcpy(page + i * size, unknown, size);
+        }
+      __atomic_store_n(&pages[index >> 8], page, __ATOMIC_RELEASE);
+    }
+  return page;
+}
+
++ (void) initialize
+{
+  if (glyphTablesLock == nil)
+    {
+      glyphTablesLock = [NSLock new];
+      glyphTables = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                                     NSNonOwnedPointerMapValueCallBacks, 16);
+    }
+}
+
 - (void) dealloc
 {
+  GSGlyphTables *tables;
+
+  [glyphTablesLock lock];
+  tables = (GSGlyphTables*)NSMapGet(glyphTables, self);
+  if (tables != NULL)
+    {
+      NSMapRemove(glyphTables, self);
+    }
+  [glyphTablesLock unlock];
+  if (tables != NULL)
+    {
+      free_pages((void**)tables->glyphPages);
+      free_pages((void**)tables->advancementPages);
+      free_pages((void**)tables->boundsPages);
+      free(tables);
+    }
   RELEASE(coveredCharacterSet);
   RELEASE(fontDictionary);
   RELEASE(fontName);
@@ -805,3 +1153,131 @@ static GSFontEnumerator *sharedEnumerator = nil;
 }
 
 @end
+
+GSGlyphTables *
+GSGlyphTablesForFont(GSFontInfo *fontInfo)
+{
+  GSGlyphTables *tables;
+
+  [glyphTablesLock lock];
+  tables = (GSGlyphTables*)NSMapGet(glyphTables, fontInfo);
+  if (tables == NULL)
+    {
+      tables = calloc(1, sizeof(GSGlyphTables));
+      if (tables != NULL)
+        {
+          NSMapInsert(glyphTables, fontInfo, tables);
+        }
+    }
+  [glyphTablesLock unlock];
+  return tables;
+}
+
+NSGlyph
+GSGlyphTablesFillGlyph(GSGlyphTables *tables, GSFontInfo *fontInfo,
+  unichar theChar)
+{
+  static const NSGlyph unknown = GSFontInfoUnknownGlyph;
+  NSGlyph glyph;
+  NSGlyph *page;
+
+  /* The backend is asked without the lock held */
+  glyph = [fontInfo glyphForCharacter: theChar];
+  if (tables == NULL)
+    {
+      return glyph;
+    }
+  [glyphTablesLock lock];
+  page = page_for_index((void**)tables->glyphPages, theChar,
+                        sizeof(NSGlyph), &unknown);
+  if (page != NULL)
+    {
+      __atomic_store_n(&page[theChar & 0xff], glyph, __ATOMIC_RELEASE);
+    }
+  [glyphTablesLock unlock];
+  return glyph;
+}
+
+NSSize
+GSGlyphTablesFillAdvancement(GSGlyphTables *tables, GSFontInfo *fontInfo,
+  NSGlyph aGlyph)
+{
+  NSSize unknown = NSMakeSize(NAN, NAN);
+  NSSize advancement;
+  NSSize *page;
+
+  advancement = [fontInfo advancementForGlyph: aGlyph];
+  if (tables == NULL || aGlyph >= 0x10000)
+    {
+      return advancement;
+    }
+  [glyphTablesLock lock];
+  page = page_for_index((void**)tables->advancementPages, aGlyph,
+                        sizeof(NSSize), &unknown);
+  if (page != NULL && isnan(page[aGlyph & 0xff].width))
+    {
+      /* Readers test the width, so it is stored last */
+      page += aGlyph & 0xff;
+      page->height = advancement.height;
+      __atomic_store(&page->width, &advancement.width, __ATOMIC_RELEASE);
+    }
+  [glyphTablesLock unlock];
+  return advancement;
+}
+
+NSRect
+GSGlyphTablesFillBoundingRect(GSGlyphTables *tables, GSFontInfo *fontInfo,
+  NSGlyph aGlyph)
+{
+  NSRect unknown = NSMakeRect(NAN, NAN, NAN, NAN);
+  NSRect bounds;
+  NSRect *page;
+
+  bounds = [fontInfo boundingRectForGlyph: aGlyph];
+  if (tables == NULL || aGlyph >= 0x10000)
+    {
+      return bounds;
+    }
+  [glyphTablesLock lock];
+  page = page_for_index((void**)tables->boundsPages, aGlyph,
+                        sizeof(NSRect), &unknown);
+  if (page != NULL && isnan(page[aGlyph & 0xff].origin.x))
+    {
+      /* Readers test the x origin, so it is stored last */
+      page += aGlyph & 0xff;
+      page->origin.y = bounds.origin.y;
+      page->size = bounds.size;
+      __atomic_store(&page->origin.x, &bounds.origin.x, __ATOMIC_RELEASE);
+    }
+  [glyphTablesLock unlock];
+  return bounds;
+}
+
+NSGlyph
+GSFontInfoGlyphForCharacter(GSFontInfo *fontInfo, unichar theChar)
+{
+  return GSGlyphTablesGlyphForCharacter(GSGlyphTablesForFont(fontInfo),
+                                        fontInfo, theChar);
+}
+
+NSSize
+GSFontInfoAdvancementForGlyph(GSFontInfo *fontInfo, NSGlyph aGlyph)
+{
+  if (aGlyph >= 0x10000)
+    {
+      return [fontInfo advancementForGlyph: aGlyph];
+    }
+  return GSGlyphTablesAdvancementForGlyph(GSGlyphTablesForFont(fontInfo),
+                                          fontInfo, aGlyph);
+}
+
+NSRect
+GSFontInfoBoundingRectForGlyph(GSFontInfo *fontInfo, NSGlyph aGlyph)
+{
+  if (aGlyph >= 0x10000)
+    {
+      return [fontInfo boundingRectForGlyph: aGlyph];
+    }
+  return GSGlyphTablesBoundingRectForGlyph(GSGlyphTablesForFont(fontInfo),
+                                           fontInfo, aGlyph);
+}
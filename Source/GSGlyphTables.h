@@ -0,0 +1,136 @@
+/*
+   GSGlyphTables.h
+
+   The glyphs and glyph metrics of a font, as remembered for text layout.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNUstep GUI Library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; see the file COPYING.LIB.
+   If not, see <http://www.gnu.org/licenses/> or write to the
+   Free Software Foundation, 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef _GNUstep_H_GSGlyphTables
+#define _GNUstep_H_GSGlyphTables
+
+#import "GNUstepGUI/GSFontInfo.h"
+#include <math.h>
+
+/* The results of -glyphForCharacter: for the BMP and of
+   -advancementForGlyph: and -boundingRectForGlyph: for the first 65536
+   glyphs of a GSFontInfo, in pages of 256 entries that are allocated as
+   they are first used. A page is only published, with an atomic store,
+   once all its entries hold the unknown value, and an entry is filled
+   by storing the field tested for the unknown value last. Filled
+   entries are thus read without a lock, and only a miss takes the lock
+   to ask the font and fill the entry. */
+typedef struct _GSGlyphTables
+{
+  NSGlyph *glyphPages[256];
+  NSSize *advancementPages[256];
+  NSRect *boundsPages[256];
+} GSGlyphTables;
+
+/* The value of the entries of glyphPages not asked for yet */
+#define GSFontInfoUnknownGlyph ((NSGlyph)0xffffffff)
+
+/* Returns the tables of fontInfo, which stay valid as long as fontInfo.
+   This takes a lock, so code looking up a run of glyphs fetches the
+   tables once for the run. Returns NULL if they can't be allocated. */
+GSGlyphTables *GSGlyphTablesForFont(GSFontInfo *fontInfo);
+
+/* Ask fontInfo for an entry missing from tables and fill it in. */
+NSGlyph GSGlyphTablesFillGlyph(GSGlyphTables *tables,
+  GSFontInfo *fontInfo, unichar theChar);
+NSSize GSGlyphTablesFillAdvancement(GSGlyphTables *tables,
+  GSFontInfo *fontInfo, NSGlyph aGlyph);
+NSRect GSGlyphTablesFillBoundingRect(GSGlyphTables *tables,
+  GSFontInfo *fontInfo, NSGlyph aGlyph);
+
+static inline NSGlyph
+GSGlyphTablesGlyphForCharacter(GSGlyphTables *tables, GSFontInfo *fontInfo,
+  unichar theChar)
+{
+  NSGlyph *page;
+  NSGlyph glyph;
+
+  if (tables != NULL)
+    {
+      page = __atomic_load_n(&tables->glyphPages[theChar >> 8],
+                             __ATOMIC_ACQUIRE);
+      if (page != NULL)
+        {
+          glyph = __atomic_load_n(&page[theChar & 0xff], __ATOMIC_ACQUIRE);
+          if (glyph != GSFontInfoUnknownGlyph)
+            {
+              return glyph;
+            }
+        }
+    }
+  return GSGlyphTablesFillGlyph(tables, fontInfo, theChar);
+}
+
+static inline NSSize
+GSGlyphTablesAdvancementForGlyph(GSGlyphTables *tables, GSFontInfo *fontInfo,
+  NSGlyph aGlyph)
+{
+  NSSize *page;
+  CGFloat width;
+
+  if (tables != NULL && aGlyph < 0x10000)
+    {
+      page = __atomic_load_n(&tables->advancementPages[aGlyph >> 8],
+                             __ATOMIC_ACQUIRE);
+      if (page != NULL)
+        {
+          page += aGlyph & 0xff;
+          __atomic_load(&page->width, &width, __ATOMIC_ACQUIRE);
+          if (!isnan(width))
+            {
+              return NSMakeSize(width, page->height);
+            }
+        }
+    }
+  return GSGlyphTablesFillAdvancement(tables, fontInfo, aGlyph);
+}
+
+static inline NSRect
+GSGlyphTablesBoundingRectForGlyph(GSGlyphTables *tables, GSFontInfo *fontInfo,
+  NSGlyph aGlyph)
+{
+  NSRect *page;
+  CGFloat x;
+
+  if (tables != NULL && aGlyph < 0x10000)
+    {
+      page = __atomic_load_n(&tables->boundsPages[aGlyph >> 8],
+                             __ATOMIC_ACQUIRE);
+      if (page != NULL)
+        {
+          page += aGlyph & 0xff;
+          __atomic_load(&page->origin.x, &x, __ATOMIC_ACQUIRE);
+          if (!isnan(x))
+            {
+              return NSMakeRect(x, page->origin.y,
+                                page->size.width, page->size.height);
+            }
+        }
+    }
+  return GSGlyphTablesFillBoundingRect(tables, fontInfo, aGlyph);
+}
+
+#endif /* _GNUstep_H_GSGlyphTables */
@@ -41,6 +41,13 @@
  */
 NSBundle *GSGuiBundle (void);
 
+/*
+ * Forget the substitute fonts found for characters missing from a
+ * font, after the fonts to choose from have changed.  Implemented in
+ * Source/NSAttributedString.m
+ */
+void GSInvalidateFontFallbacks (void);
+
 /*
  * Localize a message of the gnustep-gui library.  
  */
@@ -41,6 +41,7 @@
 #import "GNUstepGUI/GSFontInfo.h"
 #import "GNUstepGUI/GSTypesetter.h"
 #import "GNUstepGUI/GSLayoutManager_internal.h"
+#import "GSGlyphTables.h"
 
 /* TODO: is using rand() here ok? */
 static inline int random_level(void)
@@ -3245,6 +3246,8 @@ forStartingGlyphAtIndex: (NSUInteger)glyph
        characterIndex: (NSUInteger)index
 {
   glyph_run_t *run;
+  GSFontInfo *fontInfo;
+  GSGlyphTables *tables = NULL;
   int i;
   unsigned int gpos, cpos;
   NSSize advances[length];
@@ -3257,9 +3260,16 @@ forStartingGlyphAtIndex: (NSUInteger)glyph
       return;
     }
     
+  fontInfo = [run->font fontInfo];
+  if (fontInfo != nil)
+    {
+      tables = GSGlyphTablesForFont(fontInfo);
+    }
   for (i=0; i<length; i++)
     {
-      advances[i] = [run->font advancementForGlyph: glyph_list[i]];
+      advances[i] = (fontInfo != nil)
+        ? GSGlyphTablesAdvancementForGlyph(tables, fontInfo, glyph_list[i])
+        : NSMakeSize(0, 0);
     }
 
   [self insertGlyphs: glyph_list
@@ -32,15 +32,131 @@
 #import <Foundation/NSDictionary.h>
 #import <Foundation/NSIndexSet.h>
 #import <Foundation/NSKeyValueObserving.h>
+#import <Foundation/NSMapTable.h>
+#import <Foundation/NSOperation.h>
 #import <Foundation/NSPredicate.h>
+#import <Foundation/NSProcessInfo.h>
+#import <Foundation/NSSet.h>
 #import <Foundation/NSSortDescriptor.h>
 #import <Foundation/NSString.h>
+#import <Foundation/NSThread.h>
 
 #import "AppKit/NSArrayController.h"
 #import "AppKit/NSKeyValueBinding.h"
 #import "GSBindingHelpers.h"
 #import "GSFastEnumeration.h"
 
+static IMP arrangeObjectsImp = 0;
+static NSOperationQueue *arrangeQueue = nil;
+
+/* Compares two objects the way -sortedArrayUsingDescriptors: does. */
+static inline NSComparisonResult
+compareWithDescriptors(id a, id b, NSArray *descriptors)
+{
+  NSComparisonResult result = NSOrderedSame;
+  NSUInteger i, count = [descriptors count];
+
+  for (i = 0; i < count && result == NSOrderedSame; i++)
+    {
+      result = [[descriptors objectAtIndex: i] compareObject: a toObject: b];
+    }
+  return result;
+}
+
+/* State of an asynchronous arrangement. The content is split into chunks
+ * which are filtered and sorted on arrangeQueue, then the sorted chunks
+ * are merged pairwise, again in parallel. Each merge depends on the two
+ * operations it merges, so no thread waits for another, and the last one
+ * hands the task back to the main thread.
+ * The controller is not retained. It is only used on the main thread,
+ * where it cancels the task before it goes away.
+ */
+@interface GSArrangeObjectsTask : NSObject
+{
+@public
+  NSArrayController *controller;
+  NSArray *content;
+  NSPredicate *predicate;
+  NSArray *descriptors;
+  NSArray *result;
+  volatile BOOL cancelled;
+}
+- (id) initWithController: (NSArrayController*)aController;
+- (void) start;
+- (void) deliver;
+@end
+
+@interface GSArrangeOperation : NSOperation
+{
+@public
+  GSArrangeObjectsTask *task;
+  NSArray *output;
+  BOOL isLast;
+}
+- (id) initWithTask: (GSArrangeObjectsTask*)aTask;
+- (void) publish;
+@end
+
+/* Filters and sorts one range of the content. */
+@interface GSArrangeChunkOperation : GSArrangeOperation
+{
+@public
+  NSRange range;
+}
+@end
+
+/* Merges, or joins when there is nothing to sort by, the output of two
+ * other operations. */
+@interface GSArrangeMergeOperation : GSArrangeOperation
+{
+@public
+  GSArrangeOperation *first;
+  GSArrangeOperation *second;
+}
+@end
+
+/* State of each array controller that is kept outside the instance, so
+ * that the layout of the class does not change. Only used on the main
+ * thread.
+ */
+typedef struct {
+  GSArrangeObjectsTask *arrangeTask;
+  NSMapTable *arrangedIndex;
+  BOOL arrangesAsynchronously;
+  BOOL arrangedObjectsVended;
+} GSArrayControllerInfo;
+
+static NSMapTable *controllerInfo = NULL;
+
+static GSArrayControllerInfo *
+info_for_controller(NSArrayController *controller)
+{
+  GSArrayControllerInfo *info = NSMapGet(controllerInfo, controller);
+
+  if (info == NULL)
+    {
+      info = NSZoneCalloc(NSDefaultMallocZone(), 1,
+                          sizeof(GSArrayControllerInfo));
+      NSMapInsert(controllerInfo, controller, info);
+    }
+  return info;
+}
+
+#define INFO info_for_controller(self)
+
+@interface NSArrayController (Private)
+- (BOOL) _arrangesIncrementally;
+- (NSUInteger) _arrangedIndexForObject: (id)obj;
+- (void) _insertArrangedObject: (id)obj atIndex: (NSUInteger)idx;
+- (void) _arrangeInsertedObjects: (NSArray*)objects;
+- (void) _removeArrangedObjects: (NSArray*)objects;
+- (void) _removeArrangedObjectsAtIndexes: (NSIndexSet*)idx;
+- (void) _cancelArrangement;
+- (void) _finishArrangement: (GSArrangeObjectsTask*)task;
+- (void) _invalidateArrangedIndex;
+- (void) _willMutateArrangedObjects;
+@end
+
 @implementation NSArrayController
 
 + (void) initialize
@@ -48,8 +164,15 @@
   if (self == [NSArrayController class])
     {
       [self exposeBinding: NSContentArrayBinding];
-      [self setKeys: [NSArray arrayWithObjects: NSContentBinding, NSContentObjectBinding, nil] 
-            triggerChangeNotificationsForDependentKey: @"arrangedObjects"];
+      /* Changes to arrangedObjects are posted explicitly, so that
+         insertions and removals only report the indexes concerned. */
+      arrangeObjectsImp = [self instanceMethodForSelector:
+                                  @selector(arrangeObjects:)];
+      arrangeQueue = [NSOperationQueue new];
+      [arrangeQueue setMaxConcurrentOperationCount:
+        [[NSProcessInfo processInfo] activeProcessorCount]];
+      controllerInfo = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                                        NSNonOwnedPointerMapValueCallBacks, 0);
     }
 }
 
@@ -75,6 +198,15 @@
 
 - (void) dealloc
 {
+  GSArrayControllerInfo *info = NSMapGet(controllerInfo, self);
+
+  if (info != NULL)
+    {
+      [self _cancelArrangement];
+      [self _invalidateArrangedIndex];
+      NSZoneFree(NSDefaultMallocZone(), info);
+      NSMapRemove(controllerInfo, self);
+    }
   DESTROY(_arranged_objects);
   DESTROY(_selection_indexes);
   DESTROY(_sort_descriptors);
@@ -84,37 +216,14 @@
 
 - (void) addObject: (id)obj
 {
-  [self willChangeValueForKey: NSContentBinding];
-  [_content addObject: obj];
-  if ([self automaticallyRearrangesObjects])
-    {
-      [self rearrangeObjects];
-    }
-  else 
-    {
-      // FIXME: Should check whether _arranged_objects is mutable
-      ASSIGN(_arranged_objects, [_arranged_objects arrayByAddingObject: obj]);
-    }
-  if ([self selectsInsertedObjects])
-    {
-      [self addSelectedObjects: [NSArray arrayWithObject: obj]];
-    }
-  [self didChangeValueForKey: NSContentBinding];
+  [self addObjects: [NSArray arrayWithObject: obj]];
 }
 
 - (void) addObjects: (NSArray*)obj
 {
   [self willChangeValueForKey: NSContentBinding];
   [_content addObjectsFromArray: obj];
-  if ([self automaticallyRearrangesObjects])
-    {
-      [self rearrangeObjects];
-    }
-  else 
-    {
-      // FIXME: Should check whether _arranged_objects is mutable
-      ASSIGN(_arranged_objects, [_arranged_objects arrayByAddingObjectsFromArray: obj]);
-    }
+  [self _arrangeInsertedObjects: obj];
   if ([self selectsInsertedObjects])
     {
       [self addSelectedObjects: obj];
@@ -124,19 +233,7 @@
 
 - (void) removeObject: (id)obj
 {
-  [self willChangeValueForKey: NSContentBinding];
-  [_content removeObject: obj];
-  [self removeSelectedObjects: [NSArray arrayWithObject: obj]];
-  if ([self automaticallyRearrangesObjects])
-    {
-      [self rearrangeObjects];
-    }
-  else 
-    {
-      // FIXME
-      //[_arranged_objects removeObject: obj];
-    }
-  [self didChangeValueForKey: NSContentBinding];
+  [self removeObjects: [NSArray arrayWithObject: obj]];
 }
 
 - (void) removeObjects: (NSArray*)obj
@@ -144,15 +241,7 @@
   [self willChangeValueForKey: NSContentBinding];
   [_content removeObjectsInArray: obj];
   [self removeSelectedObjects: obj];
-  if ([self automaticallyRearrangesObjects])
-    {
-      [self rearrangeObjects];
-    }
-  else 
-    {
-      // FIXME
-      //[_arranged_objects removeObjectsInArray: obj];
-    }
+  [self _removeArrangedObjects: obj];
   [self didChangeValueForKey: NSContentBinding];
 }
 
@@ -177,12 +266,43 @@
 
 - (NSIndexSet*) _indexSetForObjects: (NSArray*)objects
 {
+  GSArrayControllerInfo *info = INFO;
   NSMutableIndexSet *tmp = [NSMutableIndexSet new];
   id<NSFastEnumeration> enumerator = objects;
 
+  /* Scanning the arranged objects is cheaper than indexing them for a
+     few objects, e.g. when a single inserted object gets selected.
+     The index is keyed by pointer, so that it stays valid when the
+     arranged objects are mutated and their hash changes. Objects which
+     are only equal to an arranged one are still found by scanning. */
+  if (info->arrangedIndex == NULL && [objects count] > 8)
+    {
+      NSUInteger i = [_arranged_objects count];
+
+      info->arrangedIndex = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                                             NSIntegerMapValueCallBacks, i);
+      // Walk backwards so objects map to their first index
+      while (i-- > 0)
+        {
+          NSMapInsert(info->arrangedIndex,
+                      [_arranged_objects objectAtIndex: i], (void*)i);
+        }
+    }
+
   FOR_IN (id, obj, enumerator)
   {
-    NSUInteger index = [_arranged_objects indexOfObject: obj];
+    NSUInteger index;
+    void *v;
+
+    if (info->arrangedIndex != NULL
+      && NSMapMember(info->arrangedIndex, obj, NULL, &v))
+      {
+        index = (NSUInteger)v;
+      }
+    else
+      {
+        index = [_arranged_objects indexOfObject: obj];
+      }
     if (NSNotFound != index)
       {
         [tmp addIndex: index];
@@ -372,19 +492,40 @@
 
 - (id) arrangedObjects
 {
+  /* The array is edited in place on insertions and removals, so it is
+     copied before the next edit once it has been handed out. */
+  INFO->arrangedObjectsVended = YES;
   return _arranged_objects;
 }
 
 - (void) rearrangeObjects
 {
+  GSArrayControllerInfo *info = INFO;
+  NSMutableArray *arranged;
+
+  [self _cancelArrangement];
+  if (info->arrangesAsynchronously && [self _arrangesIncrementally])
+    {
+      info->arrangeTask = [[GSArrangeObjectsTask alloc]
+                            initWithController: self];
+      [info->arrangeTask start];
+      return;
+    }
+
+  arranged = [[self arrangeObjects: _content] mutableCopy];
+
   [self willChangeValueForKey: @"arrangedObjects"];
-  ASSIGN(_arranged_objects, [self arrangeObjects: _content]);
+  [self _invalidateArrangedIndex];
+  RELEASE(_arranged_objects);
+  _arranged_objects = arranged;
+  info->arrangedObjectsVended = NO;
   [self didChangeValueForKey: @"arrangedObjects"];
 }
 
 - (void) setSortDescriptors: (NSArray*)desc
 {
   ASSIGNCOPY(_sort_descriptors, desc);
+  [self rearrangeObjects];
 }
 
 - (NSArray*) sortDescriptors
@@ -395,6 +536,7 @@
 - (void) setFilterPredicate: (NSPredicate*)filterPredicate
 {
   ASSIGN(_filter_predicate, filterPredicate);
+  [self rearrangeObjects];
 }
 
 - (NSPredicate*) filterPredicate
@@ -405,15 +547,35 @@
 - (void) insertObject: (id)obj 
 atArrangedObjectIndex: (NSUInteger)idx
 {
-  // FIXME
-  [self addObject: obj];
+  [self insertObjects: [NSArray arrayWithObject: obj]
+        atArrangedObjectIndexes: [NSIndexSet indexSetWithIndex: idx]];
 }
 
 - (void) insertObjects: (NSArray*)obj 
 atArrangedObjectIndexes: (NSIndexSet*)idx
 {
-  // FIXME
-  [self addObjects: obj];
+  NSUInteger i, index;
+
+  if ([self automaticallyRearrangesObjects])
+    {
+      // The objects end up where the sort descriptors put them
+      [self addObjects: obj];
+      return;
+    }
+
+  [self willChangeValueForKey: NSContentBinding];
+  [_content addObjectsFromArray: obj];
+  index = [idx firstIndex];
+  for (i = 0; i < [obj count] && index != NSNotFound; i++)
+    {
+      [self _insertArrangedObject: [obj objectAtIndex: i] atIndex: index];
+      index = [idx indexGreaterThanIndex: index];
+    }
+  if ([self selectsInsertedObjects])
+    {
+      [self addSelectionIndexes: idx];
+    }
+  [self didChangeValueForKey: NSContentBinding];
 }
 
 - (void) removeObjectAtArrangedObjectIndex: (NSUInteger)idx
@@ -526,3 +688,483 @@ atArrangedObjectIndexes: (NSIndexSet*)idx
 }
 
 @end
+
+@implementation NSArrayController (Private)
+
+/* The arranged objects may only be updated in place when -arrangeObjects:
+ * is not overridden, otherwise a subclass may arrange them differently.
+ */
+- (BOOL) _arrangesIncrementally
+{
+  return [self methodForSelector: @selector(arrangeObjects:)]
+    == arrangeObjectsImp;
+}
+
+/* Returns the index at which obj has to be inserted into the arranged
+ * objects to keep them sorted. Objects which compare equal to existing
+ * ones go after them, as with a stable sort.
+ */
+- (NSUInteger) _arrangedIndexForObject: (id)obj
+{
+  NSUInteger low = 0;
+  NSUInteger high = [_arranged_objects count];
+  NSUInteger count = [_sort_descriptors count];
+
+  if (count == 0)
+    {
+      return high;
+    }
+
+  while (low < high)
+    {
+      NSUInteger mid = (low + high) / 2;
+      id other = [_arranged_objects objectAtIndex: mid];
+
+      if (compareWithDescriptors(other, obj, _sort_descriptors)
+        == NSOrderedDescending)
+        {
+          high = mid;
+        }
+      else
+        {
+          low = mid + 1;
+        }
+    }
+  return low;
+}
+
+- (void) _insertArrangedObject: (id)obj atIndex: (NSUInteger)idx
+{
+  NSIndexSet *changed = [NSIndexSet indexSetWithIndex: idx];
+
+  if ([_selection_indexes lastIndex] != NSNotFound
+    && [_selection_indexes lastIndex] >= idx)
+    {
+      NSMutableIndexSet *tmp = AUTORELEASE([_selection_indexes mutableCopy]);
+
+      [tmp shiftIndexesStartingAtIndex: idx by: 1];
+      [self setSelectionIndexes: tmp];
+    }
+
+  [self willChange: NSKeyValueChangeInsertion
+   valuesAtIndexes: changed
+            forKey: @"arrangedObjects"];
+  [self _invalidateArrangedIndex];
+  [self _willMutateArrangedObjects];
+  [(NSMutableArray*)_arranged_objects insertObject: obj atIndex: idx];
+  [self didChange: NSKeyValueChangeInsertion
+  valuesAtIndexes: changed
+           forKey: @"arrangedObjects"];
+}
+
+/* Adds objects just added to the content to the arranged objects.
+ * When the objects are kept sorted, each one is tested against the filter
+ * predicate and inserted at its sorted position, unless so many objects
+ * are added that arranging everything again is cheaper.
+ */
+- (void) _arrangeInsertedObjects: (NSArray*)objects
+{
+  BOOL rearranges = [self automaticallyRearrangesObjects];
+  NSUInteger i, count = [objects count];
+
+  if (INFO->arrangeTask != nil
+    || (rearranges
+      && (![self _arrangesIncrementally]
+        || count > [_arranged_objects count] / 8 + 1)))
+    {
+      // An arrangement still in progress does not know about the objects
+      [self rearrangeObjects];
+      return;
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      id obj = [objects objectAtIndex: i];
+
+      if (!rearranges)
+        {
+          [self _insertArrangedObject: obj
+                              atIndex: [_arranged_objects count]];
+        }
+      else if (_filter_predicate == nil
+        || [_filter_predicate evaluateWithObject: obj])
+        {
+          [self _insertArrangedObject: obj
+                              atIndex: [self _arrangedIndexForObject: obj]];
+        }
+    }
+}
+
+- (void) _removeArrangedObjects: (NSArray*)objects
+{
+  NSMutableIndexSet *idx;
+  NSSet *removed;
+  NSUInteger i, count = [_arranged_objects count];
+
+  if (INFO->arrangeTask != nil
+    || ([self automaticallyRearrangesObjects]
+      && ![self _arrangesIncrementally]))
+    {
+      [self rearrangeObjects];
+      return;
+    }
+
+  /* Like -removeObjectsInArray: this removes all equal objects, which
+     are looked up by hash rather than by scanning objects each time. */
+  removed = [NSSet setWithArray: objects];
+  idx = [NSMutableIndexSet indexSet];
+  for (i = 0; i < count; i++)
+    {
+      if ([removed member: [_arranged_objects objectAtIndex: i]] != nil)
+        {
+          [idx addIndex: i];
+        }
+    }
+  [self _removeArrangedObjectsAtIndexes: idx];
+}
+
+- (void) _removeArrangedObjectsAtIndexes: (NSIndexSet*)idx
+{
+  NSUInteger index;
+
+  if ([idx count] == 0)
+    {
+      return;
+    }
+
+  if ([_selection_indexes count] > 0)
+    {
+      NSMutableIndexSet *tmp = AUTORELEASE([_selection_indexes mutableCopy]);
+
+      /* Shift the selection from the end, so that the indexes still
+         to be processed are not affected. */
+      index = [idx lastIndex];
+      while (index != NSNotFound)
+        {
+          [tmp shiftIndexesStartingAtIndex: index + 1 by: -1];
+          index = [idx indexLessThanIndex: index];
+        }
+      [self setSelectionIndexes: tmp];
+    }
+
+  [self willChange: NSKeyValueChangeRemoval
+   valuesAtIndexes: idx
+            forKey: @"arrangedObjects"];
+  [self _invalidateArrangedIndex];
+  [self _willMutateArrangedObjects];
+  [(NSMutableArray*)_arranged_objects removeObjectsAtIndexes: idx];
+  [self didChange: NSKeyValueChangeRemoval
+  valuesAtIndexes: idx
+           forKey: @"arrangedObjects"];
+}
+
+/* Forgets the object to arranged index map built by -_indexSetForObjects:.
+ * It is rebuilt on demand after the arranged objects change.
+ */
+- (void) _invalidateArrangedIndex
+{
+  GSArrayControllerInfo *info = INFO;
+
+  if (info->arrangedIndex != NULL)
+    {
+      NSFreeMapTable(info->arrangedIndex);
+      info->arrangedIndex = NULL;
+    }
+}
+
+/* Replaces the arranged objects by a private copy if they have been
+ * returned by -arrangedObjects, so that callers holding on to them do
+ * not see them change.
+ */
+- (void) _willMutateArrangedObjects
+{
+  GSArrayControllerInfo *info = INFO;
+
+  if (info->arrangedObjectsVended)
+    {
+      NSMutableArray *arranged = [_arranged_objects mutableCopy];
+
+      AUTORELEASE(_arranged_objects);
+      _arranged_objects = arranged;
+      info->arrangedObjectsVended = NO;
+    }
+}
+
+- (void) _cancelArrangement
+{
+  GSArrayControllerInfo *info = INFO;
+
+  if (info->arrangeTask != nil)
+    {
+      info->arrangeTask->cancelled = YES;
+      info->arrangeTask->controller = nil;
+      DESTROY(info->arrangeTask);
+    }
+}
+
+- (void) _finishArrangement: (GSArrangeObjectsTask*)task
+{
+  GSArrayControllerInfo *info = INFO;
+  NSMutableArray *arranged;
+
+  if (task != info->arrangeTask || task->cancelled)
+    {
+      // superseded by a later arrangement
+      return;
+    }
+
+  arranged = [task->result mutableCopy];
+  DESTROY(info->arrangeTask);
+  [self willChangeValueForKey: @"arrangedObjects"];
+  [self _invalidateArrangedIndex];
+  RELEASE(_arranged_objects);
+  _arranged_objects = arranged;
+  info->arrangedObjectsVended = NO;
+  [self didChangeValueForKey: @"arrangedObjects"];
+}
+
+@end
+
+@implementation NSArrayController (GNUstep)
+
+- (BOOL) arrangesAsynchronously
+{
+  return INFO->arrangesAsynchronously;
+}
+
+- (void) setArrangesAsynchronously: (BOOL)flag
+{
+  INFO->arrangesAsynchronously = flag;
+}
+
+@end
+
+@implementation GSArrangeObjectsTask
+
+- (id) initWithController: (NSArrayController*)aController
+{
+  if ((self = [super init]) != nil)
+    {
+      controller = aController;
+      content = [[aController content] copy];
+      ASSIGN(predicate, [aController filterPredicate]);
+      ASSIGN(descriptors, [aController sortDescriptors]);
+    }
+  return self;
+}
+
+- (void) dealloc
+{
+  DESTROY(content);
+  DESTROY(predicate);
+  DESTROY(descriptors);
+  DESTROY(result);
+  [super dealloc];
+}
+
+- (void) start
+{
+  NSUInteger count = [content count];
+  NSUInteger workers = [arrangeQueue maxConcurrentOperationCount];
+  NSUInteger chunks, chunkSize, i;
+  NSMutableArray *ops;
+  NSMutableArray *parts;
+
+  // Chunks of at least 1024 objects, at most four per worker
+  chunks = MAX(1, MIN(workers * 4, count / 1024));
+  chunkSize = (count + chunks - 1) / chunks;
+
+  ops = [NSMutableArray arrayWithCapacity: 2 * chunks];
+  parts = [NSMutableArray arrayWithCapacity: chunks];
+  for (i = 0; i < chunks; i++)
+    {
+      GSArrangeChunkOperation *op;
+      NSUInteger start = MIN(count, i * chunkSize);
+
+      op = [[GSArrangeChunkOperation alloc] initWithTask: self];
+      op->range = NSMakeRange(start, MIN(chunkSize, count - start));
+      [ops addObject: op];
+      [parts addObject: op];
+      RELEASE(op);
+    }
+
+  while ([parts count] > 1)
+    {
+      NSMutableArray *merged;
+      NSUInteger pairs = [parts count] / 2;
+
+      merged = [NSMutableArray arrayWithCapacity: pairs + 1];
+      for (i = 0; i < pairs; i++)
+        {
+          GSArrangeMergeOperation *op;
+
+          op = [[GSArrangeMergeOperation alloc] initWithTask: self];
+          ASSIGN(op->first, [parts objectAtIndex: 2 * i]);
+          ASSIGN(op->second, [parts objectAtIndex: 2 * i + 1]);
+          [op addDependency: op->first];
+          [op addDependency: op->second];
+          [ops addObject: op];
+          [merged addObject: op];
+          RELEASE(op);
+        }
+      if ([parts count] % 2 == 1)
+        {
+          [merged addObject: [parts lastObject]];
+        }
+      parts = merged;
+    }
+  ((GSArrangeOperation*)[parts lastObject])->isLast = YES;
+
+  for (i = 0; i < [ops count]; i++)
+    {
+      [arrangeQueue addOperation: [ops objectAtIndex: i]];
+    }
+}
+
+/* Runs on the main thread, where the controller cancels superseded
+ * tasks, so a task which is not cancelled here still has its controller.
+ */
+- (void) deliver
+{
+  if (!cancelled)
+    {
+      [controller _finishArrangement: self];
+    }
+}
+
+@end
+
+@implementation GSArrangeOperation
+
+- (id) initWithTask: (GSArrangeObjectsTask*)aTask
+{
+  if ((self = [super init]) != nil)
+    {
+      ASSIGN(task, aTask);
+    }
+  return self;
+}
+
+- (void) dealloc
+{
+  DESTROY(task);
+  DESTROY(output);
+  [super dealloc];
+}
+
+/* Hands the result of the last operation back to the main thread.
+ * performSelectorOnMainThread: keeps the task alive until it is
+ * delivered.
+ */
+- (void) publish
+{
+  if (isLast && !task->cancelled)
+    {
+      if (output == nil)
+        {
+          output = [NSArray new];
+        }
+      ASSIGN(task->result, output);
+      [task performSelectorOnMainThread: @selector(deliver)
+                             withObject: nil
+                          waitUntilDone: NO];
+    }
+}
+
+@end
+
+@implementation GSArrangeChunkOperation
+
+- (void) main
+{
+  CREATE_AUTORELEASE_POOL(pool);
+  NSArray *objects;
+  NSPredicate *predicate = task->predicate;
+
+  if (task->cancelled)
+    {
+      DESTROY(pool);
+      return;
+    }
+
+  objects = [task->content subarrayWithRange: range];
+  if (predicate != nil)
+    {
+      objects = [objects filteredArrayUsingPredicate: predicate];
+    }
+  if (!task->cancelled && [task->descriptors count] > 0)
+    {
+      objects = [objects sortedArrayUsingDescriptors: task->descriptors];
+    }
+  ASSIGN(output, objects);
+  [self publish];
+  DESTROY(pool);
+}
+
+@end
+
+@implementation GSArrangeMergeOperation
+
+- (void) dealloc
+{
+  DESTROY(first);
+  DESTROY(second);
+  [super dealloc];
+}
+
+- (void) main
+{
+  CREATE_AUTORELEASE_POOL(pool);
+  NSArray *descriptors = task->descriptors;
+  NSArray *a1 = first->output;
+  NSArray *a2 = second->output;
+  NSUInteger i = 0, j = 0;
+  NSUInteger n1 = [a1 count], n2 = [a2 count];
+  NSMutableArray *merged;
+
+  if (task->cancelled)
+    {
+      DESTROY(pool);
+      return;
+    }
+
+  merged = [[NSMutableArray alloc] initWithCapacity: n1 + n2];
+  while ([descriptors count] > 0 && i < n1 && j < n2)
+    {
+      id a = [a1 objectAtIndex: i];
+      id b = [a2 objectAtIndex: j];
+
+      // Take from the first array on ties to keep the merge stable
+      if (compareWithDescriptors(b, a, descriptors) == NSOrderedAscending)
+        {
+          [merged addObject: b];
+          j++;
+        }
+      else
+        {
+          [merged addObject: a];
+          i++;
+        }
+      if ((i + j) % 4096 == 0 && task->cancelled)
+        {
+          break;
+        }
+    }
+  if (!task->cancelled)
+    {
+      [merged addObjectsFromArray:
+        [a1 subarrayWithRange: NSMakeRange(i, n1 - i)]];
+      [merged addObjectsFromArray:
+        [a2 subarrayWithRange: NSMakeRange(j, n2 - j)]];
+    }
+  output = merged;
+  // The inputs are no longer needed
+  DESTROY(first->output);
+  DESTROY(second->output);
+  DESTROY(first);
+  DESTROY(second);
+  [self publish];
+  DESTROY(pool);
+}
+
+@end
@@ -37,6 +37,8 @@
 #import <Foundation/NSError.h>
 #import <Foundation/NSException.h>
 #import <Foundation/NSFileManager.h>
+#import <Foundation/NSMapTable.h>
+#import <Foundation/NSNull.h>
 #import <Foundation/NSPathUtilities.h>
 #import <Foundation/NSRange.h>
 #import <Foundation/NSSet.h>
@@ -1461,6 +1463,28 @@ static NSString *lastFont = nil;
 static NSCharacterSet *lastSet = nil;
 static NSMutableDictionary *cachedCSets = nil;
 
+/* The fonts -_substituteFontFor:font: found, by base font. For each base
+   font a map table holds the substitute for each Unicode block of 128
+   characters (keyed by the block number plus one), and NSNull for each
+   character no font was found for (keyed by the character with
+   GS_FALLBACK_CHARACTER set). */
+static NSMapTable *fallbackFonts = nil;
+
+#define GS_FALLBACK_CHARACTER 0x1000000
+#define GS_FALLBACK_MAX_FONTS 64
+
+void
+GSInvalidateFontFallbacks(void)
+{
+  if (fallbackFonts != nil)
+    {
+      NSResetMapTable(fallbackFonts);
+    }
+  DESTROY(lastFont);
+  DESTROY(lastSet);
+  [cachedCSets removeAllObjects];
+}
+
 - (NSFont*)_substituteFontWithName: (NSString*)fontName 
                               font: (NSFont*)baseFont
 {
@@ -1531,7 +1555,7 @@ static NSMutableDictionary *cachedCSets = nil;
   return [fd matchingFontDescriptorWithMandatoryKeys: mandatoryKeys];
 }
 
-- (NSFont*)_substituteFontFor: (unichar)uchar font: (NSFont*)baseFont
+- (NSFont*)_searchSubstituteFontFor: (unichar)uchar font: (NSFont*)baseFont
 {
   NSFont *subFont;
   NSFontDescriptor *descriptor;
@@ -1577,6 +1601,57 @@ static NSMutableDictionary *cachedCSets = nil;
   return nil;
 }
 
+/* Returns a font like baseFont that covers uchar, or nil if there is
+   none. Text in another script usually needs the same substitute for
+   all of its characters, so the font found is remembered for the block
+   of uchar and tried first for the other characters of the block. */
+- (NSFont*)_substituteFontFor: (unichar)uchar font: (NSFont*)baseFont
+{
+  NSUInteger blockKey = (uchar >> 7) + 1;
+  NSUInteger charKey = GS_FALLBACK_CHARACTER | uchar;
+  NSMapTable *fonts;
+  id subFont;
+
+  if (fallbackFonts == nil)
+    {
+      fallbackFonts = NSCreateMapTable(NSObjectMapKeyCallBacks,
+                                       NSObjectMapValueCallBacks, 8);
+    }
+  fonts = NSMapGet(fallbackFonts, baseFont);
+  if (fonts == nil)
+    {
+      if (NSCountMapTable(fallbackFonts) >= GS_FALLBACK_MAX_FONTS)
+        {
+          NSResetMapTable(fallbackFonts);
+        }
+      fonts = NSCreateMapTable(NSIntegerMapKeyCallBacks,
+                               NSObjectMapValueCallBacks, 8);
+      NSMapInsert(fallbackFonts, baseFont, fonts);
+      RELEASE(fonts);
+    }
+
+  subFont = NSMapGet(fonts, (void*)blockKey);
+  if (subFont != nil && [[subFont coveredCharacterSet] characterIsMember: uchar])
+    {
+      return subFont;
+    }
+  if (NSMapGet(fonts, (void*)charKey) != nil)
+    {
+      return nil;
+    }
+
+  subFont = [self _searchSubstituteFontFor: uchar font: baseFont];
+  if (subFont != nil)
+    {
+      NSMapInsert(fonts, (void*)blockKey, subFont);
+    }
+  else
+    {
+      NSMapInsert(fonts, (void*)charKey, [NSNull null]);
+    }
+  return subFont;
+}
+
 - (void) fixFontAttributeInRange: (NSRange)range
 {
   NSString *string;
@@ -33,9 +33,10 @@
 
 @interface NSBitmapImageRep (GIFReading)
 
-+ (BOOL) _bitmapIsGIF: (NSData *)imageData;
 - (id) _initBitmapFromGIF: (NSData *)imageData
              errorMessage: (NSString **)errorMsg;
+- (NSInteger) _incrementalLoadGIF: (NSData *)imageData
+                         complete: (BOOL)complete;
 - (NSData *) _GIFRepresentationWithProperties: (NSDictionary *) properties
                                  errorMessage: (NSString **)errorMsg;
 
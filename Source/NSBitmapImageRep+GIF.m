@@ -142,36 +142,41 @@ static int gs_gif_output(GifFileType *file, const GifByteType *buffer, int len)
 }
 #endif
 
-/* -----------------------------------------------------------
-   The gif loading part of NSBitmapImageRep
-   ----------------------------------------------------------- */
-
-@implementation NSBitmapImageRep (GIFReading)
+@interface NSBitmapImageRep (GSPrivate)
+- (id) _loadState;
+- (void) _setLoadState: (id)state;
+- (BOOL) _allocateBitmapPixelsWide: (NSInteger)width
+                        pixelsHigh: (NSInteger)height
+                     bitsPerSample: (NSInteger)bps
+                   samplesPerPixel: (NSInteger)spp
+                          hasAlpha: (BOOL)alpha
+                    colorSpaceName: (NSString*)colorSpaceName
+                      bitmapFormat: (NSBitmapFormat)bitmapFormat
+                       bytesPerRow: (NSInteger)rowBytes
+                      bitsPerPixel: (NSInteger)pixelBits;
+@end
 
-/* Return YES if this looks like a GIF. */
-+ (BOOL) _bitmapIsGIF: (NSData *)imageData
+/* The gif library cannot suspend when it runs out of data, so an
+   incremental load decodes the data received so far from the start.
+   To keep the total work linear in the size of the image, a new
+   attempt is only made once the data has grown by a quarter. */
+@interface GSGIFLoadState : NSObject
 {
-  struct gs_gif_input_src src;
-  GifFileType*            file;
+@public
+  NSUInteger decodedLength;   /* data length at the last attempt */
+  NSInteger rows;             /* rows decoded by the last attempt */
+  BOOL hasHeader;
+}
+@end
 
-  if (!imageData || ![imageData length])
-    {
-      return NO;
-    }
+@implementation GSGIFLoadState
+@end
 
-  gs_gif_init_input_source(&src, imageData);
-  file = DGifOpen(&src, gs_gif_input);
-  if (file == NULL)
-    {
-      /* we do not use giferror here because it doesn't
-         seem to be thread-safe (the error code is a global
-         variable, so we might get the wrong error here.  */
-      return NO;
-    }
+/* -----------------------------------------------------------
+   The gif loading part of NSBitmapImageRep
+   ----------------------------------------------------------- */
 
-  DGifCloseFile(file);
-  return YES;
-}
+@implementation NSBitmapImageRep (GIFReading)
 
 
 #define SET_ERROR_MSG(msg) \
@@ -401,6 +406,258 @@ static int gs_gif_output(GifFileType *file, const GifByteType *buffer, int len)
   return self;
 }
 
+/* Decodes as much of the first image in the gif data received so far as
+   possible. Rows not decoded yet show the background color, except that
+   the lines of each pass of an interlaced image are repeated down over
+   the lines of the later passes. Returns the number of rows decoded,
+   or a load status. */
+- (NSInteger) _decodePartialGIF: (NSData *)imageData
+                          state: (GSGIFLoadState *)state
+{
+  struct gs_gif_input_src src;
+  GifFileType            *file;
+  GifRecordType           recordType;
+  GifByteType            *extension;
+  GifPixelType           *imgBuffer;
+  GifPixelType           *imgBufferPos;
+  unsigned char          *rgbBuffer;
+  ColorMapObject         *colorMap;
+  GifColorType           *color;
+  unsigned char           colorIndex;
+  unsigned                rowSize;
+  int                     extCode;
+  int                     i, j, k;
+  int                     imgHeight = 0, imgWidth = 0, imgRow = 0, imgCol = 0;
+  int                     covered = 0;
+  BOOL                    hasAlpha = NO;
+  BOOL                    gotImage = NO;
+  BOOL                    finished = NO;
+  unsigned char           transparentColor = 0;
+  int                     sPP;
+  unsigned short          duration = 0;
+  NSInteger               result;
+
+  gs_gif_init_input_source(&src, imageData);
+  file = DGifOpen(&src, gs_gif_input);
+  if (file == NULL)
+    {
+      return NSImageRepLoadStatusReadingHeader;
+    }
+
+  rowSize = file->SWidth * sizeof(GifPixelType);
+  imgBuffer = NSZoneMalloc([self zone], file->SHeight * rowSize);
+  if (imgBuffer == NULL)
+    {
+      DGifCloseFile(file);
+      return NSImageRepLoadStatusInvalidData;
+    }
+  memset(imgBuffer, file->SBackGroundColor, file->SHeight * rowSize);
+
+  /* Read up to the end of the first image or of the data, whichever
+     comes first. A failing call means the data stops there. */
+  while (!gotImage && DGifGetRecordType(file, &recordType) == GIF_OK)
+    {
+      if (recordType == IMAGE_DESC_RECORD_TYPE)
+        {
+          if (DGifGetImageDesc(file) != GIF_OK)
+            {
+              break;
+            }
+          imgWidth  = file->Image.Width;
+          imgHeight = file->Image.Height;
+          imgRow    = file->Image.Top;
+          imgCol    = file->Image.Left;
+          if ((imgCol + imgWidth > file->SWidth)
+            || (imgRow + imgHeight > file->SHeight))
+            {
+              NSZoneFree([self zone], imgBuffer);
+              DGifCloseFile(file);
+              return NSImageRepLoadStatusInvalidData;
+            }
+          gotImage = YES;
+          covered = imgRow;
+
+          if (file->Image.Interlace)
+            {
+              for (i = 0; i < 4; i++)
+                {
+                  int repeat = (i == 0 ? 8 : InterlaceJumps[i] / 2) - 1;
+
+                  for (j = imgRow + InterlaceOffset[i]; j < imgRow + imgHeight;
+                       j = j + InterlaceJumps[i])
+                    {
+                      imgBufferPos = imgBuffer + (j * rowSize) + imgCol;
+                      if (DGifGetLine(file, imgBufferPos, imgWidth) != GIF_OK)
+                        {
+                          break;
+                        }
+                      for (k = 1; k <= repeat && j + k < imgRow + imgHeight; k++)
+                        {
+                          memcpy(imgBufferPos + k * rowSize, imgBufferPos,
+                                 imgWidth);
+                        }
+                      if (j + repeat + 1 > covered)
+                        {
+                          covered = MIN(j + repeat + 1, imgRow + imgHeight);
+                        }
+                    }
+                  if (j < imgRow + imgHeight)
+                    {
+                      break;
+                    }
+                }
+              finished = (i == 4);
+            }
+          else
+            {
+              for (i = 0; i < imgHeight; i++)
+                {
+                  imgBufferPos = imgBuffer + ((imgRow + i) * rowSize) + imgCol;
+                  if (DGifGetLine(file, imgBufferPos, imgWidth) != GIF_OK)
+                    {
+                      break;
+                    }
+                  covered = imgRow + i + 1;
+                }
+              finished = (i == imgHeight);
+            }
+        }
+      else if (recordType == EXTENSION_RECORD_TYPE)
+        {
+          if (DGifGetExtension(file, &extCode, &extension) != GIF_OK)
+            {
+              break;
+            }
+          if (extCode == GRAPHICS_EXT_FUNC_CODE && extension != NULL)
+            {
+              hasAlpha = (extension[1] & 0x01);
+              transparentColor = extension[4];
+              duration = extension[3];
+              duration = (duration << 8) + extension[2];
+            }
+          while (extension != NULL)
+            {
+              if (DGifGetExtensionNext(file, &extension) != GIF_OK)
+                {
+                  break;
+                }
+            }
+        }
+      else
+        {
+          break;
+        }
+    }
+
+  if (!gotImage)
+    {
+      NSZoneFree([self zone], imgBuffer);
+      DGifCloseFile(file);
+      return NSImageRepLoadStatusReadingHeader;
+    }
+
+  sPP = hasAlpha ? 4 : 3;
+  if (!state->hasHeader)
+    {
+      if (![self _allocateBitmapPixelsWide: file->SWidth
+                                pixelsHigh: file->SHeight
+                             bitsPerSample: 8
+                           samplesPerPixel: sPP
+                                  hasAlpha: hasAlpha
+                            colorSpaceName: NSCalibratedRGBColorSpace
+                              bitmapFormat: 0
+                               bytesPerRow: file->SWidth * sPP
+                              bitsPerPixel: 8 * sPP])
+        {
+          NSZoneFree([self zone], imgBuffer);
+          DGifCloseFile(file);
+          return NSImageRepLoadStatusInvalidData;
+        }
+      state->hasHeader = YES;
+    }
+
+  /* convert the image to rgb */
+  colorMap = (file->Image.ColorMap ? file->Image.ColorMap : file->SColorMap);
+  rgbBuffer = [self bitmapData];
+  for (i = 0; i < file->SHeight; i++)
+    {
+      imgBufferPos = imgBuffer + (i * rowSize);
+      for (j = 0; j < file->SWidth; j++)
+        {
+          colorIndex = imgBufferPos[j];
+          color = &colorMap->Colors[colorIndex];
+          *rgbBuffer++ = color->Red;
+          *rgbBuffer++ = color->Green;
+          *rgbBuffer++ = color->Blue;
+          if (hasAlpha)
+            *rgbBuffer++ = (transparentColor == colorIndex) ? 0 : 255;
+        }
+    }
+  NSZoneFree([self zone], imgBuffer);
+
+  if (finished)
+    {
+      [self setProperty: NSImageRGBColorTable
+              withValue: [NSData dataWithBytes: colorMap->Colors
+                                        length: sizeof(GifColorType)
+                                                * colorMap->ColorCount]];
+      if (duration > 0)
+        {
+          [self setProperty: NSImageCurrentFrameDuration
+                  withValue: [NSNumber numberWithFloat: (100.0 * duration)]];
+        }
+      [self setProperty: NSImageCurrentFrame
+              withValue: [NSNumber numberWithInt: 0]];
+      result = NSImageRepLoadStatusCompleted;
+    }
+  else
+    {
+      result = covered;
+    }
+
+  DGifCloseFile(file);
+  return result;
+}
+
+- (NSInteger) _incrementalLoadGIF: (NSData *)imageData
+                         complete: (BOOL)complete
+{
+  GSGIFLoadState *state = [self _loadState];
+  NSUInteger length = [imageData length];
+  NSInteger result;
+
+  if (state == nil)
+    {
+      state = [GSGIFLoadState new];
+      state->rows = NSImageRepLoadStatusReadingHeader;
+      [self _setLoadState: state];
+      RELEASE(state);
+    }
+
+  if (!complete
+    && length < state->decodedLength + MAX(4096, state->decodedLength / 4))
+    {
+      return state->rows;
+    }
+
+  state->decodedLength = length;
+  result = [self _decodePartialGIF: imageData state: state];
+  if (result == NSImageRepLoadStatusCompleted
+    || result == NSImageRepLoadStatusInvalidData)
+    {
+      [self _setLoadState: nil];
+      return result;
+    }
+  if (complete)
+    {
+      [self _setLoadState: nil];
+      return (result == NSImageRepLoadStatusReadingHeader)
+        ? NSImageRepLoadStatusInvalidData : NSImageRepLoadStatusUnexpectedEOF;
+    }
+  state->rows = result;
+  return result;
+}
+
 - (NSData *) _GIFRepresentationWithProperties: (NSDictionary *) properties
                                  errorMessage: (NSString **)errorMsg
 {
@@ -577,10 +834,6 @@ static int gs_gif_output(GifFileType *file, const GifByteType *buffer, int len)
 #else /* !HAVE_LIBUNGIF || !HAVE_LIBGIF */
 
 @implementation NSBitmapImageRep (GIFReading)
-+ (BOOL) _bitmapIsGIF: (NSData *)imageData
-{
-  return NO;
-}
 - (id) _initBitmapFromGIF: (NSData *)imageData
 	     errorMessage: (NSString **)errorMsg
 {
@@ -592,6 +845,12 @@ static int gs_gif_output(GifFileType *file, const GifByteType *buffer, int len)
   return nil;
 }
 
+- (NSInteger) _incrementalLoadGIF: (NSData *)imageData
+                         complete: (BOOL)complete
+{
+  return NSImageRepLoadStatusInvalidData;
+}
+
 - (NSData *) _GIFRepresentationWithProperties: (NSDictionary *) properties
                                  errorMessage: (NSString **)errorMsg
 {
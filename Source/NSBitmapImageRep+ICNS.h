@@ -33,9 +33,9 @@
 #import "AppKit/NSBitmapImageRep.h"
 
 @interface NSBitmapImageRep (ICNS)
-+ (BOOL) _bitmapIsICNS: (NSData *)imageData;
 + (NSArray*) _imageRepsWithICNSData: (NSData *)imageData;
 - (id) _initBitmapFromICNS: (NSData *)imageData;
+- (id) _initBitmapFromICNS: (NSData *)imageData frame: (NSInteger)frame;
 // - (NSData *) _ICNSRepresentationWithProperties: (NSDictionary *) properties;
 @end
 
@@ -38,6 +38,7 @@
 #import <Foundation/NSValue.h>
 #import "AppKit/NSGraphics.h"
 #import "GSGuiPrivate.h"
+#import "GSDeferredBitmapImageRep.h"
 
 #define ICNS_HEADER "icns"
 
@@ -446,6 +447,23 @@ static int icns_get_image32_with_mask_from_family(icns_family_t *iconFamily,
 
 #endif /* !HAVE_LIBICNS */
 
+/* Returns YES if elements of type hold an image, rather than a mask, and
+   sets width and height to its size. */
+static BOOL icns_image_size_for_type(icns_type_t type,
+                                     unsigned int *width,
+                                     unsigned int *height)
+{
+  icns_icon_info_t info = icns_get_image_info_for_type(type);
+
+#if HAVE_LIBICNS
+  if (!info.isImage)
+    return NO;
+#endif
+  *width = info.iconWidth;
+  *height = info.iconHeight;
+  return (info.iconWidth > 0 && info.iconHeight > 0);
+}
+
 // Define the pixel
 typedef struct pixel_t
 {
@@ -457,31 +475,6 @@ typedef struct pixel_t
 
 @implementation NSBitmapImageRep (ICNS)
 
-+ (BOOL) _bitmapIsICNS: (NSData *)imageData
-{
-  char header[5];
-
-  /*
-   * If the data is 0, return immediately.
-   */
-  if ([imageData length] < 8)
-    {
-      return NO;
-    }
-
-  /*
-   * Check the beginning of the data for 
-   * the string "icns".
-   */
-  [imageData getBytes: header length: 4];
-  if(strncmp(header, ICNS_HEADER, 4) == 0)
-    {
-      return YES;
-    }
-
-  return NO;
-}
-
 - (id) _initBitmapFromICNSImage: (icns_image_t*)iconImage
 {
   unsigned int iconWidth = 0, iconHeight = 0;
@@ -542,6 +535,30 @@ typedef struct pixel_t
   return self;
 }
 
+- (id) _initBitmapFromICNSFamily: (icns_family_t *)iconFamily
+                            type: (icns_type_t)typeStr
+{
+  int                     error = 0;
+  icns_image_t            iconImage;
+
+  // extract the image...
+  memset(&iconImage, 0, sizeof(icns_image_t));
+  error = icns_get_image32_with_mask_from_family(iconFamily,
+                                                 typeStr,
+                                                 &iconImage);
+  if (error)
+    {
+      NSLog(@"Error while extracting image from ICNS data.");
+      RELEASE(self);
+      return nil;
+    }
+
+  self = [self _initBitmapFromICNSImage: &iconImage];
+  icns_free_image(&iconImage);
+
+  return self;
+}
+
 - (id) _initBitmapFromICNS: (NSData *)imageData
 {
   int                     error = 0;
@@ -551,7 +568,6 @@ typedef struct pixel_t
   unsigned long           dataOffset = 0;
   icns_byte_t            *data = NULL;
   icns_type_t             typeStr = ICNS_NULL_TYPE;
-  icns_image_t            iconImage;
 
   error = icns_import_family_data(size, bytes, &iconFamily);
   if (error != ICNS_STATUS_OK)
@@ -586,21 +602,40 @@ typedef struct pixel_t
       dataOffset += element.elementSize;
     }
 
-  // extract the image...
-  memset(&iconImage, 0, sizeof(icns_image_t));
-  error = icns_get_image32_with_mask_from_family(iconFamily,
-                                                 typeStr,
-                                                 &iconImage);
-  if (error)
+  self = [self _initBitmapFromICNSFamily: iconFamily type: typeStr];
+  free(iconFamily);
+
+  return self;
+}
+
+/* Reads the icon whose element starts frame bytes into the family. */
+- (id) _initBitmapFromICNS: (NSData *)imageData frame: (NSInteger)frame
+{
+  int                     error = 0;
+  int                     size = [imageData length];
+  icns_byte_t            *bytes = (icns_byte_t *)[imageData bytes];
+  icns_family_t          *iconFamily = NULL;
+  icns_element_t          element;
+
+  error = icns_import_family_data(size, bytes, &iconFamily);
+  if (error != ICNS_STATUS_OK)
+    {
+      NSLog(@"Error reading ICNS data.");
+      RELEASE(self);
+      return nil;
+    }
+
+  if (frame < (NSInteger)(sizeof(icns_type_t) + sizeof(icns_size_t))
+      || (frame + 8) >= iconFamily->resourceSize)
     {
-      NSLog(@"Error while extracting image from ICNS data.");
       RELEASE(self);
       free(iconFamily);
       return nil;
     }
+  memcpy(&element, (icns_byte_t *)iconFamily + frame, 8);
 
-  self = [self _initBitmapFromICNSImage: &iconImage];
-  icns_free_image(&iconImage);
+  self = [self _initBitmapFromICNSFamily: iconFamily
+                                    type: element.elementType];
   free(iconFamily);
 
   return self;
@@ -615,6 +650,9 @@ typedef struct pixel_t
   icns_family_t  *iconFamily = NULL;
   unsigned long   dataOffset = 0;
   icns_byte_t    *data = NULL;
+  unsigned int    images = 0;
+  unsigned int    width, height;
+  BOOL            defer;
 
   error = icns_import_family_data(size, bytes, &iconFamily);
   if (error != ICNS_STATUS_OK)
@@ -628,6 +666,22 @@ typedef struct pixel_t
   dataOffset = sizeof(icns_type_t) + sizeof(icns_size_t);
   data = (icns_byte_t *)iconFamily;
 
+  /* When the family holds several icons only the one NSImage picks
+     needs its pixels, so leave decoding them until they are used. */
+  while (((dataOffset + 8) < iconFamily->resourceSize))
+    {
+      icns_element_t element;
+
+      memcpy(&element, (data + dataOffset), 8);
+      if (icns_image_size_for_type(element.elementType, &width, &height))
+        images++;
+      if (element.elementSize == 0)
+        break;
+      dataOffset += element.elementSize;
+    }
+  defer = (images > 1 && self == [NSBitmapImageRep class]);
+  dataOffset = sizeof(icns_type_t) + sizeof(icns_size_t);
+
   // read each icon...
   while (((dataOffset + 8) < iconFamily->resourceSize))
     {
@@ -638,6 +692,33 @@ typedef struct pixel_t
       memcpy(&element, (data + dataOffset), 8);
       memcpy(&typeStr, &(element.elementType), 4);
 
+      if (defer)
+        {
+          if (icns_image_size_for_type(typeStr, &width, &height))
+            {
+              NSBitmapImageRep *imageRep;
+
+              imageRep = [[GSDeferredBitmapImageRep alloc]
+                           initWithData: imageData
+                                  frame: dataOffset
+                                decoder: @selector(_initBitmapFromICNS:frame:)
+                             pixelsWide: width
+                             pixelsHigh: height
+                          bitsPerSample: 8
+                        samplesPerPixel: 4
+                               hasAlpha: YES
+                               isPlanar: NO
+                         colorSpaceName: NSCalibratedRGBColorSpace
+                           bitmapFormat: NSAlphaNonpremultipliedBitmapFormat];
+              [array addObject: imageRep];
+              RELEASE(imageRep);
+            }
+          if (element.elementSize == 0)
+            break;
+          dataOffset += element.elementSize;
+          continue;
+        }
+
       // extract the image...
       memset(&iconImage, 0, sizeof(icns_image_t));
       error = icns_get_image32_with_mask_from_family(iconFamily,
@@ -34,11 +34,18 @@
 
 @interface NSBitmapImageRep (JPEGReading)
 
-+ (BOOL) _bitmapIsJPEG: (NSData *)imageData;
 - (id) _initBitmapFromJPEG: (NSData *)imageData
 	      errorMessage: (NSString **)errorMsg;
+- (id) _initBitmapFromJPEG: (NSData *)imageData
+	  fittingPixelSize: (NSSize)maxSize
+	      errorMessage: (NSString **)errorMsg;
+- (NSInteger) _incrementalLoadJPEG: (NSData *)imageData
+                          complete: (BOOL)complete;
 - (NSData *) _JPEGRepresentationWithProperties: (NSDictionary *) properties
                                   errorMessage: (NSString **)errorMsg;
+- (BOOL) _writeJPEGWithProperties: (NSDictionary *) properties
+                               to: (id)output
+                     errorMessage: (NSString **)errorMsg;
 @end
 
 #endif // _NSBitmapImageRep_JPEG_H_include
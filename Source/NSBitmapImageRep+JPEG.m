@@ -30,10 +30,12 @@
 #import <Foundation/NSData.h>
 #import <Foundation/NSDictionary.h>
 #import <Foundation/NSException.h>
+#import <Foundation/NSFileHandle.h>
 #import <Foundation/NSString.h>
 #import <Foundation/NSValue.h>
 #import "AppKit/NSGraphics.h"
 #import "NSBitmapImageRep+JPEG.h"
+#import "NSBitmapImageRep+Scaling.h"
 #import "GSGuiPrivate.h"
 
 #if HAVE_LIBJPEG
@@ -206,20 +208,160 @@ static void gs_jpeg_memory_src_destroy(j_decompress_ptr cinfo)
 
 /* ------------------------------------------------------------------*/
 
+/* A data source manager for incremental loading. It reads from the data
+ * received so far and suspends the jpeg library when that is used up,
+ * unless the data is complete. In that case a fake EOI marker is
+ * inserted, so that a truncated image still finishes decoding.
+ */
+typedef struct
+{
+  struct jpeg_source_mgr parent;
+
+  const unsigned char *base;  /* start of the data last passed in */
+  NSUInteger length;          /* length of that data */
+  NSUInteger skip;            /* bytes still to skip in data not yet seen */
+  BOOL complete;
+} gs_jpeg_incremental_source_mgr;
+
+typedef gs_jpeg_incremental_source_mgr *gs_jpeg_incremental_source_ptr;
+
+static const JOCTET gs_jpeg_eoi[2] = { 0xFF, JPEG_EOI };
+
+static boolean gs_fill_incremental_buffer(j_decompress_ptr cinfo)
+{
+  gs_jpeg_incremental_source_ptr src
+    = (gs_jpeg_incremental_source_ptr)cinfo->src;
+
+  if (!src->complete)
+    {
+      return FALSE;
+    }
+
+  WARNMS(cinfo, JWRN_JPEG_EOF);
+  src->parent.next_input_byte = gs_jpeg_eoi;
+  src->parent.bytes_in_buffer = 2;
+  return TRUE;
+}
+
+static void gs_skip_incremental_data(j_decompress_ptr cinfo, long numBytes)
+{
+  gs_jpeg_incremental_source_ptr src
+    = (gs_jpeg_incremental_source_ptr)cinfo->src;
+
+  if (numBytes <= 0)
+    {
+      return;
+    }
+  if ((size_t)numBytes > src->parent.bytes_in_buffer)
+    {
+      // Skip the rest when more data arrives
+      src->skip += numBytes - src->parent.bytes_in_buffer;
+      src->parent.next_input_byte += src->parent.bytes_in_buffer;
+      src->parent.bytes_in_buffer = 0;
+    }
+  else
+    {
+      src->parent.next_input_byte += numBytes;
+      src->parent.bytes_in_buffer -= numBytes;
+    }
+}
+
+static void gs_jpeg_incremental_src_create(j_decompress_ptr cinfo)
+{
+  gs_jpeg_incremental_source_ptr src;
+
+  cinfo->src = (struct jpeg_source_mgr *)
+    calloc(1, sizeof(gs_jpeg_incremental_source_mgr));
+
+  src = (gs_jpeg_incremental_source_ptr)cinfo->src;
+  src->parent.init_source = gs_init_source;
+  src->parent.fill_input_buffer = gs_fill_incremental_buffer;
+  src->parent.skip_input_data = gs_skip_incremental_data;
+  src->parent.resync_to_restart = jpeg_resync_to_restart; /* use default */
+  src->parent.term_source = gs_term_source;
+}
+
+/* Points the source at data, which starts with the bytes passed in
+ * before. The position of the library in the data is kept.
+ */
+static void gs_jpeg_incremental_src_update(j_decompress_ptr cinfo,
+                                           NSData *data, BOOL complete)
+{
+  gs_jpeg_incremental_source_ptr src
+    = (gs_jpeg_incremental_source_ptr)cinfo->src;
+  const unsigned char *bytes = [data bytes];
+  NSUInteger length = [data length];
+  NSUInteger pos;
+
+  if (src->base == NULL)
+    {
+      pos = 0;
+    }
+  else
+    {
+      pos = src->parent.next_input_byte - src->base;
+      if (src->parent.next_input_byte == gs_jpeg_eoi)
+        {
+          pos = src->length;
+        }
+    }
+  pos = MIN(length, pos + src->skip);
+  src->skip = 0;
+
+  src->base = bytes;
+  src->length = length;
+  src->complete = complete;
+  src->parent.next_input_byte = bytes + pos;
+  src->parent.bytes_in_buffer = length - pos;
+}
+
+/* ------------------------------------------------------------------*/
+
 /*
- * A custom destination manager.
+ * A custom destination manager, handing the compressed data to an
+ * NSMutableData or an NSFileHandle a buffer at a time.
  */
 
+#define GS_JPEG_OUTPUT_SIZE 65536
+
 typedef struct
 {
   struct jpeg_destination_mgr pub; // public fields
-  unsigned char* buffer;
-  unsigned char* data;
-  NSData** finalData;
-  int length;
+  JOCTET buffer[GS_JPEG_OUTPUT_SIZE];
+  id output;
+  BOOL toFile;
 } gs_jpeg_destination_mgr;
 typedef gs_jpeg_destination_mgr * gs_jpeg_dest_ptr;
 
+/* Passes length bytes of the buffer on to the output. */
+static void gs_jpeg_flush_output (j_compress_ptr cinfo, size_t length)
+{
+  gs_jpeg_dest_ptr dest = (gs_jpeg_dest_ptr) cinfo->dest;
+  BOOL failed = NO;
+
+  if (!dest->toFile)
+    {
+      [dest->output appendBytes: dest->buffer length: length];
+      return;
+    }
+
+  NS_DURING
+    {
+      [dest->output writeData: [NSData dataWithBytesNoCopy: dest->buffer
+                                                    length: length
+                                              freeWhenDone: NO]];
+    }
+  NS_HANDLER
+    {
+      failed = YES;
+    }
+  NS_ENDHANDLER
+  if (failed)
+    {
+      ERREXIT(cinfo, JERR_FILE_WRITE);
+    }
+}
+
 /*
         Initialize destination.  This is called by jpeg_start_compress()
         before any data is actually written.  It must initialize
@@ -229,22 +371,10 @@ typedef gs_jpeg_destination_mgr * gs_jpeg_dest_ptr;
 
 static void gs_init_destination (j_compress_ptr cinfo)
 {
-        //NSLog (@"gs_init_destination");
   gs_jpeg_dest_ptr dest = (gs_jpeg_dest_ptr) cinfo->dest;
 
-  // allocate the output image
-
-  int imageSize = cinfo->image_width * cinfo->image_height;
-
-  dest->buffer = (void*) calloc ((imageSize * cinfo->input_components),
-                                sizeof(unsigned char));
-
-  dest->data = (void*) calloc ((imageSize * cinfo->input_components),
-                                sizeof(unsigned char));
-
   dest->pub.next_output_byte = dest->buffer;
-  dest->pub.free_in_buffer = imageSize * cinfo->input_components;
-  dest->length = 0;
+  dest->pub.free_in_buffer = GS_JPEG_OUTPUT_SIZE;
 }
 
 /*
@@ -261,22 +391,11 @@ static void gs_init_destination (j_compress_ptr cinfo)
 
 static boolean gs_empty_output_buffer (j_compress_ptr cinfo)
 {
-
-  //NSLog (@"gs_empty_output_buffer...");
   gs_jpeg_dest_ptr dest = (gs_jpeg_dest_ptr) cinfo->dest;
-  //NSLog (@"length added (%d)", dest->length);
-  int imageSize = cinfo->image_width * cinfo->image_height;
-  int bufSize = imageSize * cinfo->input_components;
-  int i;
 
-  for (i = 0; i < bufSize; i++)
-    {
-      dest->data [dest->length + i] = dest->buffer [i];
-    }
-
-  dest->length = dest->length + bufSize;
+  gs_jpeg_flush_output(cinfo, GS_JPEG_OUTPUT_SIZE);
   dest->pub.next_output_byte = dest->buffer;
-  dest->pub.free_in_buffer = imageSize * cinfo->input_components;
+  dest->pub.free_in_buffer = GS_JPEG_OUTPUT_SIZE;
 
   return TRUE;
 }
@@ -290,23 +409,12 @@ static boolean gs_empty_output_buffer (j_compress_ptr cinfo)
 
 static void gs_term_destination (j_compress_ptr cinfo)
 {
-  //NSLog (@"gs_term_destination");
   gs_jpeg_dest_ptr dest = (gs_jpeg_dest_ptr) cinfo->dest;
-  int imageSize = cinfo->image_width * cinfo->image_height;
-  int bufSize = imageSize * cinfo->input_components;
-  int i;
-
-  for (i = 0; i < bufSize; i++)
-    {
-      dest->data [dest->length + i] = dest->buffer [i];
-    }
-  dest->length = dest->length + bufSize;
 
-  *dest->finalData = [[NSData alloc] initWithBytes: dest->data
-    length: (dest->length) - dest->pub.free_in_buffer];
+  gs_jpeg_flush_output(cinfo, GS_JPEG_OUTPUT_SIZE - dest->pub.free_in_buffer);
 }
 
-static void gs_jpeg_memory_dest_create (j_compress_ptr cinfo, NSData** data)
+static void gs_jpeg_output_dest_create (j_compress_ptr cinfo, id output)
 {
   gs_jpeg_dest_ptr dest;
 
@@ -318,72 +426,108 @@ static void gs_jpeg_memory_dest_create (j_compress_ptr cinfo, NSData** data)
   dest->pub.init_destination = gs_init_destination;
   dest->pub.empty_output_buffer = gs_empty_output_buffer;
   dest->pub.term_destination = gs_term_destination;
-  dest->finalData = data;
+  dest->output = output;
+  dest->toFile = [output isKindOfClass: [NSFileHandle class]];
 }
 
-static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
+static void gs_jpeg_output_dest_destroy (j_compress_ptr cinfo)
 {
-  gs_jpeg_dest_ptr dest = (gs_jpeg_dest_ptr) cinfo->dest;
-  free (dest->buffer);
-  free (dest->data);
-  free (dest);
+  free (cinfo->dest);
   cinfo->dest = NULL;
 }
 
 
-/* -----------------------------------------------------------
-   The jpeg loading part of NSBitmapImageRep
-   ----------------------------------------------------------- */
-
-@implementation NSBitmapImageRep (JPEGReading)
-
+@interface NSBitmapImageRep (GSPrivate)
+- (id) _loadState;
+- (void) _setLoadState: (id)state;
+- (BOOL) _allocateBitmapPixelsWide: (NSInteger)width
+                        pixelsHigh: (NSInteger)height
+                     bitsPerSample: (NSInteger)bps
+                   samplesPerPixel: (NSInteger)spp
+                          hasAlpha: (BOOL)alpha
+                    colorSpaceName: (NSString*)colorSpaceName
+                      bitmapFormat: (NSBitmapFormat)bitmapFormat
+                       bytesPerRow: (NSInteger)rowBytes
+                      bitsPerPixel: (NSInteger)pixelBits;
+@end
 
-/* Return YES if this looks like a JPEG. */
-+ (BOOL) _bitmapIsJPEG: (NSData *)imageData
+/* State of an incremental load. */
+@interface GSJPEGLoadState : NSObject
 {
-  struct jpeg_decompress_struct  cinfo;
-  struct gs_jpeg_error_mgr  jerrMgr;
-
-  memset((void*)&cinfo, 0, sizeof(struct jpeg_decompress_struct));
+@public
+  struct jpeg_decompress_struct cinfo;
+  struct gs_jpeg_error_mgr jerrMgr;
+  int stage;          /* 0 header, 1 start, 2 scanlines, 3 finish */
+  BOOL inOutputPass;  /* buffered image mode only */
+  NSInteger rows;     /* rows of the image shown so far */
+}
+@end
 
-  /* Be sure imageData contains data */
-  if (![imageData length])
+@implementation GSJPEGLoadState
+- (id) init
+{
+  if ((self = [super init]) != nil)
     {
-      return NO;
+      gs_jpeg_error_mgr_init(&jerrMgr);
+      cinfo.err = jpeg_std_error(&jerrMgr.parent);
+      jerrMgr.parent.error_exit = gs_jpeg_error_exit;
+      jerrMgr.parent.output_message = gs_jpeg_output_message;
+      jpeg_create_decompress(&cinfo);
+      gs_jpeg_incremental_src_create(&cinfo);
     }
+  return self;
+}
 
-  /* Establish the our custom error handler */
-  gs_jpeg_error_mgr_init(&jerrMgr);
-  cinfo.err = jpeg_std_error(&jerrMgr.parent);
-  jerrMgr.parent.error_exit = gs_jpeg_error_exit;
-  jerrMgr.parent.output_message = gs_jpeg_output_message;
+- (void) dealloc
+{
+  free(cinfo.src);
+  cinfo.src = NULL;
+  jpeg_destroy_decompress(&cinfo);
+  [super dealloc];
+}
+@end
 
-  // establish return context for error handling
-  if (setjmp(jerrMgr.setjmpBuffer))
-    {
-      gs_jpeg_memory_src_destroy(&cinfo);
-      jpeg_destroy_decompress(&cinfo);
-      return NO;
-    }
+/* -----------------------------------------------------------
+   The jpeg loading part of NSBitmapImageRep
+   ----------------------------------------------------------- */
 
-  /* read the header to see if we have a jpeg */
-  jpeg_create_decompress(&cinfo);
+@implementation NSBitmapImageRep (JPEGReading)
 
-  /* Establish our own data source manager */
-  gs_jpeg_memory_src_create(&cinfo, imageData);
+/* Read the jpeg image. Assume it is from a jpeg file and imageData
+ * is not nil.
+ */
+- (id) _initBitmapFromJPEG: (NSData *)imageData
+	      errorMessage: (NSString **)errorMsg
+{
+  return [self _initBitmapFromJPEG: imageData
+		  fittingPixelSize: NSZeroSize
+		      errorMessage: errorMsg];
+}
 
-  jpeg_read_header(&cinfo, TRUE);
-  gs_jpeg_memory_src_destroy(&cinfo);
-  jpeg_destroy_decompress(&cinfo);
+/* Returns YES once every component has received its DC coefficients,
+   which is all that is needed for decoding at 1/8 scale. */
+static BOOL gs_jpeg_has_dc(j_decompress_ptr cinfo)
+{
+  int c;
 
+  for (c = 0; c < cinfo->num_components; c++)
+    {
+      if (cinfo->coef_bits[c][0] < 0)
+	{
+	  return NO;
+	}
+    }
   return YES;
 }
 
-
-/* Read the jpeg image. Assume it is from a jpeg file and imageData
- * is not nil.
+/* Read the jpeg image, scaled down to fit into maxSize unless that is
+ * NSZeroSize. The DCT is scaled by 1/2, 1/4 or 1/8 where that is still
+ * large enough, and the rest is done with a box filter while the
+ * scanlines are read. At 1/8 scale only the first scans of a
+ * progressive image are decoded.
  */
 - (id) _initBitmapFromJPEG: (NSData *)imageData
+	  fittingPixelSize: (NSSize)maxSize
 	      errorMessage: (NSString **)errorMsg
 {
   struct jpeg_decompress_struct  cinfo;
@@ -392,11 +536,17 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
   JSAMPARRAY sclbuffer = NULL;
   unsigned char *imgbuffer = NULL;
   BOOL isProgressive;
+  BOOL scaled = NO;
+  BOOL dcOnly = NO;
+  NSInteger width = 0;
+  NSInteger height = 0;
+  GSBoxScaler scaler;
 
   if (!(self = [super init]))
     return nil;
 
   memset((void*)&cinfo, 0, sizeof(struct jpeg_decompress_struct));
+  memset((void*)&scaler, 0, sizeof(GSBoxScaler));
 
   /* Establish the our custom error handler */
   gs_jpeg_error_mgr_init(&jerrMgr);
@@ -412,6 +562,7 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
 	*errorMsg = (jerrMgr.error ? (id)jerrMgr.error : (id)nil);
       gs_jpeg_memory_src_destroy(&cinfo);
       jpeg_destroy_decompress(&cinfo);
+      GSBoxScalerDestroy(&scaler);
       if (imgbuffer)
         {
           free(imgbuffer);
@@ -432,9 +583,49 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
   /* we use RGB as target color space; others are not yet supported */
   cinfo.out_color_space = JCS_RGB;
 
+#ifdef GSTEP_PROGRESSIVE_CODEC
+  isProgressive = (cinfo.process == JPROC_PROGRESSIVE);
+#else
+  isProgressive = cinfo.progressive_mode;
+#endif
+
+  if (maxSize.width > 0 && maxSize.height > 0)
+    {
+      GSFitPixelSize(cinfo.image_width, cinfo.image_height, maxSize,
+		     &width, &height);
+      if (width < (NSInteger)cinfo.image_width
+	|| height < (NSInteger)cinfo.image_height)
+	{
+	  scaled = YES;
+	  cinfo.scale_num = 1;
+	  cinfo.scale_denom = 1;
+	  while (cinfo.scale_denom < 8
+	    && (NSInteger)(cinfo.image_width / (cinfo.scale_denom * 2)) >= width
+	    && (NSInteger)(cinfo.image_height / (cinfo.scale_denom * 2)) >= height)
+	    {
+	      cinfo.scale_denom *= 2;
+	    }
+	  if (isProgressive && cinfo.scale_denom == 8)
+	    {
+	      dcOnly = YES;
+	      cinfo.buffered_image = TRUE;
+	    }
+	}
+    }
+
   /* decompress */
   jpeg_start_decompress(&cinfo);
 
+  if (dcOnly)
+    {
+      /* Read scans until the DC coefficients are complete enough, and
+	 skip the rest of the image */
+      while (!gs_jpeg_has_dc(&cinfo)
+	&& jpeg_consume_input(&cinfo) != JPEG_REACHED_EOI)
+	;
+      jpeg_start_output(&cinfo, cinfo.input_scan_number);
+    }
+
   /* process the decompressed  data */
   samplesPerRow = cinfo.output_width * cinfo.output_components;
   rowSize = samplesPerRow * sizeof(unsigned char);
@@ -447,10 +638,31 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
                                       cinfo.rec_outbuf_height);
   /* sclbuffer is freed when cinfo is destroyed */
 
-  imgbuffer = NSZoneMalloc([self zone], cinfo.output_height * rowSize);
+  if (!scaled)
+    {
+      width = cinfo.output_width;
+      height = cinfo.output_height;
+    }
+  imgbuffer = NSZoneMalloc([self zone],
+    height * width * cinfo.output_components);
   if (!imgbuffer)
     {
       NSLog(@"NSBitmapImageRep+JPEG: failed to allocated image buffer");
+      gs_jpeg_memory_src_destroy(&cinfo);
+      jpeg_destroy_decompress(&cinfo);
+      RELEASE(self);
+      return nil;
+    }
+  if (scaled
+    && !GSBoxScalerInit(&scaler, cinfo.output_width, cinfo.output_height,
+			cinfo.output_components, cinfo.output_components,
+			imgbuffer, width, height,
+			width * cinfo.output_components))
+    {
+      NSLog(@"NSBitmapImageRep+JPEG: failed to allocated image buffer");
+      gs_jpeg_memory_src_destroy(&cinfo);
+      jpeg_destroy_decompress(&cinfo);
+      NSZoneFree([self zone], imgbuffer);
       RELEASE(self);
       return nil;
     }
@@ -463,25 +675,36 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
 
       for (j = 0; j < sclcount; j++)
         {
-	  // copy a row to the image buffer
-	  memcpy((imgbuffer + (i * rowSize)),
-	    *(sclbuffer + (j * rowSize)),
-	    rowSize);
+	  if (scaled)
+	    {
+	      GSBoxScalerAddRow(&scaler, sclbuffer[j]);
+	    }
+	  else
+	    {
+	      // copy a row to the image buffer
+	      memcpy((imgbuffer + (i * rowSize)),
+		*(sclbuffer + (j * rowSize)),
+		rowSize);
+	    }
 	  i++;
         }
     }
-
-#ifdef GSTEP_PROGRESSIVE_CODEC
-  isProgressive = (cinfo.process == JPROC_PROGRESSIVE);
-#else
-  isProgressive = cinfo.progressive_mode;
-#endif
+  GSBoxScalerDestroy(&scaler);
 
   /* done */
-  jpeg_finish_decompress(&cinfo);
+  if (dcOnly)
+    {
+      jpeg_finish_output(&cinfo);
+      jpeg_abort_decompress(&cinfo);
+    }
+  else
+    {
+      jpeg_finish_decompress(&cinfo);
+    }
 
   gs_jpeg_memory_src_destroy(&cinfo);
   jpeg_destroy_decompress(&cinfo);
+  rowSize = width * cinfo.output_components;
 
   if (jerrMgr.parent.num_warnings)
     {
@@ -492,8 +715,8 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
   // create the imagerep
   //BITS_IN_JSAMPLE is defined by libjpeg
   [self initWithBitmapDataPlanes: &imgbuffer
-		      pixelsWide: cinfo.output_width
-		      pixelsHigh: cinfo.output_height
+		      pixelsWide: width
+		      pixelsHigh: height
 		   bitsPerSample: BITS_IN_JSAMPLE
 		 samplesPerPixel: cinfo.output_components
 			hasAlpha: (cinfo.output_components == 3 ? NO : YES)
@@ -507,12 +730,173 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
 
   _imageData = [[NSData alloc]
     initWithBytesNoCopy: imgbuffer
-		 length: (rowSize * cinfo.output_height)];
+		 length: (rowSize * height)];
 
   return self;
 }
 
 
+/* Reads scanlines of the current output pass into the bitmap. Returns
+   NO when the jpeg library has to wait for more data. */
+static BOOL gs_jpeg_read_rows(GSJPEGLoadState *state, unsigned char *bitmap,
+                              NSInteger rowSize)
+{
+  j_decompress_ptr cinfo = &state->cinfo;
+
+  while (cinfo->output_scanline < cinfo->output_height)
+    {
+      JSAMPROW row = bitmap + cinfo->output_scanline * rowSize;
+
+      if (jpeg_read_scanlines(cinfo, &row, 1) == 0)
+        {
+          return NO;
+        }
+      if ((NSInteger)cinfo->output_scanline > state->rows)
+        {
+          state->rows = cinfo->output_scanline;
+        }
+    }
+  return YES;
+}
+
+/* Decodes as much of imageData as possible. Progressive images are
+ * decoded in buffered image mode, where each output pass refines the
+ * whole image with the scans received so far.
+ * Returns the number of rows decoded, or a load status.
+ */
+- (NSInteger) _incrementalLoadJPEG: (NSData *)imageData
+                          complete: (BOOL)complete
+{
+  GSJPEGLoadState *state = [self _loadState];
+  j_decompress_ptr cinfo;
+
+  if (state == nil)
+    {
+      state = [GSJPEGLoadState new];
+      [self _setLoadState: state];
+      RELEASE(state);
+    }
+  cinfo = &state->cinfo;
+
+  if (setjmp(state->jerrMgr.setjmpBuffer))
+    {
+      [self _setLoadState: nil];
+      return NSImageRepLoadStatusInvalidData;
+    }
+
+  gs_jpeg_incremental_src_update(cinfo, imageData, complete);
+
+  if (state->stage == 0)
+    {
+      if (jpeg_read_header(cinfo, TRUE) == JPEG_SUSPENDED)
+        {
+          return NSImageRepLoadStatusReadingHeader;
+        }
+      /* we use RGB as target color space; others are not yet supported */
+      cinfo->out_color_space = JCS_RGB;
+      cinfo->buffered_image = jpeg_has_multiple_scans(cinfo);
+      state->stage = 1;
+    }
+
+  if (state->stage == 1)
+    {
+      if (!jpeg_start_decompress(cinfo))
+        {
+          return 0;
+        }
+      if (![self _allocateBitmapPixelsWide: cinfo->output_width
+                                pixelsHigh: cinfo->output_height
+                             bitsPerSample: BITS_IN_JSAMPLE
+                           samplesPerPixel: cinfo->output_components
+                                  hasAlpha: (cinfo->output_components == 3 ? NO : YES)
+                            colorSpaceName: NSCalibratedRGBColorSpace
+                              bitmapFormat: 0
+                               bytesPerRow: cinfo->output_width
+                                            * cinfo->output_components
+                              bitsPerPixel: BITS_IN_JSAMPLE
+                                            * cinfo->output_components])
+        {
+          [self _setLoadState: nil];
+          return NSImageRepLoadStatusInvalidData;
+        }
+      [self setProperty: NSImageProgressive
+              withValue: [NSNumber numberWithBool: cinfo->buffered_image]];
+      state->stage = 2;
+    }
+
+  if (state->stage == 2)
+    {
+      unsigned char *bitmap = [self bitmapData];
+      NSInteger rowSize = [self bytesPerRow];
+
+      if (!cinfo->buffered_image)
+        {
+          if (!gs_jpeg_read_rows(state, bitmap, rowSize))
+            {
+              return state->rows;
+            }
+        }
+      else
+        {
+          for (;;)
+            {
+              if (!state->inOutputPass)
+                {
+                  int ret;
+
+                  // Absorb all the input there is before showing it
+                  do
+                    {
+                      ret = jpeg_consume_input(cinfo);
+                    }
+                  while (ret != JPEG_SUSPENDED && ret != JPEG_REACHED_EOI);
+
+                  if (cinfo->output_scan_number >= cinfo->input_scan_number
+                    && !jpeg_input_complete(cinfo))
+                    {
+                      // Nothing new to show yet
+                      return state->rows;
+                    }
+                  if (!jpeg_start_output(cinfo, cinfo->input_scan_number))
+                    {
+                      return state->rows;
+                    }
+                  state->inOutputPass = YES;
+                }
+              if (!gs_jpeg_read_rows(state, bitmap, rowSize))
+                {
+                  return state->rows;
+                }
+              if (!jpeg_finish_output(cinfo))
+                {
+                  return state->rows;
+                }
+              state->inOutputPass = NO;
+              if (jpeg_input_complete(cinfo)
+                && cinfo->output_scan_number >= cinfo->input_scan_number)
+                {
+                  break;
+                }
+            }
+        }
+      state->stage = 3;
+    }
+
+  if (!jpeg_finish_decompress(cinfo))
+    {
+      return state->rows;
+    }
+
+  if (state->jerrMgr.parent.num_warnings)
+    {
+      NSLog(@"NSBitmapImageRep+JPEG: %ld warnings during jpeg decompression, "
+        @"image may be corrupted", state->jerrMgr.parent.num_warnings);
+    }
+  [self _setLoadState: nil];
+  return NSImageRepLoadStatusCompleted;
+}
+
+
 /* -----------------------------------------------------------
    The jpeg writing part of NSBitmapImageRep
    ----------------------------------------------------------- */
@@ -520,15 +904,34 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
 - (NSData*) _JPEGRepresentationWithProperties: (NSDictionary*) properties
                                  errorMessage: (NSString **)errorMsg
 {
-  NSData			*ret;
+  NSMutableData *ret = [NSMutableData dataWithLength: 0];
+
+  if (![self _writeJPEGWithProperties: properties
+                                   to: ret
+                         errorMessage: errorMsg])
+    {
+      return nil;
+    }
+  return ret;
+}
+
+/* Encodes the receiver as JPEG, handing the data to output, an
+   NSMutableData or an NSFileHandle, as it is produced. */
+- (BOOL) _writeJPEGWithProperties: (NSDictionary*) properties
+                               to: (id)output
+                     errorMessage: (NSString **)errorMsg
+{
   unsigned char			*imageSource;
   int				sPP;
   int				width;
   int				height;
-  int				row_stride;
+  int				bytes_per_row;
   int				quality = 90;
   NSNumber			*qualityNumber = nil;
   NSNumber			*progressiveNumber = nil;
+  NSNumber			*optimizeNumber = nil;
+  NSNumber			*subsamplingNumber = nil;
+  int				subsampling = 420;
   NSString			*colorSpace = nil;
   BOOL                          isRGB;
   struct jpeg_compress_struct	cinfo;
@@ -544,16 +947,32 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
         *errorMsg = em;
       else
         NSLog (@"JPEG image rep: Planar Image, not handled yet !");
-      return nil;
+      return NO;
+    }
+
+  subsamplingNumber = [properties objectForKey: GSImageChromaSubsampling];
+  if (subsamplingNumber != nil)
+    {
+      subsampling = [subsamplingNumber intValue];
+      if (subsampling != 444 && subsampling != 422 && subsampling != 420)
+        {
+          NSString * em = [NSString stringWithFormat:
+            @"JPEG image rep: Unknown chroma subsampling %d", subsampling];
+          if (errorMsg != NULL)
+            *errorMsg = em;
+          else
+            NSLog(@"%@", em);
+          return NO;
+        }
     }
 
   memset((void*)&cinfo, 0, sizeof(struct jpeg_compress_struct));
 
   imageSource = [self bitmapData];
   sPP = [self samplesPerPixel];
-  width = [self size].width;
-  height = [self size].height;
-  row_stride = width * sPP;
+  width = [self pixelsWide];
+  height = [self pixelsHigh];
+  bytes_per_row = [self bytesPerRow];
 
   /* Establish the our custom error handler */
   gs_jpeg_error_mgr_init(&jerrMgr);
@@ -567,9 +986,9 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
       /* assign the description of possible occured error to errorMsg */
       if (errorMsg)
 	*errorMsg = (jerrMgr.error ? (id)jerrMgr.error : (id)nil);
-      gs_jpeg_memory_dest_destroy(&cinfo);
+      gs_jpeg_output_dest_destroy(&cinfo);
       jpeg_destroy_compress(&cinfo);
-      return nil;
+      return NO;
     }
 
   // initialize libjpeg for compression
@@ -578,7 +997,7 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
 
   // specify the destination for the compressed data.. 
 
-  gs_jpeg_memory_dest_create (&cinfo, &ret);
+  gs_jpeg_output_dest_create (&cinfo, output);
 
   // set parameters
 
@@ -616,10 +1035,24 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
       if ([progressiveNumber boolValue])
         cinfo.process = JPROC_PROGRESSIVE;
 #else
-      cinfo.progressive_mode = [progressiveNumber boolValue];
+      if ([progressiveNumber boolValue])
+        jpeg_simple_progression (&cinfo);
 #endif
     }
 
+  // compute optimal Huffman tables, at the cost of a second pass
+  optimizeNumber = [properties objectForKey: GSImageOptimizedHuffmanCoding];
+  if (optimizeNumber != nil)
+    {
+      cinfo.optimize_coding = [optimizeNumber boolValue];
+    }
+
+  // set the chroma subsampling, 4:2:0 by default
+  if (subsamplingNumber != nil && cinfo.jpeg_color_space == JCS_YCbCr)
+    {
+      cinfo.comp_info[0].h_samp_factor = (subsampling == 444) ? 1 : 2;
+      cinfo.comp_info[0].v_samp_factor = (subsampling == 420) ? 2 : 1;
+    }
 
   // compress the image
 
@@ -629,12 +1062,11 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
   if (isRGB && [self hasAlpha])	// strip alpha channel before encoding
     {
       unsigned char * RGB, * pRGB, * pRGBA;
-      unsigned int iRGB, iRGBA;
+      unsigned int iRGB;
       RGB = malloc(sizeof(unsigned char)*3*width);
       while (cinfo.next_scanline < cinfo.image_height)
 	{
-	  iRGBA = cinfo.next_scanline * row_stride;
-	  pRGBA = &imageSource[iRGBA];
+	  pRGBA = &imageSource[cinfo.next_scanline * bytes_per_row];
 	  pRGB = RGB;
 	  for (iRGB = 0; iRGB < 3*width; iRGB += 3)
 	    {
@@ -651,20 +1083,18 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
     {
       while (cinfo.next_scanline < cinfo.image_height)
 	{
-	  int	index = cinfo.next_scanline * row_stride;
-
-	  row_pointer[0] = &imageSource[index];
+	  row_pointer[0] = &imageSource[cinfo.next_scanline * bytes_per_row];
 	  jpeg_write_scanlines (&cinfo, row_pointer, 1);
 	}
     }
 
   jpeg_finish_compress(&cinfo);
 
-  gs_jpeg_memory_dest_destroy (&cinfo);
+  gs_jpeg_output_dest_destroy (&cinfo);
 
   jpeg_destroy_compress(&cinfo);
 
-  return AUTORELEASE(ret);
+  return YES;
 }
 
 @end
@@ -672,22 +1102,36 @@ static void gs_jpeg_memory_dest_destroy (j_compress_ptr cinfo)
 #else /* !HAVE_LIBJPEG */
 
 @implementation NSBitmapImageRep (JPEGReading)
-+ (BOOL) _bitmapIsJPEG: (NSData *)imageData
+- (id) _initBitmapFromJPEG: (NSData *)imageData
+	      errorMessage: (NSString **)errorMsg
 {
-  return NO;
+  RELEASE(self);
+  return nil;
 }
 
 - (id) _initBitmapFromJPEG: (NSData *)imageData
+	  fittingPixelSize: (NSSize)maxSize
 	      errorMessage: (NSString **)errorMsg
 {
   RELEASE(self);
   return nil;
 }
+- (NSInteger) _incrementalLoadJPEG: (NSData *)imageData
+                          complete: (BOOL)complete
+{
+  return NSImageRepLoadStatusInvalidData;
+}
 - (NSData *) _JPEGRepresentationWithProperties: (NSDictionary *) properties
                                   errorMessage: (NSString **)errorMsg
 {
   return nil;
 }
+- (BOOL) _writeJPEGWithProperties: (NSDictionary *) properties
+                               to: (id)output
+                     errorMessage: (NSString **)errorMsg
+{
+  return NO;
+}
 @end
 
 #endif /* !HAVE_LIBJPEG */
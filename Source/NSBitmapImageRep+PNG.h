@@ -33,9 +33,14 @@
 #import "AppKit/NSBitmapImageRep.h"
 
 @interface NSBitmapImageRep (PNG)
-+ (BOOL) _bitmapIsPNG: (NSData *)imageData;
 - (id) _initBitmapFromPNG: (NSData *)imageData;
+- (id) _initBitmapFromPNG: (NSData *)imageData
+         fittingPixelSize: (NSSize)maxSize;
+- (NSInteger) _incrementalLoadPNG: (NSData *)imageData
+                         complete: (BOOL)complete;
 - (NSData *) _PNGRepresentationWithProperties: (NSDictionary *) properties;
+- (BOOL) _writePNGWithProperties: (NSDictionary *) properties
+                              to: (id)output;
 @end
 
 #endif
@@ -52,26 +52,196 @@
 #import <Foundation/NSData.h>
 #import <Foundation/NSDictionary.h>
 #import <Foundation/NSException.h>
+#import <Foundation/NSFileHandle.h>
 #import <Foundation/NSString.h>
 #import <Foundation/NSValue.h>
 #import "AppKit/NSGraphics.h"
 #import "NSBitmapImageRep+PNG.h"
+#import "NSBitmapImageRep+Scaling.h"
 
 
 #ifdef HAVE_LIBPNG
 
-@implementation NSBitmapImageRep (PNG)
+/* Sets up the transformations needed to read the image described by
+   png_info and returns the layout of the decoded image. Returns NO for
+   an unsupported color type. */
+static BOOL png_layout(png_structp png_struct, png_infop png_info,
+                       int *bytes_per_row, int *channels, int *depth,
+                       int *bpp, BOOL *alpha, NSString **colorspace)
+{
+  int type = png_get_color_type(png_struct, png_info);
+
+  *bytes_per_row = png_get_rowbytes(png_struct, png_info);
+  *channels = png_get_channels(png_struct, png_info);
+  *depth = png_get_bit_depth(png_struct, png_info);
+
+  switch (type)
+    {
+      case PNG_COLOR_TYPE_GRAY:
+	*colorspace = NSCalibratedWhiteColorSpace;
+	*alpha = NO;
+	NSCAssert(*channels == 1, @"unexpected channel/color_type combination");
+	*bpp = *depth;
+	break;
+
+      case PNG_COLOR_TYPE_GRAY_ALPHA:
+	*colorspace = NSCalibratedWhiteColorSpace;
+	*alpha = YES;
+	NSCAssert(*channels == 2, @"unexpected channel/color_type combination");
+	*bpp = *depth * 2;
+	break;
+
+      case PNG_COLOR_TYPE_PALETTE:
+	png_set_palette_to_rgb(png_struct);
+	*channels = 3;
+	*depth = 8;
 
-+ (BOOL) _bitmapIsPNG: (NSData *)imageData
+	*alpha = NO;
+	if (png_get_valid(png_struct, png_info, PNG_INFO_tRNS))
+	  {
+	    *alpha = YES;
+	    (*channels)++;
+	    png_set_tRNS_to_alpha(png_struct);
+	  }
+
+	*bpp = *channels * 8;
+	*bytes_per_row = *channels * png_get_image_width(png_struct, png_info);
+	*colorspace = NSCalibratedRGBColorSpace;
+	break;
+
+      case PNG_COLOR_TYPE_RGB:
+	*colorspace = NSCalibratedRGBColorSpace;
+	*alpha = NO;
+	*bpp = *channels * *depth; /* channels might be 4 if there's a filler */
+	*channels = 3;
+	break;
+
+      case PNG_COLOR_TYPE_RGB_ALPHA:
+	*colorspace = NSCalibratedRGBColorSpace;
+	*alpha = YES;
+	NSCAssert(*channels == 4, @"unexpected channel/color_type combination");
+	*bpp = 4 * *depth;
+	break;
+
+      default:
+	NSLog(@"NSBitmapImageRep+PNG: unknown color type %i", type);
+	return NO;
+    }
+  return YES;
+}
+
+@interface NSBitmapImageRep (GSPrivate)
+- (id) _loadState;
+- (void) _setLoadState: (id)state;
+- (BOOL) _allocateBitmapPixelsWide: (NSInteger)width
+                        pixelsHigh: (NSInteger)height
+                     bitsPerSample: (NSInteger)bps
+                   samplesPerPixel: (NSInteger)spp
+                          hasAlpha: (BOOL)alpha
+                    colorSpaceName: (NSString*)colorSpaceName
+                      bitmapFormat: (NSBitmapFormat)bitmapFormat
+                       bytesPerRow: (NSInteger)rowBytes
+                      bitsPerPixel: (NSInteger)pixelBits;
+@end
+
+/* State of an incremental load, fed to libpng's progressive reader. */
+@interface GSPNGLoadState : NSObject
 {
-  if (![imageData length])
-    return NO;
+@public
+  png_structp png_struct;
+  png_infop png_info;
+  NSBitmapImageRep *rep;
+  NSUInteger offset;            /* bytes already passed to libpng */
+  NSInteger rows;               /* rows decoded so far */
+  BOOL hasHeader;
+  BOOL done;
+  BOOL failed;
+}
+@end
 
-  if (!png_sig_cmp((png_bytep)[imageData bytes], 0, [imageData length]))
-    return YES;
-  return NO;
+@implementation GSPNGLoadState
+- (void) dealloc
+{
+  if (png_struct != NULL)
+    {
+      png_destroy_read_struct(&png_struct, &png_info, NULL);
+    }
+  [super dealloc];
+}
+@end
+
+@interface NSBitmapImageRep (PNGLoading)
+- (void) _setPropertiesFromPNG: (png_structp)png_struct
+                          info: (png_infop)png_info;
+@end
+
+static void progressive_info_func(png_structp png_struct, png_infop png_info)
+{
+  GSPNGLoadState *state = png_get_progressive_ptr(png_struct);
+  int width = png_get_image_width(png_struct, png_info);
+  int height = png_get_image_height(png_struct, png_info);
+  int bytes_per_row, channels, depth, bpp;
+  BOOL alpha;
+  NSString *colorspace;
+
+  if (!png_layout(png_struct, png_info, &bytes_per_row, &channels, &depth,
+                  &bpp, &alpha, &colorspace))
+    {
+      state->failed = YES;
+      png_error(png_struct, "unsupported color type");
+      return;
+    }
+  /* Have libpng expand the interlace passes into full rows, which are
+     then combined with what earlier passes left in the bitmap. */
+  png_set_interlace_handling(png_struct);
+  png_read_update_info(png_struct, png_info);
+
+  /* The bitmap starts cleared, so that rows not loaded yet are blank. */
+  if (![state->rep _allocateBitmapPixelsWide: width
+                                  pixelsHigh: height
+                               bitsPerSample: depth
+                             samplesPerPixel: channels
+                                    hasAlpha: alpha
+                              colorSpaceName: colorspace
+                                bitmapFormat: NSAlphaNonpremultipliedBitmapFormat
+                                 bytesPerRow: bytes_per_row
+                                bitsPerPixel: bpp])
+    {
+      state->failed = YES;
+      png_error(png_struct, "cannot allocate the bitmap");
+      return;
+    }
+  [state->rep _setPropertiesFromPNG: png_struct info: png_info];
+  state->hasHeader = YES;
+}
+
+static void progressive_row_func(png_structp png_struct, png_bytep new_row,
+                                 png_uint_32 row_num, int pass)
+{
+  GSPNGLoadState *state = png_get_progressive_ptr(png_struct);
+  NSBitmapImageRep *rep = state->rep;
+
+  if (new_row == NULL || (NSInteger)row_num >= [rep pixelsHigh])
+    {
+      return;
+    }
+  png_progressive_combine_row(png_struct,
+    [rep bitmapData] + row_num * [rep bytesPerRow], new_row);
+  if ((NSInteger)row_num >= state->rows)
+    {
+      state->rows = row_num + 1;
+    }
 }
 
+static void progressive_end_func(png_structp png_struct, png_infop png_info)
+{
+  GSPNGLoadState *state = png_get_progressive_ptr(png_struct);
+
+  state->done = YES;
+}
+
+@implementation NSBitmapImageRep (PNG)
+
 typedef struct
 {
   NSData *data;
@@ -93,18 +263,32 @@ static void reader_func(png_structp png_struct, png_bytep data,
 }
 
 - (id) _initBitmapFromPNG: (NSData *)imageData
+{
+  return [self _initBitmapFromPNG: imageData fittingPixelSize: NSZeroSize];
+}
+
+/* Reads the PNG image, scaled down to fit into maxSize unless that is
+   NSZeroSize. Images that are not interlaced are read a row at a time
+   into a box filter, so the full size image is never held in memory.
+   Interlaced images are read at full size. */
+- (id) _initBitmapFromPNG: (NSData *)imageData
+         fittingPixelSize: (NSSize)maxSize
 {
   png_structp png_struct;
   png_infop png_info, png_end_info;
 
   int width,height;
   unsigned char *buf = NULL;
+  unsigned char *row = NULL;
   int bytes_per_row;
-  int type,channels,depth;
+  int channels,depth;
 
   BOOL alpha;
   int bpp;
   NSString *colorspace;
+  NSInteger dst_width = 0;
+  NSInteger dst_height = 0;
+  GSBoxScaler scaler;
 
   reader_struct_t reader;
 
@@ -134,10 +318,13 @@ static void reader_func(png_structp png_struct, png_bytep data,
       return nil;
     }
 
+  memset(&scaler, 0, sizeof(GSBoxScaler));
   if (setjmp(png_jmpbuf(png_struct)))
     {
       // We get here when an error happens during image loading
       png_destroy_read_struct(&png_struct, &png_info, &png_end_info);
+      GSBoxScalerDestroy(&scaler);
+      free(row);
       if (buf != NULL)
         {
           NSZoneFree([self zone], buf);
@@ -154,78 +341,75 @@ static void reader_func(png_structp png_struct, png_bytep data,
 
   width = png_get_image_width(png_struct, png_info);
   height = png_get_image_height(png_struct, png_info);
-  bytes_per_row = png_get_rowbytes(png_struct, png_info);
-  type = png_get_color_type(png_struct, png_info);
-  channels = png_get_channels(png_struct, png_info);
-  depth = png_get_bit_depth(png_struct, png_info);
 
-  switch (type)
+  if (!png_layout(png_struct, png_info, &bytes_per_row, &channels, &depth,
+                  &bpp, &alpha, &colorspace))
     {
-      case PNG_COLOR_TYPE_GRAY:
-	colorspace = NSCalibratedWhiteColorSpace;
-	alpha = NO;
-	NSAssert(channels == 1, @"unexpected channel/color_type combination");
-	bpp = depth;
-	break;
-
-      case PNG_COLOR_TYPE_GRAY_ALPHA:
-	colorspace = NSCalibratedWhiteColorSpace;
-	alpha = YES;
-	NSAssert(channels == 2, @"unexpected channel/color_type combination");
-	bpp = depth * 2;
-	break;
-
-      case PNG_COLOR_TYPE_PALETTE:
-	png_set_palette_to_rgb(png_struct);
-	channels = 3;
-	depth = 8;
-
-	alpha = NO;
-	if (png_get_valid(png_struct, png_info, PNG_INFO_tRNS))
-	  {
-	    alpha = YES;
-	    channels++;
-	    png_set_tRNS_to_alpha(png_struct);
-	  }
-
-	bpp = channels * 8;
-	bytes_per_row = channels * width;
-	colorspace = NSCalibratedRGBColorSpace;
-	break;
-
-      case PNG_COLOR_TYPE_RGB:
-	colorspace = NSCalibratedRGBColorSpace;
-	alpha = NO;
-	bpp = channels * depth; /* channels might be 4 if there's a filler */
-	channels = 3;
-	break;
+      png_destroy_read_struct(&png_struct, &png_info, &png_end_info);
+      RELEASE(self);
+      return nil;
+    }
 
-      case PNG_COLOR_TYPE_RGB_ALPHA:
-	colorspace = NSCalibratedRGBColorSpace;
-	alpha = YES;
-	NSAssert(channels == 4, @"unexpected channel/color_type combination");
-	bpp = 4 * depth;
-	break;
+  if (maxSize.width > 0 && maxSize.height > 0
+      && png_get_interlace_type(png_struct, png_info) == PNG_INTERLACE_NONE)
+    {
+      GSFitPixelSize(width, height, maxSize, &dst_width, &dst_height);
+    }
+  if (dst_width > 0 && (dst_width < width || dst_height < height))
+    {
+      int y;
 
-      default:
-	NSLog(@"NSBitmapImageRep+PNG: unknown color type %i", type);
-	RELEASE(self);
-	return nil;
+      /* The box filter works on 8 bit samples */
+      if (depth == 16)
+        {
+          png_set_strip_16(png_struct);
+        }
+      else if (depth < 8)
+        {
+          png_set_expand_gray_1_2_4_to_8(png_struct);
+        }
+      depth = 8;
+      png_read_update_info(png_struct, png_info);
+      bytes_per_row = png_get_rowbytes(png_struct, png_info);
+      row = malloc(bytes_per_row);
+      buf = NSZoneMalloc([self zone], dst_width * channels * dst_height);
+      if (row == NULL || buf == NULL
+        || !GSBoxScalerInit(&scaler, width, height, channels,
+                            bytes_per_row / width, buf,
+                            dst_width, dst_height, dst_width * channels))
+        {
+          png_error(png_struct, "out of memory");
+        }
+      for (y = 0; y < height; y++)
+        {
+          png_read_row(png_struct, row, NULL);
+          GSBoxScalerAddRow(&scaler, row);
+        }
+      GSBoxScalerDestroy(&scaler);
+      free(row);
+      row = NULL;
+
+      width = dst_width;
+      height = dst_height;
+      bytes_per_row = dst_width * channels;
+      bpp = 8 * channels;
     }
+  else
+    {
+      buf = NSZoneMalloc([self zone], bytes_per_row * height);
 
-  buf = NSZoneMalloc([self zone], bytes_per_row * height);
+      {
+        png_bytep row_pointers[height];
+        int i;
 
-  {
-    png_bytep row_pointers[height];
-    int i;
+        for (i = 0; i < height; i++)
+          {
+            row_pointers[i] = buf + i * bytes_per_row;
+          }
 
-    for (i = 0; i < height; i++)
-      {
-        row_pointers[i] = buf + i * bytes_per_row;
+        png_read_image(png_struct, row_pointers);
       }
-
-    png_read_image(png_struct, row_pointers);
-  }
+    }
 
   self = [self initWithBitmapDataPlanes: &buf
                              pixelsWide: width
@@ -243,6 +427,24 @@ static void reader_func(png_structp png_struct, png_bytep data,
     initWithBytesNoCopy: buf
 		 length: bytes_per_row * height];
 
+  [self _setPropertiesFromPNG: png_struct info: png_info];
+  if (dst_width > 0)
+    {
+      [self setSize: NSMakeSize(width, height)];
+    }
+
+  png_destroy_read_struct(&png_struct, &png_info, &png_end_info);
+
+  return self;
+}
+
+/* Sets the gamma and size of the receiver from the PNG header. */
+- (void) _setPropertiesFromPNG: (png_structp)png_struct
+                          info: (png_infop)png_info
+{
+  int width = png_get_image_width(png_struct, png_info);
+  int height = png_get_image_height(png_struct, png_info);
+
   if (png_get_valid(png_struct, png_info, PNG_INFO_gAMA))
   {
     double file_gamma = 2.2;
@@ -290,21 +492,143 @@ static void reader_func(png_structp png_struct, png_bytep data,
 	[self setSize: sizeInPoints];
       }
   }
+}
 
-  png_destroy_read_struct(&png_struct, &png_info, &png_end_info);
+/* Feeds the bytes of imageData not seen so far to libpng. Returns the
+   number of rows decoded, or a load status. */
+- (NSInteger) _incrementalLoadPNG: (NSData *)imageData
+                         complete: (BOOL)complete
+{
+  GSPNGLoadState *state = [self _loadState];
+  NSUInteger length = [imageData length];
 
-  return self;
+  if (state == nil)
+    {
+      state = [GSPNGLoadState new];
+      state->rep = self;
+      state->png_struct = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+                                                 NULL, NULL, NULL);
+      if (state->png_struct != NULL)
+        {
+          state->png_info = png_create_info_struct(state->png_struct);
+        }
+      if (state->png_info == NULL)
+        {
+          RELEASE(state);
+          return NSImageRepLoadStatusInvalidData;
+        }
+      png_set_progressive_read_fn(state->png_struct, state,
+                                  progressive_info_func,
+                                  progressive_row_func,
+                                  progressive_end_func);
+      [self _setLoadState: state];
+      RELEASE(state);
+    }
+
+  if (setjmp(png_jmpbuf(state->png_struct)))
+    {
+      // We get here when an error happens during image loading
+      [self _setLoadState: nil];
+      return NSImageRepLoadStatusInvalidData;
+    }
+
+  if (length > state->offset)
+    {
+      png_process_data(state->png_struct, state->png_info,
+                       (png_bytep)[imageData bytes] + state->offset,
+                       length - state->offset);
+      state->offset = length;
+    }
+
+  if (state->done)
+    {
+      [self _setLoadState: nil];
+      return NSImageRepLoadStatusCompleted;
+    }
+  if (complete)
+    {
+      [self _setLoadState: nil];
+      return NSImageRepLoadStatusUnexpectedEOF;
+    }
+  if (!state->hasHeader)
+    {
+      return NSImageRepLoadStatusReadingHeader;
+    }
+  return state->rows;
 }
 
 /***** PNG writing support ******/
+
+/* Where the encoded data goes: an NSMutableData or an NSFileHandle. */
+typedef struct
+{
+  id output;
+  BOOL toFile;
+} gs_png_output;
+
 static void writer_func(png_structp png_struct, png_bytep data,
 			png_size_t length)
 {
-  NSMutableData * PNGRep = png_get_io_ptr(png_struct);
-  [PNGRep appendBytes: data length: length];
+  gs_png_output *out = png_get_io_ptr(png_struct);
+  BOOL failed = NO;
+
+  if (!out->toFile)
+    {
+      [out->output appendBytes: data length: length];
+      return;
+    }
+
+  NS_DURING
+    {
+      [out->output writeData: [NSData dataWithBytesNoCopy: data
+                                                   length: length
+                                             freeWhenDone: NO]];
+    }
+  NS_HANDLER
+    {
+      failed = YES;
+    }
+  NS_ENDHANDLER
+  if (failed)
+    {
+      png_error(png_struct, "unable to write the PNG data");
+    }
+}
+
+/* Maps a GSPNGFilter mask to the libpng filters. */
+static int
+png_filters(NSUInteger mask)
+{
+  int filters = 0;
+
+  if (mask & GSPNGFilterNone)
+    filters |= PNG_FILTER_NONE;
+  if (mask & GSPNGFilterSub)
+    filters |= PNG_FILTER_SUB;
+  if (mask & GSPNGFilterUp)
+    filters |= PNG_FILTER_UP;
+  if (mask & GSPNGFilterAverage)
+    filters |= PNG_FILTER_AVG;
+  if (mask & GSPNGFilterPaeth)
+    filters |= PNG_FILTER_PAETH;
+  return (filters == 0) ? PNG_FILTER_NONE : filters;
 }
 
 - (NSData *) _PNGRepresentationWithProperties: (NSDictionary *) properties
+{
+  NSMutableData *PNGRep = [NSMutableData dataWithLength: 0];
+
+  if (![self _writePNGWithProperties: properties to: PNGRep])
+    {
+      return nil;
+    }
+  return PNGRep;
+}
+
+/* Encodes the receiver as PNG, handing the data to output, an
+   NSMutableData or an NSFileHandle, as it is produced. */
+- (BOOL) _writePNGWithProperties: (NSDictionary *) properties
+                              to: (id)output
 {
   png_structp png_struct;
   png_infop png_info;
@@ -313,17 +637,19 @@ static void writer_func(png_structp png_struct, png_bytep data,
   unsigned char * bitmapData;
   int bytes_per_row;
   NSString * colorspace;
-  NSMutableData * PNGRep = nil;
+  gs_png_output out;
   int type = -1;	// illegal value
   int interlace = PNG_INTERLACE_NONE;
   int transforms = PNG_TRANSFORM_IDENTITY;	// no transformations
   NSNumber * gammaNumber = nil;
+  NSNumber * levelNumber = nil;
+  NSNumber * filtersNumber = nil;
   double gamma = 0.0;
   
   // FIXME: Need to convert to non-pre-multiplied format
   if ([self isPlanar])	// don't handle planar yet
   {
-    return nil;
+    return NO;
   } 
   // get the image parameters
   width = [self pixelsWide];
@@ -335,6 +661,8 @@ static void writer_func(png_structp png_struct, png_bytep data,
   gamma = [gammaNumber doubleValue];
   if ([[properties objectForKey: NSImageInterlaced] boolValue])
     interlace = PNG_INTERLACE_ADAM7;
+  levelNumber = [properties objectForKey: GSImageCompressionLevel];
+  filtersNumber = [properties objectForKey: GSImagePNGFilters];
 
   if ([colorspace isEqualToString: NSCalibratedWhiteColorSpace] ||
       [colorspace isEqualToString: NSDeviceWhiteColorSpace])
@@ -349,34 +677,46 @@ static void writer_func(png_structp png_struct, png_bytep data,
   png_struct = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
   if (!png_struct)
     {
-      return nil;
+      return NO;
     }
 
   png_info = png_create_info_struct(png_struct);
   if (!png_info)
     {
       png_destroy_write_struct(&png_struct, NULL);
-      return nil;
+      return NO;
     }
 
   if (setjmp(png_jmpbuf(png_struct)))
     {
       png_destroy_write_struct(&png_struct, &png_info);
-      return nil;
+      return NO;
     }
 
   // init structures
-  PNGRep = [NSMutableData dataWithLength: 0];
+  out.output = output;
+  out.toFile = [output isKindOfClass: [NSFileHandle class]];
 #if PNG_LIBPNG_VER < 10500
   // I don't think this was ever needed as png_create_info_struct()
   // sets up the structure correctly and we rely on that in all other places.
   png_info_init_3(&png_info, png_sizeof(png_info));
 #endif
-  png_set_write_fn(png_struct, PNGRep, writer_func, NULL);
+  png_set_write_fn(png_struct, &out, writer_func, NULL);
   png_set_IHDR(png_struct, png_info, width, height, depth,
    type, interlace, PNG_COMPRESSION_TYPE_BASE,
    PNG_FILTER_TYPE_BASE);
 
+  if (levelNumber != nil)
+    {
+      png_set_compression_level(png_struct,
+        MAX(0, MIN(9, [levelNumber intValue])));
+    }
+  if (filtersNumber != nil)
+    {
+      png_set_filter(png_struct, PNG_FILTER_TYPE_BASE,
+        png_filters([filtersNumber unsignedIntegerValue]));
+    }
+
   if (gammaNumber)
   {
     NSLog(@"PNGRepresentation: gamma support is experimental");
@@ -394,7 +734,7 @@ static void writer_func(png_structp png_struct, png_bytep data,
    } 
 
   // get rgb data and row pointers and
-  // write PNG out to NSMutableData
+  // write PNG out to the output
   bitmapData = [self bitmapData];
   {
     unsigned char *row_pointers[height];
@@ -406,28 +746,39 @@ static void writer_func(png_structp png_struct, png_bytep data,
     png_write_png(png_struct, png_info, transforms, NULL);
   }
                
-  //NSLog(@"PNG representation is experimental: %i bytes written", [PNGRep length]);
   png_destroy_write_struct(&png_struct, &png_info);
-  return PNGRep;
+  return YES;
 }
 @end
 
 #else /* !HAVE_LIBPNG */
 
 @implementation NSBitmapImageRep (PNG)
-+ (BOOL) _bitmapIsPNG: (NSData *)imageData
+- (id) _initBitmapFromPNG: (NSData *)imageData
 {
-  return NO;
+  RELEASE(self);
+  return nil;
 }
 - (id) _initBitmapFromPNG: (NSData *)imageData
+         fittingPixelSize: (NSSize)maxSize
 {
   RELEASE(self);
   return nil;
 }
+- (NSInteger) _incrementalLoadPNG: (NSData *)imageData
+                         complete: (BOOL)complete
+{
+  return NSImageRepLoadStatusInvalidData;
+}
 - (NSData *) _PNGRepresentationWithProperties: (NSDictionary *) properties
 {
   return nil;
 }
+- (BOOL) _writePNGWithProperties: (NSDictionary *) properties
+                              to: (id)output
+{
+  return NO;
+}
 @end
 
 #endif /* !HAVE_LIBPNG */
@@ -33,7 +33,6 @@
 
 @interface NSBitmapImageRep (PNM)
 
-+ (BOOL) _bitmapIsPNM: (NSData *)imageData;
 -(id) _initBitmapFromPNM: (NSData *)imageData
 	    errorMessage: (NSString **)error;
 
@@ -33,26 +33,6 @@
 
 @implementation NSBitmapImageRep (PNM)
 
-/* Return YES if this is a pgm or ppm file (raw only for now) */
-+ (BOOL) _bitmapIsPNM: (NSData *)imageData
-{
-  const char *bytes = [imageData bytes];
-
-  /*
-  3/4 bytes header line, 4/5 bytes size, 2/3 bytes depth. Thus, the image
-  must have a least 9 bytes.
-  */
-  if ([imageData length]<9)
-    return NO;
-
-  if (bytes[0] == 'P' && (bytes[2]=='\n' || bytes[2]=='\r'))
-    {
-      if (bytes[1] == '5' || bytes[1] == '6')
-	return YES;
-    }
-  return NO;
-}
-
 #define GET_LINE()							\
   do									\
     {									\
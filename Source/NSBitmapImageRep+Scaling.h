@@ -0,0 +1,82 @@
+/*
+   NSBitmapImageRep+Scaling.h
+
+   Methods for scaling bitmaps, while they are decoded or afterwards.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNUstep GUI Library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; see the file COPYING.LIB.
+   If not, see <http://www.gnu.org/licenses/> or write to the 
+   Free Software Foundation, 51 Franklin Street, Fifth Floor, 
+   Boston, MA 02110-1301, USA.
+*/ 
+
+#ifndef _NSBitmapImageRep_Scaling_H_include
+#define _NSBitmapImageRep_Scaling_H_include
+
+#include <stdint.h>
+#import "AppKit/NSBitmapImageRep.h"
+
+/* Box filter for 8 bit interleaved samples. Source rows are added one
+   at a time, and each destination row is written as soon as all of its
+   source rows have been seen, so only the destination bitmap has to be
+   held in memory. */
+typedef struct
+{
+  NSInteger srcWidth;
+  NSInteger srcHeight;
+  NSInteger dstWidth;
+  NSInteger dstHeight;
+  NSInteger spp;
+  NSInteger srcPixelBytes;
+  NSInteger srcRow;          /* next source row */
+  NSInteger dstRow;          /* destination row being summed up */
+  NSInteger rows;            /* source rows summed up in dstRow */
+  NSInteger *columns;        /* destination column of each source column */
+  NSInteger *counts;         /* source columns of each destination column */
+  uint64_t *sums;
+  unsigned char *dst;
+  NSInteger dstBytesPerRow;
+} GSBoxScaler;
+
+/* Returns in fitWidth and fitHeight the largest size with the aspect
+   ratio of width x height that fits into maxSize, without enlarging. */
+void GSFitPixelSize(NSInteger width, NSInteger height, NSSize maxSize,
+                    NSInteger *fitWidth, NSInteger *fitHeight);
+
+/* Prepares scaler for scaling srcWidth x srcHeight pixels of spp samples,
+   which are srcPixelBytes apart in the source rows, into dst. Returns NO
+   if memory could not be allocated. */
+BOOL GSBoxScalerInit(GSBoxScaler *scaler,
+                     NSInteger srcWidth, NSInteger srcHeight,
+                     NSInteger spp, NSInteger srcPixelBytes,
+                     unsigned char *dst, NSInteger dstWidth,
+                     NSInteger dstHeight, NSInteger dstBytesPerRow);
+void GSBoxScalerAddRow(GSBoxScaler *scaler, const unsigned char *row);
+void GSBoxScalerDestroy(GSBoxScaler *scaler);
+
+/* Sets up the worker threads of the resampler. Called once from
+   +[NSBitmapImageRep initialize]. */
+void GSResamplerInitialize(void);
+
+@interface NSBitmapImageRep (Scaling)
+- (NSBitmapImageRep *) _bitmapFittingPixelSize: (NSSize)maxSize;
+- (NSBitmapImageRep *) _bitmapResampledToPixelsWide: (NSInteger)width
+                                          pixelsHigh: (NSInteger)height
+                                              filter: (GSImageResamplingFilter)filter;
+@end
+
+#endif // _NSBitmapImageRep_Scaling_H_include
@@ -0,0 +1,779 @@
+/*
+   NSBitmapImageRep+Scaling.m
+
+   Methods for scaling bitmaps, while they are decoded or afterwards.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNUstep GUI Library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; see the file COPYING.LIB.
+   If not, see <http://www.gnu.org/licenses/> or write to the 
+   Free Software Foundation, 51 Franklin Street, Fifth Floor, 
+   Boston, MA 02110-1301, USA.
+*/ 
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#import <Foundation/NSArray.h>
+#import <Foundation/NSException.h>
+#import <Foundation/NSOperation.h>
+#import <Foundation/NSProcessInfo.h>
+#import <Foundation/NSString.h>
+#import "AppKit/NSGraphics.h"
+#import "NSBitmapImageRep+Scaling.h"
+
+@interface NSBitmapImageRep (GSPrivate)
+- (NSBitmapImageRep *) _convertToFormatBitsPerSample: (NSInteger)bps
+                                     samplesPerPixel: (NSInteger)spp
+                                            hasAlpha: (BOOL)alpha
+                                            isPlanar: (BOOL)isPlanar
+                                      colorSpaceName: (NSString*)colorSpaceName
+                                        bitmapFormat: (NSBitmapFormat)bitmapFormat 
+                                         bytesPerRow: (NSInteger)rowBytes
+                                        bitsPerPixel: (NSInteger)pixelBits;
+@end
+
+void
+GSFitPixelSize(NSInteger width, NSInteger height, NSSize maxSize,
+               NSInteger *fitWidth, NSInteger *fitHeight)
+{
+  double factor;
+
+  *fitWidth = width;
+  *fitHeight = height;
+  if (width <= 0 || height <= 0
+      || (width <= maxSize.width && height <= maxSize.height))
+    {
+      return;
+    }
+
+  factor = MIN(maxSize.width / width, maxSize.height / height);
+  *fitWidth = MAX(1, MIN(width, (NSInteger)floor(width * factor + 0.5)));
+  *fitHeight = MAX(1, MIN(height, (NSInteger)floor(height * factor + 0.5)));
+}
+
+BOOL
+GSBoxScalerInit(GSBoxScaler *scaler,
+                NSInteger srcWidth, NSInteger srcHeight,
+                NSInteger spp, NSInteger srcPixelBytes,
+                unsigned char *dst, NSInteger dstWidth,
+                NSInteger dstHeight, NSInteger dstBytesPerRow)
+{
+  NSInteger x;
+
+  memset(scaler, 0, sizeof(GSBoxScaler));
+  scaler->srcWidth = srcWidth;
+  scaler->srcHeight = srcHeight;
+  scaler->dstWidth = dstWidth;
+  scaler->dstHeight = dstHeight;
+  scaler->spp = spp;
+  scaler->srcPixelBytes = srcPixelBytes;
+  scaler->dst = dst;
+  scaler->dstBytesPerRow = dstBytesPerRow;
+
+  scaler->columns = malloc(sizeof(NSInteger) * srcWidth);
+  scaler->counts = calloc(dstWidth, sizeof(NSInteger));
+  scaler->sums = calloc(dstWidth * spp, sizeof(uint64_t));
+  if (scaler->columns == NULL || scaler->counts == NULL
+      || scaler->sums == NULL)
+    {
+      GSBoxScalerDestroy(scaler);
+      return NO;
+    }
+  for (x = 0; x < srcWidth; x++)
+    {
+      NSInteger dx = x * dstWidth / srcWidth;
+
+      scaler->columns[x] = dx;
+      scaler->counts[dx]++;
+    }
+  return YES;
+}
+
+/* Writes the average of the rows summed up so far to the destination. */
+static void
+gs_box_scaler_flush(GSBoxScaler *scaler)
+{
+  unsigned char *p = scaler->dst + scaler->dstRow * scaler->dstBytesPerRow;
+  uint64_t *sum = scaler->sums;
+  NSInteger dx;
+
+  if (scaler->rows == 0)
+    {
+      return;
+    }
+  for (dx = 0; dx < scaler->dstWidth; dx++)
+    {
+      uint64_t n = scaler->counts[dx] * scaler->rows;
+      NSInteger i;
+
+      for (i = 0; i < scaler->spp; i++, sum++, p++)
+        {
+          *p = (*sum + n / 2) / n;
+          *sum = 0;
+        }
+    }
+  scaler->rows = 0;
+}
+
+void
+GSBoxScalerAddRow(GSBoxScaler *scaler, const unsigned char *row)
+{
+  NSInteger spp = scaler->spp;
+  NSInteger step = scaler->srcPixelBytes;
+  NSInteger dy, x, i;
+
+  if (scaler->srcRow >= scaler->srcHeight)
+    {
+      return;
+    }
+
+  dy = scaler->srcRow * scaler->dstHeight / scaler->srcHeight;
+  if (dy != scaler->dstRow)
+    {
+      gs_box_scaler_flush(scaler);
+      scaler->dstRow = dy;
+    }
+
+  for (x = 0; x < scaler->srcWidth; x++, row += step)
+    {
+      uint64_t *sum = scaler->sums + scaler->columns[x] * spp;
+
+      for (i = 0; i < spp; i++)
+        {
+          sum[i] += row[i];
+        }
+    }
+  scaler->rows++;
+  scaler->srcRow++;
+  if (scaler->srcRow == scaler->srcHeight)
+    {
+      gs_box_scaler_flush(scaler);
+    }
+}
+
+void
+GSBoxScalerDestroy(GSBoxScaler *scaler)
+{
+  free(scaler->columns);
+  free(scaler->counts);
+  free(scaler->sums);
+  scaler->columns = NULL;
+  scaler->counts = NULL;
+  scaler->sums = NULL;
+}
+
+/* The kernels of the resampler, each with the distance from its centre
+   beyond which it is zero. */
+typedef struct
+{
+  double (*weight)(double x);
+  double support;
+} GSResampleKernel;
+
+static double
+gs_box_weight(double x)
+{
+  return (x > -0.5 && x <= 0.5) ? 1.0 : 0.0;
+}
+
+static double
+gs_bilinear_weight(double x)
+{
+  x = fabs(x);
+  return (x < 1.0) ? 1.0 - x : 0.0;
+}
+
+static double
+gs_sinc(double x)
+{
+  if (x == 0.0)
+    {
+      return 1.0;
+    }
+  x *= M_PI;
+  return sin(x) / x;
+}
+
+static double
+gs_lanczos3_weight(double x)
+{
+  return (x > -3.0 && x < 3.0) ? gs_sinc(x) * gs_sinc(x / 3.0) : 0.0;
+}
+
+/* Mitchell-Netravali cubic with B = C = 1/3. */
+static double
+gs_mitchell_weight(double x)
+{
+  x = fabs(x);
+  if (x < 1.0)
+    {
+      return (7.0 * x * x * x - 12.0 * x * x + 16.0 / 3.0) / 6.0;
+    }
+  if (x < 2.0)
+    {
+      return (-7.0 / 3.0 * x * x * x + 12.0 * x * x - 20.0 * x
+        + 32.0 / 3.0) / 6.0;
+    }
+  return 0.0;
+}
+
+static const GSResampleKernel gs_resample_kernels[] = {
+  { gs_box_weight, 0.5 },        /* GSImageResamplingBox */
+  { gs_bilinear_weight, 1.0 },   /* GSImageResamplingBilinear */
+  { gs_lanczos3_weight, 3.0 },   /* GSImageResamplingLanczos3 */
+  { gs_mitchell_weight, 2.0 }    /* GSImageResamplingMitchell */
+};
+
+/* The source samples each destination sample of one axis is made of:
+   count[i] samples from first[i] on, weighted by the taps weights at
+   weights + i * taps. */
+typedef struct
+{
+  NSInteger *first;
+  NSInteger *count;
+  float *weights;
+  NSInteger taps;
+} GSResampleAxis;
+
+static void
+gs_resample_axis_destroy(GSResampleAxis *axis)
+{
+  free(axis->first);
+  free(axis->count);
+  free(axis->weights);
+  axis->first = NULL;
+  axis->count = NULL;
+  axis->weights = NULL;
+}
+
+/* When scaling down the kernel is stretched to cover all the source
+   samples of a destination sample. The weights are normalised so that
+   flat areas keep their value. */
+static BOOL
+gs_resample_axis_init(GSResampleAxis *axis, NSInteger srcSize,
+  NSInteger dstSize, const GSResampleKernel *kernel)
+{
+  double scale = (double)srcSize / dstSize;
+  double stretch = MAX(scale, 1.0);
+  double support = kernel->support * stretch;
+  NSInteger i;
+
+  axis->taps = 2 * (NSInteger)ceil(support) + 1;
+  axis->first = malloc(sizeof(NSInteger) * dstSize);
+  axis->count = malloc(sizeof(NSInteger) * dstSize);
+  axis->weights = malloc(sizeof(float) * dstSize * axis->taps);
+  if (axis->first == NULL || axis->count == NULL || axis->weights == NULL)
+    {
+      gs_resample_axis_destroy(axis);
+      return NO;
+    }
+
+  for (i = 0; i < dstSize; i++)
+    {
+      double center = (i + 0.5) * scale;
+      NSInteger lo = MAX(0, (NSInteger)floor(center - support + 0.5));
+      NSInteger hi = MIN(srcSize, (NSInteger)floor(center + support + 0.5));
+      float *w = axis->weights + i * axis->taps;
+      double total = 0.0;
+      NSInteger j;
+
+      hi = MIN(hi, lo + axis->taps);
+      for (j = lo; j < hi; j++)
+        {
+          double v = kernel->weight((j + 0.5 - center) / stretch);
+
+          w[j - lo] = v;
+          total += v;
+        }
+      if (hi <= lo || total == 0.0)
+        {
+          lo = MIN(srcSize - 1, (NSInteger)center);
+          hi = lo + 1;
+          w[0] = 1.0;
+          total = 1.0;
+        }
+      for (j = 0; j < hi - lo; j++)
+        {
+          w[j] /= total;
+        }
+      axis->first[i] = lo;
+      axis->count[i] = hi - lo;
+    }
+  return YES;
+}
+
+/* A resampling of 8 bit meshed samples. Colour samples are weighted by
+   alpha while they are filtered, unless they already are. */
+typedef struct
+{
+  const unsigned char *src;
+  NSInteger srcBytesPerRow;
+  NSInteger srcWidth;
+  NSInteger spp;
+  NSInteger alpha;           /* index of the alpha sample, or -1 */
+  BOOL premultiply;
+  unsigned char *dst;
+  NSInteger dstBytesPerRow;
+  NSInteger dstWidth;
+  GSResampleAxis columns;
+  GSResampleAxis rows;
+} GSResampleJob;
+
+static void
+gs_load_samples(const GSResampleJob *job, NSInteger y, float *out)
+{
+  const unsigned char *p = job->src + y * job->srcBytesPerRow;
+  NSInteger spp = job->spp;
+  NSInteger n = job->srcWidth * spp;
+  NSInteger i, c;
+
+  for (i = 0; i < n; i++)
+    {
+      out[i] = p[i];
+    }
+  if (job->premultiply)
+    {
+      for (i = 0; i < n; i += spp)
+        {
+          float a = out[i + job->alpha] * (1.0f / 255.0f);
+
+          for (c = 0; c < spp; c++)
+            {
+              if (c != job->alpha)
+                {
+                  out[i + c] *= a;
+                }
+            }
+        }
+    }
+}
+
+static void
+gs_store_samples(const GSResampleJob *job, const float *in, unsigned char *p)
+{
+  NSInteger spp = job->spp;
+  NSInteger n = job->dstWidth * spp;
+  NSInteger i, c;
+
+  for (i = 0; i < n; i += spp)
+    {
+      float a = 255.0f;
+
+      if (job->alpha >= 0)
+        {
+          a = MIN(MAX(in[i + job->alpha], 0.0f), 255.0f);
+        }
+      for (c = 0; c < spp; c++)
+        {
+          float v = in[i + c];
+
+          if (c == job->alpha)
+            {
+              v = a;
+            }
+          else if (job->alpha >= 0)
+            {
+              if (job->premultiply)
+                {
+                  v = (a > 0.0f) ? v * 255.0f / a : 0.0f;
+                }
+              else
+                {
+                  /* Premultiplied colour can not exceed its alpha. */
+                  v = MIN(v, a);
+                }
+            }
+          p[i + c] = (unsigned char)(MIN(MAX(v, 0.0f), 255.0f) + 0.5f);
+        }
+    }
+}
+
+/* Filters one row of source samples horizontally into out. */
+static void
+gs_resample_row(const GSResampleJob *job, const float *in, float *out)
+{
+  const GSResampleAxis *axis = &job->columns;
+  NSInteger spp = job->spp;
+  NSInteger x, k, c;
+
+  for (x = 0; x < job->dstWidth; x++, out += spp)
+    {
+      const float *w = axis->weights + x * axis->taps;
+      const float *p = in + axis->first[x] * spp;
+      NSInteger n = axis->count[x];
+
+#if defined(__SSE2__)
+      if (spp == 4)
+        {
+          __m128 sum = _mm_setzero_ps();
+
+          for (k = 0; k < n; k++, p += 4)
+            {
+              sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(w[k]),
+                                               _mm_loadu_ps(p)));
+            }
+          _mm_storeu_ps(out, sum);
+          continue;
+        }
+#elif defined(__ARM_NEON)
+      if (spp == 4)
+        {
+          float32x4_t sum = vdupq_n_f32(0.0f);
+
+          for (k = 0; k < n; k++, p += 4)
+            {
+              sum = vmlaq_n_f32(sum, vld1q_f32(p), w[k]);
+            }
+          vst1q_f32(out, sum);
+          continue;
+        }
+#endif
+      for (c = 0; c < spp; c++)
+        {
+          float sum = 0.0f;
+
+          for (k = 0; k < n; k++)
+            {
+              sum += w[k] * p[k * spp + c];
+            }
+          out[c] = sum;
+        }
+    }
+}
+
+/* Adds weight times the n samples of row to sum. */
+static void
+gs_accumulate_row(float *sum, const float *row, float weight, NSInteger n)
+{
+  NSInteger i = 0;
+
+#if defined(__SSE2__)
+  __m128 w = _mm_set1_ps(weight);
+
+  for (; i + 4 <= n; i += 4)
+    {
+      _mm_storeu_ps(sum + i,
+        _mm_add_ps(_mm_loadu_ps(sum + i),
+                   _mm_mul_ps(w, _mm_loadu_ps(row + i))));
+    }
+#elif defined(__ARM_NEON)
+  for (; i + 4 <= n; i += 4)
+    {
+      vst1q_f32(sum + i, vmlaq_n_f32(vld1q_f32(sum + i),
+                                     vld1q_f32(row + i), weight));
+    }
+#endif
+  for (; i < n; i++)
+    {
+      sum[i] += weight * row[i];
+    }
+}
+
+/* Resamples the destination rows from y0 up to y1. The source rows they
+   need are filtered horizontally first, then combined vertically. Only
+   the last taps filtered rows are kept, in the slots of a ring indexed
+   by source row, as no destination row needs more than that. */
+static BOOL
+gs_resample_band(const GSResampleJob *job, NSInteger y0, NSInteger y1)
+{
+  NSInteger rowSize = job->dstWidth * job->spp;
+  NSInteger taps = job->rows.taps;
+  NSInteger *slotRow;
+  NSInteger y;
+  float *line;
+  float *rows;
+  float *sum;
+
+  line = malloc(sizeof(float) * job->srcWidth * job->spp);
+  rows = malloc(sizeof(float) * rowSize * taps);
+  sum = malloc(sizeof(float) * rowSize);
+  slotRow = malloc(sizeof(NSInteger) * taps);
+  if (line == NULL || rows == NULL || sum == NULL || slotRow == NULL)
+    {
+      free(line);
+      free(rows);
+      free(sum);
+      free(slotRow);
+      return NO;
+    }
+
+  for (y = 0; y < taps; y++)
+    {
+      slotRow[y] = -1;
+    }
+  for (y = y0; y < y1; y++)
+    {
+      const float *w = job->rows.weights + y * taps;
+      NSInteger k;
+
+      memset(sum, 0, sizeof(float) * rowSize);
+      for (k = 0; k < job->rows.count[y]; k++)
+        {
+          NSInteger r = job->rows.first[y] + k;
+          float *row = rows + (r % taps) * rowSize;
+
+          if (slotRow[r % taps] != r)
+            {
+              gs_load_samples(job, r, line);
+              gs_resample_row(job, line, row);
+              slotRow[r % taps] = r;
+            }
+          gs_accumulate_row(sum, row, w[k], rowSize);
+        }
+      gs_store_samples(job, sum, job->dst + y * job->dstBytesPerRow);
+    }
+
+  free(line);
+  free(rows);
+  free(sum);
+  free(slotRow);
+  return YES;
+}
+
+/* Resamples a band of destination rows on one of the resampler threads. */
+@interface GSResampleOperation : NSOperation
+{
+@public
+  const GSResampleJob *job;
+  NSInteger firstRow;
+  NSInteger lastRow;
+  BOOL done;
+}
+@end
+
+@implementation GSResampleOperation
+
+- (void) main
+{
+  done = gs_resample_band(job, firstRow, lastRow);
+}
+
+@end
+
+/* The worker threads of the resampler */
+static NSOperationQueue *resampleQueue = nil;
+static NSInteger resampleThreads = 1;
+
+void
+GSResamplerInitialize(void)
+{
+  resampleThreads = [[NSProcessInfo processInfo] activeProcessorCount];
+  resampleQueue = [NSOperationQueue new];
+  [resampleQueue setMaxConcurrentOperationCount: resampleThreads];
+}
+
+/* Runs job for dstHeight rows, split into bands for the resampler threads
+   when the result is large enough to be worth it. */
+static BOOL
+gs_resample(const GSResampleJob *job, NSInteger dstHeight)
+{
+  NSMutableArray *ops;
+  NSInteger bandRows;
+  NSInteger y;
+  NSUInteger i;
+  BOOL ok = YES;
+
+  if (resampleThreads < 2 || job->dstWidth * dstHeight < 256 * 256)
+    {
+      return gs_resample_band(job, 0, dstHeight);
+    }
+
+  bandRows = MAX(16, (dstHeight + 4 * resampleThreads - 1)
+    / (4 * resampleThreads));
+  ops = [NSMutableArray arrayWithCapacity: dstHeight / bandRows + 1];
+  for (y = 0; y < dstHeight; y += bandRows)
+    {
+      GSResampleOperation *op = [GSResampleOperation new];
+
+      op->job = job;
+      op->firstRow = y;
+      op->lastRow = MIN(dstHeight, y + bandRows);
+      [ops addObject: op];
+      [resampleQueue addOperation: op];
+      RELEASE(op);
+    }
+  for (i = 0; i < [ops count]; i++)
+    {
+      GSResampleOperation *op = [ops objectAtIndex: i];
+
+      [op waitUntilFinished];
+      ok = ok && op->done;
+    }
+  return ok;
+}
+
+@implementation NSBitmapImageRep (Scaling)
+
+/* Returns a copy of the receiver scaled down with a box filter to fit
+   into maxSize, or the receiver itself if it already fits. */
+- (NSBitmapImageRep *) _bitmapFittingPixelSize: (NSSize)maxSize
+{
+  NSBitmapImageRep *source = self;
+  NSBitmapImageRep *new;
+  NSInteger width, height, y;
+  GSBoxScaler scaler;
+
+  GSFitPixelSize(_pixelsWide, _pixelsHigh, maxSize, &width, &height);
+  if (width == _pixelsWide && height == _pixelsHigh)
+    {
+      return self;
+    }
+
+  if (_bitsPerSample != 8 || _isPlanar
+      || (_format & NSFloatingPointSamplesBitmapFormat)
+      || _bitsPerPixel != 8 * _numColors)
+    {
+      source = [self _convertToFormatBitsPerSample: 8
+                                   samplesPerPixel: _numColors
+                                          hasAlpha: _hasAlpha
+                                          isPlanar: NO
+                                    colorSpaceName: _colorSpace
+                                      bitmapFormat: (_format
+                                        & ~NSFloatingPointSamplesBitmapFormat)
+                                       bytesPerRow: 0
+                                      bitsPerPixel: 0];
+      if (source == nil)
+        {
+          return nil;
+        }
+    }
+
+  new = [[[self class] alloc]
+          initWithBitmapDataPlanes: NULL
+                        pixelsWide: width
+                        pixelsHigh: height
+                     bitsPerSample: 8
+                   samplesPerPixel: _numColors
+                          hasAlpha: _hasAlpha
+                          isPlanar: NO
+                    colorSpaceName: _colorSpace
+                      bitmapFormat: [source bitmapFormat]
+                       bytesPerRow: 0
+                      bitsPerPixel: 0];
+  if (!GSBoxScalerInit(&scaler, _pixelsWide, _pixelsHigh, _numColors,
+                       _numColors, [new bitmapData], width, height,
+                       [new bytesPerRow]))
+    {
+      RELEASE(new);
+      return nil;
+    }
+  for (y = 0; y < _pixelsHigh; y++)
+    {
+      GSBoxScalerAddRow(&scaler,
+                        [source bitmapData] + y * [source bytesPerRow]);
+    }
+  GSBoxScalerDestroy(&scaler);
+
+  return AUTORELEASE(new);
+}
+
+/* Returns a new bitmap of width by height pixels with the receiver
+   resampled with filter into it, converting the receiver to 8 bit
+   meshed samples first if needed. */
+- (NSBitmapImageRep *) _bitmapResampledToPixelsWide: (NSInteger)width
+                                          pixelsHigh: (NSInteger)height
+                                              filter: (GSImageResamplingFilter)filter
+{
+  NSBitmapImageRep *source = self;
+  NSBitmapImageRep *new;
+  GSResampleJob job;
+  BOOL ok;
+
+  if (width <= 0 || height <= 0 || _pixelsWide <= 0 || _pixelsHigh <= 0
+      || filter < GSImageResamplingBox || filter > GSImageResamplingMitchell)
+    {
+      [NSException raise: NSInvalidArgumentException
+                  format: @"Cannot resample %ldx%ld pixels to %ldx%ld with filter %d",
+                   (long)_pixelsWide, (long)_pixelsHigh,
+                   (long)width, (long)height, (int)filter];
+    }
+
+  if (_bitsPerSample != 8 || _isPlanar
+      || (_format & NSFloatingPointSamplesBitmapFormat)
+      || _bitsPerPixel != 8 * _numColors)
+    {
+      source = [self _convertToFormatBitsPerSample: 8
+                                   samplesPerPixel: _numColors
+                                          hasAlpha: _hasAlpha
+                                          isPlanar: NO
+                                    colorSpaceName: _colorSpace
+                                      bitmapFormat: (_format
+                                        & ~NSFloatingPointSamplesBitmapFormat)
+                                       bytesPerRow: 0
+                                      bitsPerPixel: 0];
+      if (source == nil)
+        {
+          return nil;
+        }
+    }
+
+  new = [[NSBitmapImageRep alloc]
+          initWithBitmapDataPlanes: NULL
+                        pixelsWide: width
+                        pixelsHigh: height
+                     bitsPerSample: 8
+                   samplesPerPixel: _numColors
+                          hasAlpha: _hasAlpha
+                          isPlanar: NO
+                    colorSpaceName: _colorSpace
+                      bitmapFormat: [source bitmapFormat]
+                       bytesPerRow: 0
+                      bitsPerPixel: 0];
+  if (new == nil)
+    {
+      return nil;
+    }
+  [new setSize: _size];
+
+  memset(&job, 0, sizeof(GSResampleJob));
+  job.src = [source bitmapData];
+  job.srcBytesPerRow = [source bytesPerRow];
+  job.srcWidth = _pixelsWide;
+  job.spp = _numColors;
+  job.alpha = -1;
+  if (_hasAlpha)
+    {
+      job.alpha = ([source bitmapFormat] & NSAlphaFirstBitmapFormat)
+        ? 0 : _numColors - 1;
+      job.premultiply = ([source bitmapFormat]
+        & NSAlphaNonpremultipliedBitmapFormat) ? YES : NO;
+    }
+  job.dst = [new bitmapData];
+  job.dstBytesPerRow = [new bytesPerRow];
+  job.dstWidth = width;
+
+  ok = gs_resample_axis_init(&job.columns, _pixelsWide, width,
+                             &gs_resample_kernels[filter])
+    && gs_resample_axis_init(&job.rows, _pixelsHigh, height,
+                             &gs_resample_kernels[filter])
+    && gs_resample(&job, height);
+  gs_resample_axis_destroy(&job.columns);
+  gs_resample_axis_destroy(&job.rows);
+  if (!ok)
+    {
+      RELEASE(new);
+      return nil;
+    }
+  return AUTORELEASE(new);
+}
+
+@end
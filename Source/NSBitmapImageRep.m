@@ -29,15 +29,28 @@
 #import "config.h"
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>
 #include <tiff.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #import <Foundation/NSArray.h>
 #import <Foundation/NSAutoreleasePool.h>
 #import <Foundation/NSData.h>
+#import <Foundation/NSDate.h>
 #import <Foundation/NSDebug.h>
+#import <Foundation/NSDictionary.h>
 #import <Foundation/NSException.h>
+#import <Foundation/NSFileHandle.h>
 #import <Foundation/NSFileManager.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSNull.h>
+#import <Foundation/NSOperation.h>
+#import <Foundation/NSProcessInfo.h>
 #import <Foundation/NSValue.h>
 #import "AppKit/AppKitExceptions.h"
 #import "AppKit/NSGraphics.h"
@@ -50,21 +63,74 @@
 #import "NSBitmapImageRep+JPEG.h"
 #import "NSBitmapImageRep+PNG.h"
 #import "NSBitmapImageRep+PNM.h"
+#import "NSBitmapImageRep+Scaling.h"
 #import "NSBitmapImageRep+ICNS.h"
 #import "GSGuiPrivate.h"
+#import "GSDeferredBitmapImageRep.h"
 
 #include "nsimage-tiff.h"
 
 /* Maximum number of planes */
 #define MAX_PLANES 5
 
+/* The layout of the samples of a bitmap, for the row kernels. */
+typedef struct
+{
+  unsigned char *planes[MAX_PLANES];
+  NSInteger bytesPerRow;
+  int bps;              /* 8 or 16, 16 bit samples are big endian */
+  int colors;           /* samples without alpha */
+  BOOL hasAlpha;
+  BOOL alphaFirst;
+  BOOL planar;
+} GSRowLayout;
+
+/* The readers of image data, keyed by the signature the data has within
+   its first SIGNATURE_BYTES bytes. A reader is either one of the formats
+   built into NSBitmapImageRep or a registered decoder class. */
+#define SIGNATURE_BYTES 16
+
+typedef enum
+{
+  GSImageFormatDecoder,
+  GSImageFormatPNG,
+  GSImageFormatPNM,
+  GSImageFormatJPEG,
+  GSImageFormatGIF,
+  GSImageFormatICNS,
+  GSImageFormatTIFF
+} GSImageFormatType;
+
+typedef struct _GSImageFormat
+{
+  struct _GSImageFormat *next;  /* next reader to try for the same data */
+  struct _GSImageFormat *link;  /* next reader in registration order */
+  GSImageFormatType type;
+  Class decoder;
+  NSString *name;
+  unsigned char signature[SIGNATURE_BYTES];
+  unsigned offset;
+  unsigned length;
+  unsigned minimum;             /* bytes the data needs for the reader */
+  NSUInteger decodes;
+  NSUInteger failures;
+  NSTimeInterval time;
+} GSImageFormat;
+
 /* Backend methods (optional) */
 @interface NSBitmapImageRep (GSPrivate)
 // GNUstep extension
-+ (BOOL) _bitmapIsTIFF: (NSData *)data;
 + (NSArray*) _imageRepsWithTIFFData: (NSData *)imageData;
 - (NSBitmapImageRep *) _initBitmapFromTIFF: (NSData *)imageData;
-- (NSBitmapImageRep *) _initFromTIFFImage: (TIFF *)image number: (int)imageNumber;
+- (NSBitmapImageRep *) _initBitmapFromTIFF: (NSData *)imageData
+                                     frame: (NSInteger)frame;
+- (NSBitmapImageRep *) _initFromTIFFImage: (TIFF *)image
+                                    number: (int)imageNumber
+                                      data: (NSData *)imageData;
+- (NSBitmapImageRep *) _initDeferredFromTIFFImage: (TIFF *)image
+                                           number: (int)imageNumber
+                                             data: (NSData *)imageData;
+- (void) _setPropertiesFromTIFFInfo: (NSTiffInfo *)info;
 - (void) _fillTIFFInfo: (NSTiffInfo*)info
       usingCompression: (NSTIFFCompression)type
                 factor: (float)factor;
@@ -82,6 +148,228 @@
                                         bitmapFormat: (NSBitmapFormat)bitmapFormat 
                                          bytesPerRow: (NSInteger)rowBytes
                                         bitsPerPixel: (NSInteger)pixelBits;
+- (BOOL) _getRowLayout: (GSRowLayout *)layout;
+- (BOOL) _convertRowsInto: (NSBitmapImageRep *)new;
+- (void) _loadRow: (NSInteger)y
+              atX: (NSInteger)x
+            width: (NSInteger)width
+             into: (uint16_t *)work;
+- (void) _storeRow: (NSInteger)y
+               atX: (NSInteger)x
+             width: (NSInteger)width
+              from: (const uint16_t *)work;
+- (void) _checkRectAtX: (NSInteger)x
+                     y: (NSInteger)y
+                 width: (NSInteger)width
+                height: (NSInteger)height;
+- (void) _getRGBA: (void *)buffer
+          isFloat: (BOOL)isFloat
+      bytesPerRow: (NSInteger)rowBytes
+              atX: (NSInteger)x
+                y: (NSInteger)y
+            width: (NSInteger)width
+           height: (NSInteger)height;
+- (void) _setRGBA: (const void *)buffer
+          isFloat: (BOOL)isFloat
+      bytesPerRow: (NSInteger)rowBytes
+              atX: (NSInteger)x
+                y: (NSInteger)y
+            width: (NSInteger)width
+           height: (NSInteger)height;
+- (void) _adoptBitmapOf: (NSBitmapImageRep *)rep;
+- (id) _initWithData: (NSData *)imageData format: (GSImageFormat *)format;
+- (id) _loadState;
+- (void) _setLoadState: (id)state;
+- (BOOL) _allocateBitmapPixelsWide: (NSInteger)width
+                        pixelsHigh: (NSInteger)height
+                     bitsPerSample: (NSInteger)bps
+                   samplesPerPixel: (NSInteger)spp
+                          hasAlpha: (BOOL)alpha
+                    colorSpaceName: (NSString*)colorSpaceName
+                      bitmapFormat: (NSBitmapFormat)bitmapFormat
+                       bytesPerRow: (NSInteger)rowBytes
+                      bitsPerPixel: (NSInteger)pixelBits;
+- (BOOL) _writeRepresentationUsingType: (NSBitmapImageFileType)storageType
+                            properties: (NSDictionary *)properties
+                                    to: (id)output;
++ (NSArray *) _encodeImageReps: (NSArray *)imageReps
+                     usingType: (NSBitmapImageFileType)storageType
+                    properties: (NSDictionary *)properties
+                            to: (NSArray *)outputs;
+@end
+
+/* Encodes one bitmap for +_encodeImageReps:usingType:properties:to:. */
+@interface GSImageEncodeOperation : NSOperation
+{
+@public
+  NSImageRep *rep;
+  NSBitmapImageFileType type;
+  NSDictionary *properties;
+  id output;
+  BOOL written;
+}
+@end
+
+static NSLock *formatLock = nil;
+/* Readers whose signature is at the start of the data, by first byte */
+static GSImageFormat *formatsByFirstByte[256];
+/* Readers whose signature is further into the data */
+static GSImageFormat *formatsAtOffset = NULL;
+static GSImageFormat *allFormats = NULL;
+/* The worker threads encoding images for the batch methods */
+static NSOperationQueue *encodeQueue = nil;
+
+/* Bitmaps loaded incrementally keep their decoder state and load status
+ * in this table rather than in ivars, so that the layout of the class
+ * stays the same. Entries are removed when the bitmap is deallocated.
+ */
+typedef struct {
+  id state;                     // decoder state, nil between loads
+  NSInteger status;             // last result of the incremental load
+} GSIncrementalLoad;
+
+static NSLock *incrementalLock = nil;
+static NSMapTable *incrementalLoads = NULL;
+
+/* Returns the entry of rep, which must be used with incrementalLock
+   locked. A new entry is made if create is YES. */
+static GSIncrementalLoad *
+incremental_load(NSBitmapImageRep *rep, BOOL create)
+{
+  GSIncrementalLoad *load = NSMapGet(incrementalLoads, rep);
+
+  if (load == NULL && create)
+    {
+      load = NSZoneMalloc(NSDefaultMallocZone(), sizeof(GSIncrementalLoad));
+      load->state = nil;
+      load->status = NSImageRepLoadStatusUnknownType;
+      NSMapInsert(incrementalLoads, rep, load);
+    }
+  return load;
+}
+
+static void
+add_format(GSImageFormatType type, Class decoder, NSString *name,
+  const void *signature, unsigned length, unsigned offset, unsigned minimum)
+{
+  GSImageFormat *format;
+
+  format = NSZoneCalloc(NSDefaultMallocZone(), 1, sizeof(GSImageFormat));
+  format->type = type;
+  format->decoder = decoder;
+  format->name = [name copy];
+  memcpy(format->signature, signature, length);
+  format->offset = offset;
+  format->length = length;
+  format->minimum = MAX(offset + length, minimum);
+
+  /* Later readers take precedence, so that a decoder can replace a
+     built in one. */
+  [formatLock lock];
+  if (offset == 0)
+    {
+      format->next = formatsByFirstByte[format->signature[0]];
+      formatsByFirstByte[format->signature[0]] = format;
+    }
+  else
+    {
+      format->next = formatsAtOffset;
+      formatsAtOffset = format;
+    }
+  format->link = allFormats;
+  allFormats = format;
+  [formatLock unlock];
+}
+
+/* Returns the reader for data, or NULL if no reader knows its signature. */
+static GSImageFormat *
+format_for_data(NSData *data)
+{
+  const unsigned char *bytes = [data bytes];
+  NSUInteger length = [data length];
+  GSImageFormat *format;
+
+  if (length == 0)
+    {
+      return NULL;
+    }
+
+  [formatLock lock];
+  for (format = formatsByFirstByte[bytes[0]]; format != NULL;
+       format = format->next)
+    {
+      if (length >= format->minimum
+          && memcmp(bytes, format->signature, format->length) == 0)
+        {
+          break;
+        }
+    }
+  if (format == NULL)
+    {
+      for (format = formatsAtOffset; format != NULL; format = format->next)
+        {
+          if (length >= format->minimum
+              && memcmp(bytes + format->offset, format->signature,
+                        format->length) == 0)
+            {
+              break;
+            }
+        }
+    }
+  [formatLock unlock];
+
+  return format;
+}
+
+static void
+record_decode(GSImageFormat *format, NSTimeInterval start, BOOL ok)
+{
+  NSTimeInterval time = [NSDate timeIntervalSinceReferenceDate] - start;
+
+  [formatLock lock];
+  format->decodes++;
+  if (!ok)
+    {
+      format->failures++;
+    }
+  format->time += time;
+  [formatLock unlock];
+  NSDebugLLog(@"NSImage", @"Decoded %@ image in %g seconds",
+              format->name, time);
+}
+
+@implementation GSImageEncodeOperation
+
+- (void) dealloc
+{
+  DESTROY(rep);
+  DESTROY(properties);
+  DESTROY(output);
+  [super dealloc];
+}
+
+- (void) main
+{
+  CREATE_AUTORELEASE_POOL(pool);
+
+  if ([rep isKindOfClass: [NSBitmapImageRep class]])
+    {
+      NS_DURING
+        {
+          written = [(NSBitmapImageRep*)rep _writeRepresentationUsingType: type
+                                                               properties: properties
+                                                                       to: output];
+        }
+      NS_HANDLER
+        {
+          NSLog(@"Unable to encode %@: %@", rep, localException);
+          written = NO;
+        }
+      NS_ENDHANDLER
+    }
+  DESTROY(pool);
+}
+
 @end
 
 /**
@@ -101,39 +389,55 @@
 */ 
 @implementation NSBitmapImageRep 
 
-/** Returns YES if the image stored in data can be read and decoded */
-+ (BOOL) canInitWithData: (NSData *)data
++ (void) initialize
 {
-  if (data == nil)
+  if (self == [NSBitmapImageRep class])
     {
-      return NO;
-    }
-
-#if HAVE_LIBPNG
-  if ([self _bitmapIsPNG: data])
-    return YES;
+      formatLock = [NSLock new];
+
+      add_format(GSImageFormatTIFF, Nil, @"TIFF", "II*\0", 4, 0, 0);
+      add_format(GSImageFormatTIFF, Nil, @"TIFF", "MM\0*", 4, 0, 0);
+      add_format(GSImageFormatTIFF, Nil, @"TIFF", "II+\0", 4, 0, 0);
+      add_format(GSImageFormatTIFF, Nil, @"TIFF", "MM\0+", 4, 0, 0);
+      /* ICNS data starts with an 8 byte header. */
+      add_format(GSImageFormatICNS, Nil, @"ICNS", "icns", 4, 0, 8);
+#if HAVE_LIBUNGIF || HAVE_LIBGIF
+      add_format(GSImageFormatGIF, Nil, @"GIF", "GIF87a", 6, 0, 0);
+      add_format(GSImageFormatGIF, Nil, @"GIF", "GIF89a", 6, 0, 0);
 #endif
-
-  if ([self _bitmapIsPNM: data])
-    return YES;
-
 #if HAVE_LIBJPEG
-  if ([self _bitmapIsJPEG: data])
-    return YES;
+      add_format(GSImageFormatJPEG, Nil, @"JPEG", "\xff\xd8\xff", 3, 0, 0);
 #endif
-
-#if HAVE_LIBUNGIF || HAVE_LIBGIF
-  if ([self _bitmapIsGIF: data])
-    return YES;
+      /* A raw PNM header needs at least nine bytes. */
+      add_format(GSImageFormatPNM, Nil, @"PNM", "P5\n", 3, 0, 9);
+      add_format(GSImageFormatPNM, Nil, @"PNM", "P5\r", 3, 0, 9);
+      add_format(GSImageFormatPNM, Nil, @"PNM", "P6\n", 3, 0, 9);
+      add_format(GSImageFormatPNM, Nil, @"PNM", "P6\r", 3, 0, 9);
+#if HAVE_LIBPNG
+      add_format(GSImageFormatPNG, Nil, @"PNG", "\x89PNG\r\n\x1a\n", 8, 0, 0);
 #endif
 
-  if ([self _bitmapIsICNS: data])
-    return YES;
+      incrementalLock = [NSLock new];
+      incrementalLoads = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                                          NSNonOwnedPointerMapValueCallBacks,
+                                          0);
 
-  if ([self _bitmapIsTIFF: data])
-    return YES;
+      encodeQueue = [NSOperationQueue new];
+      [encodeQueue setMaxConcurrentOperationCount:
+        [[NSProcessInfo processInfo] activeProcessorCount]];
+      GSResamplerInitialize();
+    }
+}
+
+/** Returns YES if the image stored in data can be read and decoded */
++ (BOOL) canInitWithData: (NSData *)data
+{
+  if (data == nil)
+    {
+      return NO;
+    }
 
-  return NO;
+  return (format_for_data(data) != NULL);
 }
 
 /** Returns a list of image filename extensions that are understood by
@@ -192,86 +496,123 @@
 */
 + (NSArray*) imageRepsWithData: (NSData *)imageData
 {
+  GSImageFormat *format;
+  NSTimeInterval start;
+  NSArray *reps;
+
   if (imageData == nil)
     {
       NSLog(@"NSBitmapImageRep: nil image data");
       return [NSArray array];
     }
 
-  if ([self _bitmapIsPNG: imageData])
+  format = format_for_data(imageData);
+  if (format == NULL)
     {
-      NSBitmapImageRep *rep;
-      NSArray *a;
-
-      rep = [[self alloc] _initBitmapFromPNG: imageData];
-      if (!rep)
-        return [NSArray array];
-      a = [NSArray arrayWithObject: rep];
-      DESTROY(rep);
-      return a;
+      NSLog(@"NSBitmapImageRep: unable to parse bitmap image data");
+      return [NSArray array];
     }
 
-  if ([self _bitmapIsPNM: imageData])
+  start = [NSDate timeIntervalSinceReferenceDate];
+  switch (format->type)
     {
-      NSBitmapImageRep *rep;
-      NSArray *a;
+      case GSImageFormatDecoder:
+        reps = [format->decoder imageRepsWithData: imageData];
+        break;
+      case GSImageFormatICNS:
+        reps = [self _imageRepsWithICNSData: imageData];
+        break;
+      case GSImageFormatTIFF:
+        reps = [self _imageRepsWithTIFFData: imageData];
+        break;
+      default:
+        {
+          NSBitmapImageRep *rep;
 
-      rep = [[self alloc] _initBitmapFromPNM: imageData
-			      errorMessage: NULL];
-      if (!rep)
-        return [NSArray array];
-      a = [NSArray arrayWithObject: rep];
-      DESTROY(rep);
-      return a;
+          rep = [[self alloc] _initWithData: imageData format: format];
+          reps = (rep == nil) ? [NSArray array] : [NSArray arrayWithObject: rep];
+          RELEASE(rep);
+        }
+        break;
     }
+  record_decode(format, start, [reps count] > 0);
 
-  if ([self _bitmapIsJPEG: imageData])
-    {
-      NSBitmapImageRep *rep;
-      NSArray *a;
-
-      rep = [[self alloc] _initBitmapFromJPEG: imageData
-			       errorMessage: NULL];
-      if (!rep)
-        return [NSArray array];
-      a = [NSArray arrayWithObject: rep];
-      DESTROY(rep);
-      return a;
-    }
+  return (reps == nil) ? [NSArray array] : reps;
+}
 
-  if ([self _bitmapIsGIF: imageData])
+/** Registers decoder, a class implementing its own +imageRepsWithData:
+    and -initWithData:, as the reader of images whose data holds signature
+    at offset. The signature must lie within the first 16 bytes of the
+    data. A decoder registered for the signature of a built in format
+    replaces the built in reader. */
++ (void) registerImageDecoder: (Class)decoder
+                 forSignature: (NSData *)signature
+                     atOffset: (NSUInteger)offset
+                         name: (NSString *)name
+{
+  if (decoder == Nil || [signature length] == 0
+      || offset + [signature length] > SIGNATURE_BYTES)
     {
-      NSBitmapImageRep *rep;
-      NSArray *a;
-
-      rep = [[self alloc] _initBitmapFromGIF: imageData
-			      errorMessage: NULL];
-      if (!rep)
-        return [NSArray array];
-      a = [NSArray arrayWithObject: rep];
-      DESTROY(rep);
-      return a;
+      [NSException raise: NSInvalidArgumentException
+                  format: @"Invalid image decoder signature"];
     }
-
-  if ([self _bitmapIsICNS: imageData])
+  /* Inheriting the methods would have them come back to the decoder */
+  if (![decoder respondsToSelector: @selector(imageRepsWithData:)]
+      || [decoder methodForSelector: @selector(imageRepsWithData:)]
+      == [NSBitmapImageRep methodForSelector: @selector(imageRepsWithData:)]
+      || [decoder instanceMethodForSelector: @selector(initWithData:)]
+      == [NSBitmapImageRep instanceMethodForSelector: @selector(initWithData:)])
     {
-      return [self _imageRepsWithICNSData: imageData];
+      [NSException raise: NSInvalidArgumentException
+                  format: @"Image decoder %@ must implement +imageRepsWithData:"
+                   @" and -initWithData:", NSStringFromClass(decoder)];
     }
+  add_format(GSImageFormatDecoder, decoder,
+             (name != nil) ? name : NSStringFromClass(decoder),
+             [signature bytes], [signature length], offset, 0);
+}
+
+/** Returns the number of images decoded, the number of those that
+    failed and the time spent decoding them (keys Decodes, Failures and
+    Time), by image format. */
++ (NSDictionary *) imageDecoderStatistics
+{
+  NSMutableDictionary *stats = [NSMutableDictionary dictionary];
+  GSImageFormat *format;
 
-  if ([self _bitmapIsTIFF: imageData])
+  [formatLock lock];
+  for (format = allFormats; format != NULL; format = format->link)
     {
-      return [self _imageRepsWithTIFFData: imageData];
+      NSDictionary *old = [stats objectForKey: format->name];
+      NSUInteger decodes = format->decodes;
+      NSUInteger failures = format->failures;
+      NSTimeInterval time = format->time;
+
+      /* Formats with several signatures have one reader for each */
+      if (old != nil)
+        {
+          decodes += [[old objectForKey: @"Decodes"] unsignedIntegerValue];
+          failures += [[old objectForKey: @"Failures"] unsignedIntegerValue];
+          time += [[old objectForKey: @"Time"] doubleValue];
+        }
+      [stats setObject: [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithUnsignedInteger: decodes], @"Decodes",
+        [NSNumber numberWithUnsignedInteger: failures], @"Failures",
+        [NSNumber numberWithDouble: time], @"Time",
+        nil]
+                forKey: format->name];
     }
+  [formatLock unlock];
 
-  NSLog(@"NSBitmapImageRep: unable to parse bitmap image data");
-  return [NSArray array];
+  return stats;
 }
 
 /** Loads only the default (first) image from the image contained in
    data. */
 - (id) initWithData: (NSData *)imageData
 {
-  Class class;
+  GSImageFormat *format;
+  NSTimeInterval start;
 
   if (imageData == nil)
     {
@@ -279,30 +620,63 @@
       return nil;
     }
 
-  class = [self class];
-  if ([class _bitmapIsPNG: imageData])
-    return [self _initBitmapFromPNG: imageData];
-
-  if ([class _bitmapIsPNM: imageData])
-    return [self _initBitmapFromPNM: imageData
-		       errorMessage: NULL];
+  format = format_for_data(imageData);
+  if (format == NULL)
+    {
+      DESTROY(self);
+      return nil;
+    }
 
-  if ([class _bitmapIsJPEG: imageData])
-    return [self _initBitmapFromJPEG: imageData
-			errorMessage: NULL];
+  start = [NSDate timeIntervalSinceReferenceDate];
+  self = [self _initWithData: imageData format: format];
+  record_decode(format, start, self != nil);
+  return self;
+}
 
-  if ([class _bitmapIsGIF: imageData])
-    return [self _initBitmapFromGIF: imageData
-		       errorMessage: NULL];
+- (id) initWithData: (NSData *)imageData fittingPixelSize: (NSSize)maxSize
+{
+  NSBitmapImageRep *scaled;
+  GSImageFormat *format;
+  NSTimeInterval start;
 
-  if ([class _bitmapIsICNS: imageData])
-    return [self _initBitmapFromICNS: imageData];
+  if (imageData == nil)
+    {
+      RELEASE(self);
+      return nil;
+    }
+  if (maxSize.width < 1 || maxSize.height < 1)
+    {
+      return [self initWithData: imageData];
+    }
 
-  if ([class _bitmapIsTIFF: imageData])
-    return [self _initBitmapFromTIFF: imageData];
+  format = format_for_data(imageData);
+  if (format != NULL && format->type == GSImageFormatJPEG)
+    {
+      start = [NSDate timeIntervalSinceReferenceDate];
+      self = [self _initBitmapFromJPEG: imageData
+		      fittingPixelSize: maxSize
+			  errorMessage: NULL];
+      record_decode(format, start, self != nil);
+    }
+  else if (format != NULL && format->type == GSImageFormatPNG)
+    {
+      start = [NSDate timeIntervalSinceReferenceDate];
+      self = [self _initBitmapFromPNG: imageData
+		     fittingPixelSize: maxSize];
+      record_decode(format, start, self != nil);
+    }
+  else
+    self = [self initWithData: imageData];
 
-  DESTROY(self);
-  return nil;
+  /* Scale whatever the decoder left too large */
+  scaled = [self _bitmapFittingPixelSize: maxSize];
+  if (scaled != self)
+    {
+      RETAIN(scaled);
+      RELEASE(self);
+      self = scaled;
+    }
+  return self;
 }
 
 /** Initialize with bitmap data from a rect within the focused view */
@@ -576,24 +950,91 @@
   return nil;
 }
 
+/** Initializes an empty receiver, which is then loaded by repeated
+    calls to -incrementalLoadFromData:complete:. */
 - (id) initForIncrementalLoad
 {
-  // FIXME
+  if ((self = [super init]) != nil)
+    {
+      [incrementalLock lock];
+      incremental_load(self, YES);
+      [incrementalLock unlock];
+    }
   return self;
 }
 
+/** <p>Loads the image from data, which holds all the image data received
+    so far. Each call must pass the data of the previous call plus any
+    data that arrived since, and complete must be YES once all data has
+    been received.</p>
+    <p>PNG, JPEG and GIF images are decoded as the data arrives. For them
+    the method returns the number of rows from the top of the image that
+    have been decoded so far, and the bitmap data of the receiver can be
+    drawn at any time. Otherwise one of the NSImageRepLoadStatus values
+    is returned; NSImageRepLoadStatusWillNeedAllData means the image
+    can only be decoded once complete is YES.</p> */
 - (NSInteger) incrementalLoadFromData: (NSData *)data complete: (BOOL)complete
 {
-  if (!complete)
+  const unsigned char *bytes = [data bytes];
+  NSUInteger length = [data length];
+  NSInteger status;
+
+  [incrementalLock lock];
+  status = incremental_load(self, YES)->status;
+  [incrementalLock unlock];
+  if (status == NSImageRepLoadStatusCompleted
+    || status == NSImageRepLoadStatusInvalidData
+    || status == NSImageRepLoadStatusUnexpectedEOF)
+    {
+      return status;
+    }
+
+  if (length >= 8 && memcmp(bytes, "\x89PNG\r\n\x1a\n", 8) == 0)
+    {
+      status = [self _incrementalLoadPNG: data complete: complete];
+    }
+  else if (length >= 3 && bytes[0] == 0xFF && bytes[1] == 0xD8
+    && bytes[2] == 0xFF)
+    {
+      status = [self _incrementalLoadJPEG: data complete: complete];
+    }
+  else if (length >= 6 && memcmp(bytes, "GIF8", 4) == 0)
+    {
+      status = [self _incrementalLoadGIF: data complete: complete];
+    }
+  else if (!complete)
+    {
+      // Not enough data to tell the type, or a type decoded all at once
+      status = (length < 8) ? NSImageRepLoadStatusUnknownType
+        : NSImageRepLoadStatusWillNeedAllData;
+    }
+  else
     {
-      // we don't implement it really
-      return NSImageRepLoadStatusWillNeedAllData;
+      return [self initWithData: data] ? NSImageRepLoadStatusCompleted : NSImageRepLoadStatusUnexpectedEOF;
     }
-  return [self initWithData: data] ? NSImageRepLoadStatusCompleted : NSImageRepLoadStatusUnexpectedEOF;
+
+  [incrementalLock lock];
+  incremental_load(self, YES)->status = status;
+  [incrementalLock unlock];
+  return status;
 }
 
 - (void) dealloc
 {
+  GSIncrementalLoad *load;
+
+  [incrementalLock lock];
+  load = incremental_load(self, NO);
+  if (load != NULL)
+    {
+      NSMapRemove(incrementalLoads, self);
+    }
+  [incrementalLock unlock];
+  if (load != NULL)
+    {
+      RELEASE(load->state);
+      NSZoneFree(NSDefaultMallocZone(), load);
+    }
   NSZoneFree([self zone],_imagePlanes);
   RELEASE(_imageData);
   RELEASE(_properties);
@@ -1352,6 +1793,83 @@ _set_bit_value(unsigned char *base, long msb_off, int bit_width,
   [self setPixel: pixelData atX: x y: y];
 }
 
+/** Copies the pixels of the rectangle of width by height pixels at
+    (x,y), where (0,0) is the top-left pixel in the image, into buffer as
+    8 bit RGBA samples with unpremultiplied alpha, rowBytes apart. Pixels
+    in other colour spaces are converted to RGB, and pixels of images
+    without alpha are opaque. A height of 1 reads a single row span. */
+- (void) getRGBA8: (unsigned char *)buffer
+      bytesPerRow: (NSInteger)rowBytes
+              atX: (NSInteger)x
+                y: (NSInteger)y
+            width: (NSInteger)width
+           height: (NSInteger)height
+{
+  [self _getRGBA: buffer
+        isFloat: NO
+    bytesPerRow: rowBytes
+            atX: x
+              y: y
+          width: width
+         height: height];
+}
+
+/** Stores the 8 bit RGBA samples with unpremultiplied alpha in buffer,
+    rowBytes apart, as the pixels of the rectangle of width by height
+    pixels at (x,y), converting them to the colour space and format of
+    the receiver. */
+- (void) setRGBA8: (const unsigned char *)buffer
+      bytesPerRow: (NSInteger)rowBytes
+              atX: (NSInteger)x
+                y: (NSInteger)y
+            width: (NSInteger)width
+           height: (NSInteger)height
+{
+  [self _setRGBA: buffer
+        isFloat: NO
+    bytesPerRow: rowBytes
+            atX: x
+              y: y
+          width: width
+         height: height];
+}
+
+/** Like -getRGBA8:bytesPerRow:atX:y:width:height:, but with samples
+    between 0.0 and 1.0. */
+- (void) getRGBAFloat: (float *)buffer
+          bytesPerRow: (NSInteger)rowBytes
+                  atX: (NSInteger)x
+                    y: (NSInteger)y
+                width: (NSInteger)width
+               height: (NSInteger)height
+{
+  [self _getRGBA: buffer
+        isFloat: YES
+    bytesPerRow: rowBytes
+            atX: x
+              y: y
+          width: width
+         height: height];
+}
+
+/** Like -setRGBA8:bytesPerRow:atX:y:width:height:, but with samples
+    between 0.0 and 1.0. */
+- (void) setRGBAFloat: (const float *)buffer
+          bytesPerRow: (NSInteger)rowBytes
+                  atX: (NSInteger)x
+                    y: (NSInteger)y
+                width: (NSInteger)width
+               height: (NSInteger)height
+{
+  [self _setRGBA: buffer
+        isFloat: YES
+    bytesPerRow: rowBytes
+            atX: x
+              y: y
+          width: width
+         height: height];
+}
+
 /** Draws the image in the current window according the information
     from the current gState, including information about the current
     point, scaling, etc.  */
@@ -1625,6 +2143,91 @@ _set_bit_value(unsigned char *base, long msb_off, int bit_width,
   return nil;
 }
 
+/** Writes the receiver in the format storageType to fileHandle. PNG and
+    JPEG data is written as it is encoded rather than built up in memory
+    first. Returns NO if the image could not be encoded or written. */
+- (BOOL) writeRepresentationUsingType: (NSBitmapImageFileType)storageType
+                           properties: (NSDictionary *)properties
+                         toFileHandle: (NSFileHandle *)fileHandle
+{
+  return [self _writeRepresentationUsingType: storageType
+                                  properties: properties
+                                          to: fileHandle];
+}
+
+/** Encodes the bitmaps in imageReps in the format storageType, several
+    at a time on worker threads, and returns the data of each in the same
+    order. The entries of bitmaps that could not be encoded are NSNull. */
++ (NSArray *) representationsOfImageReps: (NSArray *)imageReps
+                               usingType: (NSBitmapImageFileType)storageType
+                              properties: (NSDictionary *)properties
+{
+  NSUInteger i, count = [imageReps count];
+  NSMutableArray *outputs = [NSMutableArray arrayWithCapacity: count];
+  NSMutableArray *result = [NSMutableArray arrayWithCapacity: count];
+  NSArray *ops;
+
+  for (i = 0; i < count; i++)
+    {
+      [outputs addObject: [NSMutableData data]];
+    }
+  ops = [self _encodeImageReps: imageReps
+                     usingType: storageType
+                    properties: properties
+                            to: outputs];
+  for (i = 0; i < count; i++)
+    {
+      GSImageEncodeOperation *op = [ops objectAtIndex: i];
+
+      [result addObject: op->written ? op->output : (id)[NSNull null]];
+    }
+  return result;
+}
+
+/** Like +representationsOfImageReps:usingType:properties:, but writes
+    each bitmap to the file handle at the same index of fileHandles as it
+    is encoded. Returns NO if any of them could not be written. */
++ (BOOL) writeRepresentationsOfImageReps: (NSArray *)imageReps
+                               usingType: (NSBitmapImageFileType)storageType
+                              properties: (NSDictionary *)properties
+                           toFileHandles: (NSArray *)fileHandles
+{
+  NSEnumerator *enumerator;
+  GSImageEncodeOperation *op;
+  BOOL ok = YES;
+
+  if ([fileHandles count] != [imageReps count])
+    {
+      [NSException raise: NSInvalidArgumentException
+                  format: @"%lu file handles given for %lu images",
+                   (unsigned long)[fileHandles count],
+                   (unsigned long)[imageReps count]];
+    }
+  enumerator = [[self _encodeImageReps: imageReps
+                             usingType: storageType
+                            properties: properties
+                                    to: fileHandles] objectEnumerator];
+  while ((op = [enumerator nextObject]) != nil)
+    {
+      ok = ok && op->written;
+    }
+  return ok;
+}
+
+/** Returns a new bitmap of width by height pixels holding the receiver
+    resampled with filter. Rows and columns are filtered in turn, in
+    bands on several threads for large images, with colour weighted by
+    alpha. The result has 8 bit samples in the colour space of the
+    receiver and the same size in points. */
+- (NSBitmapImageRep *) bitmapImageRepByResamplingToPixelsWide: (NSInteger)width
+                                                   pixelsHigh: (NSInteger)height
+                                                       filter: (GSImageResamplingFilter)filter
+{
+  return [self _bitmapResampledToPixelsWide: width
+                                 pixelsHigh: height
+                                     filter: filter];
+}
+
 //
 // Setting and Checking Compression Types 
 //
@@ -1854,67 +2457,984 @@ _set_bit_value(unsigned char *base, long msb_off, int bit_width,
 
 @end
 
-@implementation NSBitmapImageRep (GSPrivate)
+/*
+ * Row kernels for premultiplying and converting bitmaps in the common
+ * 8 and 16 bit formats, instead of going through -getPixel:atX:y: and
+ * -setPixel:atX:y: for every pixel. SSE2 and NEON are part of the base
+ * instruction set of x86_64 and arm64, so the vector versions are chosen
+ * when compiling and need no check of the CPU at run time; other targets
+ * use the scalar loops. Wider AVX2 versions would need their own compiler
+ * flags and a CPUID check, for little gain as the kernels are limited by
+ * memory bandwidth rather than arithmetic once vectorized.
+ * Tests/gui/NSBitmapImageRep/conversionSpeed.m times the kernels against
+ * the pixel by pixel code they replace.
+ */
 
-+ (int) _localFromCompressionType: (NSTIFFCompression)type
+
+/* Premultiplies a row of 8 bit pixels with four samples, with the alpha
+   sample at index ai (0 or 3). v * a / 255 is rounded as in
+   ((t >> 8) + t) >> 8 with t = a * v + 0x80, which is exact for a = 0
+   and a = 255, so no pixel needs special casing. */
+static void
+gs_premultiply_row4(unsigned char *p, NSInteger width, int ai)
 {
-  switch (type)
+  NSInteger x = 0;
+
+#if defined(__SSE2__)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi16(0x80);
+    /* Keeps the alpha lanes of each 16 bit pixel */
+    const __m128i amask = (ai == 0)
+      ? _mm_set_epi16(0, 0, 0, -1, 0, 0, 0, -1)
+      : _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+    for (; x + 4 <= width; x += 4)
+      {
+        __m128i px = _mm_loadu_si128((__m128i *)(p + 4 * x));
+        __m128i lo = _mm_unpacklo_epi8(px, zero);
+        __m128i hi = _mm_unpackhi_epi8(px, zero);
+        __m128i alo, ahi, tlo, thi;
+
+        if (ai == 0)
+          {
+            alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0x00), 0x00);
+            ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0x00), 0x00);
+          }
+        else
+          {
+            alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xff), 0xff);
+            ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xff), 0xff);
+          }
+        tlo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), half);
+        thi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), half);
+        tlo = _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(tlo, 8), tlo), 8);
+        thi = _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(thi, 8), thi), 8);
+        tlo = _mm_or_si128(_mm_and_si128(amask, lo),
+                           _mm_andnot_si128(amask, tlo));
+        thi = _mm_or_si128(_mm_and_si128(amask, hi),
+                           _mm_andnot_si128(amask, thi));
+        _mm_storeu_si128((__m128i *)(p + 4 * x), _mm_packus_epi16(tlo, thi));
+      }
+  }
+#elif defined(__ARM_NEON)
+  {
+    const uint16x8_t half = vdupq_n_u16(0x80);
+
+    for (; x + 8 <= width; x += 8)
+      {
+        uint8x8x4_t px = vld4_u8(p + 4 * x);
+        uint8x8_t a = px.val[ai];
+        int i;
+
+        for (i = 0; i < 4; i++)
+          {
+            if (i != ai)
+              {
+                uint16x8_t t = vaddq_u16(vmull_u8(px.val[i], a), half);
+
+                px.val[i] = vshrn_n_u16(vaddq_u16(vshrq_n_u16(t, 8), t), 8);
+              }
+          }
+        vst4_u8(p + 4 * x, px);
+      }
+  }
+#endif
+
+  for (; x < width; x++)
     {
-    case NSTIFFCompressionNone: return COMPRESSION_NONE;
-    case NSTIFFCompressionCCITTFAX3: return COMPRESSION_CCITTFAX3;
-    case NSTIFFCompressionCCITTFAX4: return COMPRESSION_CCITTFAX4;
-    case NSTIFFCompressionLZW: return COMPRESSION_LZW;
-    case NSTIFFCompressionJPEG: return COMPRESSION_JPEG;
-    case NSTIFFCompressionNEXT: return COMPRESSION_NEXT;
-    case NSTIFFCompressionPackBits: return COMPRESSION_PACKBITS;
-    case NSTIFFCompressionOldJPEG: return COMPRESSION_OJPEG;
-    default:
-      break;
+      unsigned char *q = p + 4 * x;
+      unsigned a = q[ai];
+      int i;
+
+      for (i = 0; i < 4; i++)
+        {
+          if (i != ai)
+            {
+              unsigned t = a * q[i] + 0x80;
+
+              q[i] = ((t >> 8) + t) >> 8;
+            }
+        }
     }
-  return COMPRESSION_NONE;
 }
 
-+ (NSTIFFCompression) _compressionTypeFromLocal: (int)type
-{
-  switch (type)
-    {
-    case COMPRESSION_NONE: return NSTIFFCompressionNone;
-    case COMPRESSION_CCITTFAX3: return NSTIFFCompressionCCITTFAX3;
-    case COMPRESSION_CCITTFAX4: return NSTIFFCompressionCCITTFAX4;
-    case COMPRESSION_LZW: return NSTIFFCompressionLZW;
-    case COMPRESSION_JPEG: return NSTIFFCompressionJPEG;
-    case COMPRESSION_NEXT: return NSTIFFCompressionNEXT;
-    case COMPRESSION_PACKBITS: return NSTIFFCompressionPackBits;
-    case COMPRESSION_OJPEG: return NSTIFFCompressionOldJPEG;
-    default:
-      break;
-   }
-  return NSTIFFCompressionNone;
-}
+/* 255 * 65536 / a rounded up, so that (v * table[a]) >> 16 equals
+   v * 255 / a rounded down for all v <= a. */
+static uint32_t gs_unpremultiply_table[256];
 
-+ (BOOL) _bitmapIsTIFF: (NSData *)data
+static void
+gs_init_unpremultiply_table(void)
 {
-  TIFF *image = NSTiffOpenDataRead((char *)[data bytes], [data length]);
+  unsigned a;
 
-  if (image != NULL)
-    {
-      NSTiffClose(image);
-      return YES;
-    }
-  else
+  gs_unpremultiply_table[0] = 0;
+  for (a = 1; a < 256; a++)
     {
-      return NO;
+      gs_unpremultiply_table[a] = ((255 << 16) + a - 1) / a;
     }
 }
 
-+ (NSArray*) _imageRepsWithTIFFData: (NSData *)imageData
+/* Unpremultiplies a row of 8 bit interleaved pixels with spp samples
+   and the alpha sample at index ai. */
+static void
+gs_unpremultiply_row8(unsigned char *p, NSInteger width, int spp, int ai)
 {
-  int		 i, images;
-  TIFF		 *image;
-  NSMutableArray *array;
+  NSInteger x;
 
-  image = NSTiffOpenDataRead((char *)[imageData bytes], [imageData length]);
-  if (image == NULL)
+  for (x = 0; x < width; x++, p += spp)
+    {
+      unsigned a = p[ai];
+
+      if (a != 0 && a != 255)
+        {
+          uint32_t r = gs_unpremultiply_table[a];
+          int i;
+
+          for (i = 0; i < spp; i++)
+            {
+              if (i != ai)
+                {
+                  uint32_t c = (p[i] * r) >> 16;
+
+                  p[i] = (c >= 255) ? 255 : c;
+                }
+            }
+        }
+    }
+}
+
+/* Returns the address of sample s of the row y, and the distance between
+   the samples of neighbouring pixels. */
+static inline unsigned char *
+gs_row_sample(const GSRowLayout *l, NSInteger y, int s, NSInteger *step)
+{
+  int bytes = l->bps / 8;
+
+  if (l->planar)
+    {
+      *step = bytes;
+      return l->planes[s] + y * l->bytesPerRow;
+    }
+  *step = bytes * (l->colors + (l->hasAlpha ? 1 : 0));
+  return l->planes[0] + y * l->bytesPerRow + s * bytes;
+}
+
+/* Reads row y into work, which holds colors + 1 16 bit values per pixel
+   with alpha last. */
+static void
+gs_load_row(const GSRowLayout *l, NSInteger y, NSInteger width,
+            uint16_t *work)
+{
+  int n = l->colors + 1;
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      uint16_t *w = work + i;
+      NSInteger x, step;
+      unsigned char *p;
+      int s;
+
+      if (i == l->colors)
+        {
+          if (!l->hasAlpha)
+            {
+              for (x = 0; x < width; x++, w += n)
+                *w = 0xffff;
+              continue;
+            }
+          s = l->alphaFirst ? 0 : l->colors;
+        }
+      else
+        {
+          s = (l->hasAlpha && l->alphaFirst) ? i + 1 : i;
+        }
+
+      p = gs_row_sample(l, y, s, &step);
+      if (l->bps == 8)
+        {
+          for (x = 0; x < width; x++, p += step, w += n)
+            *w = *p * 257;
+        }
+      else
+        {
+          for (x = 0; x < width; x++, p += step, w += n)
+            *w = (p[0] << 8) | p[1];
+        }
+    }
+}
+
+/* Writes work, as filled by gs_load_row(), to row y. */
+static void
+gs_store_row(const GSRowLayout *l, NSInteger y, NSInteger width,
+             const uint16_t *work)
+{
+  int n = l->colors + 1;
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      const uint16_t *w = work + i;
+      NSInteger x, step;
+      unsigned char *p;
+      int s;
+
+      if (i == l->colors)
+        {
+          if (!l->hasAlpha)
+            continue;
+          s = l->alphaFirst ? 0 : l->colors;
+        }
+      else
+        {
+          s = (l->hasAlpha && l->alphaFirst) ? i + 1 : i;
+        }
+
+      p = gs_row_sample(l, y, s, &step);
+      if (l->bps == 8)
+        {
+          // Exact for values that are multiples of 257
+          for (x = 0; x < width; x++, p += step, w += n)
+            *p = (*w * 255u + 32895) >> 16;
+        }
+      else
+        {
+          for (x = 0; x < width; x++, p += step, w += n)
+            {
+              p[0] = *w >> 8;
+              p[1] = *w & 0xff;
+            }
+        }
+    }
+}
+
+/* Multiplies or divides the colors of a row in work by alpha. */
+static void
+gs_premultiply_work(uint16_t *work, NSInteger width, int colors,
+                    BOOL premultiply)
+{
+  int n = colors + 1;
+  NSInteger x;
+
+  for (x = 0; x < width; x++, work += n)
+    {
+      uint32_t a = work[colors];
+      int i;
+
+      if (a == 0xffff)
+        continue;
+      for (i = 0; i < colors; i++)
+        {
+          uint32_t v = work[i];
+
+          if (premultiply)
+            {
+              // Rounds v * a / 65535 like the 8 bit kernel above
+              uint32_t t = v * a + 0x8000;
+
+              v = ((t >> 16) + t) >> 16;
+            }
+          else if (a != 0)
+            {
+              v = (v * 65535 + a / 2) / a;
+              if (v > 0xffff)
+                v = 0xffff;
+            }
+          work[i] = v;
+        }
+    }
+}
+
+/* Moves the start of the rows of layout x pixels to the right. */
+static void
+gs_offset_layout(GSRowLayout *l, NSInteger x)
+{
+  int spp = l->colors + (l->hasAlpha ? 1 : 0);
+  int bytes = l->bps / 8;
+  int i;
+
+  if (l->planar)
+    {
+      for (i = 0; i < spp; i++)
+        {
+          l->planes[i] += x * bytes;
+        }
+    }
+  else
+    {
+      l->planes[0] += x * bytes * spp;
+    }
+}
+
+/* Returns the sample of bps bits at bit offset bit of base, scaled to
+   16 bits, for the layouts the row kernels do not handle. */
+static inline uint16_t
+gs_get_sample(unsigned char *base, long bit, int bps, BOOL isFloat)
+{
+  unsigned char *p = base + bit / 8;
+
+  if (bps == 32 && isFloat)
+    {
+      float f;
+
+      memcpy(&f, p, sizeof(float));
+      if (!(f > 0.0))
+        return 0;
+      return (f >= 1.0) ? 0xffff : (uint16_t)(f * 65535 + 0.5);
+    }
+  else if (bps == 16 || bps == 32)
+    {
+      return (p[0] << 8) | p[1];
+    }
+  else
+    {
+      unsigned int max = (1 << bps) - 1;
+
+      return (_get_bit_value(base, bit, bps) * 65535 + max / 2) / max;
+    }
+}
+
+/* Stores the 16 bit value v as a sample of bps bits at bit offset bit
+   of base. */
+static inline void
+gs_set_sample(unsigned char *base, long bit, int bps, BOOL isFloat,
+              uint16_t v)
+{
+  unsigned char *p = base + bit / 8;
+
+  if (bps == 32 && isFloat)
+    {
+      float f = v / 65535.0f;
+
+      memcpy(p, &f, sizeof(float));
+    }
+  else if (bps == 32)
+    {
+      // v * 65537
+      p[0] = p[2] = v >> 8;
+      p[1] = p[3] = v & 0xff;
+    }
+  else if (bps == 16)
+    {
+      p[0] = v >> 8;
+      p[1] = v & 0xff;
+    }
+  else
+    {
+      unsigned int max = (1 << bps) - 1;
+
+      _set_bit_value(base, bit, bps, (v * max + 32767) / 65535);
+    }
+}
+
+/* The colour models the RGBA accessors convert from and to. */
+typedef enum
+{
+  GSRGBAModelNone,
+  GSRGBAModelRGB,
+  GSRGBAModelWhite,
+  GSRGBAModelBlack,
+  GSRGBAModelCMYK
+} GSRGBAModel;
+
+static GSRGBAModel
+gs_rgba_model(NSString *colorSpace, NSInteger colors)
+{
+  if ([colorSpace isEqualToString: NSDeviceRGBColorSpace]
+      || [colorSpace isEqualToString: NSCalibratedRGBColorSpace])
+    {
+      return (colors == 3) ? GSRGBAModelRGB : GSRGBAModelNone;
+    }
+  if ([colorSpace isEqualToString: NSDeviceWhiteColorSpace]
+      || [colorSpace isEqualToString: NSCalibratedWhiteColorSpace])
+    {
+      return (colors == 1) ? GSRGBAModelWhite : GSRGBAModelNone;
+    }
+  if ([colorSpace isEqualToString: NSDeviceBlackColorSpace]
+      || [colorSpace isEqualToString: NSCalibratedBlackColorSpace])
+    {
+      return (colors == 1) ? GSRGBAModelBlack : GSRGBAModelNone;
+    }
+  if ([colorSpace isEqualToString: NSDeviceCMYKColorSpace])
+    {
+      return (colors == 4) ? GSRGBAModelCMYK : GSRGBAModelNone;
+    }
+  return GSRGBAModelNone;
+}
+
+/* Converts a row in work, as filled by gs_load_row(), to 16 bit RGBA.
+   CMYK is converted the way NSColor does it. */
+static void
+gs_work_to_rgba(const uint16_t *work, NSInteger width, int colors,
+                GSRGBAModel model, uint16_t *rgba)
+{
+  int n = colors + 1;
+  NSInteger x;
+
+  for (x = 0; x < width; x++, work += n, rgba += 4)
+    {
+      uint32_t white;
+      int i;
+
+      switch (model)
+        {
+          case GSRGBAModelWhite:
+            rgba[0] = rgba[1] = rgba[2] = work[0];
+            break;
+          case GSRGBAModelBlack:
+            rgba[0] = rgba[1] = rgba[2] = 0xffff - work[0];
+            break;
+          case GSRGBAModelCMYK:
+            white = 0xffff - work[3];
+            for (i = 0; i < 3; i++)
+              {
+                rgba[i] = (work[i] > white) ? 0 : white - work[i];
+              }
+            break;
+          default:
+            rgba[0] = work[0];
+            rgba[1] = work[1];
+            rgba[2] = work[2];
+            break;
+        }
+      rgba[3] = work[colors];
+    }
+}
+
+/* The reverse of gs_work_to_rgba(), again converting like NSColor. */
+static void
+gs_rgba_to_work(const uint16_t *rgba, NSInteger width, int colors,
+                GSRGBAModel model, uint16_t *work)
+{
+  int n = colors + 1;
+  NSInteger x;
+
+  for (x = 0; x < width; x++, work += n, rgba += 4)
+    {
+      uint32_t white;
+
+      switch (model)
+        {
+          case GSRGBAModelWhite:
+          case GSRGBAModelBlack:
+            white = (rgba[0] + rgba[1] + rgba[2] + 1) / 3;
+            work[0] = (model == GSRGBAModelWhite) ? white : 0xffff - white;
+            break;
+          case GSRGBAModelCMYK:
+            work[0] = 0xffff - rgba[0];
+            work[1] = 0xffff - rgba[1];
+            work[2] = 0xffff - rgba[2];
+            work[3] = 0;
+            break;
+          default:
+            work[0] = rgba[0];
+            work[1] = rgba[1];
+            work[2] = rgba[2];
+            break;
+        }
+      work[colors] = rgba[3];
+    }
+}
+
+/* Narrows count 16 bit samples to 8 bits, rounding as gs_store_row()
+   does: ((v * 255 + 32895) >> 16) equals (t - (t >> 8)) >> 8 with
+   t = v + 128 saturated at 0xffff. */
+static void
+gs_narrow_samples(const uint16_t *src, unsigned char *dst, NSInteger count)
+{
+  NSInteger i = 0;
+
+#if defined(__SSE2__)
+  {
+    const __m128i half = _mm_set1_epi16(0x80);
+
+    for (; i + 16 <= count; i += 16)
+      {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(src + i + 8));
+
+        lo = _mm_adds_epu16(lo, half);
+        hi = _mm_adds_epu16(hi, half);
+        lo = _mm_srli_epi16(_mm_sub_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_sub_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+      }
+  }
+#elif defined(__ARM_NEON)
+  {
+    const uint16x8_t half = vdupq_n_u16(0x80);
+
+    for (; i + 8 <= count; i += 8)
+      {
+        uint16x8_t t = vqaddq_u16(vld1q_u16(src + i), half);
+
+        vst1_u8(dst + i, vshrn_n_u16(vsubq_u16(t, vshrq_n_u16(t, 8)), 8));
+      }
+  }
+#endif
+
+  for (; i < count; i++)
+    {
+      dst[i] = (src[i] * 255u + 32895) >> 16;
+    }
+}
+
+/* Widens count 8 bit samples to 16 bits (v * 257). */
+static void
+gs_widen_samples(const unsigned char *src, uint16_t *dst, NSInteger count)
+{
+  NSInteger i = 0;
+
+#if defined(__SSE2__)
+  for (; i + 16 <= count; i += 16)
+    {
+      __m128i px = _mm_loadu_si128((const __m128i *)(src + i));
+
+      _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi8(px, px));
+      _mm_storeu_si128((__m128i *)(dst + i + 8), _mm_unpackhi_epi8(px, px));
+    }
+#elif defined(__ARM_NEON)
+  for (; i + 8 <= count; i += 8)
+    {
+      uint16x8_t v = vmovl_u8(vld1_u8(src + i));
+
+      vst1q_u16(dst + i, vorrq_u16(vshlq_n_u16(v, 8), v));
+    }
+#endif
+
+  for (; i < count; i++)
+    {
+      dst[i] = src[i] * 257;
+    }
+}
+
+static void
+gs_samples_to_float(const uint16_t *src, float *dst, NSInteger count)
+{
+  NSInteger i;
+
+  for (i = 0; i < count; i++)
+    {
+      dst[i] = src[i] * (1.0f / 65535);
+    }
+}
+
+static void
+gs_samples_from_float(const float *src, uint16_t *dst, NSInteger count)
+{
+  NSInteger i;
+
+  for (i = 0; i < count; i++)
+    {
+      float f = src[i];
+
+      if (!(f > 0.0f))
+        dst[i] = 0;
+      else
+        dst[i] = (f >= 1.0f) ? 0xffff : (uint16_t)(f * 65535 + 0.5f);
+    }
+}
+
+/* Copies a row of 8 bit ARGB pixels to RGBA (toAlphaLast) or back. */
+static void
+gs_rotate_row4(const unsigned char *src, unsigned char *dst,
+               NSInteger width, BOOL toAlphaLast)
+{
+  NSInteger x = 0;
+
+#if defined(__SSE2__)
+  /* The pixels are little endian 32 bit values in the registers */
+  for (; x + 4 <= width; x += 4)
+    {
+      __m128i px = _mm_loadu_si128((const __m128i *)(src + 4 * x));
+
+      if (toAlphaLast)
+        px = _mm_or_si128(_mm_srli_epi32(px, 8), _mm_slli_epi32(px, 24));
+      else
+        px = _mm_or_si128(_mm_slli_epi32(px, 8), _mm_srli_epi32(px, 24));
+      _mm_storeu_si128((__m128i *)(dst + 4 * x), px);
+    }
+#elif defined(__ARM_NEON)
+  for (; x + 8 <= width; x += 8)
+    {
+      uint8x8x4_t px = vld4_u8(src + 4 * x);
+      uint8x8x4_t out;
+      int i;
+
+      for (i = 0; i < 4; i++)
+        {
+          out.val[i] = px.val[toAlphaLast ? (i + 1) % 4 : (i + 3) % 4];
+        }
+      vst4_u8(dst + 4 * x, out);
+    }
+#endif
+
+  for (; x < width; x++)
+    {
+      const unsigned char *p = src + 4 * x;
+      unsigned char *q = dst + 4 * x;
+      int i;
+
+      for (i = 0; i < 4; i++)
+        {
+          q[i] = p[toAlphaLast ? (i + 1) % 4 : (i + 3) % 4];
+        }
+    }
+}
+
+/* Copies a row of 8 bit RGB pixels to opaque RGBA ones. */
+static void
+gs_add_alpha_row3(const unsigned char *src, unsigned char *dst,
+                  NSInteger width)
+{
+  NSInteger x = 0;
+
+#if defined(__ARM_NEON)
+  for (; x + 8 <= width; x += 8)
+    {
+      uint8x8x3_t px = vld3_u8(src + 3 * x);
+      uint8x8x4_t out;
+
+      out.val[0] = px.val[0];
+      out.val[1] = px.val[1];
+      out.val[2] = px.val[2];
+      out.val[3] = vdup_n_u8(255);
+      vst4_u8(dst + 4 * x, out);
+    }
+#endif
+
+  for (; x < width; x++)
+    {
+      dst[4 * x] = src[3 * x];
+      dst[4 * x + 1] = src[3 * x + 1];
+      dst[4 * x + 2] = src[3 * x + 2];
+      dst[4 * x + 3] = 255;
+    }
+}
+
+/* Copies a row of 8 bit RGBA pixels to RGB ones, dropping alpha. */
+static void
+gs_drop_alpha_row4(const unsigned char *src, unsigned char *dst,
+                   NSInteger width)
+{
+  NSInteger x = 0;
+
+#if defined(__ARM_NEON)
+  for (; x + 8 <= width; x += 8)
+    {
+      uint8x8x4_t px = vld4_u8(src + 4 * x);
+      uint8x8x3_t out;
+
+      out.val[0] = px.val[0];
+      out.val[1] = px.val[1];
+      out.val[2] = px.val[2];
+      vst3_u8(dst + 3 * x, out);
+    }
+#endif
+
+  for (; x < width; x++)
+    {
+      dst[3 * x] = src[4 * x];
+      dst[3 * x + 1] = src[4 * x + 1];
+      dst[3 * x + 2] = src[4 * x + 2];
+    }
+}
+
+/* Returns the colour space of a TIFF image.  8-bit palette images will
+   be converted to 24-bit RGB by the tiff routines, so account for this. */
+static NSString *
+tiff_color_space(NSTiffInfo *info)
+{
+  switch (info->photoInterp) 
+    {
+    case PHOTOMETRIC_MINISBLACK: return NSDeviceWhiteColorSpace;
+    case PHOTOMETRIC_MINISWHITE: return NSDeviceBlackColorSpace;
+    case PHOTOMETRIC_RGB: return NSDeviceRGBColorSpace;
+    case PHOTOMETRIC_PALETTE: 
+      info->samplesPerPixel = 3;
+      return NSDeviceRGBColorSpace;
+    default:
+      return nil;
+    }
+}
+
+@implementation NSBitmapImageRep (GSPrivate)
+
+/* The state kept by the decoder between incremental loads. */
+- (id) _loadState
+{
+  GSIncrementalLoad *load;
+  id state = nil;
+
+  [incrementalLock lock];
+  load = incremental_load(self, NO);
+  if (load != NULL)
+    {
+      state = load->state;
+    }
+  [incrementalLock unlock];
+  return state;
+}
+
+- (void) _setLoadState: (id)state
+{
+  GSIncrementalLoad *load;
+  id old;
+
+  [incrementalLock lock];
+  load = incremental_load(self, YES);
+  old = load->state;
+  load->state = RETAIN(state);
+  [incrementalLock unlock];
+  // The decoder state may free library resources, do so unlocked
+  RELEASE(old);
+}
+
+/* Gives a receiver made by -initForIncrementalLoad a cleared meshed
+   bitmap once the decoder knows its layout. Unlike running the
+   designated initializer again, this never releases the receiver.
+   Returns NO if the layout is invalid or the receiver already has a
+   bitmap. */
+- (BOOL) _allocateBitmapPixelsWide: (NSInteger)width
+                        pixelsHigh: (NSInteger)height
+                     bitsPerSample: (NSInteger)bps
+                   samplesPerPixel: (NSInteger)spp
+                          hasAlpha: (BOOL)alpha
+                    colorSpaceName: (NSString*)colorSpaceName
+                      bitmapFormat: (NSBitmapFormat)bitmapFormat
+                       bytesPerRow: (NSInteger)rowBytes
+                      bitsPerPixel: (NSInteger)pixelBits
+{
+  NSUInteger length;
+  unsigned int i;
+
+  if (_imagePlanes != NULL || width <= 0 || height <= 0
+    || bps <= 0 || spp <= 0)
+    {
+      return NO;
+    }
+  if (!pixelBits)
+    pixelBits = bps * spp;
+  if (!rowBytes)
+    rowBytes = ceil((float)width * pixelBits / 8);
+  if (rowBytes < (width * pixelBits + 7) / 8
+    || (NSUInteger)height > NSUIntegerMax / rowBytes)
+    {
+      return NO;
+    }
+  length = (NSUInteger)rowBytes * height;
+  _imageData = [[NSMutableData alloc] initWithLength: length];
+  if (_imageData == nil)
+    {
+      return NO;
+    }
+
+  _pixelsWide = width;
+  _pixelsHigh = height;
+  _size.width  = width;
+  _size.height = height;
+  _bitsPerSample = bps;
+  _numColors  = spp;
+  _hasAlpha   = alpha;
+  _isPlanar   = NO;
+  ASSIGN(_colorSpace, colorSpaceName);
+  _format = bitmapFormat;
+  _bitsPerPixel = pixelBits;
+  _bytesPerRow = rowBytes;
+  _imagePlanes = NSAllocateCollectable(sizeof(unsigned char*) * MAX_PLANES, 0);
+  _imagePlanes[0] = [(NSMutableData*)_imageData mutableBytes];
+  for (i = 1; i < MAX_PLANES; i++)
+    _imagePlanes[i] = NULL;
+
+  // The cleared alpha channel is transparent
+  [self setOpaque: !alpha];
+  if (_properties == nil)
+    {
+      _properties = [[NSMutableDictionary alloc] init];
+    }
+  return YES;
+}
+
+/* Writes the receiver in the format storageType to output, an
+   NSMutableData or an NSFileHandle. */
+- (BOOL) _writeRepresentationUsingType: (NSBitmapImageFileType)storageType
+                            properties: (NSDictionary *)properties
+                                    to: (id)output
+{
+  NSData *data;
+
+  if (properties == nil)
+    {
+      properties = _properties;
+    }
+  switch (storageType)
+    {
+      case NSJPEGFileType:
+        return [self _writeJPEGWithProperties: properties
+                                           to: output
+                                 errorMessage: NULL];
+      case NSPNGFileType:
+        return [self _writePNGWithProperties: properties
+                                          to: output];
+      default:
+        break;
+    }
+
+  data = [self representationUsingType: storageType properties: properties];
+  if (data == nil)
+    {
+      return NO;
+    }
+  if ([output isKindOfClass: [NSFileHandle class]])
+    {
+      NS_DURING
+        {
+          [output writeData: data];
+        }
+      NS_HANDLER
+        {
+          return NO;
+        }
+      NS_ENDHANDLER
+    }
+  else
+    {
+      [output appendData: data];
+    }
+  return YES;
+}
+
+/* Encodes each of imageReps to the output at the same index of outputs
+   on encodeQueue, and returns the finished GSImageEncodeOperations. A
+   single image is encoded on the calling thread, and so are all of them
+   when called from encodeQueue itself, where waiting for other
+   operations could use up the threads they need. A rep given more than
+   once is encoded by one operation at a time, so that a deferred rep is
+   not decoded by two threads at once. */
++ (NSArray *) _encodeImageReps: (NSArray *)imageReps
+                     usingType: (NSBitmapImageFileType)storageType
+                    properties: (NSDictionary *)properties
+                            to: (NSArray *)outputs
+{
+  NSUInteger i, count = [imageReps count];
+  NSMutableArray *ops = [NSMutableArray arrayWithCapacity: count];
+  NSMapTable *lastOps;
+
+  lastOps = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                             NSNonOwnedPointerMapValueCallBacks, count);
+  for (i = 0; i < count; i++)
+    {
+      GSImageEncodeOperation *op = [GSImageEncodeOperation new];
+      GSImageEncodeOperation *previous;
+
+      op->rep = RETAIN([imageReps objectAtIndex: i]);
+      op->type = storageType;
+      op->properties = RETAIN(properties);
+      op->output = RETAIN([outputs objectAtIndex: i]);
+      previous = NSMapGet(lastOps, op->rep);
+      if (previous != nil)
+        {
+          [op addDependency: previous];
+        }
+      NSMapInsert(lastOps, op->rep, op);
+      [ops addObject: op];
+      RELEASE(op);
+    }
+  NSFreeMapTable(lastOps);
+
+  if (count == 1 || [NSOperationQueue currentQueue] == encodeQueue)
+    {
+      for (i = 0; i < count; i++)
+        {
+          [[ops objectAtIndex: i] main];
+        }
+      return ops;
+    }
+  for (i = 0; i < count; i++)
+    {
+      [encodeQueue addOperation: [ops objectAtIndex: i]];
+    }
+  for (i = 0; i < count; i++)
+    {
+      [[ops objectAtIndex: i] waitUntilFinished];
+    }
+  return ops;
+}
+
+/* Loads the first image in imageData using the reader for its format. */
+- (id) _initWithData: (NSData *)imageData format: (GSImageFormat *)format
+{
+  switch (format->type)
+    {
+      case GSImageFormatDecoder:
+        RELEASE(self);
+        return [[format->decoder alloc] initWithData: imageData];
+      case GSImageFormatPNG:
+        return [self _initBitmapFromPNG: imageData];
+      case GSImageFormatPNM:
+        return [self _initBitmapFromPNM: imageData
+                           errorMessage: NULL];
+      case GSImageFormatJPEG:
+        return [self _initBitmapFromJPEG: imageData
+                            errorMessage: NULL];
+      case GSImageFormatGIF:
+        return [self _initBitmapFromGIF: imageData
+                           errorMessage: NULL];
+      case GSImageFormatICNS:
+        return [self _initBitmapFromICNS: imageData];
+      case GSImageFormatTIFF:
+        return [self _initBitmapFromTIFF: imageData];
+    }
+
+  DESTROY(self);
+  return nil;
+}
+
++ (int) _localFromCompressionType: (NSTIFFCompression)type
+{
+  switch (type)
+    {
+    case NSTIFFCompressionNone: return COMPRESSION_NONE;
+    case NSTIFFCompressionCCITTFAX3: return COMPRESSION_CCITTFAX3;
+    case NSTIFFCompressionCCITTFAX4: return COMPRESSION_CCITTFAX4;
+    case NSTIFFCompressionLZW: return COMPRESSION_LZW;
+    case NSTIFFCompressionJPEG: return COMPRESSION_JPEG;
+    case NSTIFFCompressionNEXT: return COMPRESSION_NEXT;
+    case NSTIFFCompressionPackBits: return COMPRESSION_PACKBITS;
+    case NSTIFFCompressionOldJPEG: return COMPRESSION_OJPEG;
+    default:
+      break;
+    }
+  return COMPRESSION_NONE;
+}
+
++ (NSTIFFCompression) _compressionTypeFromLocal: (int)type
+{
+  switch (type)
+    {
+    case COMPRESSION_NONE: return NSTIFFCompressionNone;
+    case COMPRESSION_CCITTFAX3: return NSTIFFCompressionCCITTFAX3;
+    case COMPRESSION_CCITTFAX4: return NSTIFFCompressionCCITTFAX4;
+    case COMPRESSION_LZW: return NSTIFFCompressionLZW;
+    case COMPRESSION_JPEG: return NSTIFFCompressionJPEG;
+    case COMPRESSION_NEXT: return NSTIFFCompressionNEXT;
+    case COMPRESSION_PACKBITS: return NSTIFFCompressionPackBits;
+    case COMPRESSION_OJPEG: return NSTIFFCompressionOldJPEG;
+    default:
+      break;
+   }
+  return NSTIFFCompressionNone;
+}
+
++ (NSArray*) _imageRepsWithTIFFData: (NSData *)imageData
+{
+  int		 i, images;
+  TIFF		 *image;
+  NSMutableArray *array;
+
+  image = NSTiffOpenDataRead((char *)[imageData bytes], [imageData length]);
+  if (image == NULL)
     {
       NSLog(@"NSBitmapImageRep: unable to parse TIFF data");
       return [NSArray array];
@@ -1926,7 +3446,18 @@ _set_bit_value(unsigned char *base, long msb_off, int bit_width,
   for (i = 0; i < images; i++)
     {
       NSBitmapImageRep* imageRep;
-      imageRep = [[self alloc] _initFromTIFFImage: image number: i];
+
+      /* Only the image NSImage picks needs its pixels, so leave the
+         decoding of each directory until it is used. */
+      if (images > 1 && self == [NSBitmapImageRep class])
+        imageRep = [[GSDeferredBitmapImageRep alloc]
+                     _initDeferredFromTIFFImage: image
+                                         number: i
+                                           data: imageData];
+      else
+        imageRep = [[self alloc] _initFromTIFFImage: image
+                                             number: i
+                                               data: imageData];
       if (imageRep)
 	{
 	  [array addObject: imageRep];
@@ -1939,6 +3470,14 @@ _set_bit_value(unsigned char *base, long msb_off, int bit_width,
 }
 
 - (NSBitmapImageRep *) _initBitmapFromTIFF: (NSData *)imageData
+{
+  return [self _initBitmapFromTIFF: imageData frame: -1];
+}
+
+/* Reads directory frame of the TIFF data, or the current one if frame
+   is -1. */
+- (NSBitmapImageRep *) _initBitmapFromTIFF: (NSData *)imageData
+                                     frame: (NSInteger)frame
 {
   TIFF *image = NSTiffOpenDataRead((char *)[imageData bytes], [imageData length]);
 
@@ -1949,19 +3488,66 @@ _set_bit_value(unsigned char *base, long msb_off, int bit_width,
       return nil;
     }
 
-  [self _initFromTIFFImage: image number: -1];
+  self = [self _initFromTIFFImage: image number: frame data: imageData];
   NSTiffClose(image);
   return self;
 }
 
 /* Given a TIFF image (from the libtiff library), load the image information
    into our data structure.  Reads the specified image. */
-- (NSBitmapImageRep *) _initFromTIFFImage: (TIFF *)image number: (int)imageNumber
+- (NSBitmapImageRep *) _initFromTIFFImage: (TIFF *)image
+                                    number: (int)imageNumber
+                                      data: (NSData *)imageData
+{
+  NSString* space;
+  NSTiffInfo* info;
+
+  /* Seek to the correct image and get the dictionary information */
+  info = NSTiffGetInfo(imageNumber, image);
+  if (!info) 
+    {
+      RELEASE(self);
+      NSLog(@"Tiff read invalid TIFF info in directory %d", imageNumber);
+      return nil;
+    }
+
+  space = tiff_color_space(info);
+
+  [self initWithBitmapDataPlanes: NULL
+        pixelsWide: info->width
+        pixelsHigh: info->height
+        bitsPerSample: info->bitsPerSample
+        samplesPerPixel: info->samplesPerPixel
+        hasAlpha: (info->extraSamples > 0)
+        isPlanar: (info->planarConfig == PLANARCONFIG_SEPARATE)
+        colorSpaceName: space
+        bitmapFormat: (info->assocAlpha ? 0 : 
+                       NSAlphaNonpremultipliedBitmapFormat)
+        bytesPerRow: 0
+        bitsPerPixel: 0];
+  [self _setPropertiesFromTIFFInfo: info];
+
+  if (NSTiffRead(image, info, [self bitmapData]))
+    {
+      free(info);
+      RELEASE(self);
+      NSLog(@"Tiff read invalid TIFF image data in directory %d", imageNumber);
+      return nil;
+    }
+  free(info);
+
+  return self;
+}
+
+/* Describes the specified image of a TIFF without reading its pixels,
+   which are decoded by -_initBitmapFromTIFF:frame: when first used. */
+- (NSBitmapImageRep *) _initDeferredFromTIFFImage: (TIFF *)image
+                                           number: (int)imageNumber
+                                             data: (NSData *)imageData
 {
   NSString* space;
   NSTiffInfo* info;
 
-  /* Seek to the correct image and get the dictionary information */
   info = NSTiffGetInfo(imageNumber, image);
   if (!info) 
     {
@@ -1970,34 +3556,28 @@ _set_bit_value(unsigned char *base, long msb_off, int bit_width,
       return nil;
     }
 
-  /* 8-bit RGB will be converted to 24-bit by the tiff routines, so account
-     for this. */
-  space = nil;
-  switch(info->photoInterp) 
-    {
-    case PHOTOMETRIC_MINISBLACK: space = NSDeviceWhiteColorSpace; break;
-    case PHOTOMETRIC_MINISWHITE: space = NSDeviceBlackColorSpace; break;
-    case PHOTOMETRIC_RGB: space = NSDeviceRGBColorSpace; break;
-    case PHOTOMETRIC_PALETTE: 
-      space = NSDeviceRGBColorSpace; 
-      info->samplesPerPixel = 3;
-      break;
-    default:
-      break;
-    }
-
-  [self initWithBitmapDataPlanes: NULL
-        pixelsWide: info->width
-        pixelsHigh: info->height
-        bitsPerSample: info->bitsPerSample
+  space = tiff_color_space(info);
+  self = [(GSDeferredBitmapImageRep *)self
+           initWithData: imageData
+                  frame: imageNumber
+                decoder: @selector(_initBitmapFromTIFF:frame:)
+             pixelsWide: info->width
+             pixelsHigh: info->height
+          bitsPerSample: info->bitsPerSample
         samplesPerPixel: info->samplesPerPixel
-        hasAlpha: (info->extraSamples > 0)
-        isPlanar: (info->planarConfig == PLANARCONFIG_SEPARATE)
-        colorSpaceName: space
-        bitmapFormat: (info->assocAlpha ? 0 : 
-                       NSAlphaNonpremultipliedBitmapFormat)
-        bytesPerRow: 0
-        bitsPerPixel: 0];
+               hasAlpha: (info->extraSamples > 0)
+               isPlanar: (info->planarConfig == PLANARCONFIG_SEPARATE)
+         colorSpaceName: space
+           bitmapFormat: (info->assocAlpha ? 0 : 
+                          NSAlphaNonpremultipliedBitmapFormat)];
+  [self _setPropertiesFromTIFFInfo: info];
+  free(info);
+
+  return self;
+}
+
+- (void) _setPropertiesFromTIFFInfo: (NSTiffInfo *)info
+{
   _compression = [NSBitmapImageRep _compressionTypeFromLocal: info->compression];
   _comp_factor = (((float)info->quality)/100.0);
 
@@ -2014,17 +3594,6 @@ _set_bit_value(unsigned char *base, long msb_off, int bit_width,
 				    (double)info->height * (72.0 / (double)info->ydpi));
       [self setSize: pointSize];
     }
-
-  if (NSTiffRead(image, info, [self bitmapData]))
-    {
-      free(info);
-      RELEASE(self);
-      NSLog(@"Tiff read invalid TIFF image data in directory %d", imageNumber);
-      return nil;
-    }
-  free(info);
-
-  return self;
 }
 
 - (void) _fillTIFFInfo: (NSTiffInfo*)info
@@ -2086,6 +3655,7 @@ _set_bit_value(unsigned char *base, long msb_off, int bit_width,
   SEL setPSel = @selector(setPixel:atX:y:);
   IMP getP = [self methodForSelector: getPSel];
   IMP setP = [self methodForSelector: setPSel];
+  GSRowLayout layout;
 
   if (!_hasAlpha || !(_format & NSAlphaNonpremultipliedBitmapFormat))
     return;
@@ -2103,11 +3673,34 @@ _set_bit_value(unsigned char *base, long msb_off, int bit_width,
       end = _numColors - 1;
     }
 
-  if (_bitsPerSample == 8)
+  if (_bitsPerSample == 8 && !_isPlanar && _numColors == 4
+      && _bitsPerPixel == 32)
+    {
+      // Optimize for the most common case
+      for (y = 0; y < _pixelsHigh; y++)
+        {
+          gs_premultiply_row4(_imagePlanes[0] + _bytesPerRow * y,
+                              _pixelsWide, ai);
+        }
+    }
+  else if (!(_bitsPerSample == 8 && !_isPlanar)
+           && [self _getRowLayout: &layout])
+    {
+      uint16_t *work;
+
+      work = malloc(sizeof(uint16_t) * (layout.colors + 1) * _pixelsWide);
+      for (y = 0; y < _pixelsHigh; y++)
+        {
+          gs_load_row(&layout, y, _pixelsWide, work);
+          gs_premultiply_work(work, _pixelsWide, layout.colors, YES);
+          gs_store_row(&layout, y, _pixelsWide, work);
+        }
+      free(work);
+    }
+  else if (_bitsPerSample == 8)
     {
       if (!_isPlanar)
         {
-          // Optimize for the most common case
           NSUInteger a;
           NSInteger offset;
           NSInteger line_offset;
@@ -2204,6 +3797,7 @@ _set_bit_value(unsigned char *base, long msb_off, int bit_width,
   SEL setPSel = @selector(setPixel:atX:y:);
   IMP getP = [self methodForSelector: getPSel];
   IMP setP = [self methodForSelector: setPSel];
+  GSRowLayout layout;
 
   if (!_hasAlpha || (_format & NSAlphaNonpremultipliedBitmapFormat))
     return;
@@ -2221,11 +3815,36 @@ _set_bit_value(unsigned char *base, long msb_off, int bit_width,
       end = _numColors - 1;
     }
 
-  if (_bitsPerSample == 8)
+  if (_bitsPerSample == 8 && !_isPlanar && _bitsPerPixel == 8 * _numColors)
+    {
+      // Optimize for the most common case
+      if (gs_unpremultiply_table[255] == 0)
+        {
+          gs_init_unpremultiply_table();
+        }
+      for (y = 0; y < _pixelsHigh; y++)
+        {
+          gs_unpremultiply_row8(_imagePlanes[0] + _bytesPerRow * y,
+                                _pixelsWide, _numColors, ai);
+        }
+    }
+  else if ([self _getRowLayout: &layout])
+    {
+      uint16_t *work;
+
+      work = malloc(sizeof(uint16_t) * (layout.colors + 1) * _pixelsWide);
+      for (y = 0; y < _pixelsHigh; y++)
+        {
+          gs_load_row(&layout, y, _pixelsWide, work);
+          gs_premultiply_work(work, _pixelsWide, layout.colors, NO);
+          gs_store_row(&layout, y, _pixelsWide, work);
+        }
+      free(work);
+    }
+  else if (_bitsPerSample == 8)
     {
       if (!_isPlanar)
         {
-          // Optimize for the most common case
           NSUInteger a;
           NSInteger offset;
           NSInteger line_offset;
@@ -2335,6 +3954,472 @@ _set_bit_value(unsigned char *base, long msb_off, int bit_width,
   _format |= NSAlphaNonpremultipliedBitmapFormat;
 }
 
+/* Fills in layout when the samples of the receiver can be handled by
+   the row kernels, that is 8 or 16 bit integer samples with no padding
+   between them. */
+- (BOOL) _getRowLayout: (GSRowLayout *)layout
+{
+  NSInteger colors = _numColors - (_hasAlpha ? 1 : 0);
+  NSInteger i;
+
+  if ((_bitsPerSample != 8 && _bitsPerSample != 16)
+      || (_format & NSFloatingPointSamplesBitmapFormat)
+      || colors < 1 || colors > 4 || _imagePlanes == NULL)
+    {
+      return NO;
+    }
+  if (_isPlanar ? (_bitsPerPixel != _bitsPerSample)
+      : (_bitsPerPixel != _bitsPerSample * _numColors))
+    {
+      return NO;
+    }
+
+  memset(layout, 0, sizeof(GSRowLayout));
+  for (i = 0; i < (_isPlanar ? _numColors : 1); i++)
+    {
+      layout->planes[i] = _imagePlanes[i];
+    }
+  layout->bytesPerRow = _bytesPerRow;
+  layout->bps = _bitsPerSample;
+  layout->colors = colors;
+  layout->hasAlpha = _hasAlpha;
+  layout->alphaFirst = (_format & NSAlphaFirstBitmapFormat) ? YES : NO;
+  layout->planar = _isPlanar;
+  return YES;
+}
+
+/* Copies the pixels of the receiver into new, which has the same size
+   and number of colors, a row at a time. Returns NO if either bitmap
+   has a layout the row kernels do not handle. */
+- (BOOL) _convertRowsInto: (NSBitmapImageRep *)new
+{
+  GSRowLayout from, to;
+  uint16_t *work;
+  NSInteger y;
+  BOOL convert;
+
+  if (![self _getRowLayout: &from] || ![new _getRowLayout: &to]
+      || from.colors != to.colors)
+    {
+      return NO;
+    }
+  work = malloc(sizeof(uint16_t) * (from.colors + 1) * _pixelsWide);
+  if (work == NULL)
+    {
+      return NO;
+    }
+
+  convert = _hasAlpha
+    && ((_format & NSAlphaNonpremultipliedBitmapFormat)
+        != ([new bitmapFormat] & NSAlphaNonpremultipliedBitmapFormat));
+  for (y = 0; y < _pixelsHigh; y++)
+    {
+      gs_load_row(&from, y, _pixelsWide, work);
+      if (convert)
+        {
+          gs_premultiply_work(work, _pixelsWide, from.colors,
+            (_format & NSAlphaNonpremultipliedBitmapFormat) ? YES : NO);
+        }
+      gs_store_row(&to, y, _pixelsWide, work);
+    }
+  free(work);
+  return YES;
+}
+
+/* Reads width pixels of row y from x on into work, as gs_load_row()
+   does, whatever the layout of the samples. */
+- (void) _loadRow: (NSInteger)y
+              atX: (NSInteger)x
+            width: (NSInteger)width
+             into: (uint16_t *)work
+{
+  NSInteger colors = _numColors - (_hasAlpha ? 1 : 0);
+  BOOL isFloat = (_format & NSFloatingPointSamplesBitmapFormat) ? YES : NO;
+  BOOL alphaFirst = (_format & NSAlphaFirstBitmapFormat) ? YES : NO;
+  GSRowLayout layout;
+  int n = colors + 1;
+  int i;
+
+  if ([self _getRowLayout: &layout])
+    {
+      gs_offset_layout(&layout, x);
+      gs_load_row(&layout, y, width, work);
+      return;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      uint16_t *w = work + i;
+      unsigned char *base;
+      long bit;
+      NSInteger j;
+      int s;
+
+      if (i == colors)
+        {
+          if (!_hasAlpha)
+            {
+              for (j = 0; j < width; j++, w += n)
+                *w = 0xffff;
+              continue;
+            }
+          s = alphaFirst ? 0 : colors;
+        }
+      else
+        {
+          s = (_hasAlpha && alphaFirst) ? i + 1 : i;
+        }
+
+      if (_isPlanar)
+        {
+          base = _imagePlanes[s] + y * _bytesPerRow;
+          bit = _bitsPerPixel * x;
+        }
+      else
+        {
+          base = _imagePlanes[0] + y * _bytesPerRow;
+          bit = _bitsPerPixel * x + s * _bitsPerSample;
+        }
+      for (j = 0; j < width; j++, bit += _bitsPerPixel, w += n)
+        {
+          *w = gs_get_sample(base, bit, _bitsPerSample, isFloat);
+        }
+    }
+}
+
+/* Writes work, as filled by -_loadRow:atX:width:into:, to width pixels
+   of row y from x on. */
+- (void) _storeRow: (NSInteger)y
+               atX: (NSInteger)x
+             width: (NSInteger)width
+              from: (const uint16_t *)work
+{
+  NSInteger colors = _numColors - (_hasAlpha ? 1 : 0);
+  BOOL isFloat = (_format & NSFloatingPointSamplesBitmapFormat) ? YES : NO;
+  BOOL alphaFirst = (_format & NSAlphaFirstBitmapFormat) ? YES : NO;
+  GSRowLayout layout;
+  int n = colors + 1;
+  int i;
+
+  if ([self _getRowLayout: &layout])
+    {
+      gs_offset_layout(&layout, x);
+      gs_store_row(&layout, y, width, work);
+      return;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      const uint16_t *w = work + i;
+      unsigned char *base;
+      long bit;
+      NSInteger j;
+      int s;
+
+      if (i == colors)
+        {
+          if (!_hasAlpha)
+            continue;
+          s = alphaFirst ? 0 : colors;
+        }
+      else
+        {
+          s = (_hasAlpha && alphaFirst) ? i + 1 : i;
+        }
+
+      if (_isPlanar)
+        {
+          base = _imagePlanes[s] + y * _bytesPerRow;
+          bit = _bitsPerPixel * x;
+        }
+      else
+        {
+          base = _imagePlanes[0] + y * _bytesPerRow;
+          bit = _bitsPerPixel * x + s * _bitsPerSample;
+        }
+      for (j = 0; j < width; j++, bit += _bitsPerPixel, w += n)
+        {
+          gs_set_sample(base, bit, _bitsPerSample, isFloat, *w);
+        }
+    }
+}
+
+- (void) _checkRectAtX: (NSInteger)x
+                     y: (NSInteger)y
+                 width: (NSInteger)width
+                height: (NSInteger)height
+{
+  if (x < 0 || y < 0 || width < 0 || height < 0
+      || x > _pixelsWide - width || y > _pixelsHigh - height)
+    {
+      [NSException raise: NSRangeException
+                  format: @"Rectangle of %ld by %ld pixels at (%ld, %ld) "
+                   @"is not inside the bitmap of %ld by %ld pixels",
+                   (long)width, (long)height, (long)x, (long)y,
+                   (long)_pixelsWide, (long)_pixelsHigh];
+    }
+}
+
+/* Reads the rectangle into buffer as 8 bit or float RGBA, a row at a
+   time. 8 bit RGB(A) bitmaps are copied with the 8 bit kernels, other
+   layouts are unpacked to 16 bit samples first and colour spaces that
+   have no model here go through NSColor. */
+- (void) _getRGBA: (void *)buffer
+          isFloat: (BOOL)isFloat
+      bytesPerRow: (NSInteger)rowBytes
+              atX: (NSInteger)x
+                y: (NSInteger)y
+            width: (NSInteger)width
+           height: (NSInteger)height
+{
+  NSInteger colors = _numColors - (_hasAlpha ? 1 : 0);
+  GSRGBAModel model = gs_rgba_model(_colorSpace, colors);
+  BOOL premultiplied = _hasAlpha
+    && !(_format & NSAlphaNonpremultipliedBitmapFormat);
+  unsigned char *out = buffer;
+  GSRowLayout layout;
+  uint16_t *work, *rgba;
+  NSInteger i, j;
+
+  [self _checkRectAtX: x y: y width: width height: height];
+  if (width == 0 || height == 0)
+    {
+      return;
+    }
+  if (_bitsPerSample > 16 && _bitsPerSample != 32)
+    {
+      model = GSRGBAModelNone;
+    }
+
+  if (!isFloat && model == GSRGBAModelRGB && _bitsPerSample == 8
+      && !_isPlanar && [self _getRowLayout: &layout])
+    {
+      // Optimize for the most common case
+      if (premultiplied && gs_unpremultiply_table[255] == 0)
+        {
+          gs_init_unpremultiply_table();
+        }
+      gs_offset_layout(&layout, x);
+      for (j = 0; j < height; j++, out += rowBytes)
+        {
+          unsigned char *row = layout.planes[0] + (y + j) * _bytesPerRow;
+
+          if (!_hasAlpha)
+            {
+              gs_add_alpha_row3(row, out, width);
+              continue;
+            }
+          if (layout.alphaFirst)
+            {
+              gs_rotate_row4(row, out, width, YES);
+            }
+          else
+            {
+              memcpy(out, row, 4 * width);
+            }
+          if (premultiplied)
+            {
+              gs_unpremultiply_row8(out, width, 4, 3);
+            }
+        }
+      return;
+    }
+
+  work = malloc(sizeof(uint16_t) * (colors + 5) * width);
+  if (work == NULL)
+    {
+      [NSException raise: NSMallocException
+                  format: @"Unable to allocate a row of %ld pixels",
+                   (long)width];
+    }
+  rgba = work + (colors + 1) * width;
+
+  for (j = 0; j < height; j++, out += rowBytes)
+    {
+      const uint16_t *row = rgba;
+
+      if (model == GSRGBAModelNone)
+        {
+          for (i = 0; i < width; i++)
+            {
+              NSColor *c = [[self colorAtX: x + i y: y + j]
+                colorUsingColorSpaceName: NSDeviceRGBColorSpace];
+              float f[4] = { 0.0, 0.0, 0.0, 0.0 };
+              CGFloat r, g, b, a;
+
+              if (c != nil)
+                {
+                  [c getRed: &r green: &g blue: &b alpha: &a];
+                  f[0] = r;
+                  f[1] = g;
+                  f[2] = b;
+                  f[3] = a;
+                }
+              gs_samples_from_float(f, rgba + 4 * i, 4);
+            }
+        }
+      else
+        {
+          [self _loadRow: y + j atX: x width: width into: work];
+          if (premultiplied)
+            {
+              gs_premultiply_work(work, width, colors, NO);
+            }
+          if (model == GSRGBAModelRGB)
+            {
+              // The work row already is RGBA
+              row = work;
+            }
+          else
+            {
+              gs_work_to_rgba(work, width, colors, model, rgba);
+            }
+        }
+
+      if (isFloat)
+        {
+          gs_samples_to_float(row, (float *)out, 4 * width);
+        }
+      else
+        {
+          gs_narrow_samples(row, out, 4 * width);
+        }
+    }
+  free(work);
+}
+
+/* Stores 8 bit or float RGBA from buffer into the rectangle, the
+   reverse of -_getRGBA:isFloat:bytesPerRow:atX:y:width:height:. */
+- (void) _setRGBA: (const void *)buffer
+          isFloat: (BOOL)isFloat
+      bytesPerRow: (NSInteger)rowBytes
+              atX: (NSInteger)x
+                y: (NSInteger)y
+            width: (NSInteger)width
+           height: (NSInteger)height
+{
+  NSInteger colors = _numColors - (_hasAlpha ? 1 : 0);
+  GSRGBAModel model = gs_rgba_model(_colorSpace, colors);
+  BOOL premultiplied = _hasAlpha
+    && !(_format & NSAlphaNonpremultipliedBitmapFormat);
+  const unsigned char *in = buffer;
+  GSRowLayout layout;
+  uint16_t *work, *rgba;
+  NSInteger i, j;
+
+  [self _checkRectAtX: x y: y width: width height: height];
+  if (width == 0 || height == 0)
+    {
+      return;
+    }
+  if (_bitsPerSample > 16 && _bitsPerSample != 32)
+    {
+      model = GSRGBAModelNone;
+    }
+
+  if (!isFloat && model == GSRGBAModelRGB && _bitsPerSample == 8
+      && !_isPlanar && [self _getRowLayout: &layout])
+    {
+      // Optimize for the most common case
+      gs_offset_layout(&layout, x);
+      for (j = 0; j < height; j++, in += rowBytes)
+        {
+          unsigned char *row = layout.planes[0] + (y + j) * _bytesPerRow;
+
+          if (!_hasAlpha)
+            {
+              gs_drop_alpha_row4(in, row, width);
+              continue;
+            }
+          if (layout.alphaFirst)
+            {
+              gs_rotate_row4(in, row, width, NO);
+            }
+          else
+            {
+              memcpy(row, in, 4 * width);
+            }
+          if (premultiplied)
+            {
+              gs_premultiply_row4(row, width, layout.alphaFirst ? 0 : 3);
+            }
+        }
+      return;
+    }
+
+  work = malloc(sizeof(uint16_t) * (colors + 5) * width);
+  if (work == NULL)
+    {
+      [NSException raise: NSMallocException
+                  format: @"Unable to allocate a row of %ld pixels",
+                   (long)width];
+    }
+  rgba = work + (colors + 1) * width;
+
+  for (j = 0; j < height; j++, in += rowBytes)
+    {
+      uint16_t *row = (model == GSRGBAModelRGB) ? work : rgba;
+
+      if (isFloat)
+        {
+          gs_samples_from_float((const float *)in, row, 4 * width);
+        }
+      else
+        {
+          gs_widen_samples(in, row, 4 * width);
+        }
+
+      if (model == GSRGBAModelNone)
+        {
+          for (i = 0; i < width; i++)
+            {
+              uint16_t *p = rgba + 4 * i;
+
+              [self setColor: [NSColor colorWithDeviceRed: p[0] / 65535.0
+                                                    green: p[1] / 65535.0
+                                                     blue: p[2] / 65535.0
+                                                    alpha: p[3] / 65535.0]
+                         atX: x + i
+                           y: y + j];
+            }
+          continue;
+        }
+      if (model != GSRGBAModelRGB)
+        {
+          gs_rgba_to_work(rgba, width, colors, model, work);
+        }
+      if (premultiplied)
+        {
+          gs_premultiply_work(work, width, colors, YES);
+        }
+      [self _storeRow: y + j atX: x width: width from: work];
+    }
+  free(work);
+}
+
+/* Takes over the pixels of rep, a decoded bitmap of the image the
+   receiver describes, along with their layout. */
+- (void) _adoptBitmapOf: (NSBitmapImageRep *)rep
+{
+  unsigned char **planes;
+
+  planes = _imagePlanes;
+  _imagePlanes = rep->_imagePlanes;
+  rep->_imagePlanes = planes;
+  ASSIGN(_imageData, rep->_imageData);
+
+  _bytesPerRow = rep->_bytesPerRow;
+  _numColors = rep->_numColors;
+  _bitsPerPixel = rep->_bitsPerPixel;
+  _isPlanar = rep->_isPlanar;
+  _format = rep->_format;
+  [self setBitsPerSample: [rep bitsPerSample]];
+  [self setColorSpaceName: [rep colorSpaceName]];
+  [self setAlpha: [rep hasAlpha]];
+  [self setOpaque: [rep isOpaque]];
+  [_properties addEntriesFromDictionary: rep->_properties];
+}
+
 - (NSBitmapImageRep *) _convertToFormatBitsPerSample: (NSInteger)bps
                                      samplesPerPixel: (NSInteger)spp
                                             hasAlpha: (BOOL)alpha
@@ -2392,6 +4477,11 @@ _set_bit_value(unsigned char *base, long msb_off, int bit_width,
 
           NSDebugLLog(@"NSImage", @"Converting %@ bitmap data", _colorSpace);
 
+          if ([self _convertRowsInto: new])
+            {
+              return AUTORELEASE(new);
+            }
+
           if (_bitsPerSample != bps)
             {
               _scale = (CGFloat)((1 << _bitsPerSample) - 1);
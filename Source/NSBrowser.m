@@ -47,6 +47,7 @@
 #import "AppKit/AppKitExceptions.h"
 #import "AppKit/NSScroller.h"
 #import "AppKit/NSCell.h"
+#import "AppKit/NSClipView.h"
 #import "AppKit/NSColor.h"
 #import "AppKit/NSFont.h"
 #import "AppKit/NSScrollView.h"
@@ -242,9 +243,19 @@ static BOOL browserUseBezels;
 //
 // Private NSBrowser methods
 //
+@interface NSMatrix (GSLazyCells)
+- (void) _setCreatesCellsLazily: (BOOL)flag;
+- (void) _releaseCells;
+@end
+
 @interface NSBrowser (Private)
 - (NSString *) _getTitleOfColumn: (NSInteger)column;
 - (void) _performLoadOfColumn: (NSInteger)column;
+- (void) _loadVisibleCellsInColumn: (NSInteger)column;
+- (id) _cellAtRow: (NSInteger)row
+           column: (NSInteger)column
+         inMatrix: (NSMatrix *)matrix;
+- (void) _columnClipViewChanged: (NSNotification *)notification;
 - (void) _remapColumnSubviews: (BOOL)flag;
 - (void) _setColumnTitlesNeedDisplay;
 - (NSBorderType) _resolvedBorderType;
@@ -388,6 +399,17 @@ static BOOL browserUseBezels;
       return;
     }
 
+  /* Cells of passive delegates are only loaded when they become visible,
+     but the selected cells may all be examined by -doClick:. */
+  if (_passiveDelegate)
+    {
+      NSInteger i, rows = [matrix numberOfRows];
+
+      for (i = 0; i < rows; i++)
+        {
+          [self loadedCellAtRow: i column: _lastColumnLoaded];
+        }
+    }
   [matrix selectAll: sender];
 }
 
@@ -426,7 +448,7 @@ static BOOL browserUseBezels;
       return;
     }
 
-  if ((cell = [matrix cellAtRow: row column: 0]) == nil)
+  if ((cell = [self _cellAtRow: row column: column inMatrix: matrix]) == nil)
     {
       return;
     }
@@ -790,7 +812,9 @@ static BOOL browserUseBezels;
           // find the cell in the browser matrix which is equal to aStr
           for (row = 0; row < numOfRows; row++)
             {
-              selectedCell = [matrix cellAtRow: row column: 0];
+              selectedCell = [self _cellAtRow: row
+                                       column: column
+                                     inMatrix: matrix];
 
               if ([[selectedCell stringValue] isEqualToString: aStr])
                 {
@@ -919,6 +943,19 @@ static BOOL browserUseBezels;
   [sc setHasHorizontalScroller: NO];
   [sc setHasVerticalScroller: YES];
   [sc setBorderType: [self _resolvedBorderType]];
+  /* Load the cells of passive delegates as they are scrolled into view. */
+  [[sc contentView] setPostsBoundsChangedNotifications: YES];
+  [[sc contentView] setPostsFrameChangedNotifications: YES];
+  [[NSNotificationCenter defaultCenter]
+    addObserver: self
+       selector: @selector(_columnClipViewChanged:)
+           name: NSViewBoundsDidChangeNotification
+         object: [sc contentView]];
+  [[NSNotificationCenter defaultCenter]
+    addObserver: self
+       selector: @selector(_columnClipViewChanged:)
+           name: NSViewFrameDidChangeNotification
+         object: [sc contentView]];
   
   [bc setColumnScrollView: sc];
   [self addSubview: sc];
@@ -2655,7 +2692,7 @@ static BOOL browserUseBezels;
         {
           matrix = [self matrixInColumn: 0];
 
-          if ([[matrix cells] count])
+          if ([matrix numberOfRows] > 0)
             {
               [matrix selectCellAtRow: 0 column: 0];
             }
@@ -2669,7 +2706,7 @@ static BOOL browserUseBezels;
             {
               selectedColumn++;
               matrix = [self matrixInColumn: selectedColumn];
-              if ([[matrix cells] count] && [matrix selectedCell] == nil)
+              if ([matrix numberOfRows] > 0 && [matrix selectedCell] == nil)
                 {
                   [matrix selectCellAtRow: 0 column: 0];
                 }
@@ -3268,12 +3305,23 @@ static BOOL browserUseBezels;
 
   if (_reusesColumns && matrix)
     {
-      [matrix renewRows: rows columns: cols];
-
-      // Mark all the cells as unloaded
-      for (i = 0; i < rows; i++)
+      if (_passiveDelegate)
+        {
+          /* Drop the old cells, new ones are made as they are needed. */
+          [matrix _setCreatesCellsLazily: YES];
+          [matrix _releaseCells];
+          [matrix renewRows: rows columns: cols];
+        }
+      else
         {
-          [[matrix cellAtRow: i column: 0] setLoaded: NO];
+          [matrix _setCreatesCellsLazily: NO];
+          [matrix renewRows: rows columns: cols];
+
+          // Mark all the cells as unloaded
+          for (i = 0; i < rows; i++)
+            {
+              [[matrix cellAtRow: i column: 0] setLoaded: NO];
+            }
         }
     }
   else
@@ -3286,8 +3334,12 @@ static BOOL browserUseBezels;
                    initWithFrame: matrixRect
                    mode: NSListModeMatrix
                    prototype: _browserCellPrototype
-                   numberOfRows: rows
-                   numberOfColumns: cols];
+                   numberOfRows: 0
+                   numberOfColumns: 0];
+      /* The cells of passive delegates are only made when they are
+         scrolled into view, so that columns with many rows are cheap. */
+      [matrix _setCreatesCellsLazily: _passiveDelegate];
+      [matrix renewRows: rows columns: cols];
       [matrix setIntercellSpacing: matrixIntercellSpace];
       [matrix setAllowsEmptySelection: _allowsEmptySelection];
       [matrix setAutoscroll: YES];
@@ -3313,20 +3365,18 @@ static BOOL browserUseBezels;
   // Loading is different based upon passive/active delegate
   if (_passiveDelegate)
     {
-      // Now loop through the cells and load each one
-      id aCell;
-      SEL sel1 = @selector(browser:willDisplayCell:atRow:column:);
-      IMP imp1 = [_browserDelegate methodForSelector: sel1];
-      SEL sel2 = @selector(cellAtRow:column:);
-      IMP imp2 = [matrix methodForSelector: sel2];
-      
-      for (i = 0; i < rows; i++)
+      /* Only the first cell is loaded here, as it determines the row
+         height. The other cells are loaded by -_loadVisibleCellsInColumn:
+         when they are scrolled into view, so that a column with many
+         rows does not require a delegate call for each one of them. */
+      if (rows > 0)
         {
-          aCell = (*imp2)(matrix, sel2, i, 0);
+          id aCell = [matrix cellAtRow: 0 column: 0];
+
           if (![aCell isLoaded])
             {
-              (*imp1)(_browserDelegate, sel1, self, aCell, i, 
-                      column);
+              [_browserDelegate browser: self willDisplayCell: aCell
+                                  atRow: 0 column: column];
               [aCell setLoaded: YES];
             }
         }
@@ -3365,12 +3415,93 @@ static BOOL browserUseBezels;
     [matrix setCellSize: ms];
   }
 
+  [self _loadVisibleCellsInColumn: column];
+
   // Get the title even when untitled, as this may change later.
   [self setTitle: [self _getTitleOfColumn: column] ofColumn: column];
   // Mark for redisplay
   [self displayColumn: column];
 }
 
+/* Loads the cells of a passive delegate's column which lie in or near
+   the visible part of the column. */
+- (void) _loadVisibleCellsInColumn: (NSInteger)column
+{
+  NSMatrix *matrix;
+  NSRect visibleRect;
+  CGFloat rowHeight;
+  NSInteger i, first, last, rows;
+  SEL sel1 = @selector(browser:willDisplayCell:atRow:column:);
+  IMP imp1;
+  SEL sel2 = @selector(cellAtRow:column:);
+  IMP imp2;
+
+  if (!_passiveDelegate || (matrix = [self matrixInColumn: column]) == nil)
+    {
+      return;
+    }
+
+  rows = [matrix numberOfRows];
+  rowHeight = [matrix cellSize].height + [matrix intercellSpacing].height;
+  if (rows == 0 || rowHeight <= 0)
+    {
+      return;
+    }
+
+  /* Load one extra page above and below the visible rows, so that
+     scrolling by a page does not show unloaded cells. */
+  visibleRect = [[matrix superview] bounds];
+  first = (NSInteger)floor((NSMinY(visibleRect) - NSHeight(visibleRect))
+                           / rowHeight);
+  last = (NSInteger)ceil((NSMaxY(visibleRect) + NSHeight(visibleRect))
+                         / rowHeight);
+  first = MAX(first, 0);
+  last = MIN(last, rows - 1);
+
+  imp1 = [_browserDelegate methodForSelector: sel1];
+  imp2 = [matrix methodForSelector: sel2];
+  for (i = first; i <= last; i++)
+    {
+      id aCell = (*imp2)(matrix, sel2, i, 0);
+
+      if (![aCell isLoaded])
+        {
+          (*imp1)(_browserDelegate, sel1, self, aCell, i, column);
+          [aCell setLoaded: YES];
+        }
+    }
+}
+
+/* Returns the cell at row in the matrix of column. Cells of passive
+   delegates are loaded first, as they may not have been shown yet. */
+- (id) _cellAtRow: (NSInteger)row
+           column: (NSInteger)column
+         inMatrix: (NSMatrix *)matrix
+{
+  if (_passiveDelegate)
+    {
+      return [self loadedCellAtRow: row column: column];
+    }
+  return [matrix cellAtRow: row column: 0];
+}
+
+- (void) _columnClipViewChanged: (NSNotification *)notification
+{
+  NSView *clipView = [notification object];
+  NSInteger i;
+
+  for (i = 0; i <= _lastColumnLoaded; i++)
+    {
+      NSBrowserColumn *bc = [_browserColumns objectAtIndex: i];
+
+      if ([[bc columnScrollView] contentView] == clipView)
+        {
+          [self _loadVisibleCellsInColumn: i];
+          break;
+        }
+    }
+}
+
 /* Get the title of a column. */
 - (NSString *) _getTitleOfColumn: (NSInteger)column
 {
@@ -29,6 +29,7 @@
 #import <Foundation/NSGeometry.h>
 #import <Foundation/NSIndexSet.h>
 #import <Foundation/NSKeyedArchiver.h>
+#import <Foundation/NSMapTable.h>
 
 #import "AppKit/NSApplication.h"
 #import "AppKit/NSClipView.h"
@@ -56,12 +57,28 @@ static NSString* NSCollectionViewBackgroundColorsKey         = @"NSBackgroundCol
  * Class variables
  */
 static NSString *placeholderItem = nil;
+static IMP newItemImp = NULL;
+
+/* The items of each collection view that are shown and those kept for
+ * reuse. They are kept outside the instance, so that the layout of the
+ * class does not change.
+ */
+typedef struct {
+  NSMutableIndexSet *loadedItemIndexes;
+  NSMutableArray *reusableItems;
+} GSCollectionViewInfo;
+
+static NSMapTable *viewInfo = NULL;
+
+#define INFO ((GSCollectionViewInfo *)NSMapGet(viewInfo, self))
 
 @interface NSCollectionView (CollectionViewInternalPrivate)
 
 - (void) _initDefaults;
 - (void) _resetItemSize;
 - (void) _removeItemsViews;
+- (void) _recycleItemsOutsideRect: (NSRect)aRect;
+- (BOOL) _reusesItems;
 - (NSInteger) _indexAtPoint: (NSPoint)point;
 
 - (NSRect) _frameForRowOfItemAtIndex: (NSUInteger)theIndex;
@@ -98,6 +115,10 @@ static NSString *placeholderItem = nil;
   if (self == [NSCollectionView class])
     {
       placeholderItem = @"Placeholder";
+      newItemImp = [self instanceMethodForSelector:
+                           @selector(newItemForRepresentedObject:)];
+      viewInfo = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                                  NSNonOwnedPointerMapValueCallBacks, 0);
       [self exposeBinding: NSContentBinding];
     }
 }
@@ -113,12 +134,18 @@ static NSString *placeholderItem = nil;
 
 -(void) _initDefaults
 {
+  GSCollectionViewInfo *info;
+
 //  _draggingSourceOperationMaskForLocal = NSDragOperationCopy | NSDragOperationLink | NSDragOperationGeneric | NSDragOperationPrivate;
   _draggingSourceOperationMaskForLocal = NSDragOperationGeneric | NSDragOperationMove | NSDragOperationCopy;
   _draggingSourceOperationMaskForRemote = NSDragOperationGeneric | NSDragOperationMove | NSDragOperationCopy;
   [self _resetItemSize];
   _content = [[NSArray alloc] init];
   _items = [[NSMutableArray alloc] init];
+  info = NSZoneCalloc(NSDefaultMallocZone(), 1, sizeof(GSCollectionViewInfo));
+  info->loadedItemIndexes = [[NSMutableIndexSet alloc] init];
+  info->reusableItems = [[NSMutableArray alloc] init];
+  NSMapInsert(viewInfo, self, info);
   _selectionIndexes = [[NSIndexSet alloc] init];
   _draggingOnIndex = NSNotFound;
 }
@@ -170,10 +197,15 @@ static NSString *placeholderItem = nil;
       NSView *view = [collectionItem view];
       [view setFrame: [self frameForItemAtIndex: index]];
     }
+
+  // Give back the items which have been scrolled out of view
+  [self _recycleItemsOutsideRect: [self visibleRect]];
 }
 
 - (void) dealloc
 {
+  GSCollectionViewInfo *info = INFO;
+
   //[[NSNotificationCenter defaultCenter] removeObserver: self];
 
   DESTROY (_content);
@@ -184,6 +216,13 @@ static NSString *placeholderItem = nil;
   DESTROY (_backgroundColors);
   DESTROY (_selectionIndexes);
   DESTROY (_items);
+  if (info != NULL)
+    {
+      RELEASE (info->loadedItemIndexes);
+      RELEASE (info->reusableItems);
+      NSZoneFree(NSDefaultMallocZone(), info);
+      NSMapRemove(viewInfo, self);
+    }
   //DESTROY (_mouseDownEvent);
   [super dealloc];
 }
@@ -266,6 +305,8 @@ static NSString *placeholderItem = nil;
 - (void) setItemPrototype: (NSCollectionViewItem *)prototype
 {
   ASSIGN(itemPrototype, prototype);
+  // Items copied from the old prototype must not be reused
+  [INFO->reusableItems removeAllObjects];
   [self _resetItemSize];
 }
 
@@ -467,8 +508,22 @@ static NSString *placeholderItem = nil;
 
   if (item == placeholderItem)
     {
-      item = [self newItemForRepresentedObject: [_content objectAtIndex: index]];
+      GSCollectionViewInfo *info = INFO;
+
+      if ([info->reusableItems count] > 0 && [self _reusesItems])
+        {
+          // Rebind an item that has been scrolled out of view
+          item = RETAIN([info->reusableItems lastObject]);
+          [info->reusableItems removeLastObject];
+          [item setRepresentedObject: [_content objectAtIndex: index]];
+        }
+      else
+        {
+          item = [self newItemForRepresentedObject:
+                         [_content objectAtIndex: index]];
+        }
       [_items replaceObjectAtIndex: index withObject: item];
+      [info->loadedItemIndexes addIndex: index];
       if ([[self selectionIndexes] containsIndex: index])
         {
           [item setSelected: YES];
@@ -492,6 +547,8 @@ static NSString *placeholderItem = nil;
 
 - (void) _removeItemsViews
 {
+  GSCollectionViewInfo *info = INFO;
+
   if (!_items)
     return;
   
@@ -505,7 +562,71 @@ static NSString *placeholderItem = nil;
         {
           [[item view] removeFromSuperview];
           [item setSelected: NO];
+          [item setRepresentedObject: nil];
+          if ([self _reusesItems])
+            {
+              [info->reusableItems addObject: item];
+            }
+        }
+    }
+  [info->loadedItemIndexes removeAllIndexes];
+}
+
+/* Items may only be rebound to another represented object when they
+ * come from our own -newItemForRepresentedObject:. A subclass which
+ * overrides that method expects to see every item that is shown.
+ */
+- (BOOL) _reusesItems
+{
+  return [self methodForSelector: @selector(newItemForRepresentedObject:)]
+    == newItemImp;
+}
+
+/* Items whose frame lies outside of aRect, extended by one row above and
+ * below, are replaced by the placeholder again. Their views are removed
+ * and, unless -_reusesItems says otherwise, the items are kept for
+ * -itemAtIndex: to rebind them to other represented objects, so that
+ * the number of items and subviews stays proportional to the visible
+ * area rather than to the content.
+ */
+- (void) _recycleItemsOutsideRect: (NSRect)aRect
+{
+  GSCollectionViewInfo *info = INFO;
+  NSInteger first, last, count;
+  NSUInteger index;
+
+  count = [_items count];
+  if (count == 0 || _numberOfColumns == 0)
+    {
+      return;
+    }
+
+  aRect = NSInsetRect(aRect, 0, -(_itemSize.height + _verticalMargin));
+  first = MAX(0, [self _indexAtPoint: NSMakePoint(0, NSMinY(aRect))]);
+  first -= first % _numberOfColumns;
+  /* Clamp to the items before adding the rest of the row, so that a
+     rect far below the last item can't overflow. */
+  last = MIN(count - 1, [self _indexAtPoint: NSMakePoint(0, NSMaxY(aRect))]);
+  last = MIN(count - 1, last + (NSInteger)_numberOfColumns - 1);
+
+  index = [info->loadedItemIndexes firstIndex];
+  while (index != NSNotFound)
+    {
+      if ((NSInteger)index < first || (NSInteger)index > last)
+        {
+          id item = [_items objectAtIndex: index];
+
+          [[item view] removeFromSuperviewWithoutNeedingDisplay];
+          [item setSelected: NO];
+          [item setRepresentedObject: nil];
+          if ([self _reusesItems])
+            {
+              [info->reusableItems addObject: item];
+            }
+          [_items replaceObjectAtIndex: index withObject: placeholderItem];
+          [info->loadedItemIndexes removeIndex: index];
         }
+      index = [info->loadedItemIndexes indexGreaterThanIndex: index];
     }
 }
 
@@ -66,6 +66,7 @@
 static NSString *timerKey = @"NSEventTimersKey";
 static Class dateClass;
 static Class eventClass;
+static BOOL mouseCoalescing = YES;
 
 /*
  * Class methods
@@ -375,6 +376,28 @@ static Class eventClass;
   [dict removeObjectForKey: timerKey];
 }
 
+/**
+ * Returns whether consecutive mouse moved and dragged events for the
+ * same window are merged into one while they wait in the event queue.
+ * Only events read from the display are merged, not posted ones.
+ * The default is YES.
+ */
++ (BOOL) isMouseCoalescingEnabled
+{
+  return mouseCoalescing;
+}
+
+/**
+ * Sets whether consecutive mouse moved and dragged events for the same
+ * window are merged into one while they wait in the event queue. The
+ * merged event has the location of the latest event and the sum of
+ * their deltas.
+ */
++ (void) setMouseCoalescingEnabled: (BOOL)flag
+{
+  mouseCoalescing = flag;
+}
+
 /**
  * Returns the button number for the mouse button pressed in a mouse
  * event.  Intended primarily for the case where a mouse has three or
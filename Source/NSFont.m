@@ -45,6 +45,7 @@
 #import "AppKit/NSFontManager.h"
 #import "AppKit/NSView.h"
 #import "GNUstepGUI/GSFontInfo.h"
+#import "GSGuiPrivate.h"
 
 
 @interface NSFont (Private)
@@ -418,6 +419,7 @@ static void setNSFont(NSString *key, NSFont *font)
     {
       DESTROY(font_roles[i].cachedFont);
     }
+  GSInvalidateFontFallbacks();
 
   /* Don't care about errors */
   [defaults synchronize];
@@ -590,6 +592,7 @@ static void setNSFont(NSString *key, NSFont *font)
 + (void) setPreferredFontNames: (NSArray*)fontNames
 {
   ASSIGN(_preferredFonts, fontNames);
+  GSInvalidateFontFallbacks();
   // FIXME: Should this store back the preferred fonts in the user defaults?
 }
 
@@ -1152,12 +1155,12 @@ static BOOL flip_hack;
 //
 - (NSSize) advancementForGlyph: (NSGlyph)aGlyph
 {
-  return [fontInfo advancementForGlyph: aGlyph];
+  return GSFontInfoAdvancementForGlyph(fontInfo, aGlyph);
 }
 
 - (NSRect) boundingRectForGlyph: (NSGlyph)aGlyph
 {
-  return [fontInfo boundingRectForGlyph: aGlyph];
+  return GSFontInfoBoundingRectForGlyph(fontInfo, aGlyph);
 }
 
 - (BOOL) glyphIsEncoded: (NSGlyph)aGlyph
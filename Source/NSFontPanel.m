@@ -213,6 +213,8 @@ static float sizes[] = {4.0, 6.0, 8.0, 9.0, 10.0, 11.0, 12.0, 13.0,
 
   DESTROY(_familyList);
   _familyList = familyList;
+  // The fonts to substitute missing characters from may have changed
+  GSInvalidateFontFallbacks();
   // Reload the display. 
   [familyBrowser loadColumnZero];
   // Reselect the current font. (Hopefully still there)
@@ -37,6 +37,7 @@
 /* just for NSAttachmentCharacter */
 #import "AppKit/NSTextAttachment.h"
 #import "GNUstepGUI/GSFontInfo.h"
+#import "GSGlyphTables.h"
 
 static NSGlyphGenerator* instance;
 
@@ -98,6 +99,7 @@ fb04 'ffl'
   NSGlyph gl;
   NSAttributedString *attrstr = [storage attributedString];
   GSFontInfo *fi;
+  GSGlyphTables *tables;
   int i;
   unichar buf[num];
   unsigned int cstart = 0;
@@ -111,8 +113,6 @@ fb04 'ffl'
   SEL cim_sel = @selector(characterIsMember:);
   BOOL (*characterIsMember)(id, SEL, unichar)
     = (BOOL(*)(id, SEL, unichar)) [cs methodForSelector: cim_sel];
-  SEL gfc_sel = @selector(glyphForCharacter:);
-  NSGlyph (*glyphForCharacter)(id, SEL, unichar);
   NSGlyph fallback = NSNullGlyph;
 
   [[attrstr string] getCharacters: buf range: maxRange];
@@ -126,7 +126,7 @@ fb04 'ffl'
                    format: @"Glyph generation with no font."];
       return;
     }
-  glyphForCharacter = (NSGlyph(*)(id, SEL, unichar)) [fi methodForSelector: gfc_sel];
+  tables = GSGlyphTablesForFont(fi);
 
   n = [attributes objectForKey: NSLigatureAttributeName];
   if (n)
@@ -164,7 +164,7 @@ fb04 'ffl'
                 {
                   // ffl
                   if ((buf[i + 2] == 'l') 
-                      && (NSNullGlyph != (gl = glyphForCharacter(fi, gfc_sel, 0xfb04))))
+                      && (NSNullGlyph != (gl = GSGlyphTablesGlyphForCharacter(tables, fi, 0xfb04))))
                     {
                       *g = gl;
                       g++;
@@ -174,7 +174,7 @@ fb04 'ffl'
                     }
                   // ffi
                   if ((buf[i + 2] == 'i') 
-                      && (NSNullGlyph != (gl = glyphForCharacter(fi, gfc_sel, 0xfb03))))
+                      && (NSNullGlyph != (gl = GSGlyphTablesGlyphForCharacter(tables, fi, 0xfb03))))
                     {
                       *g = gl;
                       g++;
@@ -186,7 +186,7 @@ fb04 'ffl'
               
               // ff
               if ((ch2 == 'f')
-                  && (NSNullGlyph != (gl = glyphForCharacter(fi, gfc_sel, 0xfb00))))
+                  && (NSNullGlyph != (gl = GSGlyphTablesGlyphForCharacter(tables, fi, 0xfb00))))
                 {
                   *g = gl;
                   g++;
@@ -196,7 +196,7 @@ fb04 'ffl'
                 }
               // fi
               if ((ch2 == 'i')
-                  && (NSNullGlyph != (gl = glyphForCharacter(fi, gfc_sel, 0xfb01))))
+                  && (NSNullGlyph != (gl = GSGlyphTablesGlyphForCharacter(tables, fi, 0xfb01))))
                 {
                   *g = gl;
                   g++;
@@ -206,7 +206,7 @@ fb04 'ffl'
                 }
               // fl
               if ((ch2 == 'l')
-                  && (NSNullGlyph != (gl = glyphForCharacter(fi, gfc_sel, 0xfb02))))
+                  && (NSNullGlyph != (gl = GSGlyphTablesGlyphForCharacter(tables, fi, 0xfb02))))
                 {
                   *g = gl;
                   g++;
@@ -235,7 +235,7 @@ fb04 'ffl'
             }
         }
 
-      gl = glyphForCharacter(fi, gfc_sel, ch);
+      gl = GSGlyphTablesGlyphForCharacter(tables, fi, ch);
       if (gl != NSNullGlyph)
         {
           *g = gl;
@@ -255,7 +255,7 @@ fb04 'ffl'
             {              
               for (; *decomp; decomp++)
                 {
-                  gl = glyphForCharacter(fi, gfc_sel, *decomp);
+                  gl = GSGlyphTablesGlyphForCharacter(tables, fi, *decomp);
                   if (gl == NSNullGlyph)
                     {
                       break;
@@ -275,7 +275,7 @@ fb04 'ffl'
           // FIXME: Find a suitable fallback glyph
             unichar uc = '?';
             
-            fallback = glyphForCharacter(fi, gfc_sel, uc);
+            fallback = GSGlyphTablesGlyphForCharacter(tables, fi, uc);
         }
       *g = fallback;
       g++;
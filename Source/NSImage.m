@@ -25,10 +25,13 @@
 */
 
 #include "config.h"
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
 #import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
 #import <Foundation/NSBundle.h>
 #import <Foundation/NSDebug.h>
 #import <Foundation/NSDictionary.h>
@@ -36,8 +39,14 @@
 #import <Foundation/NSFileManager.h>
 #import <Foundation/NSKeyedArchiver.h>
 #import <Foundation/NSLock.h>
+#import <Foundation/NSMapTable.h>
 #import <Foundation/NSNotification.h>
+#import <Foundation/NSOperation.h>
+#import <Foundation/NSProcessInfo.h>
 #import <Foundation/NSString.h>
+#import <Foundation/NSSet.h>
+#import <Foundation/NSThread.h>
+#import <Foundation/NSUserDefaults.h>
 #import <Foundation/NSValue.h>
 
 #import "AppKit/NSImage.h"
@@ -55,6 +64,7 @@
 #import "AppKit/DPSOperators.h"
 #import "GNUstepGUI/GSDisplayServer.h"
 #import "GSThemePrivate.h"
+#import "GSDeferredBitmapImageRep.h"
 
 BOOL NSImageForceCaching = NO; /* use on missmatch */
 
@@ -345,6 +355,98 @@ fixupImageNameAndType(NSString **name, NSString **type)
 }
 @end
 
+/* The device a best representation was chosen for, reduced to the
+   values the _bestRep: filters look at, plus the size the choice was
+   made for (the image size or the size of the destination rect). */
+typedef struct
+{
+  BOOL forRect;
+  NSUInteger colors;
+  NSInteger bps;
+  NSSize resolution;
+  NSSize size;
+} GSBestRepKey;
+
+#define GS_BEST_REP_SLOTS 4
+#define GS_SCALED_REP_SLOTS 4
+
+/* A bitmap resampled on the CPU to 1/2^level of the size of original,
+   for drawing original much smaller than its size. */
+typedef struct
+{
+  NSImageRep *original;
+  NSBitmapImageRep *rep;
+  NSUInteger level;
+} GSScaledRep;
+
+/* Lookup state derived from the _reps array of an image. It is thrown
+   away whenever the array changes, so nothing in it is retained. */
+typedef struct
+{
+  GSBestRepKey keys[GS_BEST_REP_SLOTS];
+  NSImageRep *best[GS_BEST_REP_SLOTS];
+  unsigned count;
+  unsigned next;
+  NSMapTable *caches;	/* Original rep -> array of its cache GSRepData */
+  GSScaledRep scaled[GS_SCALED_REP_SLOTS];	/* Retains the rep */
+  unsigned nextScaled;
+  NSUInteger lastUse;	/* useClock when the image was last used */
+} GSImageRepCache;
+
+static void
+best_rep_key(GSBestRepKey *key, NSDictionary *deviceDescription,
+  BOOL forRect, NSSize size)
+{
+  NSString *colorSpace;
+  NSValue *resolution;
+  NSNumber *bps;
+
+  /* Cleared first, as keys are compared with memcmp(). */
+  memset(key, 0, sizeof(GSBestRepKey));
+  colorSpace = [deviceDescription objectForKey: NSDeviceColorSpaceName];
+  resolution = [deviceDescription objectForKey: NSDeviceResolution];
+  bps = [deviceDescription objectForKey: NSDeviceBitsPerSample];
+  key->forRect = forRect;
+  key->colors = (colorSpace == nil)
+    ? NSNotFound : NSNumberOfColorComponents(colorSpace);
+  key->bps = (bps == nil) ? NSNotFound : [bps integerValue];
+  key->resolution = (resolution == nil)
+    ? NSMakeSize(-1, -1) : [resolution sizeValue];
+  key->size = size;
+}
+
+static BOOL
+best_rep_lookup(GSImageRepCache *cache, const GSBestRepKey *key,
+  NSImageRep **rep)
+{
+  unsigned i;
+
+  for (i = 0; i < cache->count; i++)
+    {
+      if (memcmp(&cache->keys[i], key, sizeof(GSBestRepKey)) == 0)
+        {
+          *rep = cache->best[i];
+          return YES;
+        }
+    }
+  return NO;
+}
+
+static void
+best_rep_remember(GSImageRepCache *cache, const GSBestRepKey *key,
+  NSImageRep *rep)
+{
+  unsigned i = cache->next;
+
+  cache->keys[i] = *key;
+  cache->best[i] = rep;
+  cache->next = (i + 1) % GS_BEST_REP_SLOTS;
+  if (cache->count < GS_BEST_REP_SLOTS)
+    {
+      cache->count++;
+    }
+}
+
 /* Class variables and functions for class methods */
 static NSRecursiveLock		*imageLock = nil;
 static NSMutableDictionary	*nameDict = nil;
@@ -356,9 +458,97 @@ static NSArray *imageUnfilteredFileTypes = nil;
 static NSArray *imageFileTypes = nil;
 static NSArray *imageUnfilteredPasteboardTypes = nil;
 static NSArray *imagePasteboardTypes = nil;
+static NSOperationQueue *loadQueue = nil;
+// Memory accounting of the named images
+static NSUInteger namedImageCacheLimit = 0;
+static NSMutableSet *loadedNames = nil;
+static NSMapTable *evictedImages = nil;	/* Name -> image, not retained */
+static NSMapTable *evictedNames = nil;	/* Image -> name */
+static NSUInteger useClock = 0;
+static NSUInteger trimClock = 0;
+static BOOL trimScheduled = NO;
+/* The GSImageRepCache of each image, kept here rather than in an ivar so
+   that the layout of the class stays the same. */
+static NSLock *repCacheLock = nil;
+static NSMapTable *repCaches = NULL;
 
 static NSArray *iterate_reps_for_types(NSArray *imageReps, SEL method);
 
+/* Returns the rep cache of image, making it first if create is YES. */
+static GSImageRepCache *
+rep_cache(NSImage *image, BOOL create)
+{
+  GSImageRepCache *cache;
+
+  [repCacheLock lock];
+  cache = (GSImageRepCache*)NSMapGet(repCaches, image);
+  if (cache == NULL && create == YES)
+    {
+      cache = calloc(1, sizeof(GSImageRepCache));
+      NSMapInsert(repCaches, image, cache);
+    }
+  [repCacheLock unlock];
+  return cache;
+}
+
+/* Returns the number of bytes used by the pixels of rep. */
+static NSUInteger
+rep_byte_size(NSImageRep *rep)
+{
+  NSInteger w, h;
+
+  if ([rep isKindOfClass: [GSDeferredBitmapImageRep class]]
+    && [(GSDeferredBitmapImageRep*)rep isDecoded] == NO)
+    {
+      /* Only the description of the image has been read so far */
+      return 0;
+    }
+  if ([rep isKindOfClass: bitmapClass])
+    {
+      return [(NSBitmapImageRep*)rep bytesPerPlane]
+        * [(NSBitmapImageRep*)rep numberOfPlanes];
+    }
+  w = [rep pixelsWide];
+  h = [rep pixelsHigh];
+  if (w > 0 && h > 0)
+    {
+      return w * h * 4;
+    }
+  return 0;
+}
+
+/* Returns the number of bytes used by the resampled bitmaps of cache. */
+static NSUInteger
+scaled_byte_size(GSImageRepCache *cache)
+{
+  NSUInteger total = 0;
+  unsigned i;
+
+  if (cache != NULL)
+    {
+      for (i = 0; i < GS_SCALED_REP_SLOTS; i++)
+        {
+          total += rep_byte_size(cache->scaled[i].rep);
+        }
+    }
+  return total;
+}
+
+typedef struct
+{
+  NSUInteger stamp;
+  NSString *name;
+} GSNameUse;
+
+static int
+compare_name_use(const void *a, const void *b)
+{
+  NSUInteger sa = ((const GSNameUse*)a)->stamp;
+  NSUInteger sb = ((const GSNameUse*)b)->stamp;
+
+  return (sa < sb) ? -1 : ((sa > sb) ? 1 : 0);
+}
+
 /* Find the GSRepData object holding a representation */
 static GSRepData*
 repd_for_rep(NSArray *_reps, NSImageRep *rep)
@@ -380,17 +570,71 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
   return nil;
 }
 
+/* Decodes an image file on one of the threads of loadQueue and passes
+   the image to its target on the main thread. The image rep registry
+   and the filter services are not thread safe, so the rep class is
+   chosen and the file filtered on the main thread, but the data is
+   always decoded here. The target is only used on the main thread. */
+@interface GSImageLoadOperation : NSOperation
+{
+@public
+  Class imageClass;
+  Class repClass;
+  BOOL needsFilter;
+  NSString *fileName;
+  id target;
+  SEL selector;
+  NSData *data;
+  NSArray *reps;
+}
+@end
+
 @interface NSImage (Private)
 + (void) _clearFileTypeCaches: (NSNotification*)notif;
 + (void) _reloadCachedImages;
++ (void) _scheduleTrim;
++ (void) _trimNamedImages;
+- (NSUInteger) _discardCachedReps;
 - (BOOL) _useFromFile: (NSString *)fileName;
 - (BOOL) _loadFromData: (NSData *)data;
 - (BOOL) _loadFromFile: (NSString *)fileName;
 - (BOOL) _resetAndUseFromFile: (NSString *)fileName;
 - (GSRepData*) _cacheForRep: (NSImageRep*)rep;
 - (NSCachedImageRep*) _doImageCache: (NSImageRep *)rep;
+- (GSImageRepCache *) _repCache;
+- (void) _invalidateBestReps;
+- (void) _invalidateRepCache;
+- (NSMutableArray *) _cachesForRep: (NSImageRep *)rep;
+- (NSDictionary *) _deviceDescription: (NSDictionary*)deviceDescription;
+- (NSImageRep *) _scaledRep: (NSImageRep *)rep
+                    forRect: (NSRect)srcRect
+                     inRect: (NSRect)dstRect
+                    context: (NSGraphicsContext *)ctxt;
 @end
 
+/* Marks a named image as used, for the LRU order of the named image
+   cache. The stamp is kept in the image so that drawing does not need
+   imageLock; the cache only needs an approximate order. */
+static void
+touch_image(NSImage *image)
+{
+  [image _repCache]->lastUse = ++useClock;
+}
+
+/* Forgets that image was evicted from the named image cache while still
+   in use. Must be called with imageLock held. */
+static void
+forget_evicted(NSImage *image)
+{
+  NSString *name = (NSString*)NSMapGet(evictedNames, image);
+
+  if (name != nil)
+    {
+      NSMapRemove(evictedImages, name);
+      NSMapRemove(evictedNames, image);
+    }
+}
+
 @implementation NSImage
 
 + (void) initialize
@@ -416,6 +660,28 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
       clearColor = RETAIN([NSColor clearColor]);
       cachedClass = [NSCachedImageRep class];
       bitmapClass = [NSBitmapImageRep class];
+      loadQueue = [NSOperationQueue new];
+      [loadQueue setMaxConcurrentOperationCount:
+        [[NSProcessInfo processInfo] activeProcessorCount]];
+      loadedNames = [NSMutableSet new];
+      evictedImages = NSCreateMapTable(NSObjectMapKeyCallBacks,
+                                       NSNonRetainedObjectMapValueCallBacks,
+                                       16);
+      evictedNames = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                                      NSObjectMapValueCallBacks, 16);
+      repCacheLock = [NSLock new];
+      repCaches = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                                   NSNonOwnedPointerMapValueCallBacks, 64);
+      if ([[NSUserDefaults standardUserDefaults]
+            objectForKey: @"GSNamedImageCacheLimit"] != nil)
+        {
+          namedImageCacheLimit = [[NSUserDefaults standardUserDefaults]
+                                   integerForKey: @"GSNamedImageCacheLimit"];
+        }
+      else
+        {
+          namedImageCacheLimit = 64 * 1024 * 1024;
+        }
       [[NSNotificationCenter defaultCenter]
 	addObserver: self
 	   selector: @selector(_clearFileTypeCaches:)
@@ -440,6 +706,16 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
   image = (NSImage*)[nameDict objectForKey: realName];
 
   if (image == nil && realName != nil)
+    {
+      image = (NSImage*)NSMapGet(evictedImages, realName);
+    }
+  if (image != nil && image->_name == nil)
+    {
+      /* Evicted but still in use, so the same image is named again */
+      [image setName: realName];
+      [loadedNames addObject: realName];
+    }
+  else if (image == nil && realName != nil)
     {
       NSString  *path = [[NSBundle mainBundle] pathForImageResource: realName];
 
@@ -452,9 +728,15 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
               [image setName: realName];
               image->_flags.archiveByName = YES;
               AUTORELEASE(image);
+              /* It can be loaded again if it is evicted */
+              [loadedNames addObject: realName];
             }
         }
     }
+  else if (image != nil)
+    {
+      touch_image(image);
+    }
 
   IF_NO_GC([[image retain] autorelease]);
   [imageLock unlock];
@@ -635,8 +917,22 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
 
 - (void) dealloc
 {
+  GSImageRepCache *cache;
+
   if (_name == nil)
     {
+      if (NSCountMapTable(evictedNames) > 0)
+        {
+          [imageLock lock];
+          forget_evicted(self);
+          [imageLock unlock];
+        }
+      [self _invalidateRepCache];
+      [repCacheLock lock];
+      cache = (GSImageRepCache*)NSMapGet(repCaches, self);
+      NSMapRemove(repCaches, self);
+      [repCacheLock unlock];
+      free(cache);
       RELEASE(_reps);
       TEST_RELEASE(_fileName);
       RELEASE(_color);
@@ -730,6 +1026,7 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
       /* We retain self in case removing from the dictionary releases us */
       IF_NO_GC([[self retain] autorelease]);
       [nameDict removeObjectForKey: _name]; 
+      [loadedNames removeObject: _name];
       DESTROY(_name);
     }
   
@@ -741,9 +1038,12 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
       return NO;
     }
 
+  forget_evicted(self);
   ASSIGN(_name, aName);
 
   [nameDict setObject: self forKey: _name];
+  touch_image(self);
+  [NSImage _scheduleTrim];
   
   [imageLock unlock];
   return YES;
@@ -793,6 +1093,7 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
 - (void) setUsesEPSOnResolutionMismatch: (BOOL)flag
 {
   _flags.useEPSOnResolutionMismatch = flag;
+  [self _invalidateBestReps];
 }
 
 - (BOOL) usesEPSOnResolutionMismatch
@@ -803,6 +1104,7 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
 - (void) setPrefersColorMatch: (BOOL)flag
 {
   _flags.colorMatchPreferred = flag;
+  [self _invalidateBestReps];
 }
 
 - (BOOL) prefersColorMatch
@@ -813,6 +1115,7 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
 - (void) setMatchesOnMultipleResolution: (BOOL)flag
 {
   _flags.multipleResolutionMatching = flag;
+  [self _invalidateBestReps];
 }
 
 - (BOOL) matchesOnMultipleResolution
@@ -910,6 +1213,7 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
           [_reps removeObjectAtIndex: i];
         }
     }
+  [self _invalidateRepCache];
 }
 
 - (void) setScalesWhenResized: (BOOL)flag
@@ -1100,6 +1404,7 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
 	      hints: (NSDictionary*)hints
 {
   NSImageRep *rep;
+  NSImageRep *scaledRep;
   NSGraphicsContext *ctxt;
   NSSize imgSize, repSize;
   NSRect repSrcRect;
@@ -1131,11 +1436,24 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
 
   // Try to cache / get a cached version of the best rep
   
+  /**
+   * If asked to, bitmaps drawn at less than half their size are replaced
+   * by a copy resampled on the CPU, which looks much better than what the
+   * backend makes of such a reduction.
+   */
+  if (_flags.resamplesWhenReduced && _cacheMode != NSImageCacheNever &&
+      (scaledRep = [self _scaledRep: rep
+			    forRect: srcRect
+			     inRect: dstRect
+			    context: ctxt]) != nil)
+    {
+      rep = scaledRep;
+    }
   /** 
    * We only use caching on backends that can efficiently draw a rect from the cache
    * onto the current graphics context respecting the CTM, which is currently cairo.
    */
-  if (_cacheMode != NSImageCacheNever &&
+  else if (_cacheMode != NSImageCacheNever &&
       [ctxt supportsDrawGState])
     {
       NSCachedImageRep *cache = [self _doImageCache: rep];
@@ -1178,6 +1496,7 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
       repd->rep = RETAIN(imageRep);
       [_reps addObject: repd]; 
       RELEASE(repd);
+      [self _invalidateBestReps];
     }
 }
 
@@ -1194,6 +1513,10 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
       [_reps addObject: repd]; 
       RELEASE(repd);
     }
+  if (count > 0)
+    {
+      [self _invalidateBestReps];
+    }
 }
 
 - (void) removeRepresentation: (NSImageRep *)imageRep
@@ -1217,6 +1540,7 @@ repd_for_rep(NSArray *_reps, NSImageRep *rep)
           [_reps removeObjectAtIndex: i];
         }
     }
+  [self _invalidateRepCache];
 }
 
 - (void) lockFocus
@@ -1631,23 +1955,7 @@ static NSSize GSResolutionOfImageRep(NSImageRep *rep)
 {
   NSMutableArray *reps = [self _representationsWithCachedImages: NO];
   
-  if (deviceDescription == nil)
-    {
-      if ([GSCurrentContext() isDrawingToScreen] == YES)
-        {
-          // Take the device description from the current context.
-          deviceDescription = [[[GSCurrentContext() attributes] objectForKey: 
-                NSGraphicsContextDestinationAttributeName] 
-                                  deviceDescription];
-        }
-      else if ([NSPrintOperation currentOperation])
-        {
-          /* FIXME: We could try to use the current printer, 
-             but there are many cases where might
-             not be printing (EPS, PDF, etc) to a specific device */
-        }
-    }
-
+  deviceDescription = [self _deviceDescription: deviceDescription];
   if (_flags.colorMatchPreferred == YES)
     {
       reps = [self _bestRep: reps withColorMatch: deviceDescription];
@@ -1665,7 +1973,20 @@ static NSSize GSResolutionOfImageRep(NSImageRep *rep)
 
 - (NSImageRep *) bestRepresentationForDevice: (NSDictionary*)deviceDescription
 {
-  NSArray *reps = [self _bestRepresentationsForDevice: deviceDescription];
+  GSBestRepKey key;
+  NSImageRep *bestRep = nil;
+  NSArray *reps;
+
+  /* The choice only changes with the device, the image size and the
+   * representations, so remember it for the next drawing operation. */
+  deviceDescription = [self _deviceDescription: deviceDescription];
+  best_rep_key(&key, deviceDescription, NO, _size);
+  if (best_rep_lookup([self _repCache], &key, &bestRep) == YES)
+    {
+      return bestRep;
+    }
+
+  reps = [self _bestRepresentationsForDevice: deviceDescription];
 
   /* If we have more than one match check for a representation whose size
    * matches the image size exactly. Otherwise, arbitrarily choose the first
@@ -1679,29 +2000,37 @@ static NSSize GSResolutionOfImageRep(NSImageRep *rep)
 	{
 	  if (NSEqualSizes(_size, [rep size]) == YES)
 	    {
-	      return rep;
+	      bestRep = rep;
+	      break;
 	    }
 	}
     }
   
-  
-  if ([reps count] > 0)
+  if (bestRep == nil && [reps count] > 0)
     {
-      return [reps objectAtIndex: 0];
-    }
-  else
-    {
-      return nil;
+      bestRep = [reps objectAtIndex: 0];
     }
+  best_rep_remember([self _repCache], &key, bestRep);
+  return bestRep;
 }
 
 - (NSImageRep *) bestRepresentationForRect: (NSRect)rect
 				   context: (NSGraphicsContext *)context
 				     hints: (NSDictionary *)deviceDescription
 {
-  NSArray *reps = [self _bestRepresentationsForDevice: deviceDescription];
   const NSSize desiredSize = rect.size;
   NSImageRep *bestRep = nil;
+  GSBestRepKey key;
+  NSArray *reps;
+
+  deviceDescription = [self _deviceDescription: deviceDescription];
+  best_rep_key(&key, deviceDescription, YES, desiredSize);
+  if (best_rep_lookup([self _repCache], &key, &bestRep) == YES)
+    {
+      return bestRep;
+    }
+
+  reps = [self _bestRepresentationsForDevice: deviceDescription];
 
   // Pick the smallest rep that is greater than or equal to the
   // desired size.
@@ -1728,6 +2057,7 @@ static NSSize GSResolutionOfImageRep(NSImageRep *rep)
     {
       bestRep = [reps lastObject];
     }
+  best_rep_remember([self _repCache], &key, bestRep);
   
   return bestRep;
 }
@@ -2158,6 +2488,264 @@ iterate_reps_for_types(NSArray* imageReps, SEL method)
   return (NSArray *)types;
 }
 
+@implementation GSImageLoadOperation
+
+- (void) dealloc
+{
+  RELEASE(fileName);
+  RELEASE(data);
+  RELEASE(reps);
+  [super dealloc];
+}
+
+- (void) main
+{
+  NSAutoreleasePool *pool = [NSAutoreleasePool new];
+
+  if ([self isCancelled])
+    {
+      DESTROY(pool);
+      return;
+    }
+
+  NS_DURING
+    {
+      if (needsFilter)
+        {
+          [self performSelectorOnMainThread: @selector(_filter)
+                                 withObject: nil
+                              waitUntilDone: YES];
+        }
+      else
+        {
+          data = RETAIN([NSData dataWithContentsOfFile: fileName]);
+        }
+
+      /* Without a known file type, look at the data instead. The formats
+         of NSBitmapImageRep can be recognised on this thread; any other
+         rep class has to be found on the main thread. */
+      if (data != nil && repClass == Nil && ![self isCancelled])
+        {
+          if ([bitmapClass canInitWithData: data])
+            {
+              repClass = bitmapClass;
+            }
+          else
+            {
+              [self performSelectorOnMainThread: @selector(_findRepClass)
+                                     withObject: nil
+                                  waitUntilDone: YES];
+            }
+        }
+
+      if (data == nil || repClass == Nil || [self isCancelled])
+        {
+          reps = nil;
+        }
+      else if ([repClass respondsToSelector: @selector(imageRepsWithData:)])
+        {
+          reps = RETAIN([repClass imageRepsWithData: data]);
+        }
+      else
+        {
+          NSImageRep *rep = [repClass imageRepWithData: data];
+
+          if (rep != nil)
+            {
+              reps = [[NSArray alloc] initWithObjects: rep, nil];
+            }
+        }
+    }
+  NS_HANDLER
+    {
+      NSDebugLLog(@"NSImage", @"Failed to load %@: %@",
+                  fileName, localException);
+      DESTROY(reps);
+    }
+  NS_ENDHANDLER
+  DESTROY(data);
+  [self performSelectorOnMainThread: @selector(_deliver)
+                         withObject: nil
+                      waitUntilDone: NO];
+  DESTROY(pool);
+}
+
+/* Called on the main thread to convert the file to a type repClass
+   reads, as +[NSImageRep imageRepsWithContentsOfFile:] does. */
+- (void) _filter
+{
+  NSPasteboard *p;
+  NSEnumerator *enumerator;
+  NSMutableArray *ptypes;
+  NSString *type;
+
+  if ([self isCancelled])
+    {
+      return;
+    }
+  p = [NSPasteboard pasteboardByFilteringFile: fileName];
+  ptypes = [NSMutableArray array];
+  enumerator = [[repClass imageUnfilteredFileTypes] objectEnumerator];
+  while ((type = [enumerator nextObject]) != nil)
+    {
+      [ptypes addObject: NSCreateFileContentsPboardType(type)];
+    }
+  type = [p availableTypeFromArray: ptypes];
+  if (type != nil)
+    {
+      ASSIGN(data, [p dataForType: type]);
+    }
+}
+
+/* Called on the main thread to look up the rep class for data. */
+- (void) _findRepClass
+{
+  repClass = [NSImageRep imageRepClassForData: data];
+}
+
+/* Called on the main thread, so a load cancelled there is never
+   delivered. */
+- (void) _deliver
+{
+  id t = target;
+  NSImage *image = nil;
+
+  target = nil;
+  if (t == nil)
+    {
+      return;
+    }
+
+  if ([reps count] > 0)
+    {
+      image = AUTORELEASE([[imageClass alloc] init]);
+      [image setDataRetained: YES];
+      [image addRepresentations: reps];
+    }
+  [t performSelector: selector withObject: image];
+}
+
+- (void) cancel
+{
+  target = nil;
+  [super cancel];
+}
+
+@end
+
+@implementation NSImage (GSAsynchronousLoading)
+
++ (id) loadImageWithContentsOfFile: (NSString *)fileName
+                            target: (id)target
+                          selector: (SEL)aSelector
+{
+  GSImageLoadOperation *op;
+  NSString *ext;
+
+  if (fileName == nil || target == nil || aSelector == 0)
+    {
+      return nil;
+    }
+  if (![NSThread isMainThread])
+    {
+      NSWarnMLog(@"called on a thread other than the main thread");
+    }
+
+  op = AUTORELEASE([GSImageLoadOperation new]);
+  op->imageClass = self;
+  ASSIGNCOPY(op->fileName, fileName);
+  op->target = target;
+  op->selector = aSelector;
+
+  /* Choose the rep class here, as +imageRepsWithContentsOfFile: would,
+     since the registry must not be used by the worker threads. When
+     the extension is not known the worker looks at the data. */
+  ext = [[fileName pathExtension] lowercaseString];
+  if ([ext length] > 0)
+    {
+      op->repClass = [NSImageRep imageRepClassForFileType: ext];
+      op->needsFilter = (op->repClass != Nil
+        && ![[op->repClass imageUnfilteredFileTypes] containsObject: ext]);
+    }
+  [loadQueue addOperation: op];
+  return op;
+}
+
++ (void) cancelImageLoad: (id)loadToken
+{
+  if (![NSThread isMainThread])
+    {
+      NSWarnMLog(@"called on a thread other than the main thread");
+    }
+  [loadToken cancel];
+}
+
+@end
+
+@implementation NSImage (GSResampling)
+
+- (void) setResamplesWhenReduced: (BOOL)flag
+{
+  if (_flags.resamplesWhenReduced && !flag)
+    {
+      [self _invalidateRepCache];
+    }
+  _flags.resamplesWhenReduced = flag;
+}
+
+- (BOOL) resamplesWhenReduced
+{
+  return _flags.resamplesWhenReduced;
+}
+
+@end
+
+@implementation NSImage (GSNamedImageCache)
+
++ (void) setNamedImageCacheLimit: (NSUInteger)bytes
+{
+  [imageLock lock];
+  namedImageCacheLimit = bytes;
+  [self _scheduleTrim];
+  [imageLock unlock];
+}
+
++ (NSUInteger) namedImageCacheLimit
+{
+  return namedImageCacheLimit;
+}
+
++ (NSUInteger) namedImageCacheSize
+{
+  NSEnumerator *e;
+  NSImage *image;
+  NSUInteger total = 0;
+
+  [imageLock lock];
+  e = [nameDict objectEnumerator];
+  while ((image = [e nextObject]) != nil)
+    {
+      total += [image byteSize];
+    }
+  [imageLock unlock];
+  return total;
+}
+
+- (NSUInteger) byteSize
+{
+  NSUInteger count = [_reps count];
+  NSUInteger total = scaled_byte_size(rep_cache(self, NO));
+  NSUInteger i;
+
+  for (i = 0; i < count; i++)
+    {
+      total += rep_byte_size(((GSRepData*)[_reps objectAtIndex: i])->rep);
+    }
+  return total;
+}
+
+@end
+
 @implementation NSImage (Private)
     
 + (void) _clearFileTypeCaches: (NSNotification*)notif
@@ -2197,6 +2785,121 @@ iterate_reps_for_types(NSArray* imageReps, SEL method)
   [imageLock unlock];
 }
 
+/* Arranges for the named images to be trimmed to the cache limit once
+   control returns to the run loop. Must be called with imageLock held. */
++ (void) _scheduleTrim
+{
+  if (trimScheduled == NO && namedImageCacheLimit > 0)
+    {
+      trimScheduled = YES;
+      [self performSelectorOnMainThread: @selector(_trimNamedImages)
+                             withObject: nil
+                          waitUntilDone: NO];
+    }
+}
+
+/* Brings the bytes used by the named images under namedImageCacheLimit.
+ * Images loaded by +imageNamed: lose their name and are released, least
+ * recently used first. An image still used elsewhere is remembered,
+ * without being retained, as in the font cache of NSFont, so that
+ * +imageNamed: returns it again rather than loading a copy. If that is
+ * not enough, the cached reps of the images not used since the last
+ * trim are discarded too.
+ */
++ (void) _trimNamedImages
+{
+  NSUInteger total = 0;
+  NSUInteger count, i;
+
+  [imageLock lock];
+  trimScheduled = NO;
+  count = [nameDict count];
+  if (namedImageCacheLimit > 0 && count > 0)
+    {
+      NSString *keys[count];
+      GSNameUse *uses;
+      NSImage *image;
+
+      [[nameDict allKeys] getObjects: keys];
+      for (i = 0; i < count; i++)
+        {
+          total += [[nameDict objectForKey: keys[i]] byteSize];
+        }
+
+      if (total > namedImageCacheLimit
+        && (uses = malloc(count * sizeof(GSNameUse))) != NULL)
+        {
+          /* Sort the names by last use, oldest first */
+          for (i = 0; i < count; i++)
+            {
+              uses[i].name = keys[i];
+              uses[i].stamp
+                = [[nameDict objectForKey: keys[i]] _repCache]->lastUse;
+            }
+          qsort(uses, count, sizeof(GSNameUse), compare_name_use);
+
+          for (i = 0; i < count && total > namedImageCacheLimit; i++)
+            {
+              NSString *name = uses[i].name;
+
+              image = [nameDict objectForKey: name];
+              if ([loadedNames containsObject: name])
+                {
+                  NSDebugLLog(@"NSImage", @"Evicting image %@", name);
+                  total -= MIN(total, [image byteSize]);
+                  [loadedNames removeObject: name];
+                  /* Forgotten again by -dealloc */
+                  NSMapInsert(evictedImages, name, image);
+                  NSMapInsert(evictedNames, image, name);
+                  /* Without its name, the image may be deallocated */
+                  DESTROY(image->_name);
+                  [nameDict removeObjectForKey: name];
+                  uses[i].name = nil;
+                }
+            }
+
+          for (i = 0; i < count && total > namedImageCacheLimit; i++)
+            {
+              if (uses[i].name != nil && uses[i].stamp <= trimClock)
+                {
+                  image = [nameDict objectForKey: uses[i].name];
+                  total -= MIN(total, [image _discardCachedReps]);
+                }
+            }
+          free(uses);
+        }
+    }
+  trimClock = useClock;
+  [imageLock unlock];
+}
+
+/* Removes the reps cached by -_cacheForRep: from the receiver and
+   returns the number of bytes they used. */
+- (NSUInteger) _discardCachedReps
+{
+  NSUInteger bytes = 0;
+  NSUInteger i;
+
+  if (_lockedView != nil)
+    {
+      return 0;
+    }
+  bytes = scaled_byte_size(rep_cache(self, NO));
+  i = [_reps count];
+  while (i-- > 0)
+    {
+      GSRepData *repd = (GSRepData*)[_reps objectAtIndex: i];
+
+      if (repd->original != nil)
+        {
+          bytes += rep_byte_size(repd->rep);
+          [_reps removeObjectAtIndex: i];
+        }
+    }
+  [self _invalidateRepCache];
+  return bytes;
+}
+
 
 + (NSString *) _resourceNameForImageNamed: (NSString *)aName 
                                      type: (NSString **)aType
@@ -2284,12 +2987,14 @@ iterate_reps_for_types(NSArray* imageReps, SEL method)
 
   ASSIGN(_fileName, fileName);
   _flags.syncLoad = YES;
+  [self _invalidateBestReps];
   return YES;
 }
 
 - (BOOL) _resetAndUseFromFile: (NSString *)fileName
 {
   [_reps removeAllObjects];
+  [self _invalidateRepCache];
   
   if (!_flags.sizeWasExplicitlySet)
     {
@@ -2328,11 +3033,199 @@ iterate_reps_for_types(NSArray* imageReps, SEL method)
       
       NSDebugLLog(@"NSImage", @"Rendered rep %p on background %@",
                   cache, repd->bg);
+      if (_name != nil)
+        {
+          [imageLock lock];
+          [NSImage _scheduleTrim];
+          [imageLock unlock];
+        }
+    }
+  if (_name != nil)
+    {
+      touch_image(self);
     }
   
   return cache;
 }
 
+- (GSImageRepCache *) _repCache
+{
+  return rep_cache(self, YES);
+}
+
+/* Forgets the representations chosen by -bestRepresentationForDevice:
+   and -bestRepresentationForRect:context:hints:. Must be called whenever
+   something they depend upon changes. */
+- (void) _invalidateBestReps
+{
+  GSImageRepCache *cache = rep_cache(self, NO);
+
+  if (cache != NULL)
+    {
+      cache->count = 0;
+      cache->next = 0;
+    }
+}
+
+/* As -_invalidateBestReps, and also drops the index of the cached reps
+   and the resampled bitmaps. Must be called whenever a rep is removed
+   from _reps. */
+- (void) _invalidateRepCache
+{
+  GSImageRepCache *cache = rep_cache(self, NO);
+
+  if (cache != NULL)
+    {
+      unsigned i;
+
+      [self _invalidateBestReps];
+      if (cache->caches != NULL)
+        {
+          NSFreeMapTable(cache->caches);
+          cache->caches = NULL;
+        }
+      for (i = 0; i < GS_SCALED_REP_SLOTS; i++)
+        {
+          cache->scaled[i].original = nil;
+          DESTROY(cache->scaled[i].rep);
+        }
+    }
+}
+
+/* Returns the GSRepData of the reps cached for rep, building the index
+   from _reps the first time it is needed. The array is kept up to date
+   by -_cacheForRep: as it adds new caches. */
+- (NSMutableArray *) _cachesForRep: (NSImageRep *)rep
+{
+  GSImageRepCache *cache = [self _repCache];
+  NSMutableArray *caches;
+
+  if (cache->caches == NULL)
+    {
+      NSUInteger count = [_reps count];
+      NSUInteger i;
+
+      cache->caches = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+        NSObjectMapValueCallBacks, 0);
+      for (i = 0; i < count; i++)
+        {
+          GSRepData *repd = (GSRepData*)[_reps objectAtIndex: i];
+
+          if (repd->original != nil)
+            {
+              [[self _cachesForRep: repd->original] addObject: repd];
+            }
+        }
+    }
+
+  caches = NSMapGet(cache->caches, rep);
+  if (caches == nil)
+    {
+      caches = [NSMutableArray new];
+      NSMapInsert(cache->caches, rep, caches);
+      RELEASE(caches);
+    }
+  return caches;
+}
+
+/* Returns a bitmap resampled from rep for drawing its part srcRect (in
+   image coordinates) into dstRect, when that reduces it to half its
+   size or less. The bitmap is reduced by the largest power of two that
+   still leaves at least as many pixels as the destination covers, so
+   that the backend only has to scale it down a little further. The last
+   few are kept until the representations change or -recache is called. */
+- (NSImageRep *) _scaledRep: (NSImageRep *)rep
+                    forRect: (NSRect)srcRect
+                     inRect: (NSRect)dstRect
+                    context: (NSGraphicsContext *)ctxt
+{
+  GSImageRepCache *cache;
+  NSBitmapImageRep *scaled;
+  NSSize pixels;
+  NSSize imgSize;
+  double factor;
+  NSUInteger level;
+  NSInteger w, h;
+  unsigned i;
+
+  if ([rep isKindOfClass: bitmapClass] == NO || ctxt == nil)
+    {
+      return nil;
+    }
+  pixels = [[ctxt GSCurrentCTM] transformSize: dstRect.size];
+  imgSize = [self size];
+  w = [rep pixelsWide];
+  h = [rep pixelsHigh];
+  if (fabs(pixels.width) < 1 || fabs(pixels.height) < 1 || w <= 1 || h <= 1)
+    {
+      return nil;
+    }
+
+  /* Source pixels per destination pixel */
+  factor = MIN(srcRect.size.width / imgSize.width * w / fabs(pixels.width),
+               srcRect.size.height / imgSize.height * h / fabs(pixels.height));
+  if (!(factor >= 2.0))
+    {
+      return nil;
+    }
+  level = (NSUInteger)floor(log2(factor));
+
+  cache = [self _repCache];
+  for (i = 0; i < GS_SCALED_REP_SLOTS; i++)
+    {
+      if (cache->scaled[i].original == rep && cache->scaled[i].level == level)
+        {
+          return cache->scaled[i].rep;
+        }
+    }
+
+  scaled = [(NSBitmapImageRep*)rep
+             bitmapImageRepByResamplingToPixelsWide: MAX(1, w >> level)
+                                         pixelsHigh: MAX(1, h >> level)
+                                             filter: GSImageResamplingMitchell];
+  if (scaled == nil)
+    {
+      return nil;
+    }
+  NSDebugLLog(@"NSImage", @"Resampled %@ to level %lu", rep,
+              (unsigned long)level);
+  i = cache->nextScaled;
+  cache->scaled[i].original = rep;
+  cache->scaled[i].level = level;
+  ASSIGN(cache->scaled[i].rep, scaled);
+  cache->nextScaled = (i + 1) % GS_SCALED_REP_SLOTS;
+  if (_name != nil)
+    {
+      [imageLock lock];
+      [NSImage _scheduleTrim];
+      [imageLock unlock];
+    }
+  return scaled;
+}
+
+/* Returns deviceDescription, or when that is nil the description of the
+   device the current context draws to. */
+- (NSDictionary *) _deviceDescription: (NSDictionary*)deviceDescription
+{
+  if (deviceDescription == nil)
+    {
+      if ([GSCurrentContext() isDrawingToScreen] == YES)
+        {
+          // Take the device description from the current context.
+          deviceDescription = [[[GSCurrentContext() attributes] objectForKey: 
+                NSGraphicsContextDestinationAttributeName] 
+                                  deviceDescription];
+        }
+      else if ([NSPrintOperation currentOperation])
+        {
+          /* FIXME: We could try to use the current printer, 
+             but there are many cases where might
+             not be printing (EPS, PDF, etc) to a specific device */
+        }
+    }
+  return deviceDescription;
+}
+
 - (GSRepData*) _cacheForRep: (NSImageRep*)rep
 {
   if ([rep isKindOfClass: cachedClass] == YES)
@@ -2346,7 +3239,20 @@ iterate_reps_for_types(NSArray* imageReps, SEL method)
        * for this image rep. If none is found create a cache to be used to
        * render the image rep into, and switch to the cached rep.
        */
-      NSUInteger count = [_reps count];
+      NSMutableArray *caches;
+      NSUInteger count;
+
+      /* Only the caches made for rep need to be looked at. With no rep
+       * at all the whole array is searched, as before. */
+      if (rep != nil)
+        {
+          caches = [self _cachesForRep: rep];
+        }
+      else
+        {
+          caches = _reps;
+        }
+      count = [caches count];
 
       if (count > 0)
         {
@@ -2357,7 +3263,7 @@ iterate_reps_for_types(NSArray* imageReps, SEL method)
           NSUInteger i;
           BOOL opaque = [rep isOpaque];
           
-          [_reps getObjects: reps];
+          [caches getObjects: reps];
           
           /*
            * Search the cached image reps for any whose original is our
@@ -2379,7 +3285,8 @@ iterate_reps_for_types(NSArray* imageReps, SEL method)
                                   repd->bg, _color, repd->rep);
                       invalidCache = repd;
                     }
-                  else if (opaque == YES || [repd->bg isEqual: _color] == YES)
+                  else if (opaque == YES || repd->bg == _color
+                    || [repd->bg isEqual: _color] == YES)
                     {
                       NSDebugLLog(@"NSImage", @"Exact %@ ... %@ %@", 
                                   repd->bg, _color, repd->rep);
@@ -2480,6 +3387,10 @@ iterate_reps_for_types(NSArray* imageReps, SEL method)
           repd->rep = cacheRep;
           repd->original = rep; // may be nil!
           [_reps addObject: repd]; 
+          if (rep != nil)
+            {
+              [[self _cachesForRep: rep] addObject: repd];
+            }
           RELEASE(repd); /* Retained in _reps array. */
 
           return repd;
@@ -26,6 +26,7 @@
    Boston, MA 02110-1301, USA.
 */
 
+#import <Foundation/NSMapTable.h>
 #import "AppKit/NSDragging.h"
 #import "AppKit/NSEvent.h"
 #import "AppKit/NSImage.h"
@@ -41,6 +42,10 @@
 static Class usedCellClass;
 static Class imageCellClass;
 
+/* The token of the load started by -setImageWithContentsOfFile:placeholder:
+   for each view waiting for its image. Only used on the main thread. */
+static NSMapTable *imageLoads = NULL;
+
 @implementation NSImageView
 
 //
@@ -53,6 +58,8 @@ static Class imageCellClass;
       [self setVersion: 2];
       imageCellClass = [NSImageCell class];
       usedCellClass = imageCellClass;
+      imageLoads = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                                    NSObjectMapValueCallBacks, 0);
     }
 }
 
@@ -86,8 +93,27 @@ static Class imageCellClass;
   return self;
 }
 
+- (void) dealloc
+{
+  id load = NSMapGet(imageLoads, self);
+
+  if (load != nil)
+    {
+      [NSImage cancelImageLoad: load];
+      NSMapRemove(imageLoads, self);
+    }
+  [super dealloc];
+}
+
 - (void) setImage: (NSImage *)image
 {
+  id load = NSMapGet(imageLoads, self);
+
+  if (load != nil)
+    {
+      [NSImage cancelImageLoad: load];
+      NSMapRemove(imageLoads, self);
+    }
   [_cell setImage: image];
   [self updateCell: _cell];
 }
@@ -432,4 +458,28 @@ static Class imageCellClass;
   _ivflags.initiatesDrag = flag;
 }
 
+- (void) setImageWithContentsOfFile: (NSString *)path
+                        placeholder: (NSImage *)placeholder
+{
+  id load;
+
+  [self setImage: placeholder];
+  load = [NSImage loadImageWithContentsOfFile: path
+                                       target: self
+                                     selector: @selector(_imageDidLoad:)];
+  if (load != nil)
+    {
+      NSMapInsert(imageLoads, self, load);
+    }
+}
+
+- (void) _imageDidLoad: (NSImage *)image
+{
+  NSMapRemove(imageLoads, self);
+  if (image != nil)
+    {
+      [self setImage: image];
+    }
+}
+
 @end
@@ -37,6 +37,9 @@
 #import <Foundation/NSKeyValueCoding.h>
 #import <Foundation/NSLock.h>
 #import <Foundation/NSMapTable.h>
+#import <Foundation/NSRunLoop.h>
+#import <Foundation/NSThread.h>
+#import <Foundation/NSUserDefaults.h>
 #import <Foundation/NSValue.h>
 #import <Foundation/NSValueTransformer.h>
 #import <GNUstepBase/GSLock.h>
@@ -122,7 +125,54 @@
 
 static NSRecursiveLock *bindingLock = nil;
 static NSMapTable *classTable = NULL;      //available bindings
-static NSMapTable *objectTable = NULL;     //bound bindings
+
+/* The bound bindings are spread over several tables, each with its own
+ * lock, chosen by the address of the bound object. Lookups for different
+ * objects rarely contend. The number of objects in each table is read
+ * atomically before taking its lock, so that a table holding no object
+ * at all is skipped without locking, which is the common case for views
+ * and cells being deallocated in applications making little use of
+ * bindings. The locks are lazy, so they cost next to nothing until a
+ * second thread is started.
+ */
+#define GS_BINDING_STRIPES 64
+
+typedef struct {
+  NSRecursiveLock *lock;
+  NSMapTable *table;                       //bound bindings
+  NSUInteger count;                        //number of bound objects
+} GSBindingStripe;
+
+static GSBindingStripe *objectTables = NULL;
+
+/* When coalescing, bindings whose observed value changes on the main
+ * thread are only marked dirty. Each dirty binding is then updated once,
+ * with the value current at that time, just before the windows are
+ * redisplayed at the end of the run loop iteration.
+ */
+static BOOL coalescesUpdates = NO;
+static NSMapTable *pendingUpdates = NULL;  //binding -> binding name
+static NSArray *updateModes = nil;
+static NSUInteger appliedUpdates = 0;
+static NSUInteger coalescedUpdates = 0;
+
+static inline GSBindingStripe *
+stripeForObject(id anObject)
+{
+  uintptr_t h = (uintptr_t)anObject;
+
+  // The low bits of an object address carry little information
+  h ^= h >> 11;
+  return &objectTables[(h >> 4) % GS_BINDING_STRIPES];
+}
+
+/* Returns YES if no object is bound in stripe. The count only changes
+   with the lock of the stripe held. */
+static inline BOOL
+stripeIsEmpty(GSBindingStripe *stripe)
+{
+  return __atomic_load_n(&stripe->count, __ATOMIC_ACQUIRE) == 0;
+}
 
 typedef enum {
   GSBindingOperationAnd = 0,
@@ -143,12 +193,111 @@ void GSBindingInvokeAction(NSString *targetKey, NSString *argumentKey,
 {
   if (self == [GSKeyValueBinding class])
     {
+      GSBindingStripe *stripes;
+      unsigned i;
+
       bindingLock = [GSLazyRecursiveLock new];
       classTable = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
           NSObjectMapValueCallBacks, 128);
-      objectTable = NSCreateMapTable(NSNonRetainedObjectMapKeyCallBacks,
-          NSObjectMapValueCallBacks, 128);
+      stripes = NSZoneCalloc(NSDefaultMallocZone(), GS_BINDING_STRIPES,
+                             sizeof(GSBindingStripe));
+      for (i = 0; i < GS_BINDING_STRIPES; i++)
+        {
+          stripes[i].lock = [GSLazyRecursiveLock new];
+          stripes[i].table = NSCreateMapTable(
+            NSNonRetainedObjectMapKeyCallBacks, NSObjectMapValueCallBacks, 16);
+        }
+      objectTables = stripes;
+
+      coalescesUpdates = [[NSUserDefaults standardUserDefaults]
+                           boolForKey: @"GSCoalesceBindingUpdates"];
+    }
+}
+
++ (void) setCoalescesUpdates: (BOOL)flag
+{
+  coalescesUpdates = flag;
+}
+
++ (BOOL) coalescesUpdates
+{
+  return coalescesUpdates;
+}
+
++ (NSUInteger) appliedUpdateCount
+{
+  return appliedUpdates;
+}
+
++ (NSUInteger) coalescedUpdateCount
+{
+  return coalescedUpdates;
+}
+
++ (void) _applyPendingUpdates: (id)sender
+{
+  NSMapTable *pending = pendingUpdates;
+  NSMapEnumerator enumerator;
+  GSKeyValueBinding *theBinding;
+  NSString *binding;
+
+  // Updates caused by these updates go into a new table
+  pendingUpdates = NULL;
+  if (pending == NULL)
+    return;
+
+  enumerator = NSEnumerateMapTable(pending);
+  while (NSNextMapEnumeratorPair(&enumerator, (void **)&theBinding,
+                                 (void **)&binding))
+    {
+      // The binding may have been removed in the meantime
+      if (theBinding->src != nil)
+        {
+          [theBinding setValueFor: binding];
+          appliedUpdates++;
+        }
+    }
+  NSEndMapTableEnumeration(&enumerator);
+  NSFreeMapTable(pending);
+}
+
+/* Marks the binding as needing an update at the end of the run loop
+ * iteration. Returns NO if updates should be applied right away.
+ */
+- (BOOL) _scheduleValueFor: (NSString *)binding
+{
+  if (!coalescesUpdates || ![NSThread isMainThread])
+    return NO;
+
+  if (pendingUpdates == NULL)
+    {
+      pendingUpdates = NSCreateMapTable(NSObjectMapKeyCallBacks,
+          NSObjectMapValueCallBacks, 64);
+      if (updateModes == nil)
+        {
+          updateModes = [[NSArray alloc] initWithObjects:
+            NSDefaultRunLoopMode, NSModalPanelRunLoopMode,
+            NSEventTrackingRunLoopMode, nil];
+        }
+      /* Run before the windows update their state (599999) and are
+         redisplayed (600000). */
+      [[NSRunLoop currentRunLoop]
+        performSelector: @selector(_applyPendingUpdates:)
+                 target: [GSKeyValueBinding class]
+               argument: nil
+                  order: 599998
+                  modes: updateModes];
+    }
+
+  if (NSMapGet(pendingUpdates, self) != NULL)
+    {
+      coalescedUpdates++;
+    }
+  else
+    {
+      NSMapInsert(pendingUpdates, self, binding);
     }
+  return YES;
 }
 
 + (void) exposeBinding: (NSString *)binding forClass: (Class)clazz
@@ -186,17 +335,22 @@ void GSBindingInvokeAction(NSString *targetKey, NSString *argumentKey,
 {
   NSMutableDictionary *bindings;
   GSKeyValueBinding *theBinding = nil;
+  GSBindingStripe *stripe;
 
-  if (!objectTable)
+  if (!objectTables)
     return nil;
 
-  [bindingLock lock];
-  bindings = (NSMutableDictionary *)NSMapGet(objectTable, (void *)anObject);
+  stripe = stripeForObject(anObject);
+  if (stripeIsEmpty(stripe))
+    return nil;
+
+  [stripe->lock lock];
+  bindings = (NSMutableDictionary *)NSMapGet(stripe->table, (void *)anObject);
   if (bindings != nil)
     {
       theBinding = (GSKeyValueBinding*)[bindings objectForKey: binding];
     }
-  [bindingLock unlock];
+  [stripe->lock unlock];
 
   return theBinding;
 }
@@ -219,25 +373,37 @@ void GSBindingInvokeAction(NSString *targetKey, NSString *argumentKey,
   NSMutableDictionary *bindings;
   id observedObject;
   NSString *keyPath;
-  GSKeyValueBinding *theBinding;
+  GSKeyValueBinding *theBinding = nil;
+  GSBindingStripe *stripe;
 
-  if (!objectTable)
+  if (!objectTables)
     return;
 
-  [bindingLock lock];
-  bindings = (NSMutableDictionary *)NSMapGet(objectTable, (void *)anObject);
-  if (bindings != nil)
+  stripe = stripeForObject(anObject);
+  if (stripeIsEmpty(stripe))
+    return;
+
+  [stripe->lock lock];
+  bindings = (NSMutableDictionary *)NSMapGet(stripe->table, (void *)anObject);
+  theBinding = (GSKeyValueBinding*)[bindings objectForKey: binding];
+  if (theBinding != nil)
     {
-      theBinding = (GSKeyValueBinding*)[bindings objectForKey: binding];
-      if (theBinding != nil)
-        {
-          observedObject = [theBinding->info objectForKey: NSObservedObjectKey];
-          keyPath = [theBinding->info objectForKey: NSObservedKeyPathKey];
-          [observedObject removeObserver: theBinding forKeyPath: keyPath];
-          [bindings setValue: nil forKey: binding];
-        }
+      RETAIN(theBinding);
+      // Keep a pending update from reaching the object
+      theBinding->src = nil;
+      [bindings setValue: nil forKey: binding];
+    }
+  [stripe->lock unlock];
+
+  /* Removing the observer may take locks of the observed object, so it
+     is done without holding the stripe lock. */
+  if (theBinding != nil)
+    {
+      observedObject = [theBinding->info objectForKey: NSObservedObjectKey];
+      keyPath = [theBinding->info objectForKey: NSObservedKeyPathKey];
+      [observedObject removeObserver: theBinding forKeyPath: keyPath];
+      RELEASE(theBinding);
     }
-  [bindingLock unlock];
 }
 
 + (void) unbindAllForObject: (id)anObject
@@ -245,24 +411,40 @@ void GSBindingInvokeAction(NSString *targetKey, NSString *argumentKey,
   NSEnumerator *enumerator;
   NSString *binding;
   NSDictionary *list;
+  NSArray *keys = nil;
+  GSBindingStripe *stripe;
 
-  if (!objectTable)
+  if (!objectTables)
     return;
 
-  [bindingLock lock];
-  list = (NSDictionary *)NSMapGet(objectTable, (void *)anObject);
-  if (list != nil)
+  stripe = stripeForObject(anObject);
+  if (stripeIsEmpty(stripe))
+    return;
+
+  [stripe->lock lock];
+  list = (NSDictionary *)NSMapGet(stripe->table, (void *)anObject);
+  keys = RETAIN([list allKeys]);
+  [stripe->lock unlock];
+
+  if (keys == nil)
+    return;
+
+  /* -unbind: may be overridden and call back into other objects, so the
+     stripe lock must not be held while it runs. */
+  enumerator = [keys objectEnumerator];
+  while ((binding = [enumerator nextObject]))
     {
-      NSArray *keys = [list allKeys];
+      [anObject unbind: binding];
+    }
+  RELEASE(keys);
 
-      enumerator = [keys objectEnumerator];
-      while ((binding = [enumerator nextObject]))
-        {
-          [anObject unbind: binding];
-        }
-      NSMapRemove(objectTable, (void *)anObject);
+  [stripe->lock lock];
+  if (NSMapGet(stripe->table, (void *)anObject) != nil)
+    {
+      NSMapRemove(stripe->table, (void *)anObject);
+      __atomic_sub_fetch(&stripe->count, 1, __ATOMIC_RELEASE);
     }
-  [bindingLock unlock];
+  [stripe->lock unlock];
 }
 
 - (id) initWithBinding: (NSString *)binding 
@@ -273,6 +455,7 @@ void GSBindingInvokeAction(NSString *targetKey, NSString *argumentKey,
             fromObject: (id)source
 {
   NSMutableDictionary *bindings;
+  GSBindingStripe *stripe;
   
   src = source;
   if (options == nil)
@@ -296,16 +479,18 @@ void GSBindingInvokeAction(NSString *targetKey, NSString *argumentKey,
         options: NSKeyValueObservingOptionNew
         context: binding];
 
-  [bindingLock lock];
-  bindings = (NSMutableDictionary *)NSMapGet(objectTable, (void *)source);
+  stripe = stripeForObject(source);
+  [stripe->lock lock];
+  bindings = (NSMutableDictionary *)NSMapGet(stripe->table, (void *)source);
   if (bindings == nil)
     {
       bindings = [NSMutableDictionary new];
-      NSMapInsert(objectTable, (void*)source, (void*)bindings);
+      NSMapInsert(stripe->table, (void*)source, (void*)bindings);
       RELEASE(bindings);
+      __atomic_add_fetch(&stripe->count, 1, __ATOMIC_RELEASE);
     }
   [bindings setObject: self forKey: name];
-  [bindingLock unlock];
+  [stripe->lock unlock];
 
   [self setValueFor: binding];
 
@@ -374,6 +559,18 @@ void GSBindingInvokeAction(NSString *targetKey, NSString *argumentKey,
 
   if (change != nil)
     {
+      if ([self _scheduleValueFor: binding])
+        {
+          return;
+        }
+      if ([[change objectForKey: NSKeyValueChangeKindKey] intValue]
+        != NSKeyValueChangeSetting)
+        {
+          /* Insertions and removals only report the objects concerned,
+             so the whole new value has to be fetched. */
+          [self setValueFor: binding];
+          return;
+        }
       options = [info objectForKey: NSOptionsKey];
       newValue = [change objectForKey: NSKeyValueChangeNewKey];
       newValue = [self transformValue: newValue withOptions: options];
@@ -484,19 +681,24 @@ void GSBindingInvokeAction(NSString *targetKey, NSString *argumentKey,
 - (void) setValueFor: (NSString *)binding 
 {
   NSDictionary *bindings;
+  GSBindingStripe *stripe;
   BOOL res;
   
-  if (!objectTable)
+  if (!objectTables)
     return;
 
- [bindingLock lock];
-  bindings = (NSDictionary *)NSMapGet(objectTable, (void *)src);
+  stripe = stripeForObject(src);
+  [stripe->lock lock];
+  bindings = (NSDictionary *)NSMapGet(stripe->table, (void *)src);
   if (!bindings)
-    return;
+    {
+      [stripe->lock unlock];
+      return;
+    }
 
   res = GSBindingResolveMultipleValueBool(binding, bindings,
                                           GSBindingOperationOr);
-  [bindingLock unlock];
+  [stripe->lock unlock];
   [src setValue: [NSNumber numberWithBool: res] forKey: binding];
 }
 
@@ -505,7 +707,10 @@ void GSBindingInvokeAction(NSString *targetKey, NSString *argumentKey,
                          change: (NSDictionary *)change
                         context: (void *)context
 {
-  [self setValueFor: (NSString*)context];
+  if (![self _scheduleValueFor: (NSString*)context])
+    {
+      [self setValueFor: (NSString*)context];
+    }
 }
 
 @end
@@ -515,19 +720,24 @@ void GSBindingInvokeAction(NSString *targetKey, NSString *argumentKey,
 - (void) setValueFor: (NSString *)binding 
 {
   NSDictionary *bindings;
+  GSBindingStripe *stripe;
   BOOL res;
   
-  if (!objectTable)
+  if (!objectTables)
     return;
 
-  [bindingLock lock];
-  bindings = (NSDictionary *)NSMapGet(objectTable, (void *)src);
+  stripe = stripeForObject(src);
+  [stripe->lock lock];
+  bindings = (NSDictionary *)NSMapGet(stripe->table, (void *)src);
   if (!bindings)
-    return;
+    {
+      [stripe->lock unlock];
+      return;
+    }
 
   res = GSBindingResolveMultipleValueBool(binding, bindings,
                                           GSBindingOperationAnd);
-  [bindingLock unlock];
+  [stripe->lock unlock];
   [src setValue: [NSNumber numberWithBool: res] forKey: binding];
 }
 
@@ -536,7 +746,10 @@ void GSBindingInvokeAction(NSString *targetKey, NSString *argumentKey,
                          change: (NSDictionary *)change
                         context: (void *)context
 {
-  [self setValueFor: (NSString*)context];
+  if (![self _scheduleValueFor: (NSString*)context])
+    {
+      [self setValueFor: (NSString*)context];
+    }
 }
 
 @end
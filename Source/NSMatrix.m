@@ -186,6 +186,29 @@ static inline MPoint MakePoint (NSInteger x, NSInteger y)
              column: (NSInteger)column;
 @end
 
+@interface NSMatrix (GSLazyCells)
+- (void) _setCreatesCellsLazily: (BOOL)flag;
+- (void) _releaseCells;
+@end
+
+/* Matrices which leave their cells empty until they are first used. */
+static NSHashTable *lazyMatrices = NULL;
+
+static id
+lazy_cell(NSMatrix *matrix, NSInteger row, NSInteger column)
+{
+  if (lazyMatrices != NULL && NSHashGet(lazyMatrices, matrix) != NULL)
+    {
+      return [matrix makeCellAtRow: row column: column];
+    }
+  return nil;
+}
+
+/* Reads the cell at row and column, making it if the matrix creates
+   its cells lazily. */
+#define CELL(r, c) \
+  (_cells[r][c] != nil ? _cells[r][c] : lazy_cell(self, r, c))
+
 enum {
   DEFAULT_CELL_HEIGHT = 17,
   DEFAULT_CELL_WIDTH = 100
@@ -395,6 +418,10 @@ static SEL getSel;
       _textObject = nil;
     }
 
+  if (lazyMatrices != NULL)
+    {
+      NSHashRemove(lazyMatrices, self);
+    }
   for (i = 0; i < _maxRows; i++)
     {
       int j;
@@ -785,7 +812,7 @@ static SEL getSel;
 	}
       if (column == _dottedColumn)
 	{
-	  if (_numCols && [_cells[_dottedRow][0] acceptsFirstResponder])
+	  if (_numCols && [CELL(_dottedRow, 0) acceptsFirstResponder])
 	    _dottedColumn = 0;
 	  else
 	    _dottedRow = _dottedColumn = -1;
@@ -838,7 +865,7 @@ static SEL getSel;
 	}
       if (row == _dottedRow)
 	{
-	  if (_numRows && [_cells[0][_dottedColumn] acceptsFirstResponder])
+	  if (_numRows && [CELL(0, _dottedColumn) acceptsFirstResponder])
 	    _dottedRow = 0;
 	  else
 	    _dottedRow = _dottedColumn = -1;
@@ -894,7 +921,7 @@ static SEL getSel;
     {
       for (j = 0; j < _numCols; j++)
 	{
-	  (*add)(sorted, @selector(addObject:), _cells[i][j]);
+	  (*add)(sorted, @selector(addObject:), CELL(i, j));
 	}
     }
 
@@ -924,7 +951,7 @@ static SEL getSel;
     {
       for (j = 0; j < _numCols; j++)
 	{
-	  (*add)(sorted, @selector(addObject:), _cells[i][j]);
+	  (*add)(sorted, @selector(addObject:), CELL(i, j));
 	}
     }
 
@@ -1124,7 +1151,7 @@ static SEL getSel;
 	{
 	  if (_selectedCells[i][j])
 	    {
-	      NSCell *aCell = _cells[i][j];
+	      NSCell *aCell = CELL(i, j);
 	      BOOL isHighlighted = [aCell isHighlighted];
 
 	      _selectedCells[i][j] = NO;
@@ -1168,7 +1195,7 @@ static SEL getSel;
 	{
 	  if (_selectedCells[i][j])
 	    {
-	      [_cells[i][j] setState: NSOffState];
+	      [CELL(i, j) setState: NSOffState];
 	      _selectedCells[i][j] = NO;
 	    }
 	}
@@ -1201,10 +1228,10 @@ static SEL getSel;
     {
       for (j = 0; j < _numCols; j++)
 	{
-	  if ([_cells[i][j] isEnabled] == YES
-	    && [_cells[i][j] isEditable] == NO)
+	  if ([CELL(i, j) isEnabled] == YES
+	    && [CELL(i, j) isEditable] == NO)
 	    {
-	      _selectedCell = _cells[i][j];
+	      _selectedCell = CELL(i, j);
 	      [_selectedCell setState: NSOnState];
 	      _selectedCells[i][j] = YES;
 
@@ -1327,7 +1354,7 @@ static SEL getSel;
 
       while (j-- > 0)
 	{
-	  aCell = _cells[i][j];
+	  aCell = CELL(i, j);
 	  if ([aCell tag] == anInt)
 	    {
 	      [self _selectCell: aCell atRow: i column: j];
@@ -1354,7 +1381,7 @@ static SEL getSel;
 	{
 	  if (_selectedCells[i][j] == YES)
 	    {
-	      [array addObject: _cells[i][j]];
+	      [array addObject: CELL(i, j)];
 	    }
 	}
     }
@@ -1498,7 +1525,7 @@ static SEL getSel;
 	  {
 	    if (_selectedCells[i][j])
 	      {
-		_selectedCell = _cells[i][j];
+		_selectedCell = CELL(i, j);
 		_selectedRow = i;
 		_selectedColumn = j;
 		return;
@@ -1520,7 +1547,7 @@ static SEL getSel;
 {
   if (row < 0 || row >= _numRows || column < 0 || column >= _numCols)
     return nil;
-  return _cells[row][column];
+  return CELL(row, column);
 }
 
 /**<p>Returns the cell with tag <var>anInt</var>
@@ -1536,7 +1563,7 @@ static SEL getSel;
 
       while (j-- > 0)
 	{
-	  id aCell = _cells[i][j];
+	  id aCell = CELL(i, j);
 
 	  if ([aCell tag] == anInt)
 	    {
@@ -1563,7 +1590,7 @@ static SEL getSel;
 
       for (j = 0; j < _numCols; j++)
 	{
-	  (*add)(c, @selector(addObject:), _cells[i][j]);
+	  (*add)(c, @selector(addObject:), CELL(i, j));
 	}
     }
   return c;
@@ -1624,14 +1651,14 @@ static SEL getSel;
   // we select the cell if and only if it is 'selectable', which looks
   // more appropriate.  This is going to start editing if and only if
   // the cell is also 'editable'.
-  if ([_cells[row][column] isSelectable] == NO)
+  if ([CELL(row, column) isSelectable] == NO)
     {
       return nil;
     }
 
   if (_textObject)
     {
-      if (_selectedCell == _cells[row][column])
+      if (_selectedCell == CELL(row, column))
 	{
 	  [_textObject selectAll: self];
 	  return _selectedCell;
@@ -1654,7 +1681,7 @@ static SEL getSel;
 	return nil;
       }
 
-    [self _selectCell: _cells[row][column] atRow: row column: column];
+    [self _selectCell: CELL(row, column) atRow: row column: column];
 
     /* See comment in NSTextField */
     length = [[_selectedCell stringValue] length];
@@ -1678,7 +1705,7 @@ static SEL getSel;
     }
   else if (_cells != 0)
     {
-      return _cells[_dottedRow][_dottedColumn];
+      return CELL(_dottedRow, _dottedColumn);
     }
 
   return nil;
@@ -2000,7 +2027,7 @@ static SEL getSel;
     {
       for (j = 0; j < _numCols; j++)
 	{
-	  NSSize tempSize = [_cells[i][j] cellSize];
+	  NSSize tempSize = [CELL(i, j) cellSize];
 	  tempSize.height = ceil(tempSize.height);
 	  tempSize.width = ceil(tempSize.width);
 	  if (tempSize.width > newSize.width)
@@ -2238,7 +2265,7 @@ static SEL getSel;
 	  for (j = 0; j < _numCols; j++)
 	    {
 	      if (![anObject performSelector: aSelector
-				  withObject: _cells[i][j]])
+				  withObject: CELL(i, j)])
 		{
 		  return;
 		}
@@ -2256,7 +2283,7 @@ static SEL getSel;
 	      if (_selectedCells[i][j])
 		{
 		  if (![anObject performSelector: aSelector
-				      withObject: _cells[i][j]])
+				      withObject: CELL(i, j)])
 		    {
 		      return;
 		    }
@@ -2575,9 +2602,9 @@ static SEL getSel;
 	    column: &column
 	    forPoint: lastLocation])
     {
-      if ([_cells[row][column] isEnabled])
+      if ([CELL(row, column) isEnabled])
 	{
-	  if ([_cells[row][column] isSelectable])
+	  if ([CELL(row, column) isSelectable])
 	    {
 	      NSText *t = [_window fieldEditor: YES forObject: self];
 
@@ -2590,7 +2617,7 @@ static SEL getSel;
 		    }
 		}
 	      // During editing, the selected cell is the cell being edited
-              [self _selectCell: _cells[row][column] atRow: row column: column];
+              [self _selectCell: CELL(row, column) atRow: row column: column];
 	      _textObject = [_selectedCell setUpFieldEditorAttributes: t];
 	      [_selectedCell editWithFrame: [self cellFrameAtRow: row
 						  column: column]
@@ -3244,7 +3271,7 @@ static SEL getSel;
     {
       for (j = 0; j < _numCols; j++)
 	{
-	  [_cells[i][j] setEnabled: flag];
+	  [CELL(i, j) setEnabled: flag];
 	}
     }
 }
@@ -3446,7 +3473,7 @@ static SEL getSel;
 	    {
 	      for (i = 0; i < _numRows; i++)
 		{
-		  if ([_cells[i][h] acceptsFirstResponder])
+		  if ([CELL(i, h) acceptsFirstResponder])
 		    {
 		      _dottedRow = i;
 		      _dottedColumn = h;
@@ -3464,7 +3491,7 @@ static SEL getSel;
 	    {
 	      for (h = 0; h < _numCols; h++)
 		{
-		  if ([_cells[i][h] acceptsFirstResponder])
+		  if ([CELL(i, h) acceptsFirstResponder])
 		    {
 		      _dottedRow = i;
 		      _dottedColumn = h;
@@ -3505,7 +3532,7 @@ static SEL getSel;
 
 	  for (i = _dottedRow-1; i >= 0; i--)
 	    {
-	      if ([_cells[i][_dottedColumn] acceptsFirstResponder])
+	      if ([CELL(i, _dottedColumn) acceptsFirstResponder])
 		{
 		  _dottedRow = i;
 		  break;
@@ -3519,7 +3546,7 @@ static SEL getSel;
 
 	  for (i = _dottedRow+1; i < _numRows; i++)
 	    {
-	      if ([_cells[i][_dottedColumn] acceptsFirstResponder])
+	      if ([CELL(i, _dottedColumn) acceptsFirstResponder])
 		{
 		  _dottedRow = i;
 		  break;
@@ -3533,7 +3560,7 @@ static SEL getSel;
 
 	  for (i = _dottedColumn-1; i >= 0; i--)
 	    {
-	      if ([_cells[_dottedRow][i] acceptsFirstResponder])
+	      if ([CELL(_dottedRow, i) acceptsFirstResponder])
 		{
 		  _dottedColumn = i;
 		  break;
@@ -3547,7 +3574,7 @@ static SEL getSel;
 
 	  for (i = _dottedColumn+1; i < _numCols; i++)
 	    {
-	      if ([_cells[_dottedRow][i] acceptsFirstResponder])
+	      if ([CELL(_dottedRow, i) acceptsFirstResponder])
 		{
 		  _dottedColumn = i;
 		  break;
@@ -3569,7 +3596,7 @@ static SEL getSel;
 	    {
 	      /* FIXME */
 	      /*
-	      NSCell *aCell = _cells[lastDottedRow][lastDottedColumn];
+	      NSCell *aCell = CELL(lastDottedRow, lastDottedColumn);
 	      BOOL    isHighlighted = [aCell isHighlighted];
 
 	      if ([aCell state] || isHighlighted)
@@ -3643,7 +3670,7 @@ static SEL getSel;
 
       for (i = _dottedRow-1; i >= 0; i--)
 	{
-	  if ([_cells[i][_dottedColumn] acceptsFirstResponder])
+	  if ([CELL(i, _dottedColumn) acceptsFirstResponder])
 	    {
 	      _dottedRow = i;
 	      break;
@@ -3660,7 +3687,7 @@ static SEL getSel;
 
       for (i = _dottedRow+1; i < _numRows; i++)
 	{
-	  if ([_cells[i][_dottedColumn] acceptsFirstResponder])
+	  if ([CELL(i, _dottedColumn) acceptsFirstResponder])
 	    {
 	      _dottedRow = i;
 	      break;
@@ -3674,7 +3701,7 @@ static SEL getSel;
 
       for (i = _dottedColumn-1; i >= 0; i--)
 	{
-	  if ([_cells[_dottedRow][i] acceptsFirstResponder])
+	  if ([CELL(_dottedRow, i) acceptsFirstResponder])
 	    {
 	      _dottedColumn = i;
 	      break;
@@ -3688,7 +3715,7 @@ static SEL getSel;
 
       for (i = _dottedColumn+1; i < _numCols; i++)
 	{
-	  if ([_cells[_dottedRow][i] acceptsFirstResponder])
+	  if ([CELL(_dottedRow, i) acceptsFirstResponder])
 	    {
 	      _dottedColumn = i;
 	      break;
@@ -3697,8 +3724,8 @@ static SEL getSel;
     }
 
   [self lockFocus];
-  [self drawCell: _cells[lastDottedRow][lastDottedColumn]];
-  [self drawCell: _cells[_dottedRow][_dottedColumn]];
+  [self drawCell: CELL(lastDottedRow, lastDottedColumn)];
+  [self drawCell: CELL(_dottedRow, _dottedColumn)];
   [self unlockFocus];
   [_window flushWindow];
 
@@ -4001,6 +4028,7 @@ static SEL getSel;
   NSInteger i, j;
   NSInteger oldMaxC;
   NSInteger oldMaxR;
+  BOOL lazy;
   SEL mkSel = @selector(makeCellAtRow:column:);
   IMP mkImp = [self methodForSelector: mkSel];
 
@@ -4042,6 +4070,9 @@ static SEL getSel;
   if (row > _maxRows)
     _maxRows = row;
 
+  // New cells of lazy matrices are made by CELL() when first used.
+  lazy = (lazyMatrices != NULL && NSHashGet(lazyMatrices, self) != NULL);
+
   if (col > oldMaxC)
     {
       NSInteger end = col - 1;
@@ -4062,7 +4093,10 @@ static SEL getSel;
 		}
 	      else
 		{
-		  (*mkImp)(self, mkSel, i, j);
+		  if (!lazy)
+		    {
+		      (*mkImp)(self, mkSel, i, j);
+		    }
 		}
 	    }
 	}
@@ -4094,7 +4128,10 @@ static SEL getSel;
 		    }
 		  else
 		    {
-		      (*mkImp)(self, mkSel, i, j);
+		      if (!lazy)
+		        {
+		          (*mkImp)(self, mkSel, i, j);
+		        }
 		    }
 		}
 	    }
@@ -4104,7 +4141,10 @@ static SEL getSel;
 		{
 		  _cells[i][j] = nil;
 		  _selectedCells[i][j] = NO;
-		  (*mkImp)(self, mkSel, i, j);
+		  if (!lazy)
+		    {
+		      (*mkImp)(self, mkSel, i, j);
+		    }
 		}
 	    }
 	}
@@ -4144,7 +4184,7 @@ static SEL getSel;
 
       for (; j <= colLimit; j++)
 	{
-	  NSCell *aCell = _cells[i][j];
+	  NSCell *aCell = CELL(i, j);
 
           if ([aCell isEnabled]
 	    && ([aCell state] != state || [aCell isHighlighted] != highlight
@@ -4176,7 +4216,7 @@ static SEL getSel;
       // First look for cells in the same row
       for (j = column + 1; j < _numCols; j++)
 	{
-	  if ([_cells[row][j] isEnabled] && [_cells[row][j] isSelectable])
+	  if ([CELL(row, j) isEnabled] && [CELL(row, j) isSelectable])
 	    {
 	      _selectedCell = [self selectTextAtRow: row column: j];
 	      _selectedRow = row;
@@ -4191,7 +4231,7 @@ static SEL getSel;
     {
       for (j = 0; j < _numCols; j++)
 	{
-	  if ([_cells[i][j] isEnabled] && [_cells[i][j] isSelectable])
+	  if ([CELL(i, j) isEnabled] && [CELL(i, j) isSelectable])
 	    {
 	      _selectedCell = [self selectTextAtRow: i column: j];
 	      _selectedRow = i;
@@ -4214,7 +4254,7 @@ static SEL getSel;
       // First look for cells in the same row
       for (j = column - 1; j > -1; j--)
 	{
-	  if ([_cells[row][j] isEnabled] && [_cells[row][j] isSelectable])
+	  if ([CELL(row, j) isEnabled] && [CELL(row, j) isSelectable])
 	    {
 	      _selectedCell = [self selectTextAtRow: row column: j];
 	      _selectedRow = row;
@@ -4229,7 +4269,7 @@ static SEL getSel;
     {
       for (j = _numCols - 1; j > -1; j--)
 	{
-	  if ([_cells[i][j] isEnabled] && [_cells[i][j] isSelectable])
+	  if ([CELL(i, j) isEnabled] && [CELL(i, j) isSelectable])
 	    {
 	      _selectedCell = [self selectTextAtRow: i column: j];
 	      _selectedRow = i;
@@ -4248,7 +4288,7 @@ static SEL getSel;
     {
       return;
     }
-  if ([_cells[row][column] acceptsFirstResponder])
+  if ([CELL(row, column) acceptsFirstResponder])
     {
       if (_dottedRow != -1 && _dottedColumn != -1)
         {
@@ -4263,3 +4303,46 @@ static SEL getSel;
 }
 
 @end
+
+@implementation NSMatrix (GSLazyCells)
+
+/* When flag is YES, new cells of the receiver are not made when rows and
+   columns are added, but when they are first asked for. This lets
+   NSBrowser show columns with a huge number of rows. */
+- (void) _setCreatesCellsLazily: (BOOL)flag
+{
+  if (flag)
+    {
+      if (lazyMatrices == NULL)
+	{
+	  lazyMatrices = NSCreateHashTable(NSNonOwnedPointerHashCallBacks, 0);
+	}
+      NSHashInsert(lazyMatrices, self);
+    }
+  else if (lazyMatrices != NULL)
+    {
+      NSHashRemove(lazyMatrices, self);
+    }
+}
+
+/* Releases all cells of a matrix which creates its cells lazily, so that
+   fresh ones are made when they are next used. */
+- (void) _releaseCells
+{
+  NSInteger i, j;
+
+  if (lazyMatrices == NULL || NSHashGet(lazyMatrices, self) == NULL)
+    {
+      return;
+    }
+  [self deselectAllCells];
+  for (i = 0; i < _maxRows; i++)
+    {
+      for (j = 0; j < _maxCols; j++)
+	{
+	  DESTROY(_cells[i][j]);
+	}
+    }
+}
+
+@end
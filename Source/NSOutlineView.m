@@ -38,6 +38,7 @@
 #import <Foundation/NSDictionary.h>
 #import <Foundation/NSEnumerator.h>
 #import <Foundation/NSException.h>
+#import <Foundation/NSHashTable.h>
 #import <Foundation/NSIndexSet.h>
 #import <Foundation/NSMapTable.h>
 #import <Foundation/NSNotification.h>
@@ -66,6 +67,21 @@
 #include <math.h>
 
 static NSMapTableKeyCallBacks keyCallBacks;
+static NSHashTableCallBacks itemCallBacks;
+
+/* Lookup tables of each outline view. They are kept outside the
+ * instance, so that the layout of the class does not change.
+ */
+typedef struct {
+  NSHashTable *expandedItems;
+  NSMapTable *parentOfItems;
+  NSMapTable *rowOfItems;
+  NSUInteger validRowCount;
+} GSOutlineViewInfo;
+
+static NSMapTable *viewInfo = NULL;
+
+#define INFO ((GSOutlineViewInfo *)NSMapGet(viewInfo, self))
 static NSNotificationCenter *nc = nil;
 static const int current_version = 1;
 
@@ -129,7 +145,11 @@ static NSImage *unexpandable  = nil;
 - (void) _openItem: (id)item;
 - (void) _closeItem: (id)item;
 - (void) _removeChildren: (id)startitem;
+- (void) _unloadChildren: (id)startitem;
 - (void) _noteNumberOfRowsChangedBelowItem: (id)item by: (int)n;
+- (NSUInteger) _rowOfItem: (id)item;
+- (void) _invalidateRowsFromRow: (NSUInteger)row;
+- (void) _replaceItem: (id)item withItem: (id)newItem;
 @end
 
 @interface	NSOutlineView (Private)
@@ -150,6 +170,11 @@ static NSImage *unexpandable  = nil;
        */
       keyCallBacks = NSObjectMapKeyCallBacks;
       keyCallBacks.isEqual = NSOwnedPointerMapKeyCallBacks.isEqual;
+      itemCallBacks = NSObjectHashCallBacks;
+      itemCallBacks.hash = NSNonOwnedPointerHashCallBacks.hash;
+      itemCallBacks.isEqual = NSNonOwnedPointerHashCallBacks.isEqual;
+      viewInfo = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                                  NSNonOwnedPointerMapValueCallBacks, 0);
 #if 0
 /* Old Interface Builder style. */
       collapsed    = [NSImage imageNamed: @"common_outlineCollapsed"];
@@ -188,11 +213,20 @@ static NSImage *unexpandable  = nil;
 
 - (void) dealloc
 {
+  GSOutlineViewInfo *info = INFO;
+
   RELEASE(_items);
-  RELEASE(_expandedItems);
 
   NSFreeMapTable(_itemDict);
   NSFreeMapTable(_levelOfItems);
+  if (info != NULL)
+    {
+      NSFreeHashTable(info->expandedItems);
+      NSFreeMapTable(info->parentOfItems);
+      NSFreeMapTable(info->rowOfItems);
+      NSZoneFree(NSDefaultMallocZone(), info);
+      NSMapRemove(viewInfo, self);
+    }
 
   if (_autosaveExpandedItems)
     {
@@ -440,12 +474,8 @@ static NSImage *unexpandable  = nil;
     {
       return YES;
     }
-  // Check the array to determine if it is expanded.
-  if ([_expandedItems indexOfObjectIdenticalTo: item] == NSNotFound)
-    {
-      return NO;
-    }
-  return YES;
+  // Check the set to determine if it is expanded.
+  return (NSHashGet(INFO->expandedItems, item) != NULL);
 }
 
 /**
@@ -496,22 +526,15 @@ static NSImage *unexpandable  = nil;
  */
 - (id) parentForItem: (id)item
 {
-  NSArray *allKeys = NSAllMapTableKeys(_itemDict);
-  NSEnumerator *en = [allKeys objectEnumerator];
-  NSInteger index;
   id parent;
 
-  while ((parent = [en nextObject]))
+  if (item == nil)
     {
-      NSMutableArray *childArray = NSMapGet(_itemDict, parent);
-
-      if ((index = [childArray indexOfObjectIdenticalTo: item]) != NSNotFound)
-        {
-          return (parent == [NSNull null]) ? (id)nil : (id)parent;
-        }
+      return nil;
     }
 
-  return nil;
+  parent = NSMapGet(INFO->parentOfItems, item);
+  return (parent == [NSNull null]) ? (id)nil : (id)parent;
 }
 
 /**
@@ -530,22 +553,21 @@ static NSImage *unexpandable  = nil;
  */
 - (void) reloadItem: (id)item reloadChildren: (BOOL)reloadChildren
 {
+  GSOutlineViewInfo *info = INFO;
   NSInteger index;
   id parent;
   BOOL expanded;
   id dsobj = nil;
-  id object = (item == nil) ? (id)[NSNull null] : (id)item;
-  NSArray *allKeys = NSAllMapTableKeys(_itemDict);
-  NSEnumerator *en = [allKeys objectEnumerator];
 
   expanded = [self isItemExpanded: item];
 
   // find the parent of the item
-  while ((parent = [en nextObject]))
+  parent = (item == nil) ? nil : NSMapGet(info->parentOfItems, item);
+  if (parent != nil)
     {
       NSMutableArray *childArray = NSMapGet(_itemDict, parent);
 
-      if ((index = [childArray indexOfObjectIdenticalTo: object]) != NSNotFound)
+      if ((index = [childArray indexOfObjectIdenticalTo: item]) != NSNotFound)
         {
           parent = (parent == [NSNull null]) ? (id)nil : (id)parent;
           dsobj = [_dataSource outlineView: self
@@ -554,11 +576,9 @@ static NSImage *unexpandable  = nil;
 
           if (dsobj != item)
             {
+              [self _replaceItem: item withItem: dsobj];
               [childArray replaceObjectAtIndex: index withObject: dsobj];
-              // FIXME We need to correct _items, _itemDict, _levelOfItems,
-              // _expandedItems and _selectedItems
             }
-          break;
         }
     }
 
@@ -582,12 +602,9 @@ static NSImage *unexpandable  = nil;
  */
 - (NSInteger) rowForItem: (id)item
 {
-  NSInteger row;
-  if (item == nil)
-    return -1;
+  NSUInteger row = [self _rowOfItem: item];
 
-  row = [_items indexOfObjectIdenticalTo: item];
-  return (row == NSNotFound) ? -1 : row;
+  return (row == NSNotFound) ? -1 : (NSInteger)row;
 }
 
 /**
@@ -731,6 +748,9 @@ static NSImage *unexpandable  = nil;
   _levelOfItems = NSCreateMapTable(keyCallBacks,
                                    NSObjectMapValueCallBacks,
                                    64);
+  NSResetMapTable(INFO->parentOfItems);
+  NSResetMapTable(INFO->rowOfItems);
+  INFO->validRowCount = 0;
 
   // reload all the open items...
   [self _openItem: nil];
@@ -1082,7 +1102,7 @@ static NSImage *unexpandable  = nil;
 - (void) setDropItem: (id)item
       dropChildIndex: (NSInteger)childIndex
 {
-  if (item != nil && [_items indexOfObjectIdenticalTo: item] == NSNotFound)
+  if (item != nil && [self _rowOfItem: item] == NSNotFound)
     {
       /* FIXME raise an exception, or perhaps we should support
        * setting an item which is not visible (inside a collapsed
@@ -1204,7 +1224,7 @@ static NSImage *unexpandable  = nil;
 // TODO: Move a method common to -drapOnRootIndicator and the one below to GSTheme
 - (void) drawDropOnIndicatorWithDropItem: (id)currentDropItem
 {
-  int row = [_items indexOfObjectIdenticalTo: currentDropItem];
+  int row = [self rowForItem: currentDropItem];
   int level = [self levelForItem: currentDropItem];
   NSRect newRect = [self frameOfCellAtColumn: 0
                                          row: row];
@@ -1943,14 +1963,24 @@ Also returns the child index relative to this parent. */
 
 - (void) _initOutlineDefaults
 {
+  GSOutlineViewInfo *info;
+
   _itemDict = NSCreateMapTable(keyCallBacks,
                                NSObjectMapValueCallBacks,
                                64);
   _items = [[NSMutableArray alloc] init];
-  _expandedItems = [[NSMutableArray alloc] init];
   _levelOfItems = NSCreateMapTable(keyCallBacks,
                                    NSObjectMapValueCallBacks,
                                    64);
+  info = NSZoneCalloc(NSDefaultMallocZone(), 1, sizeof(GSOutlineViewInfo));
+  info->expandedItems = NSCreateHashTable(itemCallBacks, 64);
+  info->parentOfItems = NSCreateMapTable(keyCallBacks,
+                                         NSObjectMapValueCallBacks,
+                                         64);
+  info->rowOfItems = NSCreateMapTable(keyCallBacks,
+                                      NSIntegerMapValueCallBacks,
+                                      64);
+  NSMapInsert(viewInfo, self, info);
 
   _indentationMarkerFollowsCell = YES;
   _autoResizesOutlineColumn = NO;
@@ -1968,7 +1998,8 @@ Also returns the child index relative to this parent. */
       defaults  = [NSUserDefaults standardUserDefaults];
       tableKey = [NSString stringWithFormat: @"NSOutlineView Expanded Items %@",
                            _autosaveName];
-      [defaults setObject: _expandedItems  forKey: tableKey];
+      [defaults setObject: NSAllHashTableObjects(INFO->expandedItems)
+                   forKey: tableKey];
       [defaults synchronize];
     }
 }
@@ -1998,7 +2029,9 @@ Also returns the child index relative to this parent. */
     }
 }
 
-// Collect all of the items under a given element.
+/* Collect all of the items shown under a given element, in row order.
+ * Children of collapsed items are not shown, so they are skipped.
+ */
 - (void)_collectItemsStartingWith: (id)startitem
                              into: (NSMutableArray *)allChildren
 {
@@ -2007,18 +2040,19 @@ Also returns the child index relative to this parent. */
   id sitem = (startitem == nil) ? (id)[NSNull null] : (id)startitem;
   NSMutableArray *anarray;
 
+  // Only collect the children if the item is expanded
+  if (![self isItemExpanded: startitem])
+    {
+      return;
+    }
+
   anarray = NSMapGet(_itemDict, sitem);
   num = [anarray count];
   for (i = 0; i < num; i++)
     {
       id anitem = [anarray objectAtIndex: i];
 
-      // Only collect the children if the item is expanded
-      if ([self isItemExpanded: startitem])
-        {
-          [allChildren addObject: anitem];
-        }
-
+      [allChildren addObject: anitem];
       [self _collectItemsStartingWith: anitem
             into: allChildren];
     }
@@ -2076,15 +2110,31 @@ Also returns the child index relative to this parent. */
                                ofItem: startitem];
 
       [anarray addObject: anitem];
+      NSMapInsert(INFO->parentOfItems, anitem, sitem);
       [self _loadDictionaryStartingWith: anitem
             atLevel: level + 1];
     }
 }
 
+/* The rows shown below an expanded item are its visible descendants,
+ * so they always form one contiguous block directly after the row of
+ * the item. Opening and closing an item splices that whole block into
+ * or out of _items in a single step.
+ */
 - (void)_closeItem: (id)item
 {
   NSUInteger i, numChildren;
   NSMutableArray *removeAll = [NSMutableArray array];
+  NSUInteger row;
+
+  row = [self _rowOfItem: item];
+  if (item != nil && row == NSNotFound)
+    {
+      // the item is hidden inside a collapsed parent, no rows to remove
+      NSHashRemove(INFO->expandedItems, item);
+      return;
+    }
+  row = (row == NSNotFound) ? 0 : row + 1;
 
   [self _collectItemsStartingWith: item into: removeAll];
   numChildren = [removeAll count];
@@ -2092,30 +2142,28 @@ Also returns the child index relative to this parent. */
   // close the item...
   if (item != nil)
     {
-      [_expandedItems removeObjectIdenticalTo: item];
+      NSHashRemove(INFO->expandedItems, item);
     }
 
-  // For the close method it doesn't matter what order they are
-  // removed in.
+  // rows below the item move up, so their cached indexes are stale
+  [self _invalidateRowsFromRow: row];
+  [_items removeObjectsInRange: NSMakeRange(row, numChildren)];
   for (i = 0; i < numChildren; i++)
     {
-      id child = [removeAll objectAtIndex: i];
-      [_items removeObjectIdenticalTo: child];
+      NSMapRemove(INFO->rowOfItems, [removeAll objectAtIndex: i]);
     }
   [self _noteNumberOfRowsChangedBelowItem: item by: -numChildren];
 }
 
 - (void)_openItem: (id)item
 {
-  NSUInteger insertionPoint, numChildren, numDescendants;
-  NSInteger i;
-  id object;
-  id sitem = (item == nil) ? (id)[NSNull null] : (id)item;
+  NSUInteger insertionPoint;
+  NSMutableArray *insertAll;
 
   // open the item...
   if (item != nil)
     {
-      [_expandedItems addObject: item];
+      NSHashInsert(INFO->expandedItems, item);
     }
 
   // Load the children of the item if needed
@@ -2125,12 +2173,15 @@ Also returns the child index relative to this parent. */
                                 atLevel: [self levelForItem: item]];
     }
 
-  object = NSMapGet(_itemDict, sitem);
-  numChildren = numDescendants = [object count];
-
-  insertionPoint = [_items indexOfObjectIdenticalTo: item];
+  insertionPoint = [self _rowOfItem: item];
   if (insertionPoint == NSNotFound)
     {
+      if (item != nil)
+        {
+          /* The item is hidden inside a collapsed parent, its children
+           * get shown when that parent is expanded. */
+          return;
+        }
       insertionPoint = 0;
     }
   else
@@ -2138,37 +2189,48 @@ Also returns the child index relative to this parent. */
       insertionPoint++;
     }
 
-  for (i = numChildren-1; i >= 0; i--)
-    {
-      id obj = NSMapGet(_itemDict, sitem);
-      id child = [obj objectAtIndex: i];
+  // Add all of the children and their visible descendants at once...
+  insertAll = [NSMutableArray array];
+  [self _collectItemsStartingWith: item into: insertAll];
+  [self _invalidateRowsFromRow: insertionPoint];
+  [_items replaceObjectsInRange: NSMakeRange(insertionPoint, 0)
+           withObjectsFromArray: insertAll];
+
+  [self _noteNumberOfRowsChangedBelowItem: item by: [insertAll count]];
+}
 
-      // Add all of the children...
-      if ([self isItemExpanded: child])
+- (void) _removeChildren: (id)startitem
+{
+  id sitem = (startitem == nil) ? (id)[NSNull null] : (id)startitem;
+  NSMutableArray *removeAll = [NSMutableArray array];
+  NSUInteger i, row, numRows = 0;
+
+  // drop the block of visible descendants, if the item is shown at all
+  row = [self _rowOfItem: startitem];
+  if (startitem == nil || row != NSNotFound)
+    {
+      row = (row == NSNotFound) ? 0 : row + 1;
+      [self _collectItemsStartingWith: startitem into: removeAll];
+      numRows = [removeAll count];
+      [self _invalidateRowsFromRow: row];
+      [_items removeObjectsInRange: NSMakeRange(row, numRows)];
+      for (i = 0; i < numRows; i++)
         {
-          NSUInteger numItems;
-          NSInteger j;
-          NSMutableArray *insertAll = [NSMutableArray array];
-
-          [self _collectItemsStartingWith: child into: insertAll];
-          numItems = [insertAll count];
-          numDescendants += numItems;
-          for (j = numItems-1; j >= 0; j--)
-            {
-              [_items insertObject: [insertAll objectAtIndex: j]
-                      atIndex: insertionPoint];
-            }
+          NSMapRemove(INFO->rowOfItems, [removeAll objectAtIndex: i]);
         }
-
-      // Add the parent
-      [_items insertObject: child atIndex: insertionPoint];
     }
 
-  [self _noteNumberOfRowsChangedBelowItem: item by: numDescendants];
+  [self _unloadChildren: startitem];
+  [NSMapGet(_itemDict, sitem) removeAllObjects];
+  [self _noteNumberOfRowsChangedBelowItem: startitem by: -numRows];
 }
 
-- (void) _removeChildren: (id)startitem
+/* Forget everything known about the descendants of an item.
+ * The caller is responsible for removing their rows.
+ */
+- (void) _unloadChildren: (id)startitem
 {
+  GSOutlineViewInfo *info = INFO;
   NSUInteger i, numChildren;
   id sitem = (startitem == nil) ? (id)[NSNull null] : (id)startitem;
   NSMutableArray *anarray;
@@ -2179,13 +2241,11 @@ Also returns the child index relative to this parent. */
     {
       id child = [anarray objectAtIndex: i];
 
-      [self _removeChildren: child];
+      [self _unloadChildren: child];
       NSMapRemove(_itemDict, child);
-      [_items removeObjectIdenticalTo: child];
-      [_expandedItems removeObjectIdenticalTo: child];
+      NSMapRemove(info->parentOfItems, child);
+      NSHashRemove(info->expandedItems, child);
     }
-  [anarray removeAllObjects];
-  [self _noteNumberOfRowsChangedBelowItem: startitem by: -numChildren];
 }
 
 - (void) _noteNumberOfRowsChangedBelowItem: (id)item by: (int)numItems
@@ -2201,7 +2261,7 @@ Also returns the child index relative to this parent. */
   /* Note: We update the selected row indexes directly instead of calling
    * -selectRowIndexes:extendingSelection: to avoid posting bogus selection
    * did change notifications. */
-  rowIndex = [_items indexOfObjectIdenticalTo: item];
+  rowIndex = [self _rowOfItem: item];
   rowIndex = (rowIndex == NSNotFound) ? 0 : rowIndex + 1;
   nextIndex = [_selectedRows indexGreaterThanOrEqualToIndex: rowIndex];
   if (nextIndex != NSNotFound)
@@ -2272,6 +2332,108 @@ Also returns the child index relative to this parent. */
     }
 }
 
+/* The row index of items is cached in rowOfItems. Entries for rows
+ * below validRowCount are known to be correct; the remaining ones are
+ * filled in lazily, so a change in the middle of the view only costs
+ * a rescan of the rows following it.
+ */
+- (NSUInteger) _rowOfItem: (id)item
+{
+  GSOutlineViewInfo *info = INFO;
+  NSUInteger count = [_items count];
+  void *value;
+
+  if (item == nil)
+    {
+      return NSNotFound;
+    }
+
+  if (info->validRowCount > count)
+    {
+      info->validRowCount = count;
+    }
+
+  if (NSMapMember(info->rowOfItems, item, NULL, &value))
+    {
+      NSUInteger row = (NSUInteger)(uintptr_t)value;
+
+      if (row < info->validRowCount && [_items objectAtIndex: row] == item)
+        {
+          return row;
+        }
+    }
+
+  while (info->validRowCount < count)
+    {
+      NSUInteger row = info->validRowCount++;
+      id anitem = [_items objectAtIndex: row];
+
+      NSMapInsert(info->rowOfItems, anitem, (void *)(uintptr_t)row);
+      if (anitem == item)
+        {
+          return row;
+        }
+    }
+
+  return NSNotFound;
+}
+
+- (void) _invalidateRowsFromRow: (NSUInteger)row
+{
+  GSOutlineViewInfo *info = INFO;
+
+  if (row < info->validRowCount)
+    {
+      info->validRowCount = row;
+    }
+}
+
+/* Moves everything known about item over to newItem, which the data
+ * source now returns in its place.
+ */
+- (void) _replaceItem: (id)item withItem: (id)newItem
+{
+  GSOutlineViewInfo *info = INFO;
+  NSMutableArray *children;
+  NSUInteger i, row;
+  id value;
+
+  row = [self _rowOfItem: item];
+  if (row != NSNotFound)
+    {
+      [_items replaceObjectAtIndex: row withObject: newItem];
+      NSMapInsert(info->rowOfItems, newItem, (void *)(uintptr_t)row);
+    }
+  NSMapRemove(info->rowOfItems, item);
+
+  NSMapInsert(info->parentOfItems, newItem,
+              NSMapGet(info->parentOfItems, item));
+  NSMapRemove(info->parentOfItems, item);
+
+  if ((value = NSMapGet(_levelOfItems, item)) != nil)
+    {
+      NSMapInsert(_levelOfItems, newItem, value);
+      NSMapRemove(_levelOfItems, item);
+    }
+
+  if (NSHashGet(info->expandedItems, item) != NULL)
+    {
+      NSHashRemove(info->expandedItems, item);
+      NSHashInsert(info->expandedItems, newItem);
+    }
+
+  if ((children = NSMapGet(_itemDict, item)) != nil)
+    {
+      NSMapInsert(_itemDict, newItem, children);
+      NSMapRemove(_itemDict, item);
+      for (i = 0; i < [children count]; i++)
+        {
+          NSMapInsert(info->parentOfItems, [children objectAtIndex: i],
+                      newItem);
+        }
+    }
+}
+
 - (NSCell *) preparedCellAtColumn: (NSInteger)columnIndex row: (NSInteger)rowIndex
 {
   NSCell *cell = nil;
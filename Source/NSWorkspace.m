@@ -106,6 +106,66 @@
 static NSMutableDictionary *folderPathIconDict = nil;
 static NSMutableDictionary *folderIconCache = nil;
 
+/* Icons read in the background from folder icon and thumbnail files,
+   with the modification date of the file they were read from. */
+static NSMutableDictionary *loadedIconCache = nil;
+static NSMutableSet *pendingIconLoads = nil;
+#define	GS_LOADED_ICON_LIMIT	256
+
+/* A background load of an icon file started by
+   -iconForFile:target:selector:loadToken:. It is the load token
+   returned by that method, and keeps the icon before passing it on. */
+@interface GSIconFileLoad : NSObject
+{
+@public
+  NSString	*iconPath;
+  NSDate	*modified;
+  id		target;
+  SEL		selector;
+}
+- (void) cancel;
+- (void) iconDidLoad: (NSImage*)image;
+@end
+
+@implementation GSIconFileLoad
+
+- (void) dealloc
+{
+  RELEASE(iconPath);
+  RELEASE(modified);
+  [super dealloc];
+}
+
+/* The icon is still loaded and kept, only the target is forgotten. */
+- (void) cancel
+{
+  target = nil;
+}
+
+- (void) iconDidLoad: (NSImage*)image
+{
+  id	t = target;
+
+  target = nil;
+  if (image != nil && modified != nil)
+    {
+      if ([loadedIconCache count] >= GS_LOADED_ICON_LIMIT)
+	{
+	  [loadedIconCache removeAllObjects];
+	}
+      [loadedIconCache setObject: [NSArray arrayWithObjects:
+					     modified, image, nil]
+			  forKey: iconPath];
+    }
+  if (t != nil)
+    {
+      [t performSelector: selector withObject: image];
+    }
+  [pendingIconLoads removeObject: self];
+}
+
+@end
+
 static NSImage	*folderImage = nil;
 static NSImage	*multipleFiles = nil;
 static NSImage	*unknownApplication = nil;
@@ -413,6 +473,8 @@ static id GSLaunched(NSNotification *notification, BOOL active)
 - (NSImage*) _extIconForApp: (NSString*)appName info: (NSDictionary*)extInfo;
 - (NSImage*) unknownFiletypeImage;
 - (NSImage*) _saveImageFor: (NSString*)iconPath;
+- (NSString*) _folderIconPathFor: (NSString*)fullPath;
+- (NSString*) _iconImagePathFor: (NSString*)fullPath;
 - (NSString*) thumbnailForFile: (NSString *)file;
 - (NSImage*) _iconForExtension: (NSString*)ext;
 - (BOOL) _extension: (NSString*)ext
@@ -768,6 +830,8 @@ static NSString			*_rootPath = @"/";
 	forKey: [desktopDir objectAtIndex: i]];
     }
   folderIconCache = [[NSMutableDictionary alloc] init];
+  loadedIconCache = [[NSMutableDictionary alloc] init];
+  pendingIconLoads = [[NSMutableSet alloc] init];
 
   return self;
 }
@@ -1383,16 +1447,7 @@ inFileViewerRootedAtPath: (NSString*)rootFullpath
        */
       if (iconPath == nil)
 	{
-	  iconPath = [fullPath stringByAppendingPathComponent: @".dir.png"];
-	  if ([mgr isReadableFileAtPath: iconPath] == NO)
-	    {
-	      iconPath
-		= [fullPath stringByAppendingPathComponent: @".dir.tiff"];
-	      if ([mgr isReadableFileAtPath: iconPath] == NO)
-		{
-		  iconPath = nil;
-		}
-	    }
+	  iconPath = [self _folderIconPathFor: fullPath];
 	}
 
       if (iconPath != nil)
@@ -2220,6 +2275,90 @@ launchIdentifiers: (NSArray **)identifiers
 
 @implementation	NSWorkspace (GNUstep)
 
+/**
+ * Returns the icon for fullPath like -iconForFile:, but without decoding
+ * folder icons or freedesktop thumbnails on the calling thread.  If the
+ * icon has to be read from such a file, a placeholder is returned and
+ * the file is decoded in the background, after which aSelector is sent
+ * to target on the main thread with the icon (or nil if the file could
+ * not be read).<br />
+ * On return loadToken, if not NULL, holds the token to pass to
+ * +[NSImage cancelImageLoad:], or nil if the returned icon is final.
+ * Icons loaded in the background are kept, and returned at once by
+ * later calls until their file changes.
+ */
+- (NSImage*) iconForFile: (NSString*)fullPath
+		  target: (id)target
+		selector: (SEL)aSelector
+	       loadToken: (id*)loadToken
+{
+  NSString	*iconPath = [self _iconImagePathFor: fullPath];
+  NSImage	*image;
+  NSDate	*modified = nil;
+  NSArray	*loaded = nil;
+  id		token = nil;
+
+  if (iconPath != nil)
+    {
+      modified = [[[NSFileManager defaultManager]
+	fileAttributesAtPath: iconPath traverseLink: YES]
+	fileModificationDate];
+      loaded = [loadedIconCache objectForKey: iconPath];
+    }
+
+  if (iconPath == nil)
+    {
+      image = [self iconForFile: fullPath];
+    }
+  else if (loaded != nil && [[loaded objectAtIndex: 0] isEqual: modified])
+    {
+      image = [loaded objectAtIndex: 1];
+    }
+  else
+    {
+      GSIconFileLoad	*load;
+
+      image = [self _iconForExtension: [[fullPath pathExtension]
+					 lowercaseString]];
+      if (image == nil || image == [self unknownFiletypeImage])
+	{
+	  BOOL	isDir = NO;
+
+	  [[NSFileManager defaultManager] fileExistsAtPath: fullPath
+					       isDirectory: &isDir];
+	  if (isDir == YES)
+	    {
+	      if (folderImage == nil)
+		{
+		  folderImage = RETAIN([NSImage _standardImageWithName:
+						  @"Folder"]);
+		}
+	      image = folderImage;
+	    }
+	  else
+	    {
+	      image = [self unknownFiletypeImage];
+	    }
+	}
+      load = AUTORELEASE([GSIconFileLoad new]);
+      ASSIGN(load->iconPath, iconPath);
+      ASSIGN(load->modified, modified);
+      load->target = target;
+      load->selector = aSelector;
+      [NSImage loadImageWithContentsOfFile: iconPath
+				    target: load
+				  selector: @selector(iconDidLoad:)];
+      // Kept until the icon has been loaded, even if cancelled
+      [pendingIconLoads addObject: load];
+      token = load;
+    }
+  if (loadToken != NULL)
+    {
+      *loadToken = token;
+    }
+  return image;
+}
+
 /**
  * Returns the 'best' application to open a file with the specified extension
  * using the given role.  If the role is nil then apps which can edit are
@@ -2752,6 +2891,50 @@ launchIdentifiers: (NSArray **)identifiers
   return tmp;
 }
 
+/** Returns the 'dir/.dir.png' or 'dir/.dir.tiff' icon of a directory */
+- (NSString*) _folderIconPathFor: (NSString*)fullPath
+{
+  NSFileManager	*mgr = [NSFileManager defaultManager];
+  NSString	*iconPath;
+
+  iconPath = [fullPath stringByAppendingPathComponent: @".dir.png"];
+  if ([mgr isReadableFileAtPath: iconPath] == NO)
+    {
+      iconPath = [fullPath stringByAppendingPathComponent: @".dir.tiff"];
+      if ([mgr isReadableFileAtPath: iconPath] == NO)
+	{
+	  iconPath = nil;
+	}
+    }
+  return iconPath;
+}
+
+/** Returns the image file -iconForFile: reads the icon of fullPath from,
+ * or nil if the icon does not come from a file of its own.
+ */
+- (NSString*) _iconImagePathFor: (NSString*)fullPath
+{
+  NSFileManager	*mgr = [NSFileManager defaultManager];
+  NSDictionary	*attributes;
+  NSString	*iconPath;
+
+  attributes = [mgr fileAttributesAtPath: fullPath traverseLink: YES];
+  if ([[attributes objectForKey: NSFileType] isEqual: NSFileTypeDirectory])
+    {
+      return [self _folderIconPathFor: fullPath];
+    }
+  if ([[NSUserDefaults standardUserDefaults] boolForKey: 
+	  @"GSUseFreedesktopThumbnails"])
+    {
+      iconPath = [self thumbnailForFile: fullPath];
+      if ([mgr isReadableFileAtPath: iconPath] == YES)
+	{
+	  return iconPath;
+	}
+    }
+  return nil;
+}
+
 /** Returns the freedesktop thumbnail file name for a given file name */
 - (NSString*) thumbnailForFile: (NSString *)file
 {
@@ -3215,6 +3398,7 @@ launchIdentifiers: (NSArray **)identifiers
    *	Invalidate the cache of icons for file extensions.
    */
   [_iconMap removeAllObjects];
+  [loadedIconCache removeAllObjects];
 }
 
 
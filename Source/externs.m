@@ -124,6 +124,10 @@ NSString *NSImageLoopCount = @"NSImageLoopCount";
 NSString *NSImageGamma = @"NSImageGamma";
 NSString *NSImageProgressive = @"NSImageProgressive";
 NSString *NSImageEXIFData = @"NSImageEXIFData";  // No support yet in GNUstep
+NSString *GSImageCompressionLevel = @"GSImageCompressionLevel";
+NSString *GSImagePNGFilters = @"GSImagePNGFilters";
+NSString *GSImageOptimizedHuffmanCoding = @"GSImageOptimizedHuffmanCoding";
+NSString *GSImageChromaSubsampling = @"GSImageChromaSubsampling";
 
 // NSBrowser notification
 NSString *NSBrowserColumnConfigurationDidChangeNotification = @"NSBrowserColumnConfigurationDidChange";
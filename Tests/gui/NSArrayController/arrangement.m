@@ -0,0 +1,132 @@
+/*
+Test that objects added to or removed from an automatically rearranging
+NSArrayController are put at their arranged index.
+*/
+#include "Testing.h"
+
+#include <Foundation/NSArray.h>
+#include <Foundation/NSAutoreleasePool.h>
+#include <Foundation/NSIndexSet.h>
+#include <Foundation/NSKeyValueObserving.h>
+#include <Foundation/NSPredicate.h>
+#include <Foundation/NSSortDescriptor.h>
+#include <Foundation/NSString.h>
+#include <Foundation/NSValue.h>
+
+#include <AppKit/NSArrayController.h>
+
+@interface Observer : NSObject
+{
+@public
+  int kind;
+  NSIndexSet *indexes;
+}
+@end
+
+@implementation Observer
+- (void) observeValueForKeyPath: (NSString *)keyPath
+                       ofObject: (id)object
+                         change: (NSDictionary *)change
+                        context: (void *)context
+{
+  kind = [[change objectForKey: NSKeyValueChangeKindKey] intValue];
+  ASSIGN(indexes, [change objectForKey: NSKeyValueChangeIndexesKey]);
+}
+@end
+
+int main(int argc, char **argv)
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSArrayController *ac;
+  Observer *o;
+  NSArray *sd;
+  NSArray *arranged;
+  NSMutableArray *content;
+  int i;
+
+  content = [NSMutableArray arrayWithObjects:
+    [NSNumber numberWithInt: 5], [NSNumber numberWithInt: 1],
+    [NSNumber numberWithInt: 8], [NSNumber numberWithInt: 3], nil];
+  sd = [NSArray arrayWithObject:
+    AUTORELEASE([[NSSortDescriptor alloc] initWithKey: @"intValue"
+                                            ascending: YES])];
+
+  ac = [[NSArrayController alloc] initWithContent: content];
+  [ac setAutomaticallyRearrangesObjects: YES];
+  [ac setSelectsInsertedObjects: NO];
+  [ac setSortDescriptors: sd];
+  [ac setFilterPredicate: [NSPredicate predicateWithFormat: @"intValue < 10"]];
+  [ac rearrangeObjects];
+
+  o = [Observer new];
+  [ac addObserver: o forKeyPath: @"arrangedObjects" options: 0 context: NULL];
+
+  [ac setSelectionIndex: 2];
+  arranged = RETAIN([ac arrangedObjects]);
+  [ac addObject: [NSNumber numberWithInt: 4]];
+  pass([arranged count] == 4,
+       "arranged objects handed out earlier do not change");
+  DESTROY(arranged);
+  pass([[ac arrangedObjects] isEqual: [NSArray arrayWithObjects:
+    [NSNumber numberWithInt: 1], [NSNumber numberWithInt: 3],
+    [NSNumber numberWithInt: 4], [NSNumber numberWithInt: 5],
+    [NSNumber numberWithInt: 8], nil]],
+       "added object is inserted at its sorted position");
+  pass(o->kind == NSKeyValueChangeInsertion
+       && [o->indexes isEqual: [NSIndexSet indexSetWithIndex: 2]],
+       "insertion is reported for its arranged index only");
+  pass([ac selectionIndex] == 3, "selection follows the selected object");
+
+  [ac addObject: [NSNumber numberWithInt: 12]];
+  pass([[ac arrangedObjects] count] == 5,
+       "object rejected by the filter predicate is not arranged");
+  pass([[ac content] count] == 6, "rejected object is still in the content");
+
+  [ac removeObject: [NSNumber numberWithInt: 3]];
+  pass([[ac arrangedObjects] count] == 4
+       && [[[ac arrangedObjects] objectAtIndex: 1] intValue] == 4,
+       "removed object is taken out of the arranged objects");
+  pass(o->kind == NSKeyValueChangeRemoval
+       && [o->indexes isEqual: [NSIndexSet indexSetWithIndex: 1]],
+       "removal is reported for its arranged index only");
+  pass([ac selectionIndex] == 2, "selection follows the selected object");
+
+  [ac removeObserver: o forKeyPath: @"arrangedObjects"];
+  DESTROY(o);
+  DESTROY(ac);
+
+  content = [NSMutableArray array];
+  for (i = 0; i < 100; i++)
+    {
+      [content addObject: [NSNumber numberWithInt: i % 50]];
+    }
+  ac = [[NSArrayController alloc] initWithContent: content];
+  [ac setSelectedObjects: [content subarrayWithRange: NSMakeRange(40, 20)]];
+  pass([[ac selectionIndexes] count] == 20
+       && [[ac selectionIndexes] containsIndexesInRange: NSMakeRange(0, 10)]
+       && [[ac selectionIndexes] containsIndexesInRange: NSMakeRange(40, 10)],
+       "selected objects resolve to the first equal arranged object");
+  [ac removeObject: [NSNumber numberWithInt: 0]];
+  [ac setSelectedObjects:
+    [[ac content] subarrayWithRange: NSMakeRange(0, 10)]];
+  pass([[ac selectionIndexes] isEqual:
+    [NSIndexSet indexSetWithIndexesInRange: NSMakeRange(0, 10)]],
+       "selection resolves against the arranged objects after a change");
+  DESTROY(ac);
+
+  content = [NSMutableArray array];
+  for (i = 0; i < 20; i++)
+    {
+      [content addObject: [NSMutableString stringWithFormat: @"item%d", i]];
+    }
+  ac = [[NSArrayController alloc] initWithContent: content];
+  [ac setSelectedObjects: [content subarrayWithRange: NSMakeRange(0, 10)]];
+  [[content objectAtIndex: 15] appendString: @" changed"];
+  [ac setSelectedObjects: [content subarrayWithRange: NSMakeRange(10, 10)]];
+  pass([[ac selectionIndexes] isEqual:
+    [NSIndexSet indexSetWithIndexesInRange: NSMakeRange(10, 10)]],
+       "selection resolves objects mutated after they were indexed");
+  DESTROY(ac);
+  DESTROY(arp);
+  return 0;
+}
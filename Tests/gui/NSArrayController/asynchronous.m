@@ -0,0 +1,122 @@
+/*
+Test that an NSArrayController arranging asynchronously publishes its
+arranged objects once, and that later arrangements cancel or supersede
+the ones still in progress.
+*/
+#include "Testing.h"
+
+#include <Foundation/NSArray.h>
+#include <Foundation/NSAutoreleasePool.h>
+#include <Foundation/NSDate.h>
+#include <Foundation/NSKeyValueObserving.h>
+#include <Foundation/NSPredicate.h>
+#include <Foundation/NSRunLoop.h>
+#include <Foundation/NSSortDescriptor.h>
+#include <Foundation/NSValue.h>
+
+#include <AppKit/NSArrayController.h>
+
+@interface Observer : NSObject
+{
+@public
+  int changes;
+}
+@end
+
+@implementation Observer
+- (void) observeValueForKeyPath: (NSString *)keyPath
+                       ofObject: (id)object
+                         change: (NSDictionary *)change
+                        context: (void *)context
+{
+  changes++;
+}
+@end
+
+static void
+spin(Observer *o, int changes, NSTimeInterval seconds)
+{
+  NSDate *limit = [NSDate dateWithTimeIntervalSinceNow: seconds];
+
+  while (o->changes < changes && [limit timeIntervalSinceNow] > 0)
+    {
+      [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                               beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.01]];
+    }
+}
+
+static BOOL
+isSorted(NSArray *a)
+{
+  NSUInteger i;
+
+  for (i = 1; i < [a count]; i++)
+    {
+      if ([[a objectAtIndex: i - 1] intValue] > [[a objectAtIndex: i] intValue])
+        {
+          return NO;
+        }
+    }
+  return YES;
+}
+
+int main(int argc, char **argv)
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSArrayController *ac;
+  NSMutableArray *content;
+  NSArray *sd;
+  Observer *o;
+  int i;
+
+  content = [NSMutableArray array];
+  for (i = 0; i < 20000; i++)
+    {
+      [content addObject: [NSNumber numberWithInt: (i * 7919) % 20000]];
+    }
+  sd = [NSArray arrayWithObject:
+    AUTORELEASE([[NSSortDescriptor alloc] initWithKey: @"intValue"
+                                            ascending: YES])];
+
+  ac = [[NSArrayController alloc] initWithContent: content];
+  [ac setArrangesAsynchronously: YES];
+  o = [Observer new];
+  [ac addObserver: o forKeyPath: @"arrangedObjects" options: 0 context: NULL];
+
+  [ac setSortDescriptors: sd];
+  pass(o->changes == 0, "arranging asynchronously returns at once");
+  spin(o, 1, 10.0);
+  pass(o->changes == 1 && [[ac arrangedObjects] count] == 20000
+       && isSorted([ac arrangedObjects]),
+       "arranged objects are published when done");
+
+  o->changes = 0;
+  [ac setFilterPredicate: [NSPredicate predicateWithFormat: @"intValue < 100"]];
+  [ac setFilterPredicate: [NSPredicate predicateWithFormat: @"intValue < 50"]];
+  spin(o, 1, 10.0);
+  spin(o, 2, 0.2);
+  pass(o->changes == 1, "a superseded arrangement is not published");
+  pass([[ac arrangedObjects] count] == 50 && isSorted([ac arrangedObjects]),
+       "the latest arrangement is published");
+
+  o->changes = 0;
+  [ac setFilterPredicate: nil];
+  [ac setArrangesAsynchronously: NO];
+  [ac rearrangeObjects];
+  pass(o->changes == 1 && [[ac arrangedObjects] count] == 20000,
+       "a synchronous arrangement cancels the one in progress");
+  spin(o, 2, 0.2);
+  pass(o->changes == 1, "a cancelled arrangement is not published");
+
+  [ac setArrangesAsynchronously: YES];
+  [ac rearrangeObjects];
+  [ac removeObserver: o forKeyPath: @"arrangedObjects"];
+  DESTROY(ac);
+  o->changes = 0;
+  spin(o, 1, 0.2);
+  pass(YES, "a controller may go away while arranging");
+
+  DESTROY(o);
+  DESTROY(arp);
+  return 0;
+}
@@ -0,0 +1,89 @@
+#import "ObjectTesting.h"
+#include <math.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSException.h>
+#import <AppKit/NSApplication.h>
+#import <AppKit/NSBitmapImageRep.h>
+#import <AppKit/NSGraphics.h>
+
+int main()
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSBitmapImageRep *bitmap;
+  unsigned char rgba[4 * 4 * 3], back[4 * 4 * 3];
+  float f[4];
+  NSUInteger pixel[5];
+  NSUInteger i;
+
+  for (i = 0; i < sizeof(rgba); i++)
+    {
+      rgba[i] = (i * 37) & 0xff;
+    }
+  for (i = 3; i < sizeof(rgba); i += 4)
+    {
+      rgba[i] = 255;
+    }
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: 5
+                                                   pixelsHigh: 4
+                                                bitsPerSample: 8
+                                              samplesPerPixel: 3
+                                                     hasAlpha: NO
+                                                     isPlanar: NO
+                                               colorSpaceName: NSDeviceRGBColorSpace
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  [bitmap setRGBA8: rgba bytesPerRow: 16 atX: 1 y: 1 width: 4 height: 3];
+  [bitmap getPixel: pixel atX: 2 y: 3];
+  pass(pixel[0] == rgba[36] && pixel[1] == rgba[37] && pixel[2] == rgba[38],
+       "8 bit RGB pixels are stored");
+  [bitmap getRGBA8: back bytesPerRow: 16 atX: 1 y: 1 width: 4 height: 3];
+  pass(memcmp(rgba, back, sizeof(rgba)) == 0, "8 bit RGB pixels are read");
+  PASS_EXCEPTION([bitmap getRGBA8: back bytesPerRow: 16
+                              atX: 2 y: 1 width: 4 height: 3],
+                 NSRangeException,
+                 "reading outside of the bitmap raises");
+  RELEASE(bitmap);
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: 4
+                                                   pixelsHigh: 3
+                                                bitsPerSample: 16
+                                              samplesPerPixel: 4
+                                                     hasAlpha: YES
+                                                     isPlanar: YES
+                                               colorSpaceName: NSDeviceRGBColorSpace
+                                                 bitmapFormat: NSAlphaNonpremultipliedBitmapFormat
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  [bitmap setRGBA8: rgba bytesPerRow: 16 atX: 0 y: 0 width: 4 height: 3];
+  memset(back, 0, sizeof(back));
+  [bitmap getRGBA8: back bytesPerRow: 16 atX: 0 y: 0 width: 4 height: 3];
+  pass(memcmp(rgba, back, sizeof(rgba)) == 0,
+       "16 bit planar pixels round trip");
+  [bitmap getRGBAFloat: f bytesPerRow: 16 atX: 1 y: 0 width: 1 height: 1];
+  pass(fabs(f[0] - rgba[4] / 255.0) < 0.0001 && fabs(f[3] - 1.0) < 0.0001,
+       "float samples are read");
+  RELEASE(bitmap);
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: 8
+                                                   pixelsHigh: 1
+                                                bitsPerSample: 1
+                                              samplesPerPixel: 1
+                                                     hasAlpha: NO
+                                                     isPlanar: NO
+                                               colorSpaceName: NSDeviceWhiteColorSpace
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  [bitmap bitmapData][0] = 0xa0;
+  [bitmap getRGBA8: back bytesPerRow: 32 atX: 0 y: 0 width: 8 height: 1];
+  pass(back[0] == 255 && back[2] == 255 && back[3] == 255
+       && back[4] == 0 && back[8] == 255 && back[12] == 0,
+       "1 bit gray pixels are read as RGBA");
+  RELEASE(bitmap);
+
+  [arp release];
+  return 0;
+}
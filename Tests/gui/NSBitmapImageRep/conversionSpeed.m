@@ -0,0 +1,189 @@
+/*
+Benchmark of the row kernels used to premultiply and convert bitmaps.
+Each conversion is timed against the pixel by pixel -getPixel:atX:y: and
+-setPixel:atX:y: loop it replaces, and checked to give the same result.
+The timings are printed, so that the speed-up can be read from the log.
+*/
+#import "ObjectTesting.h"
+#include <stdio.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSDate.h>
+#import <AppKit/NSApplication.h>
+#import <AppKit/NSBitmapImageRep.h>
+#import <AppKit/NSGraphics.h>
+
+#define WIDTH 2048
+#define HEIGHT 1024
+
+@interface NSBitmapImageRep (GSPrivate)
+- (void) _premultiply;
+- (NSBitmapImageRep *) _convertToFormatBitsPerSample: (NSInteger)bps
+                                     samplesPerPixel: (NSInteger)spp
+                                            hasAlpha: (BOOL)alpha
+                                            isPlanar: (BOOL)isPlanar
+                                      colorSpaceName: (NSString*)colorSpaceName
+                                        bitmapFormat: (NSBitmapFormat)bitmapFormat
+                                         bytesPerRow: (NSInteger)rowBytes
+                                        bitsPerPixel: (NSInteger)pixelBits;
+@end
+
+static NSBitmapImageRep *
+newBitmap(NSInteger bps, NSInteger spp, BOOL isPlanar)
+{
+  return [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                 pixelsWide: WIDTH
+                                                 pixelsHigh: HEIGHT
+                                              bitsPerSample: bps
+                                            samplesPerPixel: spp
+                                                   hasAlpha: (spp == 4)
+                                                   isPlanar: isPlanar
+                                             colorSpaceName: NSDeviceRGBColorSpace
+                                               bitmapFormat: NSAlphaNonpremultipliedBitmapFormat
+                                                bytesPerRow: 0
+                                               bitsPerPixel: 0];
+}
+
+static void
+report(const char *name, NSTimeInterval kernel, NSTimeInterval reference)
+{
+  printf("%-24s %4dx%-4d kernels %.3fs, per pixel %.3fs (%.1fx)\n",
+         name, WIDTH, HEIGHT, kernel, reference,
+         kernel > 0.0 ? reference / kernel : 0.0);
+}
+
+/* Copies the pixels of source into dest one at a time, scaling samples
+   from sbps to dbps bits, as the conversion did before the kernels. */
+static void
+convertPerPixel(NSBitmapImageRep *source, NSBitmapImageRep *dest,
+                NSInteger sbps, NSInteger dbps, NSInteger samples)
+{
+  NSUInteger pixel[5];
+  NSInteger x, y, i;
+
+  for (y = 0; y < HEIGHT; y++)
+    {
+      for (x = 0; x < WIDTH; x++)
+        {
+          [source getPixel: pixel atX: x y: y];
+          if (sbps != dbps)
+            {
+              for (i = 0; i < samples; i++)
+                {
+                  pixel[i] = pixel[i] * ((1 << dbps) - 1) / ((1 << sbps) - 1);
+                }
+            }
+          [dest setPixel: pixel atX: x y: y];
+        }
+    }
+}
+
+int main()
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSBitmapImageRep *source, *kernel, *reference;
+  NSDate *start;
+  NSTimeInterval kt, rt;
+  NSUInteger pixel[5];
+  NSInteger x, y, i;
+  unsigned char *data;
+
+  source = newBitmap(8, 4, NO);
+  data = [source bitmapData];
+  for (i = 0; i < WIDTH * HEIGHT * 4; i++)
+    {
+      data[i] = (i * 7 + (i >> 11)) & 0xff;
+    }
+
+  /* Premultiplying 8 bit RGBA */
+  kernel = [source copy];
+  reference = [source copy];
+  start = [NSDate date];
+  [kernel _premultiply];
+  kt = -[start timeIntervalSinceNow];
+  start = [NSDate date];
+  for (y = 0; y < HEIGHT; y++)
+    {
+      for (x = 0; x < WIDTH; x++)
+        {
+          [reference getPixel: pixel atX: x y: y];
+          for (i = 0; i < 3; i++)
+            {
+              NSUInteger t = pixel[3] * pixel[i] + 0x80;
+
+              pixel[i] = ((t >> 8) + t) >> 8;
+            }
+          [reference setPixel: pixel atX: x y: y];
+        }
+    }
+  rt = -[start timeIntervalSinceNow];
+  report("premultiply RGBA8", kt, rt);
+  pass(memcmp([kernel bitmapData], [reference bitmapData],
+              WIDTH * HEIGHT * 4) == 0,
+       "premultiplied pixels match the per pixel result");
+  RELEASE(kernel);
+  RELEASE(reference);
+
+  /* Make the source opaque, so that dropping its alpha does not
+     premultiply it */
+  for (i = 3; i < WIDTH * HEIGHT * 4; i += 4)
+    {
+      data[i] = 255;
+    }
+
+  /* Dropping the alpha of 8 bit RGBA */
+  start = [NSDate date];
+  kernel = [source _convertToFormatBitsPerSample: 8
+                                 samplesPerPixel: 3
+                                        hasAlpha: NO
+                                        isPlanar: NO
+                                  colorSpaceName: NSDeviceRGBColorSpace
+                                    bitmapFormat: 0
+                                     bytesPerRow: 0
+                                    bitsPerPixel: 0];
+  kt = -[start timeIntervalSinceNow];
+  reference = newBitmap(8, 3, NO);
+  start = [NSDate date];
+  convertPerPixel(source, reference, 8, 8, 3);
+  rt = -[start timeIntervalSinceNow];
+  report("RGBA8 -> RGB8", kt, rt);
+  pass([kernel samplesPerPixel] == 3
+       && memcmp([kernel bitmapData], [reference bitmapData],
+                 WIDTH * HEIGHT * 3) == 0,
+       "RGB pixels match the per pixel result");
+  RELEASE(reference);
+
+  /* Widening 8 bit RGBA to 16 bit planar */
+  start = [NSDate date];
+  kernel = [source _convertToFormatBitsPerSample: 16
+                                 samplesPerPixel: 4
+                                        hasAlpha: YES
+                                        isPlanar: YES
+                                  colorSpaceName: NSDeviceRGBColorSpace
+                                    bitmapFormat: NSAlphaNonpremultipliedBitmapFormat
+                                     bytesPerRow: 0
+                                    bitsPerPixel: 0];
+  kt = -[start timeIntervalSinceNow];
+  reference = newBitmap(16, 4, YES);
+  start = [NSDate date];
+  convertPerPixel(source, reference, 8, 16, 4);
+  rt = -[start timeIntervalSinceNow];
+  report("RGBA8 -> planar RGBA16", kt, rt);
+  {
+    unsigned char *kp[5], *rp[5];
+
+    [kernel getBitmapDataPlanes: kp];
+    [reference getBitmapDataPlanes: rp];
+    for (i = 0; i < 4; i++)
+      {
+        if (memcmp(kp[i], rp[i], WIDTH * HEIGHT * 2) != 0)
+          break;
+      }
+    pass([kernel bitsPerSample] == 16 && [kernel isPlanar] && i == 4,
+         "16 bit planar pixels match the per pixel result");
+  }
+  RELEASE(reference);
+
+  RELEASE(source);
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,98 @@
+#import "ObjectTesting.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSValue.h>
+#import <AppKit/NSApplication.h>
+#import <AppKit/NSBitmapImageRep.h>
+#import <AppKit/NSGraphics.h>
+
+static int decoded = 0;
+
+@interface TestDecoder : NSBitmapImageRep
+@end
+
+@implementation TestDecoder
++ (NSArray *) imageRepsWithData: (NSData *)data
+{
+  id rep = AUTORELEASE([[self alloc] initWithData: data]);
+
+  return [NSArray arrayWithObject: rep];
+}
+
+- (id) initWithData: (NSData *)data
+{
+  decoded++;
+  return [self initWithBitmapDataPlanes: NULL
+                             pixelsWide: 2
+                             pixelsHigh: 2
+                          bitsPerSample: 8
+                        samplesPerPixel: 3
+                               hasAlpha: NO
+                               isPlanar: NO
+                         colorSpaceName: NSDeviceRGBColorSpace
+                            bytesPerRow: 0
+                           bitsPerPixel: 0];
+}
+@end
+
+int main()
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSData *test = [NSData dataWithBytes: "RIFF\0\0\0\0GSTEST" length: 14];
+  NSBitmapImageRep *bitmap;
+  NSArray *reps;
+  NSDictionary *stats;
+
+  pass(![NSBitmapImageRep canInitWithData: test],
+       "unknown signature is not accepted");
+  pass(![NSBitmapImageRep canInitWithData:
+    [NSData dataWithBytes: "icns\0\0" length: 6]],
+       "truncated ICNS data is not accepted");
+
+  [NSBitmapImageRep registerImageDecoder: [TestDecoder class]
+                            forSignature: [NSData dataWithBytes: "GSTEST"
+                                                         length: 6]
+                                atOffset: 8
+                                    name: @"Test"];
+  pass([NSBitmapImageRep canInitWithData: test],
+       "registered signature is accepted");
+  reps = [NSBitmapImageRep imageRepsWithData: test];
+  pass([reps count] == 1
+       && [[reps objectAtIndex: 0] isKindOfClass: [TestDecoder class]]
+       && decoded == 1, "data is read by the registered decoder");
+
+  stats = [[NSBitmapImageRep imageDecoderStatistics] objectForKey: @"Test"];
+  pass([[stats objectForKey: @"Decodes"] intValue] == 1
+       && [[stats objectForKey: @"Failures"] intValue] == 0,
+       "decodes are counted by format");
+
+  PASS_EXCEPTION([NSBitmapImageRep registerImageDecoder: [TestDecoder class]
+                                           forSignature: test
+                                               atOffset: 8
+                                                   name: @"Test"],
+                 NSInvalidArgumentException,
+                 "signature beyond the first 16 bytes is rejected");
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: 4
+                                                   pixelsHigh: 4
+                                                bitsPerSample: 8
+                                              samplesPerPixel: 3
+                                                     hasAlpha: NO
+                                                     isPlanar: NO
+                                               colorSpaceName: NSDeviceRGBColorSpace
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  reps = [NSBitmapImageRep imageRepsWithData: [bitmap TIFFRepresentation]];
+  pass([reps count] == 1 && [[reps objectAtIndex: 0] pixelsWide] == 4,
+       "built in formats are still read");
+  stats = [[NSBitmapImageRep imageDecoderStatistics] objectForKey: @"TIFF"];
+  pass([[stats objectForKey: @"Decodes"] intValue] >= 1,
+       "TIFF decodes are counted");
+  RELEASE(bitmap);
+
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,126 @@
+#import "ObjectTesting.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSFileHandle.h>
+#import <Foundation/NSFileManager.h>
+#import <Foundation/NSPathUtilities.h>
+#import <Foundation/NSValue.h>
+#import <AppKit/NSApplication.h>
+#import <AppKit/NSBitmapImageRep.h>
+#import <AppKit/NSGraphics.h>
+
+static NSBitmapImageRep *
+makeBitmap(unsigned char seed)
+{
+  NSBitmapImageRep *bitmap;
+  unsigned char *p;
+  NSUInteger i;
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: 64
+                                                   pixelsHigh: 32
+                                                bitsPerSample: 8
+                                              samplesPerPixel: 3
+                                                     hasAlpha: NO
+                                                     isPlanar: NO
+                                               colorSpaceName: NSDeviceRGBColorSpace
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  p = [bitmap bitmapData];
+  for (i = 0; i < 64 * 32 * 3; i++)
+    {
+      p[i] = (i + seed) & 0xff;
+    }
+  return AUTORELEASE(bitmap);
+}
+
+int main()
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSMutableArray *bitmaps = [NSMutableArray array];
+  NSDictionary *properties;
+  NSArray *encoded;
+  NSUInteger i;
+  BOOL same = YES;
+
+  for (i = 0; i < 4; i++)
+    {
+      [bitmaps addObject: makeBitmap(i * 7)];
+    }
+
+  START_SET("PNG encoding")
+    if ([[bitmaps objectAtIndex: 0] representationUsingType: NSPNGFileType
+                                                 properties: nil] == nil)
+      SKIP("PNG support not available")
+
+    properties = [NSDictionary dictionaryWithObjectsAndKeys:
+      [NSNumber numberWithInt: 9], GSImageCompressionLevel,
+      [NSNumber numberWithInt: GSPNGFilterPaeth], GSImagePNGFilters,
+      nil];
+    encoded = [NSBitmapImageRep representationsOfImageReps: bitmaps
+                                                 usingType: NSPNGFileType
+                                                properties: properties];
+    pass([encoded count] == 4, "every bitmap is encoded");
+    for (i = 0; i < [encoded count]; i++)
+      {
+        NSBitmapImageRep *b = [bitmaps objectAtIndex: i];
+        NSBitmapImageRep *d;
+
+        d = [NSBitmapImageRep imageRepWithData: [encoded objectAtIndex: i]];
+        same = same && d != nil
+          && memcmp([d bitmapData], [b bitmapData], 64 * 32 * 3) == 0;
+      }
+    pass(same, "batch encoded PNG images decode to their bitmaps");
+
+    encoded = [NSBitmapImageRep representationsOfImageReps:
+      [NSArray arrayWithObjects: [bitmaps objectAtIndex: 1],
+        [bitmaps objectAtIndex: 1], [bitmaps objectAtIndex: 2], nil]
+                                                 usingType: NSPNGFileType
+                                                properties: properties];
+    pass([encoded count] == 3
+         && [[encoded objectAtIndex: 0] isEqual: [encoded objectAtIndex: 1]],
+         "a bitmap given twice is encoded the same both times");
+  END_SET("PNG encoding")
+
+  START_SET("JPEG encoding")
+    NSString *path;
+    NSFileHandle *handle;
+    NSData *data;
+
+    properties = [NSDictionary dictionaryWithObjectsAndKeys:
+      [NSNumber numberWithBool: YES], NSImageProgressive,
+      [NSNumber numberWithBool: YES], GSImageOptimizedHuffmanCoding,
+      [NSNumber numberWithInt: 444], GSImageChromaSubsampling,
+      nil];
+    data = [[bitmaps objectAtIndex: 0] representationUsingType: NSJPEGFileType
+                                                    properties: properties];
+    if (data == nil)
+      SKIP("JPEG support not available")
+
+    path = [NSTemporaryDirectory()
+      stringByAppendingPathComponent: @"encoding-test.jpg"];
+    [[NSFileManager defaultManager] createFileAtPath: path
+                                            contents: nil
+                                          attributes: nil];
+    handle = [NSFileHandle fileHandleForWritingAtPath: path];
+    pass([[bitmaps objectAtIndex: 0] writeRepresentationUsingType: NSJPEGFileType
+                                                       properties: properties
+                                                     toFileHandle: handle],
+         "JPEG is written to a file handle");
+    [handle closeFile];
+    pass([[NSData dataWithContentsOfFile: path] isEqual: data],
+         "streamed JPEG matches the in memory encoding");
+    [[NSFileManager defaultManager] removeFileAtPath: path handler: nil];
+
+    properties = [NSDictionary dictionaryWithObject:
+      [NSNumber numberWithInt: 411] forKey: GSImageChromaSubsampling];
+    pass([[bitmaps objectAtIndex: 0] representationUsingType: NSJPEGFileType
+                                                  properties: properties]
+         == nil, "an unknown chroma subsampling is rejected");
+  END_SET("JPEG encoding")
+
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,86 @@
+#import "ObjectTesting.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSFileHandle.h>
+#import <Foundation/NSFileManager.h>
+#import <Foundation/NSPathUtilities.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSURL.h>
+#import <AppKit/NSApplication.h>
+#import <AppKit/NSBitmapImageRep.h>
+#import <AppKit/NSGraphics.h>
+
+int main()
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSBitmapImageRep *bitmap, *loaded;
+  NSString *path;
+  NSData *tiff, *file;
+  NSMutableData *pnm;
+  NSFileHandle *handle;
+  unsigned char *p;
+  NSUInteger i, size = 200 * 200 * 3;
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: 200
+                                                   pixelsHigh: 200
+                                                bitsPerSample: 8
+                                              samplesPerPixel: 3
+                                                     hasAlpha: NO
+                                                     isPlanar: NO
+                                               colorSpaceName: NSDeviceRGBColorSpace
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  p = [bitmap bitmapData];
+  for (i = 0; i < size; i++)
+    {
+      p[i] = (i * 13) & 0xff;
+    }
+
+  path = [NSTemporaryDirectory()
+    stringByAppendingPathComponent: @"file-image.tiff"];
+  tiff = [bitmap TIFFRepresentationUsingCompression: NSTIFFCompressionNone
+                                             factor: 0.0];
+  [tiff writeToFile: path atomically: YES];
+
+  loaded = (NSBitmapImageRep *)[NSBitmapImageRep imageRepWithContentsOfFile: path];
+  pass(loaded != nil && [loaded pixelsWide] == 200
+       && [loaded pixelsHigh] == 200, "uncompressed TIFF file is loaded");
+  pass(memcmp([loaded bitmapData], p, size) == 0,
+       "TIFF file has the right pixels");
+  memset([loaded bitmapData], 0, size);
+  file = [NSData dataWithContentsOfFile: path];
+  pass([file isEqual: tiff], "changing the bitmap leaves the file alone");
+
+  loaded = (NSBitmapImageRep *)[NSBitmapImageRep imageRepWithContentsOfURL:
+    [NSURL fileURLWithPath: path]];
+  pass(loaded != nil && memcmp([loaded bitmapData], p, size) == 0,
+       "TIFF file URL has the right pixels");
+
+  loaded = (NSBitmapImageRep *)[NSBitmapImageRep imageRepWithContentsOfFile: path];
+  handle = [NSFileHandle fileHandleForUpdatingAtPath: path];
+  [handle truncateFileAtOffset: 0];
+  [handle closeFile];
+  pass(loaded != nil && memcmp([loaded bitmapData], p, size) == 0,
+       "the bitmap survives the truncation of its file");
+  [[NSFileManager defaultManager] removeFileAtPath: path handler: nil];
+
+  path = [NSTemporaryDirectory()
+    stringByAppendingPathComponent: @"file-image.ppm"];
+  pnm = [NSMutableData dataWithData:
+    [@"P6\n200 200\n255\n" dataUsingEncoding: NSASCIIStringEncoding]];
+  [pnm appendBytes: p length: size];
+  [pnm writeToFile: path atomically: YES];
+
+  loaded = (NSBitmapImageRep *)[NSBitmapImageRep imageRepWithContentsOfFile: path];
+  pass(loaded != nil && memcmp([loaded bitmapData], p, size) == 0,
+       "PPM file has the right pixels");
+  memset([loaded bitmapData], 0, size);
+  pass([[NSData dataWithContentsOfFile: path] isEqual: pnm],
+       "changing the bitmap leaves the PPM file alone");
+  [[NSFileManager defaultManager] removeFileAtPath: path handler: nil];
+
+  RELEASE(bitmap);
+  [arp release];
+  return 0;
+}
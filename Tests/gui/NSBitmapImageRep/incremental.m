@@ -0,0 +1,176 @@
+#import "ObjectTesting.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDictionary.h>
+#import <AppKit/NSApplication.h>
+#import <AppKit/NSBitmapImageRep.h>
+#import <AppKit/NSGraphics.h>
+
+/* Feeds encoded to loaded in slices of step bytes, and returns NO if
+   the rows reported do not grow as the data arrives. */
+static BOOL
+feed(NSBitmapImageRep *loaded, NSData *encoded, NSUInteger step)
+{
+  NSUInteger i, length = [encoded length];
+  NSInteger status, rows = -1;
+  BOOL ordered = YES;
+
+  for (i = step; i < length; i += step)
+    {
+      status = [loaded incrementalLoadFromData:
+        [encoded subdataWithRange: NSMakeRange(0, i)] complete: NO];
+      if (status >= 0)
+        {
+          if (status < rows)
+            ordered = NO;
+          rows = status;
+        }
+      else if (status != NSImageRepLoadStatusReadingHeader
+        && status != NSImageRepLoadStatusUnknownType)
+        {
+          ordered = NO;
+        }
+    }
+  return ordered;
+}
+
+/* Returns YES if loaded has the same size and pixels as the image
+   decoded from encoded at once. */
+static BOOL
+sameAsDecoded(NSBitmapImageRep *loaded, NSData *encoded)
+{
+  NSBitmapImageRep *decoded = [NSBitmapImageRep imageRepWithData: encoded];
+
+  return decoded != nil
+    && [loaded pixelsWide] == [decoded pixelsWide]
+    && [loaded pixelsHigh] == [decoded pixelsHigh]
+    && [loaded bytesPerRow] == [decoded bytesPerRow]
+    && memcmp([loaded bitmapData], [decoded bitmapData],
+              [decoded bytesPerRow] * [decoded pixelsHigh]) == 0;
+}
+
+int main()
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSBitmapImageRep *bitmap, *loaded;
+  NSData *png, *jpeg, *gif;
+  NSUInteger i, length;
+  NSInteger status, rows = -1;
+  BOOL ordered = YES;
+  unsigned char *data;
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: 64
+                                                   pixelsHigh: 64
+                                                bitsPerSample: 8
+                                              samplesPerPixel: 3
+                                                     hasAlpha: NO
+                                                     isPlanar: NO
+                                               colorSpaceName: NSCalibratedRGBColorSpace
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  data = [bitmap bitmapData];
+  for (i = 0; i < 64 * 64 * 3; i++)
+    {
+      data[i] = (i * 7) & 0xff;
+    }
+  png = [bitmap representationUsingType: NSPNGFileType
+                             properties: [NSDictionary dictionary]];
+
+  START_SET("PNG incremental loading")
+    if (png == nil)
+      SKIP("PNG support not available")
+
+    loaded = [[NSBitmapImageRep alloc] initForIncrementalLoad];
+    status = [loaded incrementalLoadFromData: [NSData data] complete: NO];
+    pass(status == NSImageRepLoadStatusUnknownType,
+         "type is unknown without data");
+
+    length = [png length];
+    for (i = 16; i < length; i += 16)
+      {
+        status = [loaded incrementalLoadFromData:
+          [png subdataWithRange: NSMakeRange(0, i)] complete: NO];
+        if (status >= 0)
+          {
+            if (status < rows)
+              ordered = NO;
+            rows = status;
+          }
+        else if (status != NSImageRepLoadStatusReadingHeader)
+          {
+            ordered = NO;
+          }
+      }
+    pass(ordered, "rows are reported as the data arrives");
+    status = [loaded incrementalLoadFromData: png complete: YES];
+    pass(status == NSImageRepLoadStatusCompleted, "load completes");
+    pass([loaded pixelsWide] == 64 && [loaded pixelsHigh] == 64,
+         "loaded image has the right size");
+    pass(memcmp([loaded bitmapData], data, 64 * 64 * 3) == 0,
+         "loaded image has the right pixels");
+    RELEASE(loaded);
+  END_SET("PNG incremental loading")
+
+  jpeg = [bitmap representationUsingType: NSJPEGFileType
+                              properties: [NSDictionary dictionary]];
+
+  START_SET("JPEG incremental loading")
+    if (jpeg == nil)
+      SKIP("JPEG support not available")
+
+    loaded = [[NSBitmapImageRep alloc] initForIncrementalLoad];
+    pass(feed(loaded, jpeg, 64), "rows are reported as the data arrives");
+    status = [loaded incrementalLoadFromData: jpeg complete: YES];
+    pass(status == NSImageRepLoadStatusCompleted, "load completes");
+    pass([loaded pixelsWide] == 64 && [loaded pixelsHigh] == 64,
+         "loaded image has the right size");
+    pass(sameAsDecoded(loaded, jpeg),
+         "loaded image matches the image decoded at once");
+    status = [loaded incrementalLoadFromData: jpeg complete: YES];
+    pass(status == NSImageRepLoadStatusCompleted,
+         "a completed load stays completed");
+    RELEASE(loaded);
+
+    loaded = [[NSBitmapImageRep alloc] initForIncrementalLoad];
+    feed(loaded, jpeg, 64);
+    status = [loaded incrementalLoadFromData:
+      [jpeg subdataWithRange: NSMakeRange(0, [jpeg length] / 2)]
+                                    complete: YES];
+    pass(status == NSImageRepLoadStatusUnexpectedEOF
+         || status == NSImageRepLoadStatusCompleted,
+         "truncated data ends the load");
+    RELEASE(loaded);
+  END_SET("JPEG incremental loading")
+
+  gif = [bitmap representationUsingType: NSGIFFileType
+                             properties: [NSDictionary dictionary]];
+
+  START_SET("GIF incremental loading")
+    if (gif == nil)
+      SKIP("GIF support not available")
+
+    loaded = [[NSBitmapImageRep alloc] initForIncrementalLoad];
+    pass(feed(loaded, gif, 32), "rows are reported as the data arrives");
+    status = [loaded incrementalLoadFromData: gif complete: YES];
+    pass(status == NSImageRepLoadStatusCompleted, "load completes");
+    pass([loaded pixelsWide] == 64 && [loaded pixelsHigh] == 64,
+         "loaded image has the right size");
+    pass(sameAsDecoded(loaded, gif),
+         "loaded image matches the image decoded at once");
+    RELEASE(loaded);
+
+    loaded = [[NSBitmapImageRep alloc] initForIncrementalLoad];
+    status = [loaded incrementalLoadFromData:
+      [gif subdataWithRange: NSMakeRange(0, 16)] complete: YES];
+    pass(status == NSImageRepLoadStatusInvalidData
+         || status == NSImageRepLoadStatusUnexpectedEOF,
+         "truncated data ends the load");
+    RELEASE(loaded);
+  END_SET("GIF incremental loading")
+
+  RELEASE(bitmap);
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,70 @@
+#import "ObjectTesting.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <AppKit/NSApplication.h>
+#import <AppKit/NSBitmapImageRep.h>
+#import <AppKit/NSGraphics.h>
+#import <AppKit/NSImage.h>
+
+static NSBitmapImageRep *
+makeBitmap(NSInteger size, unsigned char value)
+{
+  NSBitmapImageRep *bitmap;
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: size
+                                                   pixelsHigh: size
+                                                bitsPerSample: 8
+                                              samplesPerPixel: 3
+                                                     hasAlpha: NO
+                                                     isPlanar: NO
+                                               colorSpaceName: NSDeviceRGBColorSpace
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  memset([bitmap bitmapData], value, size * size * 3);
+  return AUTORELEASE(bitmap);
+}
+
+static unsigned char
+valueForSize(NSInteger size)
+{
+  return (size == 16) ? 10 : ((size == 32) ? 20 : 30);
+}
+
+int main()
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSArray *bitmaps, *reps;
+  NSBitmapImageRep *rep, *copy;
+  NSData *tiff;
+  NSImage *image;
+
+  bitmaps = [NSArray arrayWithObjects: makeBitmap(16, valueForSize(16)),
+    makeBitmap(32, valueForSize(32)), makeBitmap(64, valueForSize(64)), nil];
+  tiff = [NSBitmapImageRep TIFFRepresentationOfImageRepsInArray: bitmaps];
+
+  reps = [NSBitmapImageRep imageRepsWithData: tiff];
+  pass([reps count] == 3, "every image of a TIFF is loaded");
+  rep = [reps objectAtIndex: 1];
+  pass([rep pixelsWide] == 32 && [rep pixelsHigh] == 32
+       && [rep bitsPerSample] == 8 && [rep samplesPerPixel] == 3,
+       "image is described before it is drawn");
+  pass([rep bitmapData][0] == 20 && [rep bitmapData][32 * 32 * 3 - 1] == 20,
+       "image has the right pixels when they are asked for");
+
+  rep = [reps objectAtIndex: 2];
+  copy = AUTORELEASE([rep copy]);
+  pass([copy pixelsWide] == 64 && [copy bitmapData][0] == 30,
+       "copy of an image has its pixels");
+
+  image = AUTORELEASE([[NSImage alloc] initWithData: tiff]);
+  pass([[image representations] count] == 3, "image has all representations");
+  rep = (NSBitmapImageRep *)[image bestRepresentationForRect:
+    NSMakeRect(0, 0, 64, 64) context: nil hints: nil];
+  pass([rep bitmapData][0] == valueForSize([rep pixelsWide]),
+       "best representation has the right pixels");
+
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,80 @@
+#import "ObjectTesting.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSException.h>
+#import <AppKit/NSApplication.h>
+#import <AppKit/NSBitmapImageRep.h>
+#import <AppKit/NSGraphics.h>
+
+int main()
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSBitmapImageRep *bitmap;
+  NSBitmapImageRep *scaled;
+  unsigned char *p;
+  NSUInteger i;
+  BOOL flat = YES;
+  int filter;
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: 300
+                                                   pixelsHigh: 200
+                                                bitsPerSample: 8
+                                              samplesPerPixel: 3
+                                                     hasAlpha: NO
+                                                     isPlanar: NO
+                                               colorSpaceName: NSDeviceRGBColorSpace
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  [bitmap setSize: NSMakeSize(150, 100)];
+  memset([bitmap bitmapData], 77, 300 * 200 * 3);
+  for (filter = GSImageResamplingBox; filter <= GSImageResamplingMitchell;
+       filter++)
+    {
+      scaled = [bitmap bitmapImageRepByResamplingToPixelsWide: 97
+                                                   pixelsHigh: 41
+                                                       filter: filter];
+      p = [scaled bitmapData];
+      for (i = 0; i < 97 * 41 * 3; i++)
+        {
+          flat = flat && p[i] == 77;
+        }
+    }
+  pass(flat, "every filter keeps a flat image flat");
+  pass([scaled pixelsWide] == 97 && [scaled pixelsHigh] == 41
+       && NSEqualSizes([scaled size], NSMakeSize(150, 100)),
+       "the result has the requested pixels and the size of the source");
+  PASS_EXCEPTION([bitmap bitmapImageRepByResamplingToPixelsWide: 0
+                                                     pixelsHigh: 10
+                                                         filter: GSImageResamplingBox],
+                 NSInvalidArgumentException,
+                 "resampling to no pixels raises");
+  RELEASE(bitmap);
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: 4
+                                                   pixelsHigh: 1
+                                                bitsPerSample: 8
+                                              samplesPerPixel: 2
+                                                     hasAlpha: YES
+                                                     isPlanar: NO
+                                               colorSpaceName: NSDeviceWhiteColorSpace
+                                                 bitmapFormat: NSAlphaNonpremultipliedBitmapFormat
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  p = [bitmap bitmapData];
+  p[0] = 0;   p[1] = 255;
+  p[2] = 100; p[3] = 255;
+  p[4] = 255; p[5] = 0;
+  p[6] = 200; p[7] = 255;
+  scaled = [bitmap bitmapImageRepByResamplingToPixelsWide: 2
+                                               pixelsHigh: 1
+                                                   filter: GSImageResamplingBox];
+  p = [scaled bitmapData];
+  pass(p[0] == 50 && p[1] == 255, "box filter averages pixels");
+  pass(p[2] == 200 && p[3] == 128,
+       "transparent pixels do not bleed into their neighbours");
+  RELEASE(bitmap);
+
+  [arp release];
+  return 0;
+}
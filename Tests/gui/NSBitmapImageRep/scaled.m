@@ -0,0 +1,85 @@
+#import "ObjectTesting.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDictionary.h>
+#import <AppKit/NSApplication.h>
+#import <AppKit/NSBitmapImageRep.h>
+#import <AppKit/NSGraphics.h>
+
+static BOOL
+isUniform(NSBitmapImageRep *rep, unsigned char r, unsigned char g,
+          unsigned char b)
+{
+  NSInteger x, y;
+
+  for (y = 0; y < [rep pixelsHigh]; y++)
+    {
+      unsigned char *p = [rep bitmapData] + y * [rep bytesPerRow];
+
+      for (x = 0; x < [rep pixelsWide]; x++, p += 3)
+        {
+          if (p[0] != r || p[1] != g || p[2] != b)
+            return NO;
+        }
+    }
+  return YES;
+}
+
+int main()
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSBitmapImageRep *bitmap, *scaled;
+  NSData *data;
+  unsigned char *p;
+  NSUInteger i;
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: 64
+                                                   pixelsHigh: 48
+                                                bitsPerSample: 8
+                                              samplesPerPixel: 3
+                                                     hasAlpha: NO
+                                                     isPlanar: NO
+                                               colorSpaceName: NSCalibratedRGBColorSpace
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  p = [bitmap bitmapData];
+  for (i = 0; i < 64 * 48; i++, p += 3)
+    {
+      p[0] = 200;
+      p[1] = 100;
+      p[2] = 50;
+    }
+
+  data = [bitmap TIFFRepresentation];
+  scaled = [[NSBitmapImageRep alloc] initWithData: data
+                                 fittingPixelSize: NSMakeSize(16, 16)];
+  pass([scaled pixelsWide] == 16 && [scaled pixelsHigh] == 12,
+       "TIFF image is scaled to fit keeping its aspect ratio");
+  pass(isUniform(scaled, 200, 100, 50), "scaled TIFF keeps its colour");
+  RELEASE(scaled);
+
+  scaled = [[NSBitmapImageRep alloc] initWithData: data
+                                 fittingPixelSize: NSMakeSize(100, 100)];
+  pass([scaled pixelsWide] == 64 && [scaled pixelsHigh] == 48,
+       "small images are not enlarged");
+  RELEASE(scaled);
+
+  START_SET("PNG scaled loading")
+    data = [bitmap representationUsingType: NSPNGFileType
+                                properties: [NSDictionary dictionary]];
+    if (data == nil)
+      SKIP("PNG support not available")
+
+    scaled = [[NSBitmapImageRep alloc] initWithData: data
+                                   fittingPixelSize: NSMakeSize(10, 30)];
+    pass([scaled pixelsWide] == 10 && [scaled pixelsHigh] == 8,
+         "PNG image is scaled to fit keeping its aspect ratio");
+    pass(isUniform(scaled, 200, 100, 50), "scaled PNG keeps its colour");
+    RELEASE(scaled);
+  END_SET("PNG scaled loading")
+
+  RELEASE(bitmap);
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,131 @@
+/*
+Test that NSBrowser only makes and loads the cells of a passive delegate
+which are shown, and that selecting rows of an active delegate does not
+send it -browser:willDisplayCell:atRow:column:.
+*/
+#include "Testing.h"
+
+#include <Foundation/NSAutoreleasePool.h>
+#include <Foundation/NSString.h>
+
+#include <AppKit/NSApplication.h>
+#include <AppKit/NSBrowser.h>
+#include <AppKit/NSBrowserCell.h>
+#include <AppKit/NSMatrix.h>
+
+static NSUInteger copies = 0;
+
+@interface CountingCell : NSBrowserCell
+@end
+
+@implementation CountingCell
+- (id) copyWithZone: (NSZone *)zone
+{
+  copies++;
+  return [super copyWithZone: zone];
+}
+@end
+
+@interface PassiveDelegate : NSObject
+{
+@public
+  NSUInteger displayed;
+}
+@end
+
+@implementation PassiveDelegate
+- (NSInteger) browser: (NSBrowser *)b numberOfRowsInColumn: (NSInteger)column
+{
+  return 100000;
+}
+
+- (void) browser: (NSBrowser *)b
+ willDisplayCell: (id)cell
+           atRow: (NSInteger)row
+          column: (NSInteger)column
+{
+  displayed++;
+  [cell setStringValue: [NSString stringWithFormat: @"%ld", (long)row]];
+  [cell setLeaf: YES];
+}
+@end
+
+@interface ActiveDelegate : NSObject
+{
+@public
+  NSUInteger displayed;
+}
+@end
+
+@implementation ActiveDelegate
+- (void) browser: (NSBrowser *)b
+createRowsForColumn: (NSInteger)column
+        inMatrix: (NSMatrix *)matrix
+{
+  NSInteger i;
+
+  [matrix renewRows: 10 columns: 1];
+  for (i = 0; i < 10; i++)
+    {
+      id cell = [matrix cellAtRow: i column: 0];
+
+      [cell setStringValue: [NSString stringWithFormat: @"%ld", (long)i]];
+      [cell setLeaf: YES];
+    }
+}
+
+- (void) browser: (NSBrowser *)b
+ willDisplayCell: (id)cell
+           atRow: (NSInteger)row
+          column: (NSInteger)column
+{
+  displayed++;
+}
+@end
+
+int main(int argc, char **argv)
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSBrowser *browser;
+  PassiveDelegate *passive;
+  ActiveDelegate *active;
+  CountingCell *prototype;
+
+  [NSApplication sharedApplication];
+
+  passive = [PassiveDelegate new];
+  prototype = [CountingCell new];
+  browser = [[NSBrowser alloc] initWithFrame: NSMakeRect(0, 0, 200, 200)];
+  [browser setCellPrototype: prototype];
+  [browser setDelegate: passive];
+  [browser loadColumnZero];
+  pass([[browser matrixInColumn: 0] numberOfRows] == 100000,
+       "the column has a row for every item");
+  pass(copies < 1000, "only the cells near the visible rows are made");
+  pass(passive->displayed < 1000,
+       "only the cells near the visible rows are loaded");
+
+  [browser selectRow: 54321 inColumn: 0];
+  pass([[[browser selectedCell] stringValue] isEqual: @"54321"],
+       "selecting a row far down loads its cell");
+  pass(copies < 1000 && passive->displayed < 1000,
+       "selecting a row does not load the rows before it");
+  DESTROY(browser);
+  DESTROY(passive);
+  DESTROY(prototype);
+
+  active = [ActiveDelegate new];
+  browser = [[NSBrowser alloc] initWithFrame: NSMakeRect(0, 0, 200, 200)];
+  [browser setDelegate: active];
+  [browser loadColumnZero];
+  [browser selectRow: 5 inColumn: 0];
+  pass([[[browser selectedCell] stringValue] isEqual: @"5"],
+       "a row of an active delegate can be selected");
+  pass(active->displayed == 0,
+       "selecting a row does not ask an active delegate to load it");
+  DESTROY(browser);
+  DESTROY(active);
+
+  DESTROY(arp);
+  return 0;
+}
@@ -0,0 +1,95 @@
+/*
+Test that NSCollectionView rebinds the items it no longer shows to other
+represented objects, but keeps calling -newItemForRepresentedObject: for
+every item when a subclass overrides that method.
+*/
+#include "Testing.h"
+
+#include <Foundation/NSArray.h>
+#include <Foundation/NSAutoreleasePool.h>
+#include <Foundation/NSString.h>
+
+#include <AppKit/NSApplication.h>
+#include <AppKit/NSCollectionView.h>
+#include <AppKit/NSCollectionViewItem.h>
+#include <AppKit/NSView.h>
+
+static NSUInteger copies = 0;
+static NSUInteger made = 0;
+
+@interface CountingItem : NSCollectionViewItem
+@end
+
+@implementation CountingItem
+- (id) copyWithZone: (NSZone *)zone
+{
+  copies++;
+  return [super copyWithZone: zone];
+}
+@end
+
+@interface MakingCollectionView : NSCollectionView
+@end
+
+@implementation MakingCollectionView
+- (NSCollectionViewItem *) newItemForRepresentedObject: (id)object
+{
+  made++;
+  return [super newItemForRepresentedObject: object];
+}
+@end
+
+static void
+showAll(NSCollectionView *cv, NSUInteger count)
+{
+  NSUInteger i;
+
+  for (i = 0; i < count; i++)
+    {
+      [cv itemAtIndex: i];
+    }
+}
+
+int main()
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSArray *first = [NSArray arrayWithObjects: @"a", @"b", @"c", nil];
+  NSArray *second = [NSArray arrayWithObjects: @"d", @"e", @"f", nil];
+  NSCollectionView *cv;
+  CountingItem *prototype;
+
+  [NSApplication sharedApplication];
+
+  prototype = AUTORELEASE([[CountingItem alloc] init]);
+  [prototype setView: AUTORELEASE([[NSView alloc]
+    initWithFrame: NSMakeRect(0, 0, 10, 10)])];
+
+  cv = AUTORELEASE([[NSCollectionView alloc]
+    initWithFrame: NSMakeRect(0, 0, 100, 100)]);
+  [cv setItemPrototype: prototype];
+  [cv setContent: first];
+  showAll(cv, 3);
+  pass(copies == 3, "an item is made for each shown object");
+  [cv setContent: second];
+  showAll(cv, 3);
+  pass(copies == 3, "items are reused for new content");
+  pass([[[cv itemAtIndex: 1] representedObject] isEqual: @"e"],
+       "a reused item shows its new object");
+
+  copies = 0;
+  cv = AUTORELEASE([[MakingCollectionView alloc]
+    initWithFrame: NSMakeRect(0, 0, 100, 100)]);
+  [cv setItemPrototype: prototype];
+  [cv setContent: first];
+  showAll(cv, 3);
+  pass(made == 3, "the subclass makes each shown item");
+  [cv setContent: second];
+  showAll(cv, 3);
+  pass(made == 6 && copies == 6,
+       "items are not reused when -newItemForRepresentedObject: is overridden");
+  pass([[[cv itemAtIndex: 2] representedObject] isEqual: @"f"],
+       "a new item shows its object");
+
+  DESTROY(arp);
+  return 0;
+}
@@ -0,0 +1,172 @@
+#include "Testing.h"
+
+#include <Foundation/NSAutoreleasePool.h>
+#include <Foundation/NSDate.h>
+#include <Foundation/NSRunLoop.h>
+
+#include <AppKit/NSApplication.h>
+#include <AppKit/NSEvent.h>
+#include <GNUstepGUI/GSDisplayServer.h>
+
+/* Mouse events from a tablet */
+@interface TestTabletEvent : NSEvent
+@end
+
+@implementation TestTabletEvent
+
+- (short) subtype
+{
+  return NSTabletPointEventSubtype;
+}
+
+@end
+
+/* Adds events the way backends do */
+@interface GSDisplayServer (TestBackend)
+- (void) testAddEvent: (NSEvent*)anEvent;
+@end
+
+@implementation GSDisplayServer (TestBackend)
+
+- (void) testAddEvent: (NSEvent*)anEvent
+{
+  [event_queue addObject: anEvent];
+}
+
+@end
+
+static NSEvent *
+makeEventOfClass(Class cls, NSEventType type, CGFloat x)
+{
+  return [cls mouseEventWithType: type
+                        location: NSMakePoint(x, 0.0)
+                   modifierFlags: 0
+                       timestamp: 0
+                    windowNumber: 0
+                         context: nil
+                     eventNumber: 0
+                      clickCount: 0
+                        pressure: 0.0
+                    buttonNumber: 0
+                          deltaX: x
+                          deltaY: 1.0
+                          deltaZ: 0.0];
+}
+
+static NSEvent *
+makeEvent(NSEventType type, CGFloat x)
+{
+  return makeEventOfClass([NSEvent class], type, x);
+}
+
+static NSEvent *
+nextEvent(GSDisplayServer *server, unsigned mask)
+{
+  return [server getEventMatchingMask: mask
+                           beforeDate: [NSDate distantPast]
+                               inMode: NSDefaultRunLoopMode
+                              dequeue: YES];
+}
+
+int main()
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  GSDisplayServer *server;
+  NSEvent *ev;
+  BOOL ordered;
+  int i;
+
+  [NSApplication sharedApplication];
+  server = GSCurrentServer();
+
+  [server testAddEvent: makeEvent(NSMouseMoved, 1.0)];
+  [server testAddEvent: makeEvent(NSMouseMoved, 2.0)];
+  [server testAddEvent: makeEvent(NSMouseMoved, 3.0)];
+  [server testAddEvent: makeEvent(NSLeftMouseDown, 4.0)];
+  [server testAddEvent: makeEvent(NSMouseMoved, 5.0)];
+  [server postEvent: makeEvent(NSKeyUp, 0.0) atStart: YES];
+
+  ev = nextEvent(server, NSLeftMouseDownMask);
+  pass([ev type] == NSLeftMouseDown, "an event is found inside the queue");
+  ev = nextEvent(server, NSAnyEventMask);
+  pass([ev type] == NSKeyUp, "an event can be posted at the start");
+  ev = nextEvent(server, NSAnyEventMask);
+  pass([ev type] == NSMouseMoved && [ev locationInWindow].x == 3.0,
+       "consecutive mouse moved events are coalesced");
+  pass([ev deltaX] == 6.0 && [ev deltaY] == 3.0,
+       "coalesced events keep the sum of their deltas");
+  ev = nextEvent(server, NSAnyEventMask);
+  pass([ev type] == NSMouseMoved && [ev deltaX] == 5.0,
+       "events separated by another event are not coalesced");
+  pass(nextEvent(server, NSAnyEventMask) == nil, "the queue is empty");
+
+  [server postEvent: makeEvent(NSMouseMoved, 1.0) atStart: NO];
+  [server postEvent: makeEvent(NSMouseMoved, 2.0) atStart: NO];
+  ev = nextEvent(server, NSAnyEventMask);
+  pass(ev != nil && [ev deltaX] == 1.0
+       && [nextEvent(server, NSAnyEventMask) deltaX] == 2.0,
+       "posted events are not coalesced");
+
+  [server testAddEvent: makeEventOfClass([TestTabletEvent class],
+                                         NSMouseMoved, 1.0)];
+  [server testAddEvent: makeEventOfClass([TestTabletEvent class],
+                                         NSMouseMoved, 2.0)];
+  ev = nextEvent(server, NSAnyEventMask);
+  pass([ev isKindOfClass: [TestTabletEvent class]] && [ev deltaX] == 1.0
+       && [nextEvent(server, NSAnyEventMask) deltaX] == 2.0,
+       "events with another subtype are not coalesced");
+
+  /* Wrap the queue around the end of its buffer and make it grow. */
+  for (i = 0; i < 20; i++)
+    {
+      [server postEvent: makeEvent(NSLeftMouseDown, 20 + i) atStart: NO];
+    }
+  for (i = 0; i < 20; i++)
+    {
+      [server postEvent: makeEvent(NSLeftMouseDown, 19 - i) atStart: YES];
+    }
+  ordered = YES;
+  for (i = 0; i < 40; i++)
+    {
+      ev = nextEvent(server, NSAnyEventMask);
+      ordered = ordered && [ev deltaX] == i;
+    }
+  pass(ordered, "the queue grows past its initial size keeping the order");
+  pass(nextEvent(server, NSAnyEventMask) == nil,
+       "the grown queue is empty");
+
+  /* Remove an event from the first half of the queue. */
+  [server postEvent: makeEvent(NSLeftMouseDown, 1.0) atStart: NO];
+  [server postEvent: makeEvent(NSLeftMouseUp, 2.0) atStart: NO];
+  for (i = 3; i <= 5; i++)
+    {
+      [server postEvent: makeEvent(NSLeftMouseDown, i) atStart: NO];
+    }
+  ev = nextEvent(server, NSLeftMouseUpMask);
+  pass(ev != nil && [ev deltaX] == 2.0, "an event is found near the start");
+  ordered = YES;
+  for (i = 1; i <= 5; i++)
+    {
+      if (i != 2)
+        {
+          ev = nextEvent(server, NSAnyEventMask);
+          ordered = ordered && [ev deltaX] == i;
+        }
+    }
+  pass(ordered, "the events around it are kept in order");
+  pass(nextEvent(server, NSAnyEventMask) == nil,
+       "the queue is empty again");
+
+  [NSEvent setMouseCoalescingEnabled: NO];
+  [server testAddEvent: makeEvent(NSLeftMouseDragged, 1.0)];
+  [server testAddEvent: makeEvent(NSLeftMouseDragged, 2.0)];
+  ev = nextEvent(server, NSLeftMouseDraggedMask);
+  pass(ev != nil && [ev deltaX] == 1.0,
+       "events are not coalesced when coalescing is disabled");
+  ev = nextEvent(server, NSLeftMouseDraggedMask);
+  pass(ev != nil && [ev deltaX] == 2.0, "all events are kept");
+  [NSEvent setMouseCoalescingEnabled: YES];
+
+  DESTROY(arp);
+  return 0;
+}
@@ -0,0 +1,110 @@
+#import "ObjectTesting.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSFileManager.h>
+#import <Foundation/NSPathUtilities.h>
+#import <Foundation/NSRunLoop.h>
+#import <AppKit/NSApplication.h>
+#import <AppKit/NSBitmapImageRep.h>
+#import <AppKit/NSGraphics.h>
+#import <AppKit/NSImage.h>
+
+@interface Receiver : NSObject
+{
+@public
+  NSImage *image;
+  int calls;
+}
+- (void) imageDidLoad: (NSImage *)anImage;
+@end
+
+@implementation Receiver
+- (void) imageDidLoad: (NSImage *)anImage
+{
+  ASSIGN(image, anImage);
+  calls++;
+}
+@end
+
+static void
+waitFor(Receiver *r, NSTimeInterval seconds)
+{
+  NSDate *limit = [NSDate dateWithTimeIntervalSinceNow: seconds];
+
+  while (r->calls == 0 && [limit timeIntervalSinceNow] > 0)
+    {
+      [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                               beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.01]];
+    }
+}
+
+int main()
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSBitmapImageRep *bitmap;
+  NSString *path, *bare;
+  Receiver *loaded, *sniffed, *missing, *cancelled;
+  id token;
+
+  [NSApplication sharedApplication];
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: 20
+                                                   pixelsHigh: 10
+                                                bitsPerSample: 8
+                                              samplesPerPixel: 3
+                                                     hasAlpha: NO
+                                                     isPlanar: NO
+                                               colorSpaceName: NSCalibratedRGBColorSpace
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  path = [NSTemporaryDirectory()
+    stringByAppendingPathComponent: @"asynchronous-image.tiff"];
+  [[bitmap TIFFRepresentation] writeToFile: path atomically: YES];
+  bare = [path stringByDeletingPathExtension];
+  [[bitmap TIFFRepresentation] writeToFile: bare atomically: YES];
+  RELEASE(bitmap);
+
+  loaded = AUTORELEASE([Receiver new]);
+  token = [NSImage loadImageWithContentsOfFile: path
+                                        target: loaded
+                                      selector: @selector(imageDidLoad:)];
+  pass(token != nil, "load returns a token");
+  pass(loaded->calls == 0, "image is not delivered synchronously");
+  waitFor(loaded, 10.0);
+  pass(loaded->calls == 1, "image is delivered on the main thread");
+  pass(loaded->image != nil
+       && NSEqualSizes([loaded->image size], NSMakeSize(20, 10)),
+       "delivered image has the right size");
+
+  sniffed = AUTORELEASE([Receiver new]);
+  [NSImage loadImageWithContentsOfFile: bare
+                                target: sniffed
+                              selector: @selector(imageDidLoad:)];
+  waitFor(sniffed, 10.0);
+  pass(sniffed->calls == 1 && sniffed->image != nil
+       && NSEqualSizes([sniffed->image size], NSMakeSize(20, 10)),
+       "file without an extension is recognised from its data");
+
+  missing = AUTORELEASE([Receiver new]);
+  [NSImage loadImageWithContentsOfFile: @"/nonexistent/image.tiff"
+                                target: missing
+                              selector: @selector(imageDidLoad:)];
+  waitFor(missing, 10.0);
+  pass(missing->calls == 1 && missing->image == nil,
+       "nil is delivered for a file that cannot be read");
+
+  cancelled = AUTORELEASE([Receiver new]);
+  token = [NSImage loadImageWithContentsOfFile: path
+                                        target: cancelled
+                                      selector: @selector(imageDidLoad:)];
+  [NSImage cancelImageLoad: token];
+  waitFor(cancelled, 0.5);
+  pass(cancelled->calls == 0, "cancelled load is not delivered");
+
+  [[NSFileManager defaultManager] removeFileAtPath: path handler: nil];
+  [[NSFileManager defaultManager] removeFileAtPath: bare handler: nil];
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,69 @@
+#import "ObjectTesting.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <AppKit/NSApplication.h>
+#import <AppKit/NSBitmapImageRep.h>
+#import <AppKit/NSGraphics.h>
+#import <AppKit/NSImage.h>
+
+static NSBitmapImageRep *
+makeBitmap(NSInteger size)
+{
+  NSBitmapImageRep *bitmap;
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: size
+                                                   pixelsHigh: size
+                                                bitsPerSample: 8
+                                              samplesPerPixel: 4
+                                                     hasAlpha: YES
+                                                     isPlanar: NO
+                                               colorSpaceName: NSCalibratedRGBColorSpace
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  return AUTORELEASE(bitmap);
+}
+
+int main()
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSBitmapImageRep *small = makeBitmap(16);
+  NSBitmapImageRep *large = makeBitmap(32);
+  NSRect rect = NSMakeRect(0, 0, 24, 24);
+  NSImage *image;
+  NSImage *copy;
+
+  [NSApplication sharedApplication];
+
+  image = [[NSImage alloc] initWithSize: NSMakeSize(16, 16)];
+  [image addRepresentation: small];
+  pass([image bestRepresentationForRect: rect context: nil hints: nil] == small,
+       "the only rep is the best one");
+
+  [image addRepresentation: large];
+  pass([image bestRepresentationForRect: rect context: nil hints: nil] == large,
+       "adding a rep updates the best rep for a rect");
+  pass([image bestRepresentationForRect: rect context: nil hints: nil] == large,
+       "the best rep for a rect is stable");
+  pass([image bestRepresentationForDevice: nil] == small,
+       "the rep matching the image size is the best for the device");
+
+  [image setSize: NSMakeSize(32, 32)];
+  pass([image bestRepresentationForDevice: nil] == large,
+       "resizing the image changes the best rep for the device");
+
+  copy = [image copy];
+  [copy removeRepresentation: large];
+  pass([copy bestRepresentationForRect: rect context: nil hints: nil] == small,
+       "removing a rep updates the best rep for a rect");
+  pass([image bestRepresentationForRect: rect context: nil hints: nil] == large,
+       "the copy does not share the choice of the original");
+  RELEASE(copy);
+
+  [image removeRepresentation: large];
+  pass([image bestRepresentationForDevice: nil] == small,
+       "removing a rep updates the best rep for the device");
+  RELEASE(image);
+
+  [arp release];
+  return 0;
+}
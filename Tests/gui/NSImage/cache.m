@@ -0,0 +1,73 @@
+#import "ObjectTesting.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSRunLoop.h>
+#import <AppKit/NSApplication.h>
+#import <AppKit/NSBitmapImageRep.h>
+#import <AppKit/NSGraphics.h>
+#import <AppKit/NSImage.h>
+
+int main()
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSAutoreleasePool *pool;
+  NSBitmapImageRep *bitmap;
+  NSImage *image;
+  NSImage *loaded;
+  NSUInteger before;
+
+  [NSApplication sharedApplication];
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: 32
+                                                   pixelsHigh: 16
+                                                bitsPerSample: 8
+                                              samplesPerPixel: 4
+                                                     hasAlpha: YES
+                                                     isPlanar: NO
+                                               colorSpaceName: NSCalibratedRGBColorSpace
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  image = [[NSImage alloc] initWithSize: NSMakeSize(32, 16)];
+  pass([image byteSize] == 0, "empty image uses no bytes");
+  [image addRepresentation: bitmap];
+  RELEASE(bitmap);
+  pass([image byteSize] == 32 * 16 * 4, "byte size counts the bitmap");
+
+  before = [NSImage namedImageCacheSize];
+  [image setName: @"cache-test-image"];
+  pass([NSImage namedImageCacheSize] == before + 32 * 16 * 4,
+       "named image is accounted for");
+
+  [NSImage setNamedImageCacheLimit: 1024];
+  pass([NSImage namedImageCacheLimit] == 1024, "cache limit can be set");
+  [[NSRunLoop currentRunLoop] runUntilDate: [NSDate date]];
+  pass([NSImage imageNamed: @"cache-test-image"] == image,
+       "images named by the application are not evicted");
+
+  pool = [NSAutoreleasePool new];
+  loaded = RETAIN([NSImage imageNamed: @"GSSearch"]);
+  pass(loaded != nil && [[loaded representations] count] > 0,
+       "an image is loaded by name");
+  [[NSRunLoop currentRunLoop] runUntilDate: [NSDate date]];
+  pass([loaded name] == nil && [loaded isValid],
+       "images loaded by name are evicted over the limit");
+  pass([NSImage imageNamed: @"GSSearch"] == loaded
+       && [[loaded name] isEqual: @"GSSearch"],
+       "an evicted image still in use is named again");
+  [NSImage setNamedImageCacheLimit: 1024];
+  [[NSRunLoop currentRunLoop] runUntilDate: [NSDate date]];
+  pass([loaded name] == nil, "the image is evicted again");
+  RELEASE(loaded);
+  [pool release];
+
+  loaded = [NSImage imageNamed: @"GSSearch"];
+  pass([[loaded name] isEqual: @"GSSearch"]
+       && [[loaded representations] count] > 0,
+       "an evicted image is loaded again once released");
+
+  [image setName: nil];
+  RELEASE(image);
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,81 @@
+#import "ObjectTesting.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <AppKit/NSApplication.h>
+#import <AppKit/NSBitmapImageRep.h>
+#import <AppKit/NSGraphics.h>
+#import <AppKit/NSGraphicsContext.h>
+#import <AppKit/NSImage.h>
+
+static NSBitmapImageRep *
+makeBitmap(NSInteger size)
+{
+  NSBitmapImageRep *bitmap;
+
+  bitmap = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                   pixelsWide: size
+                                                   pixelsHigh: size
+                                                bitsPerSample: 8
+                                              samplesPerPixel: 4
+                                                     hasAlpha: YES
+                                                     isPlanar: NO
+                                               colorSpaceName: NSCalibratedRGBColorSpace
+                                                  bytesPerRow: 0
+                                                 bitsPerPixel: 0];
+  return AUTORELEASE(bitmap);
+}
+
+int main()
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSRect rect = NSMakeRect(0, 0, 16, 16);
+  NSGraphicsContext *ctxt;
+  NSImage *image;
+  NSUInteger before;
+
+  [NSApplication sharedApplication];
+
+  image = [[NSImage alloc] initWithSize: NSMakeSize(64, 64)];
+  [image addRepresentation: makeBitmap(64)];
+  pass([image resamplesWhenReduced] == NO, "images are not resampled by default");
+
+  START_SET("resampled drawing")
+    ctxt = [NSGraphicsContext graphicsContextWithBitmapImageRep:
+      makeBitmap(16)];
+    if (ctxt == nil)
+      SKIP("bitmap graphics contexts not available")
+
+    [NSGraphicsContext saveGraphicsState];
+    [NSGraphicsContext setCurrentContext: ctxt];
+
+    before = [image byteSize];
+    [image drawInRect: rect
+             fromRect: NSZeroRect
+            operation: NSCompositeSourceOver
+             fraction: 1.0];
+    pass([image byteSize] == before,
+         "drawing reduced makes no copy unless asked to");
+
+    [image setResamplesWhenReduced: YES];
+    [image drawInRect: rect
+             fromRect: NSZeroRect
+            operation: NSCompositeSourceOver
+             fraction: 1.0];
+    pass([image byteSize] == before + 16 * 16 * 4,
+         "drawing at a quarter of the size makes a resampled copy");
+    [image drawInRect: rect
+             fromRect: NSZeroRect
+            operation: NSCompositeSourceOver
+             fraction: 1.0];
+    pass([image byteSize] == before + 16 * 16 * 4,
+         "the resampled copy is reused");
+
+    [image setResamplesWhenReduced: NO];
+    pass([image byteSize] == before, "turning resampling off drops the copy");
+
+    [NSGraphicsContext restoreGraphicsState];
+  END_SET("resampled drawing")
+
+  RELEASE(image);
+  [arp release];
+  return 0;
+}
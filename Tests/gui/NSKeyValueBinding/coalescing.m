@@ -0,0 +1,109 @@
+/*
+Test that with GSCoalesceBindingUpdates set, several changes of a bound
+value in one run loop iteration update the bound object only once.
+*/
+#include "Testing.h"
+
+#include <Foundation/NSAutoreleasePool.h>
+#include <Foundation/NSDate.h>
+#include <Foundation/NSDictionary.h>
+#include <Foundation/NSRunLoop.h>
+#include <Foundation/NSString.h>
+#include <Foundation/NSUserDefaults.h>
+
+#include <AppKit/NSApplication.h>
+#include <AppKit/NSKeyValueBinding.h>
+#include <AppKit/NSView.h>
+
+@interface Model : NSObject
+{
+  NSString *value;
+}
+@end
+
+@implementation Model
+- (NSString *) value
+{
+  return value;
+}
+- (void) setValue: (NSString *)aValue
+{
+  ASSIGN(value, aValue);
+}
+- (void) dealloc
+{
+  DESTROY(value);
+  [super dealloc];
+}
+@end
+
+@interface BoundView : NSView
+{
+@public
+  NSString *title;
+  unsigned updates;
+}
+@end
+
+@implementation BoundView
++ (void) initialize
+{
+  if (self == [BoundView class])
+    {
+      [self exposeBinding: @"title"];
+    }
+}
+
+- (void) setTitle: (NSString *)aTitle
+{
+  ASSIGN(title, aTitle);
+  updates++;
+}
+
+- (void) dealloc
+{
+  DESTROY(title);
+  [super dealloc];
+}
+@end
+
+int main()
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  Model *model;
+  BoundView *view;
+
+  // Must be set before the first binding is made
+  [[NSUserDefaults standardUserDefaults] registerDefaults:
+    [NSDictionary dictionaryWithObject: @"YES"
+                                forKey: @"GSCoalesceBindingUpdates"]];
+  [NSApplication sharedApplication];
+
+  model = AUTORELEASE([Model new]);
+  [model setValue: @"one"];
+  view = AUTORELEASE([[BoundView alloc]
+    initWithFrame: NSMakeRect(0, 0, 10, 10)]);
+  [view bind: @"title" toObject: model withKeyPath: @"value" options: nil];
+  pass([view->title isEqual: @"one"], "binding sets the bound value at once");
+
+  view->updates = 0;
+  [model setValue: @"two"];
+  [model setValue: @"three"];
+  [model setValue: @"four"];
+  pass(view->updates == 0, "changes are not applied at once");
+
+  [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                           beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+  pass(view->updates == 1, "changes in one iteration cause a single update");
+  pass([view->title isEqual: @"four"], "the update uses the latest value");
+
+  [model setValue: @"five"];
+  [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                           beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+  pass(view->updates == 2 && [view->title isEqual: @"five"],
+       "a change in a later iteration causes another update");
+
+  [view unbind: @"title"];
+  DESTROY(arp);
+  return 0;
+}
@@ -0,0 +1,138 @@
+/*
+Test that the bindings of an object are all removed when it goes away,
+and that -unbind: runs without the binding table locked, so that it may
+look at bindings from another thread.
+*/
+#include "Testing.h"
+
+#include <Foundation/NSAutoreleasePool.h>
+#include <Foundation/NSDate.h>
+#include <Foundation/NSString.h>
+#include <Foundation/NSThread.h>
+
+#include <AppKit/NSApplication.h>
+#include <AppKit/NSKeyValueBinding.h>
+#include <AppKit/NSView.h>
+
+static volatile unsigned looked = 0;
+static unsigned unbound = 0;
+static id unbinding = nil;
+
+@interface Model : NSObject
+{
+  NSString *value;
+}
+@end
+
+@implementation Model
+- (NSString *) value
+{
+  return value;
+}
+- (void) setValue: (NSString *)aValue
+{
+  ASSIGN(value, aValue);
+}
+- (void) dealloc
+{
+  DESTROY(value);
+  [super dealloc];
+}
+@end
+
+@interface BoundView : NSView
+{
+@public
+  NSString *title;
+  NSString *name;
+}
+@end
+
+@implementation BoundView
++ (void) initialize
+{
+  if (self == [BoundView class])
+    {
+      [self exposeBinding: @"title"];
+      [self exposeBinding: @"name"];
+    }
+}
+
+- (void) setTitle: (NSString *)aTitle
+{
+  ASSIGN(title, aTitle);
+}
+
+- (void) setName: (NSString *)aName
+{
+  ASSIGN(name, aName);
+}
+
++ (void) lookAtBindings: (id)arg
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  [unbinding infoForBinding: @"title"];
+  looked++;
+  DESTROY(arp);
+}
+
+/* Waits for another thread to look up a binding of the receiver, which
+ * blocks for good if the binding table is locked during -unbind:.
+ * The class is the thread target, since the receiver may be deallocating.
+ */
+- (void) unbind: (NSString *)binding
+{
+  NSDate *limit = [NSDate dateWithTimeIntervalSinceNow: 2.0];
+  unsigned before = looked;
+
+  unbound++;
+  unbinding = self;
+  [NSThread detachNewThreadSelector: @selector(lookAtBindings:)
+                           toTarget: [BoundView class]
+                         withObject: nil];
+  while (looked == before && [limit timeIntervalSinceNow] > 0)
+    {
+      [NSThread sleepForTimeInterval: 0.01];
+    }
+  [super unbind: binding];
+}
+
+- (void) dealloc
+{
+  DESTROY(title);
+  DESTROY(name);
+  [super dealloc];
+}
+@end
+
+int main()
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  Model *model;
+  BoundView *view;
+  unsigned lookups;
+
+  [NSApplication sharedApplication];
+
+  model = AUTORELEASE([Model new]);
+  [model setValue: @"one"];
+  view = [[BoundView alloc] initWithFrame: NSMakeRect(0, 0, 10, 10)];
+  [view bind: @"title" toObject: model withKeyPath: @"value" options: nil];
+  [view bind: @"name" toObject: model withKeyPath: @"value" options: nil];
+  pass([view->title isEqual: @"one"] && [view->name isEqual: @"one"],
+       "bindings set the bound values");
+
+  unbound = 0;
+  looked = 0;
+  DESTROY(view);
+  lookups = looked;
+  pass(unbound == 2, "all bindings are removed when the object goes away");
+  pass(lookups == 2,
+       "bindings can be looked up from another thread while unbinding");
+
+  [model setValue: @"two"];
+  pass(YES, "changes no longer reach the object which went away");
+
+  DESTROY(arp);
+  return 0;
+}
@@ -0,0 +1,134 @@
+/*
+Test that -parentForItem: and -rowForItem: stay consistent while items
+are expanded, collapsed and reloaded.
+*/
+#include "Testing.h"
+
+#include <Foundation/NSArray.h>
+#include <Foundation/NSAutoreleasePool.h>
+#include <Foundation/NSString.h>
+
+#include <AppKit/NSApplication.h>
+#include <AppKit/NSOutlineView.h>
+
+/* Inner nodes are arrays of their children, leaves are strings. */
+@interface TreeSource : NSObject
+{
+  NSArray *root;
+}
+- (id) initWithRoot: (NSArray *)r;
+@end
+
+@implementation TreeSource
+
+- (id) initWithRoot: (NSArray *)r
+{
+  ASSIGN(root, r);
+  return self;
+}
+
+- (void) dealloc
+{
+  RELEASE(root);
+  [super dealloc];
+}
+
+- (id) outlineView: (NSOutlineView *)ov child: (NSInteger)index ofItem: (id)item
+{
+  return [(item == nil ? root : item) objectAtIndex: index];
+}
+
+- (BOOL) outlineView: (NSOutlineView *)ov isItemExpandable: (id)item
+{
+  return [item isKindOfClass: [NSArray class]];
+}
+
+- (NSInteger) outlineView: (NSOutlineView *)ov numberOfChildrenOfItem: (id)item
+{
+  return [(item == nil ? root : item) count];
+}
+
+- (id) outlineView: (NSOutlineView *)ov
+objectValueForTableColumn: (NSTableColumn *)tc
+            byItem: (id)item
+{
+  return [item description];
+}
+
+@end
+
+int main(int argc, char **argv)
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSOutlineView *ov;
+  TreeSource *ds;
+  NSArray *a, *b, *newA;
+  NSMutableArray *root;
+  id a1, a2, b1, c;
+
+  [NSApplication sharedApplication];
+
+  a1 = [NSString stringWithFormat: @"a%d", 1];
+  a2 = [NSString stringWithFormat: @"a%d", 2];
+  b1 = [NSString stringWithFormat: @"b%d", 1];
+  c = [NSString stringWithFormat: @"c"];
+  b = [NSArray arrayWithObject: b1];
+  a = [NSArray arrayWithObjects: a1, b, a2, nil];
+  root = [NSMutableArray arrayWithObjects: a, c, nil];
+
+  ds = [[TreeSource alloc] initWithRoot: root];
+  ov = [[NSOutlineView alloc] initWithFrame: NSMakeRect(0, 0, 100, 100)];
+  [ov setDataSource: ds];
+
+  pass([ov numberOfRows] == 2, "only the top level items are shown");
+  pass([ov parentForItem: a] == nil, "top level item has no parent");
+  pass([ov rowForItem: c] == 1, "row of a top level item");
+
+  [ov expandItem: a];
+  pass([ov numberOfRows] == 5, "expanding an item shows its children");
+  pass([ov parentForItem: a2] == a, "parent of an expanded child");
+  pass([ov rowForItem: a2] == 3, "row of an expanded child");
+  pass([ov rowForItem: c] == 4, "rows below an expanded item move down");
+
+  [ov expandItem: b];
+  pass([ov parentForItem: b1] == b, "parent of a grandchild");
+  pass([ov rowForItem: b1] == 3, "row of a grandchild");
+  pass([ov rowForItem: a2] == 4, "rows below a nested expansion move down");
+
+  [ov collapseItem: a];
+  pass([ov numberOfRows] == 2, "collapsing an item hides its descendants");
+  pass([ov rowForItem: b1] == -1, "hidden items have no row");
+  pass([ov rowForItem: c] == 1, "rows below a collapsed item move up");
+
+  [ov expandItem: a];
+  pass([ov numberOfRows] == 6, "re-expanding an item restores expanded children");
+  pass([ov rowForItem: b1] == 3, "row of a restored grandchild");
+
+  [ov collapseItem: a];
+  [ov collapseItem: b];
+  [ov expandItem: b];
+  pass([ov numberOfRows] == 2, "expanding a hidden item adds no rows");
+  pass([ov isItemExpanded: b], "a hidden item can be expanded");
+
+  [ov reloadItem: a reloadChildren: YES];
+  pass([ov rowForItem: c] == 1, "rows are unchanged by reloading a collapsed item");
+
+  [ov expandItem: a];
+  newA = [NSArray arrayWithObjects: a1, b, a2, nil];
+  [root replaceObjectAtIndex: 0 withObject: newA];
+  [ov reloadItem: a];
+  pass([ov rowForItem: newA] == 0 && [ov rowForItem: a] == -1,
+       "a reloaded item replaces the old one in its row");
+  pass([ov isItemExpanded: newA] && [ov levelForItem: newA] == 0,
+       "a reloaded item keeps its expansion and level");
+  pass([ov parentForItem: a2] == newA,
+       "the children of a reloaded item have it as parent");
+  [ov reloadItem: newA reloadChildren: YES];
+  pass([ov numberOfRows] == 5 && [ov rowForItem: c] == 4,
+       "the children of a replaced item can be reloaded");
+
+  DESTROY(ov);
+  DESTROY(ds);
+  DESTROY(arp);
+  return 0;
+}
@@ -0,0 +1,128 @@
+/*
+  Check that GSFontEnumerator keeps the enumerated fonts in its cache file
+  and enumerates them again when a font directory changes.
+*/
+
+#import "Testing.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSFileManager.h>
+#import <Foundation/NSPathUtilities.h>
+#import <Foundation/NSValue.h>
+#import <AppKit/NSFontDescriptor.h>
+#import <GNUstepGUI/GSFontInfo.h>
+
+static unsigned enumerations = 0;
+static NSString *fontDir = nil;
+
+@interface TestFontEnumerator : GSFontEnumerator
+- (BOOL) defaultCanCacheFontEnumeration;
+@end
+
+@implementation TestFontEnumerator
+
+- (void) enumerateFontsAndFamilies
+{
+  NSNumber *regular = [NSNumber numberWithInt: 0];
+  NSNumber *bold = [NSNumber numberWithInt: NSBoldFontMask];
+  NSNumber *w5 = [NSNumber numberWithInt: 5];
+  NSNumber *w9 = [NSNumber numberWithInt: 9];
+
+  enumerations++;
+  allFontNames = [[NSArray alloc] initWithObjects:
+    @"Test-Regular", @"Test-Bold", @"Other-Bold", nil];
+  allFontFamilies = [[NSMutableDictionary alloc] initWithObjectsAndKeys:
+    [NSArray arrayWithObjects:
+      [NSArray arrayWithObjects: @"Test-Regular", @"Regular", w5, regular, nil],
+      [NSArray arrayWithObjects: @"Test-Bold", @"Bold", w9, bold, nil],
+      nil], @"Test",
+    [NSArray arrayWithObjects:
+      [NSArray arrayWithObjects: @"Other-Bold", @"Bold", w9, bold, nil],
+      nil], @"Other",
+    nil];
+}
+
+- (BOOL) canCacheFontEnumeration
+{
+  return YES;
+}
+
+- (BOOL) defaultCanCacheFontEnumeration
+{
+  return [super canCacheFontEnumeration];
+}
+
+- (NSArray *) fontDirectories
+{
+  return [NSArray arrayWithObject: fontDir];
+}
+
+- (NSString *) fontCachePath
+{
+  return [fontDir stringByAppendingPathExtension: @"cache"];
+}
+
+@end
+
+int
+main(int argc, char **argv)
+{
+  NSFileManager *mgr = [NSFileManager defaultManager];
+  TestFontEnumerator *fe;
+  NSDictionary *traits;
+  NSArray *found;
+  CREATE_AUTORELEASE_POOL(arp);
+
+  fontDir = [NSTemporaryDirectory()
+    stringByAppendingPathComponent: @"fontEnumeratorCache"];
+  [mgr removeFileAtPath: fontDir handler: nil];
+  [mgr removeFileAtPath: [fontDir stringByAppendingPathExtension: @"cache"]
+                handler: nil];
+  [mgr createDirectoryAtPath: fontDir
+ withIntermediateDirectories: YES
+                  attributes: nil
+                       error: NULL];
+
+  fe = [TestFontEnumerator new];
+  pass(enumerations == 1, "fonts are enumerated without a cache");
+  pass([fe defaultCanCacheFontEnumeration] == NO,
+       "backends have to enable the cache");
+  RELEASE(fe);
+
+  fe = [TestFontEnumerator new];
+  pass(enumerations == 1, "fonts are read from the cache");
+  pass([[fe availableFonts] count] == 3
+       && [[fe availableMembersOfFontFamily: @"Test"] count] == 2,
+       "cached fonts match the enumerated ones");
+
+  traits = [NSDictionary dictionaryWithObject:
+    [NSNumber numberWithUnsignedInt: NSBoldFontMask]
+                                       forKey: NSFontSymbolicTrait];
+  found = [fe matchingFontDescriptorsFor:
+    [NSDictionary dictionaryWithObjectsAndKeys:
+      @"Test", NSFontFamilyAttribute, traits, NSFontTraitsAttribute, nil]];
+  pass([found count] == 1
+       && [[[found objectAtIndex: 0] objectForKey: NSFontNameAttribute]
+            isEqual: @"Test-Bold"],
+       "descriptors are matched by family and traits");
+  found = [fe matchingFontDescriptorsFor:
+    [NSDictionary dictionaryWithObject: @"Missing"
+                                forKey: NSFontFamilyAttribute]];
+  pass([found count] == 0, "an unknown family matches nothing");
+  RELEASE(fe);
+
+  [mgr createDirectoryAtPath: [fontDir stringByAppendingPathComponent: @"new"]
+ withIntermediateDirectories: YES
+                  attributes: nil
+                       error: NULL];
+  fe = [TestFontEnumerator new];
+  pass(enumerations == 2, "a new font directory invalidates the cache");
+  RELEASE(fe);
+
+  [mgr removeFileAtPath: fontDir handler: nil];
+  [mgr removeFileAtPath: [fontDir stringByAppendingPathExtension: @"cache"]
+                handler: nil];
+  DESTROY(arp);
+  return 0;
+}
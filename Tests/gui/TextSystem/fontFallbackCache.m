@@ -0,0 +1,97 @@
+/*
+  Check that NSMutableAttributedString remembers the substitute fonts it
+  found for a font and forgets them when the fonts change.
+*/
+
+#import "Testing.h"
+#import <Foundation/NSAttributedString.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSCharacterSet.h>
+#import <AppKit/NSApplication.h>
+#import <AppKit/NSAttributedString.h>
+#import <AppKit/NSFont.h>
+
+void GSInvalidateFontFallbacks(void);
+
+/* Stands in for a font covering the Latin letters, so the test does not
+   depend on the fonts of the backend. */
+@interface TestSubstituteFont : NSObject
+@end
+
+@implementation TestSubstituteFont
+
+- (NSCharacterSet *) coveredCharacterSet
+{
+  return [NSCharacterSet letterCharacterSet];
+}
+
+@end
+
+@interface TestFallbackString : NSMutableAttributedString
+{
+@public
+  unsigned searches;
+  id substitute;
+}
+- (NSFont*) _substituteFontFor: (unichar)uchar font: (NSFont*)baseFont;
+@end
+
+@implementation TestFallbackString
+
+- (NSFont*) _searchSubstituteFontFor: (unichar)uchar font: (NSFont*)baseFont
+{
+  searches++;
+  if (uchar < 0x80)
+    {
+      return substitute;
+    }
+  return nil;
+}
+
+@end
+
+int
+main(int argc, char **argv)
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  TestFallbackString *str;
+  NSFont *base = (NSFont*)@"TestBaseFont";
+  NSFont *found;
+
+  [NSApplication sharedApplication];
+
+  str = [TestFallbackString alloc];
+  str->substitute = [TestSubstituteFont new];
+
+  GSInvalidateFontFallbacks();
+  found = [str _substituteFontFor: 'a' font: base];
+  pass(found == str->substitute && str->searches == 1,
+       "a substitute is searched for the first character");
+  found = [str _substituteFontFor: 'b' font: base];
+  pass(found == str->substitute && str->searches == 1,
+       "the substitute is reused for the same block");
+
+  found = [str _substituteFontFor: 0x4e2d font: base];
+  pass(found == nil && str->searches == 2,
+       "a character without a substitute is searched once");
+  found = [str _substituteFontFor: 0x4e2d font: base];
+  pass(found == nil && str->searches == 2,
+       "a character without a substitute is remembered");
+
+  found = [str _substituteFontFor: 'a' font: (NSFont*)@"OtherBaseFont"];
+  pass(found == str->substitute && str->searches == 3,
+       "substitutes are kept for each base font");
+
+  GSInvalidateFontFallbacks();
+  found = [str _substituteFontFor: 'a' font: base];
+  pass(found == str->substitute && str->searches == 4,
+       "invalidating the fallbacks drops the remembered substitutes");
+  found = [str _substituteFontFor: 0x4e2d font: base];
+  pass(found == nil && str->searches == 5,
+       "invalidating the fallbacks drops the missing characters");
+
+  GSInvalidateFontFallbacks();
+  RELEASE(str->substitute);
+  DESTROY(arp);
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*
+  Check that GSFontInfo asks its subclass only once for the glyph of a
+  character and the metrics of a glyph.
+*/
+
+#import "Testing.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <GNUstepGUI/GSFontInfo.h>
+
+@interface TestFontInfo : GSFontInfo
+{
+@public
+  unsigned glyphCalls;
+  unsigned advancementCalls;
+  unsigned boundsCalls;
+}
+@end
+
+@implementation TestFontInfo
+
+- (NSGlyph) glyphForCharacter: (unichar)theChar
+{
+  glyphCalls++;
+  return (theChar == 'x') ? NSNullGlyph : theChar + 1;
+}
+
+- (NSSize) advancementForGlyph: (NSGlyph)aGlyph
+{
+  advancementCalls++;
+  return NSMakeSize(aGlyph / 2.0, 0);
+}
+
+- (NSRect) boundingRectForGlyph: (NSGlyph)aGlyph
+{
+  boundsCalls++;
+  return NSMakeRect(0, -1, aGlyph, 2);
+}
+
+@end
+
+int
+main(int argc, char **argv)
+{
+  TestFontInfo *fi;
+  BOOL same = YES;
+  unsigned i;
+  CREATE_AUTORELEASE_POOL(arp);
+
+  fi = [TestFontInfo new];
+  for (i = 0; i < 3; i++)
+    {
+      same = same && GSFontInfoGlyphForCharacter(fi, 'a') == 'a' + 1
+        && GSFontInfoGlyphForCharacter(fi, 0x4e2d) == 0x4e2e
+        && GSFontInfoGlyphForCharacter(fi, 'x') == NSNullGlyph;
+    }
+  pass(same, "glyphs for characters are returned");
+  pass(fi->glyphCalls == 3, "each character is looked up once");
+
+  same = YES;
+  for (i = 0; i < 3; i++)
+    {
+      same = same && GSFontInfoAdvancementForGlyph(fi, 10).width == 5.0
+        && GSFontInfoAdvancementForGlyph(fi, 0x12345).width == 0x12345 / 2.0
+        && GSFontInfoBoundingRectForGlyph(fi, 7).size.width == 7.0;
+    }
+  pass(same, "glyph metrics are returned");
+  pass(fi->advancementCalls == 4 && fi->boundsCalls == 1,
+       "metrics of glyphs below 65536 are looked up once");
+  RELEASE(fi);
+
+  DESTROY(arp);
+  return 0;
+}